@@ -0,0 +1,64 @@
+// Repeated builds of one scene, as a long-running process does them: with
+// fresh scratch every build, with one reused arena, and with the arena on
+// huge pages. Reports the time and the scratch each build used.
+//   usage: build_bench.x [n_triangles] [n_builds]
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "scene_gen.hpp"
+#include "timer.hpp"
+#include "utils/arena.hpp"
+
+namespace {
+
+void report(const char* name, const double ms, const utils::ArenaStats& stats) {
+  std::cout << name << ": " << ms << " ms"
+            << "  allocations=" << stats.n_allocations
+            << "  scratch="
+            << static_cast<double>(stats.peak_bytes) / (1 << 20) << " MiB"
+            << "  system blocks=" << stats.n_blocks << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+  const size_t n_builds =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+
+  std::vector<geometry::Triangle> scene = bench::random_scene(n);
+  std::cout << "triangles: " << n << "\n";
+
+  utils::Arena arena;
+  utils::Arena huge_arena(utils::ArenaConfig{0, true});
+
+  for (const auto engine :
+      {acceleration::BuildEngine::SAH, acceleration::BuildEngine::LBVH}) {
+    std::cout << acceleration::to_string(engine) << "\n";
+
+    std::optional<acceleration::BVHTree<geometry::Triangle>> tree;
+    utils::ArenaStats                                        stats;
+    const double fresh_ms = bench::best_of(n_builds, [&] {
+      tree.reset();
+      tree.emplace(scene, engine);
+      stats = tree->build_memory_stats();
+    });
+    report("  fresh scratch", fresh_ms, stats);
+
+    for (utils::Arena* scratch : {&arena, &huge_arena}) {
+      const double ms = bench::best_of(n_builds, [&] {
+        tree.reset();
+        tree.emplace(scene, engine, *scratch);
+        stats = tree->build_memory_stats();
+      });
+      report(scratch == &arena ? "  reused arena " : "  huge pages   ", ms,
+          stats);
+    }
+  }
+  std::cout << "huge pages granted: " << huge_arena.has_huge_pages() << "\n";
+}
@@ -0,0 +1,48 @@
+// Triangle::is_intersect throughput on a coplanar-heavy tiled scene.
+//   usage: coplanar_bench.x [n_triangles]
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "scene_gen.hpp"
+#include "timer.hpp"
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+  std::vector<geometry::Triangle> scene = bench::coplanar_scene(n);
+
+  // Neighbouring tiles are the pairs the BVH hands to the narrowphase.
+  std::vector<std::pair<size_t, size_t>> pairs;
+  for (size_t i = 0; i + 2 < scene.size(); ++i) {
+    pairs.emplace_back(i, i + 1);
+    pairs.emplace_back(i, i + 2);
+  }
+
+  size_t       n_hits = 0;
+  const double pair_ms = bench::best_of(3, [&] {
+    n_hits = 0;
+    for (const auto& [i, j] : pairs) {
+      n_hits += scene[i].is_intersect(scene[j]);
+    }
+  });
+
+  std::cout << "coplanar pairs: " << pairs.size() << " (" << n_hits
+            << " hits)  " << pair_ms << " ms  "
+            << static_cast<double>(pairs.size()) / (pair_ms / 1000.0)
+            << " pairs/s\n";
+
+  acceleration::BVHTree<geometry::Triangle> tree{scene};
+  acceleration::QueryStats                  stats;
+  const double query_ms = bench::best_of(1, [&] {
+    (void)tree.get_intersections({}, &stats);
+  });
+
+  std::cout << "get_intersections: " << query_ms << " ms  narrowphase="
+            << stats.n_narrowphase << "  hits=" << stats.n_hits << "\n";
+  return 0;
+}
@@ -0,0 +1,49 @@
+// Narrowphase calls removed by the triangle-vs-box SAT stage.
+//   usage: cull_bench.x [n_triangles] [sliver_length]
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "scene_gen.hpp"
+#include "timer.hpp"
+
+namespace {
+
+void run(const char* scene_name, std::vector<geometry::Triangle>& scene) {
+  acceleration::BVHTree<geometry::Triangle> tree{scene};
+
+  std::cout << scene_name << " (" << scene.size() << " triangles)\n";
+
+  for (const bool sat : {false, true}) {
+    acceleration::QueryStats stats;
+    const double             ms = bench::best_of(1, [&] {
+      (void)tree.get_intersections({acceleration::QueryMode::Fused, sat},
+          &stats);
+    });
+
+    std::cout << (sat ? "  sat on : " : "  sat off: ") << ms << " ms"
+              << "  candidates=" << stats.n_candidates
+              << "  sat_tests=" << stats.n_sat_tests
+              << "  sat_culled=" << stats.n_sat_culled
+              << "  narrowphase=" << stats.n_narrowphase
+              << "  hits=" << stats.n_hits << "\n";
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t n      = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50000;
+  const double length = argc > 2 ? std::strtod(argv[2], nullptr) : 10.0;
+
+  std::vector<geometry::Triangle> diagonal =
+      bench::diagonal_scene(n, 100.0, length);
+  run("diagonal", diagonal);
+
+  std::vector<geometry::Triangle> random = bench::random_scene(n);
+  run("random", random);
+  return 0;
+}
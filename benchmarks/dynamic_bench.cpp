@@ -0,0 +1,111 @@
+// DynamicBVH edits on a random scene: bulk build, then batches of small
+// moves, large moves, inserts and erases, against rebuilding a BVHTree;
+// then moves that keep IncrementalIntersections flags up to date.
+//   usage: dynamic_bench.x [n_triangles] [n_edits]
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "scene_gen.hpp"
+#include "timer.hpp"
+
+namespace {
+
+using Tree = acceleration::DynamicBVH<geometry::Triangle>;
+
+geometry::Triangle shifted(
+    const geometry::Triangle& tri, const geometry::Vector3D& delta) {
+  return geometry::Triangle(tri.a + delta, tri.b + delta, tri.c + delta);
+}
+
+void report(const char* name, const double ms, const size_t n_edits,
+    const Tree& tree) {
+  std::cout << name << ": " << ms << " ms"
+            << "  edits/s=" << static_cast<double>(n_edits) / (ms / 1000.0)
+            << "  height=" << tree.height() << "  cost=" << tree.sah_cost()
+            << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const size_t n_edits =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+
+  std::vector<geometry::Triangle> scene = bench::random_scene(n);
+  std::mt19937                    gen(7);
+
+  std::optional<Tree> built;
+  std::cout << "triangles: " << n << "  edits per batch: " << n_edits << "\n";
+  const double build_ms = bench::best_of(1, [&] { built.emplace(scene); });
+  Tree&        tree     = *built;
+  report("bulk build", build_ms, n, tree);
+  const double rebuild_ms = bench::best_of(1, [&] {
+    const acceleration::BVHTree<geometry::Triangle> rebuilt(scene);
+  });
+  std::cout << "BVHTree rebuild: " << rebuild_ms << " ms\n";
+  std::cout << "get_intersections: "
+            << bench::best_of(1, [&] { (void)tree.get_intersections(); })
+            << " ms\n";
+
+  auto move_batch = [&](const double step) {
+    std::uniform_real_distribution<double> off(-step, step);
+    for (size_t i = 0; i < n_edits; ++i) {
+      const size_t id = gen() % n;
+      tree.move(id, shifted(tree.object(id), {off(gen), off(gen), off(gen)}));
+    }
+  };
+  report("small moves", bench::best_of(1, [&] { move_batch(0.01); }), n_edits,
+      tree);
+  report("large moves", bench::best_of(1, [&] { move_batch(10.0); }), n_edits,
+      tree);
+
+  const std::vector<geometry::Triangle> extra =
+      bench::random_scene(n_edits, 100.0, 1.0, 8);
+  std::vector<Tree::Id> ids;
+  ids.reserve(n_edits);
+  report("inserts", bench::best_of(1, [&] {
+    for (const geometry::Triangle& tri : extra) {
+      ids.push_back(tree.insert(tri));
+    }
+  }), n_edits, tree);
+  report("erases", bench::best_of(1, [&] {
+    for (const Tree::Id id : ids) { tree.erase(id); }
+  }), n_edits, tree);
+
+  const double query_ms =
+      bench::best_of(1, [&] { (void)tree.get_intersections(); });
+  std::cout << "get_intersections after edits: " << query_ms << " ms\n";
+
+  // Flags kept up to date per edit instead of re-queried.
+  std::optional<acceleration::IncrementalIntersections<geometry::Triangle>>
+      incremental;
+  std::cout << "incremental counts: "
+            << bench::best_of(1, [&] { incremental.emplace(scene); })
+            << " ms\n";
+
+  std::vector<size_t>                    flipped;
+  size_t                                 n_flipped = 0;
+  std::uniform_real_distribution<double> off(-1.0, 1.0);
+
+  const double incremental_ms = bench::best_of(1, [&] {
+    for (size_t i = 0; i < n_edits; ++i) {
+      const size_t              id = gen() % n;
+      const geometry::Triangle& tri = incremental->tree().object(id);
+      incremental->move(
+          id, shifted(tri, {off(gen), off(gen), off(gen)}), &flipped);
+      n_flipped += flipped.size();
+    }
+  });
+  std::cout << "incremental moves: " << incremental_ms << " ms  edits/s="
+            << static_cast<double>(n_edits) / (incremental_ms / 1000.0)
+            << "  flips/edit="
+            << static_cast<double>(n_flipped) / static_cast<double>(n_edits)
+            << "\n";
+}
@@ -0,0 +1,50 @@
+// Scheduling overhead of ThreadPool::parallel_for at different grain sizes
+// against a plain serial loop over the same work.
+//   usage: pool_bench.x [n_items] [n_workers]
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "timer.hpp"
+#include "utils/thread_pool.hpp"
+
+namespace {
+
+// A few flops per item, enough that the compiler can't drop the loop.
+void work(std::vector<double>& data, const size_t lo, const size_t hi) {
+  for (size_t i = lo; i < hi; ++i) { data[i] = std::sqrt(data[i] + 1.0); }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const size_t n_workers =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+  const size_t reps = 5;
+
+  utils::ThreadPool   pool{utils::ThreadPoolConfig{n_workers}};
+  std::vector<double> data(n, 1.0);
+
+  std::cout << "items: " << n << "  workers: " << pool.size() << "\n";
+
+  const double serial_ms = bench::best_of(reps, [&] { work(data, 0, n); });
+  std::cout << "serial:       " << serial_ms << " ms\n";
+
+  for (const size_t grain : {1, 16, 256, 4096, 65536}) {
+    const size_t n_tasks = (n + grain - 1) / grain;
+    const double ms      = bench::best_of(reps, [&] {
+      pool.parallel_for(0, n, grain,
+          [&](const size_t lo, const size_t hi) { work(data, lo, hi); });
+    });
+    const double overhead_ns =
+        (ms - serial_ms) * 1e6 / static_cast<double>(n_tasks);
+
+    std::cout << "grain " << grain << ": " << ms << " ms"
+              << "  tasks=" << n_tasks << "  overhead/task=" << overhead_ns
+              << " ns  speedup=" << serial_ms / ms << "\n";
+  }
+}
@@ -0,0 +1,74 @@
+// Point-vs-plane classification: Plane + math::is_zero vs the orient3d
+// filter, and how often orient2d/orient3d have to fall back to exact
+// arithmetic.
+//   usage: predicates_bench.x [n_points]
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "geometry/geometry.hpp"
+#include "math/math.hpp"
+#include "timer.hpp"
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::mt19937                           gen(42);
+  std::uniform_real_distribution<double> coord(-100.0, 100.0);
+
+  std::vector<geometry::Vector3D> points;
+  points.reserve(n + 3);
+  for (size_t i = 0; i < n + 3; ++i) {
+    points.emplace_back(coord(gen), coord(gen), coord(gen));
+  }
+
+  size_t       n_sides = 0;
+  const double plane_ms = bench::best_of(3, [&] {
+    n_sides = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const geometry::Vector3D& a = points[i];
+      const geometry::Vector3D& b = points[i + 1];
+      const geometry::Vector3D& c = points[i + 2];
+      const geometry::Plane     plane{a, (b - a).cross(c - a)};
+
+      const double dist = plane.get_normal().scalar(points[i + 3]) -
+                          plane.get_D();
+      n_sides += !math::is_zero(dist) && dist > 0.0;
+    }
+  });
+
+  size_t       n_orient = 0;
+  const double orient_ms = bench::best_of(3, [&] {
+    n_orient = 0;
+    for (size_t i = 0; i < n; ++i) {
+      n_orient += geometry::orient3d(points[i], points[i + 1], points[i + 2],
+                      points[i + 3]) < 0.0;
+    }
+  });
+
+  std::cout << "plane + is_zero: " << plane_ms << " ms (" << n_sides
+            << " above)\n";
+  std::cout << "orient3d       : " << orient_ms << " ms (" << n_orient
+            << " above)\n";
+
+  // Degenerate input: every query point is exactly on the plane x = y, so
+  // the filter always fails and the exact stage decides.
+  size_t       n_zero = 0;
+  const double exact_ms = bench::best_of(3, [&] {
+    n_zero = 0;
+    for (size_t i = 0; i + 3 < n; i += 4) {
+      auto on_plane = [&](const size_t k) {
+        return geometry::Vector3D{points[k].x, points[k].x, points[k].z};
+      };
+      n_zero += geometry::orient3d(on_plane(i), on_plane(i + 1),
+                    on_plane(i + 2), on_plane(i + 3)) == 0.0;
+    }
+  });
+
+  std::cout << "orient3d exact : " << exact_ms << " ms for " << n / 4
+            << " coplanar quadruples (" << n_zero << " exactly zero)\n";
+  return 0;
+}
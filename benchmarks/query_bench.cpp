@@ -0,0 +1,158 @@
+// Fused vs pipelined get_intersections() on a random scene, with double and
+// float32 (TriangleF) triangle storage, with the float tree on 64-bit
+// indexes, and with the float scene viewed in vertex and index buffers; with
+// OpenCL also the device build and query, split into copies and kernels.
+// Then find_hits() for a batch of as many outside triangles, in Morton and
+// in batch order.
+//   usage: query_bench.x [n_triangles] [triangle_size]
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "acceleration/opencl_runtime.hpp"
+#include "scene_gen.hpp"
+#include "timer.hpp"
+
+namespace {
+
+void report(const char* name, const double ms,
+    const acceleration::QueryStats& stats, const size_t reps) {
+  const double pairs_per_sec =
+      static_cast<double>(stats.n_candidates / reps) / (ms / 1000.0);
+
+  std::cout << name << ": " << ms << " ms"
+            << "  candidates=" << stats.n_candidates / reps
+            << "  narrowphase=" << stats.n_narrowphase / reps
+            << "  hits=" << stats.n_hits / reps
+            << "  hit/candidate=" << stats.hit_ratio()
+            << "  candidate pairs/s=" << pairs_per_sec << "\n";
+}
+
+#ifdef USE_OPENCL
+void report_device(const char* name, const double ms,
+    const acceleration::DeviceTimings& timings) {
+  std::cout << name << ": " << ms << " ms"
+            << "  upload=" << timings.upload_us / 1000.0 << " ms"
+            << "  kernels=" << timings.kernel_us / 1000.0 << " ms"
+            << "  readback=" << timings.readback_us / 1000.0 << " ms"
+            << "  overlapped=" << timings.overlap_us() / 1000.0 << " ms\n";
+}
+#endif  // USE_OPENCL
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t n    = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  const double size = argc > 2 ? std::strtod(argv[2], nullptr) : 1.0;
+  const size_t reps = 3;
+
+  std::vector<geometry::Triangle> scene = bench::random_scene(n, 100.0, size);
+  std::vector<geometry::TriangleF> compact;
+  compact.reserve(n);
+  for (geometry::Triangle& tri : scene) {
+    compact.emplace_back(geometry::Vector3F{tri.a}, geometry::Vector3F{tri.b},
+        geometry::Vector3F{tri.c});
+    tri = compact.back().to_triangle();
+  }
+
+  acceleration::BVHTree<geometry::Triangle>  tree{scene};
+  acceleration::BVHTree<geometry::TriangleF> compact_tree{compact};
+  acceleration::BVHTree<geometry::TriangleF, uint64_t> wide_tree{compact};
+
+  // The float scene as a mesh would hold it: position, normal and uv per
+  // vertex, and an index buffer.
+  constexpr size_t      floats_per_vertex = 8;
+  std::vector<float>    vertex_buffer;
+  std::vector<uint32_t> index_buffer;
+  for (const geometry::TriangleF& tri : compact) {
+    for (const geometry::Vector3F* corner : {&tri.a, &tri.b, &tri.c}) {
+      index_buffer.push_back(
+          static_cast<uint32_t>(vertex_buffer.size() / floats_per_vertex));
+      vertex_buffer.insert(vertex_buffer.end(),
+          {corner->x, corner->y, corner->z, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f});
+    }
+  }
+  const acceleration::BVHTree<geometry::TriangleF> view_tree{
+      acceleration::ObjectView<geometry::TriangleF>(
+          acceleration::VertexLayout<float>::interleaved(vertex_buffer.data(),
+              floats_per_vertex * sizeof(float),
+              vertex_buffer.size() / floats_per_vertex),
+          index_buffer)};
+
+  std::cout << "triangles: " << n << "\n";
+
+  for (const auto mode :
+      {acceleration::QueryMode::Fused, acceleration::QueryMode::Pipelined}) {
+    const bool is_fused = mode == acceleration::QueryMode::Fused;
+
+    acceleration::QueryStats stats;
+    const double             ms = bench::best_of(reps, [&] {
+      (void)tree.get_intersections(mode, &stats);
+    });
+    report(is_fused ? "fused    double" : "pipelined double", ms, stats, reps);
+
+    acceleration::QueryStats compact_stats;
+    const double             compact_ms = bench::best_of(reps, [&] {
+      (void)compact_tree.get_intersections(mode, &compact_stats);
+    });
+    report(is_fused ? "fused    float " : "pipelined float ", compact_ms,
+        compact_stats, reps);
+
+    acceleration::QueryStats wide_stats;
+    const double             wide_ms = bench::best_of(reps, [&] {
+      (void)wide_tree.get_intersections(mode, &wide_stats);
+    });
+    report(is_fused ? "fused    wide  " : "pipelined wide  ", wide_ms,
+        wide_stats, reps);
+
+    acceleration::QueryStats view_stats;
+    const double             view_ms = bench::best_of(reps, [&] {
+      (void)view_tree.get_intersections(mode, &view_stats);
+    });
+    report(is_fused ? "fused    view  " : "pipelined view  ", view_ms,
+        view_stats, reps);
+  }
+
+  std::vector<geometry::TriangleF> batch;
+  for (const geometry::Triangle& tri : bench::random_scene(n, 100.0, size, 7)) {
+    batch.emplace_back(geometry::Vector3F{tri.a}, geometry::Vector3F{tri.b},
+        geometry::Vector3F{tri.c});
+  }
+  for (const bool morton : {true, false}) {
+    acceleration::HitOptions options;
+    options.morton_order = morton;
+
+    size_t       n_hits = 0;
+    const double ms     = bench::best_of(reps, [&] {
+      n_hits = compact_tree.find_hits(batch, options).objects.size();
+    });
+    std::cout << (morton ? "hits     morton" : "hits     batch ") << ": " << ms
+              << " ms  hits=" << n_hits << "\n";
+  }
+
+#ifdef USE_OPENCL
+  if (!acceleration::CLRuntime::instance().is_available()) { return 0; }
+
+  acceleration::DeviceTimings build_timings;
+  const double                build_ms = bench::best_of(reps, [&] {
+    std::vector<geometry::Triangle> input = scene;
+    const acceleration::BVHTree<geometry::Triangle> device_tree(
+        input, acceleration::BuildEngine::OpenCL);
+    build_timings = device_tree.device_build_timings();
+  });
+  report_device("device   build ", build_ms, build_timings);
+
+  acceleration::QueryStats device_stats;
+  const double             device_ms = bench::best_of(reps, [&] {
+    device_stats = {};
+    (void)tree.get_intersections(
+        acceleration::QueryMode::Device, &device_stats);
+  });
+  report_device("device   query ", device_ms, device_stats.device);
+#endif  // USE_OPENCL
+  return 0;
+}
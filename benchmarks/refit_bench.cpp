@@ -0,0 +1,66 @@
+// A deforming scene: every frame each triangle drifts along its own random
+// velocity. Refit against a full rebuild, and how queries on the refit tree
+// slow down as its SAH cost grows.
+//   usage: refit_bench.x [n_triangles] [n_frames] [speed]
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "scene_gen.hpp"
+#include "timer.hpp"
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  const size_t n_frames =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+  const double speed = argc > 3 ? std::strtod(argv[3], nullptr) : 1.0;
+
+  std::vector<geometry::Triangle> scene = bench::random_scene(n);
+  std::vector<geometry::Vector3D> velocity;
+  velocity.reserve(n);
+  std::mt19937                           gen(5);
+  std::uniform_real_distribution<double> dir(-speed, speed);
+  for (size_t i = 0; i < n; ++i) {
+    velocity.emplace_back(dir(gen), dir(gen), dir(gen));
+  }
+
+  acceleration::BVHTree<geometry::Triangle> tree{scene};
+  std::cout << "triangles: " << n << "  engine: "
+            << static_cast<int>(tree.build_engine()) << "\n";
+
+  for (size_t frame = 1; frame <= n_frames; ++frame) {
+    for (size_t i = 0; i < n; ++i) {
+      scene[i] = geometry::Triangle(scene[i].a + velocity[i],
+          scene[i].b + velocity[i], scene[i].c + velocity[i]);
+    }
+
+    const double refit_ms = bench::best_of(1, [&] {
+      (void)tree.refit(std::numeric_limits<double>::infinity());
+    });
+    const double refit_query_ms =
+        bench::best_of(1, [&] { (void)tree.get_intersections(); });
+
+    std::vector<geometry::Triangle> copy = scene;
+    std::unique_ptr<acceleration::BVHTree<geometry::Triangle>> rebuilt;
+    const double rebuild_ms = bench::best_of(1, [&] {
+      rebuilt =
+          std::make_unique<acceleration::BVHTree<geometry::Triangle>>(copy);
+    });
+    const double rebuilt_query_ms =
+        bench::best_of(1, [&] { (void)rebuilt->get_intersections(); });
+
+    std::cout << "frame " << frame << ": refit " << refit_ms << " ms"
+              << "  rebuild " << rebuild_ms << " ms"
+              << "  growth " << tree.cost_growth()
+              << "  cost refit/rebuilt "
+              << tree.sah_cost() / rebuilt->sah_cost()
+              << "  query refit " << refit_query_ms << " ms"
+              << "  rebuilt " << rebuilt_query_ms << " ms\n";
+  }
+}
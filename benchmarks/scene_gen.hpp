@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "geometry/geometry.hpp"
+
+namespace bench {
+
+// Small random triangles scattered uniformly inside [0, side]^3.
+inline std::vector<geometry::Triangle> random_scene(const size_t n,
+    const double side = 100.0, const double tri_size = 1.0,
+    const unsigned seed = 42) {
+  std::mt19937                           gen(seed);
+  std::uniform_real_distribution<double> pos(0.0, side);
+  std::uniform_real_distribution<double> off(-tri_size, tri_size);
+
+  std::vector<geometry::Triangle> scene;
+  scene.reserve(n);
+
+  for (size_t i = 0; i < n; ++i) {
+    const geometry::Vector3D base{pos(gen), pos(gen), pos(gen)};
+    const geometry::Vector3D b{off(gen), off(gen), off(gen)};
+    const geometry::Vector3D c{off(gen), off(gen), off(gen)};
+    scene.emplace_back(base, base + b, base + c);
+  }
+  return scene;
+}
+
+// Long thin triangles running along the xy diagonal: their bounding boxes are
+// almost cubes, so box overlap says little about triangle overlap.
+inline std::vector<geometry::Triangle> diagonal_scene(const size_t n,
+    const double side = 100.0, const double length = 10.0,
+    const double width = 0.05, const unsigned seed = 42) {
+  std::mt19937                           gen(seed);
+  std::uniform_real_distribution<double> pos(0.0, side);
+  std::uniform_real_distribution<double> jitter(-width, width);
+
+  std::vector<geometry::Triangle> scene;
+  scene.reserve(n);
+
+  for (size_t i = 0; i < n; ++i) {
+    const geometry::Vector3D base{pos(gen), pos(gen), pos(gen)};
+    const geometry::Vector3D dir =
+        (i % 2) ? geometry::Vector3D{length, length, jitter(gen)}
+                : geometry::Vector3D{length, -length, jitter(gen)};
+    const geometry::Vector3D side_off{jitter(gen), jitter(gen), width};
+
+    scene.emplace_back(base, base + dir, base + dir + side_off);
+  }
+  return scene;
+}
+
+// Jittered tiles on one tilted plane: nearly every candidate pair is
+// coplanar, as in floor and panel meshes.
+inline std::vector<geometry::Triangle> coplanar_scene(const size_t n,
+    const double tile = 1.0, const double jitter = 0.3,
+    const unsigned seed = 42) {
+  std::mt19937                           gen(seed);
+  std::uniform_real_distribution<double> off(-jitter, jitter);
+
+  const geometry::Vector3D u{0.8, 0.0, 0.6};
+  const geometry::Vector3D v{0.0, 1.0, 0.0};
+  const size_t             row = static_cast<size_t>(std::sqrt(n / 2.0)) + 1;
+
+  auto on_plane = [&](const double s, const double t) { return u * s + v * t; };
+
+  std::vector<geometry::Triangle> scene;
+  scene.reserve(n);
+
+  for (size_t i = 0; scene.size() < n; ++i) {
+    const double s = tile * static_cast<double>(i % row);
+    const double t = tile * static_cast<double>(i / row);
+
+    scene.emplace_back(on_plane(s + off(gen), t + off(gen)),
+        on_plane(s + tile + off(gen), t + off(gen)),
+        on_plane(s + off(gen), t + tile + off(gen)));
+    if (scene.size() == n) { break; }
+    scene.emplace_back(on_plane(s + tile + off(gen), t + off(gen)),
+        on_plane(s + tile + off(gen), t + tile + off(gen)),
+        on_plane(s + off(gen), t + tile + off(gen)));
+  }
+  return scene;
+}
+
+}  // namespace bench
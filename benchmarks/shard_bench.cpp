@@ -0,0 +1,48 @@
+// One tree in this process against the scene split between 2, 4 and 8
+// worker processes, each a copy of this benchmark with --shard-worker.
+// Reports the time and the ghosts sent along with the shards.
+//   usage: shard_bench.x [n_triangles]
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "scene_gen.hpp"
+#include "server/shard.hpp"
+#include "timer.hpp"
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string_view(argv[1]) == "--shard-worker") {
+    return server::serve_shards(STDIN_FILENO, STDOUT_FILENO);
+  }
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::vector<geometry::TriangleF> scene;
+  scene.reserve(n);
+  for (const geometry::Triangle& tri : bench::random_scene(n)) {
+    scene.emplace_back(geometry::Vector3F{tri.a}, geometry::Vector3F{tri.b},
+        geometry::Vector3F{tri.c});
+  }
+
+  const double one_ms = bench::best_of(
+      3, [&] { (void)acceleration::find_all_intersections(scene); });
+  std::cout << "triangles: " << n << "\none tree: " << one_ms << " ms\n";
+
+  for (const size_t n_shards : {2, 4, 8}) {
+    server::ShardConfig config;
+    config.n_shards = n_shards;
+
+    server::ShardStats stats;
+    const double       ms = bench::best_of(3, [&] {
+      (void)server::find_intersections_sharded(scene, config, &stats);
+    });
+    std::cout << n_shards << " shards: " << ms << " ms"
+              << "  ghosts=" << stats.n_ghosts
+              << "  largest shard=" << stats.max_shard_triangles << "\n";
+  }
+}
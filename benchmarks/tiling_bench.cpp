@@ -0,0 +1,52 @@
+// The out-of-core path on a scene given as triangles.x text: in memory, and
+// cut into tiles on disk under budgets of 1/4, 1/16 and 1/64 of the memory
+// the whole scene would take. Reports the time, the tiles and the records
+// spilled, duplicates included.
+//   usage: tiling_bench.x [n_triangles] [spill_dir]
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "acceleration/acceleration.hpp"
+#include "scene_gen.hpp"
+#include "timer.hpp"
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::ostringstream text;
+  text.precision(9);
+  text << n << "\n";
+  for (const geometry::Triangle& tri : bench::random_scene(n)) {
+    for (const geometry::Vector3D& p : {tri.a, tri.b, tri.c}) {
+      text << static_cast<float>(p.x) << " " << static_cast<float>(p.y) << " "
+           << static_cast<float>(p.z) << " ";
+    }
+    text << "\n";
+  }
+  const std::string scene = text.str();
+  std::cout << "triangles: " << n << "  scene in memory: "
+            << static_cast<double>(acceleration::tile_memory(n)) / (1 << 20)
+            << " MiB\n";
+
+  for (const size_t divisor : {1, 4, 16, 64}) {
+    acceleration::OutOfCoreConfig config;
+    config.memory_budget = acceleration::tile_memory(n) / divisor;
+    if (argc > 2) { config.spill_dir = argv[2]; }
+
+    acceleration::OutOfCoreStats stats;
+    const double                 ms = bench::best_of(1, [&] {
+      std::istringstream in(scene);
+      (void)acceleration::find_intersections_out_of_core(in, config, &stats);
+    });
+    std::cout << "budget 1/" << divisor << ": " << ms << " ms"
+              << "  tiles=" << stats.n_tiles
+              << "  spilled=" << stats.n_spilled
+              << "  largest tile=" << stats.max_tile_triangles
+              << "  oversized=" << stats.n_oversized << "\n";
+  }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace bench {
+
+// Runs `fn` `reps` times and returns the best wall time in milliseconds.
+template <typename Fn>
+double best_of(const size_t reps, Fn&& fn) {
+  double best = 0.0;
+  for (size_t i = 0; i < reps; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    const auto   stop = std::chrono::steady_clock::now();
+    const double ms =
+        std::chrono::duration<double, std::milli>(stop - start).count();
+    if (i == 0 || ms < best) { best = ms; }
+  }
+  return best;
+}
+
+}  // namespace bench
@@ -1,31 +1,109 @@
 #pragma once
 
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
 
 #include "geometry/geometry.hpp"
+#include "math/math.hpp"
 
 namespace acceleration {
 
+namespace detail {
+
+// Nearest floats below and above a double; exact when it is a float already.
+[[nodiscard]] inline float round_down(const double value) {
+  const float rounded = static_cast<float>(value);
+  return rounded > value ? std::nextafter(rounded, -INFINITY) : rounded;
+}
+
+[[nodiscard]] inline float round_up(const double value) {
+  const float rounded = static_cast<float>(value);
+  return rounded < value ? std::nextafter(rounded, INFINITY) : rounded;
+}
+
+}  // namespace detail
+
+// Bounds are stored in float32: double corners are rounded outward, so the
+// stored box always contains the exact one and the overlap tests stay
+// conservative. Corners use the padded four-lane layout, so with SSE the
+// overlap test and merge are one aligned load and one vector op per corner.
 struct AABB {
-  geometry::Vector3D min;
-  geometry::Vector3D max;
+  geometry::PaddedVector3F min;
+  geometry::PaddedVector3F max;
 
   AABB() = default;
-  AABB(const geometry::Vector3D min_, const geometry::Vector3D max_)
-      : min(min_), max(max_) {}
+  AABB(const geometry::Vector3D& min_, const geometry::Vector3D& max_);
   AABB(const geometry::Triangle& tri);
+  AABB(const geometry::TriangleF& tri);
 
   [[nodiscard]] bool is_valid() const;
   [[nodiscard]] bool is_intersect(const AABB& other) const;
+  // Overlap without a tolerance. Pass a loosened() box as `other` to get the
+  // is_intersect() answer without adding math::eps on every comparison.
+  [[nodiscard]] bool is_overlap(const AABB& other) const;
+  // Separating-axis test (box faces, triangle normal, 9 edge cross products)
+  // against the box padded by `pad`; degenerate triangles are allowed.
+  [[nodiscard]] bool is_intersect(
+      const geometry::Triangle& tri, const double pad = math::eps) const;
+  [[nodiscard]] bool is_intersect(
+      const geometry::TriangleF& tri, const double pad = math::eps) const;
   [[nodiscard]] bool is_inside(const AABB& other) const;
   [[nodiscard]] bool is_contains(const AABB& other) const;
 
+  // The box grown by `pad` on every side, rounded outward.
+  [[nodiscard]] AABB loosened(const double pad = math::eps) const;
+  // Cost metric of the SAH builder: the chance a random ray meets the box.
+  [[nodiscard]] double surface_area() const;
+
   void expand(const geometry::Vector3D& p);
   void merge(const AABB& other);
 
   void add_tri_to_aabb(const geometry::Triangle& tri, AABB& aabb);
 };
 
-[[nodiscard]] AABB merge(const AABB& a, const AABB& b);
+inline bool AABB::is_overlap(const AABB& other) const {
+  assert(this->is_valid());
+  assert(other.is_valid());
+
+#ifdef __SSE__
+  // Padding lanes are zero on both sides, so they always compare true.
+  const __m128 below =
+      _mm_cmple_ps(_mm_load_ps(&min.x), _mm_load_ps(&other.max.x));
+  const __m128 above =
+      _mm_cmple_ps(_mm_load_ps(&other.min.x), _mm_load_ps(&max.x));
+  return _mm_movemask_ps(_mm_and_ps(below, above)) == 0xF;
+#else
+  return min.x <= other.max.x && other.min.x <= max.x && min.y <= other.max.y &&
+         other.min.y <= max.y && min.z <= other.max.z && other.min.z <= max.z;
+#endif  // __SSE__
+}
+
+inline void AABB::merge(const AABB& other) {
+  assert(this->is_valid());
+  assert(other.is_valid());
+
+#ifdef __SSE__
+  _mm_store_ps(
+      &min.x, _mm_min_ps(_mm_load_ps(&min.x), _mm_load_ps(&other.min.x)));
+  _mm_store_ps(
+      &max.x, _mm_max_ps(_mm_load_ps(&max.x), _mm_load_ps(&other.max.x)));
+#else
+  for (size_t i = 0; i < 3; ++i) {
+    min[i] = std::fmin(min[i], other.min[i]);
+    max[i] = std::fmax(max[i], other.max[i]);
+  }
+#endif  // __SSE__
+}
+
+[[nodiscard]] inline AABB merge(const AABB& a, const AABB& b) {
+  AABB res = a;
+  res.merge(b);
+  return res;
+}
 
 }  // namespace acceleration
\ No newline at end of file
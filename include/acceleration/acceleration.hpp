@@ -1,4 +1,8 @@
 #pragma once
 
-#include "AABB.hpp"      // IWYU pragma: export
-#include "bvh_tree.hpp"  // IWYU pragma: export
\ No newline at end of file
+#include "AABB.hpp"                       // IWYU pragma: export
+#include "bvh_tree.hpp"                   // IWYU pragma: export
+#include "dynamic_bvh.hpp"                // IWYU pragma: export
+#include "incremental_intersections.hpp"  // IWYU pragma: export
+#include "object_view.hpp"                // IWYU pragma: export
+#include "out_of_core.hpp"                // IWYU pragma: export
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <numeric>
+#include <vector>
+
+#include "utils/thread_pool.hpp"
+
+namespace acceleration {
+
+// Saved trees of another version are rejected, never converted.
+inline constexpr uint32_t bvh_file_version = 2;
+
+namespace detail {
+
+// On-disk tree (BVHTree::save): this header, then the node array, the index
+// array and optionally the objects, each at a multiple of
+// bvh_file_alignment, all in the writer's native layout so a reader maps
+// them as they are. Readers with another byte order or layout see a
+// different endian tag or sizes and reject the file.
+inline constexpr char     bvh_file_magic[8]  = {'T', 'R', 'I', 'B', 'V', 'H'};
+inline constexpr uint32_t bvh_endian_tag     = 0x01020304;
+inline constexpr size_t   bvh_file_alignment = 64;
+
+struct BVHFileHeader {
+  char     magic[8]    = {};
+  uint32_t version     = 0;
+  uint32_t endian_tag  = 0;
+  uint32_t node_size   = 0;  // bytes per BVHNode
+  uint32_t index_size  = 0;  // bytes per index
+  uint32_t object_size = 0;  // bytes per object
+  uint32_t coord_size  = 0;  // bytes per object coordinate
+  uint32_t engine      = 0;  // BuildEngine that built the tree
+  uint32_t max_depth   = 0;
+
+  uint64_t n_objects      = 0;
+  uint64_t n_nodes        = 0;
+  uint64_t input_checksum = 0;
+  uint64_t nodes_offset   = 0;
+  uint64_t indexes_offset = 0;
+  uint64_t objects_offset = 0;  // 0 when the objects aren't stored
+
+  double cost       = 0.0;  // BVHTree::sah_cost() when saved
+  double built_cost = 0.0;  // and right after its build
+};
+static_assert(sizeof(BVHFileHeader) == 104);
+
+[[nodiscard]] inline uint64_t align_file_offset(const uint64_t offset) {
+  return (offset + bvh_file_alignment - 1) / bvh_file_alignment *
+         bvh_file_alignment;
+}
+
+// Read-only private mapping of a whole file, kept alive by the trees using
+// it. Throws std::runtime_error if the file can't be opened or mapped.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  [[nodiscard]] const std::byte* data() const { return base; }
+  [[nodiscard]] size_t           size() const { return length; }
+
+ private:
+  const std::byte* base   = nullptr;
+  size_t           length = 0;
+};
+
+[[nodiscard]] inline uint64_t checksum_mix(
+    uint64_t hash, const uint64_t word) {
+  hash ^= word * 0x9e3779b97f4a7c15ull;
+  return std::rotl(hash, 27) * 0xff51afd7ed558ccdull;
+}
+
+// Hash of the vertex coordinates, widened to double, so it doesn't depend
+// on padding in the object type or on how the objects are stored. Blocks of
+// objects are hashed in parallel and combined in order: the result doesn't
+// depend on the schedule.
+template <typename Objects>
+[[nodiscard]] uint64_t input_checksum(
+    const Objects& input, utils::ThreadPool& pool) {
+  constexpr size_t block = 4096;
+
+  std::vector<uint64_t> partial((input.size() + block - 1) / block);
+  pool.parallel_for(0, input.size(), block,
+      [&](const size_t first, const size_t last) {
+        uint64_t hash = first;
+        for (size_t i = first; i < last; ++i) {
+          const auto& object = input[i];
+          for (const auto* vertex : {&object.a, &object.b, &object.c}) {
+            for (size_t axis = 0; axis < 3; ++axis) {
+              hash = checksum_mix(
+                  hash, std::bit_cast<uint64_t>(double{(*vertex)[axis]}));
+            }
+          }
+        }
+        partial[first / block] = hash;
+      });
+  return std::accumulate(partial.begin(), partial.end(),
+      static_cast<uint64_t>(input.size()), checksum_mix);
+}
+
+}  // namespace detail
+
+}  // namespace acceleration
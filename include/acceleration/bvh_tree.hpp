@@ -1,21 +1,39 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <numeric>
 #include <ostream>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "AABB.hpp"
+#include "bvh_file.hpp"
+#include "dispatcher.hpp"
+#include "object_view.hpp"
 #include "geometry/geometry.hpp"
 #include "math/math.hpp"
+#include "utils/arena.hpp"
+#include "utils/cache.hpp"
 #include "utils/logger.hpp"
+#include "utils/thread_pool.hpp"
 
 namespace acceleration {
 
@@ -23,52 +41,518 @@ inline constexpr size_t max_leaf_cap_for_cpu = 4;
 inline constexpr size_t tree_max_depth       = 64;
 inline constexpr size_t morton_code_size     = 32;  // bits
 inline constexpr size_t grid_resolution      = 1024;
-
-#ifdef USE_OPENCL
-inline const std::string opencl_file = "source/acceleration/kernels/lbvh.cl";
-#endif  // USE_OPENCL
-
+inline constexpr size_t candidate_buffer_cap = 256;
+
+// Subtrees with fewer objects are built on the thread that reached them.
+inline constexpr size_t parallel_build_grain = 4096;
+// Parallel queries split the input into about this many ranges per worker,
+// so stealing can even out dense and empty regions.
+inline constexpr size_t query_ranges_per_worker = 8;
+inline constexpr size_t min_query_grain         = 256;
+// Centroid bins per axis of the SAH builder.
+inline constexpr size_t sah_bin_count = 16;
+// Nodes per task of the refit, which runs one tree level at a time.
+inline constexpr size_t refit_grain = 1024;
+// refit() rebuilds the tree once its SAH cost grew by this factor.
+inline constexpr double refit_max_cost_growth = 1.5;
+
+// Linear BVH radix sort: digit width and keys per work-item, and the values
+// per work-item of the prefix sums.
+inline constexpr size_t lbvh_radix_bits  = 4;
+inline constexpr size_t lbvh_radix_chunk = 256;
+inline constexpr size_t lbvh_scan_block  = 256;
+// Traversal stack of the device query; deeper trees are queried on the host.
+inline constexpr size_t query_stack_size = 64;
+// Objects per staged vertex upload and nodes per staged readback: each
+// chunk is copied while the previous one is processed.
+inline constexpr size_t lbvh_upload_chunk   = 1 << 16;
+inline constexpr size_t lbvh_readback_chunk = 1 << 16;
+
+// Trees index their nodes and objects with uint32_t, or with uint64_t for
+// scenes of more than max_tree_objects<uint32_t> objects.
+template <typename Index>
+inline constexpr bool is_tree_index_v =
+    std::is_same_v<Index, uint32_t> || std::is_same_v<Index, uint64_t>;
+
+// Most objects a tree indexed by `Index` holds: its 2n - 1 nodes must stay
+// below the all-ones child index that marks a leaf.
+template <typename Index>
+inline constexpr size_t max_tree_objects =
+    std::numeric_limits<Index>::max() / 2;
+
+// `box` is the loose bound: the exact bound of the node loosened by math::eps
+// once at build time, so traversal tests it with AABB::is_overlap and never
+// adds the tolerance per comparison.
+template <typename Index>
 struct BVHNode {
+  static_assert(is_tree_index_v<Index>);
+  static constexpr Index no_child = std::numeric_limits<Index>::max();
+
   AABB box;
 
-  int32_t left_idx  = -1;
-  int32_t right_idx = -1;
+  Index left_idx  = no_child;
+  Index right_idx = no_child;
 
-  size_t start  = 0;
-  size_t n_objs = 0;
+  Index start  = 0;
+  Index n_objs = 0;
 
-  BVHNode(const AABB& box_ = AABB(), const size_t first_ = 0,
-      const size_t n_objs_ = 0);
+  BVHNode(const AABB& box_ = AABB(), const Index first_ = 0,
+      const Index n_objs_ = 0);
 
   [[nodiscard]] bool is_leaf() const { return (n_objs > 0); }
   [[nodiscard]] bool is_valid() const;
 
-  void init_leaf(const AABB& box_, const size_t start_, const size_t n_objs_);
+  void init_leaf(const AABB& box_, const Index start_, const Index n_objs_);
   void init_internal(
-      const AABB& box_, const int left_idx_, const int right_idx_);
+      const AABB& box_, const Index left_idx_, const Index right_idx_);
+};
+static_assert(sizeof(BVHNode<uint32_t>) == 48);
+static_assert(sizeof(BVHNode<uint64_t>) == 64);
+
+enum class QueryMode {
+  Fused,      // narrowphase runs inside the traversal, first hit stops a query
+  Pipelined,  // traversal fills a candidate buffer, narrowphase runs in batches
+  Device,     // Fused in an OpenCL kernel; Fused on the host without a device
+  Auto,       // Device or parallel Pipelined, as the Dispatcher estimates
 };
 
-template <typename ObjT>
+struct QueryOptions {
+  QueryMode mode = QueryMode::Fused;
+  // Separating-axis triangle-vs-box stage between the box overlap and the
+  // exact test: the query triangle is checked against leaf and candidate boxes
+  bool sat_culling = false;
+  // Spread the queries over the tree's thread pool. Pipelined results are
+  // the same as serial ones; fused ones too as long as is_intersect is
+  // symmetric, since the order in which pairs are met changes.
+  bool parallel = false;
+
+  QueryOptions(const QueryMode mode_ = QueryMode::Fused,
+      const bool sat_culling_ = false, const bool parallel_ = false)
+      : mode(mode_), sat_culling(sat_culling_), parallel(parallel_) {}
+};
+
+// Options of the triangles.x query: Auto, unless TRIANGLES_QUERY=device or
+// host forces the device or parallel pipelined host queries.
+[[nodiscard]] QueryOptions default_query_options();
+
+// Which scene objects find_hits() reports for each query.
+enum class HitMode {
+  Any,     // one, if there is any: the traversal stops at the first hit
+  FirstK,  // up to max_hits, the first ones the traversal meets
+  All,     // every object the query intersects
+};
+
+struct HitOptions {
+  HitMode mode     = HitMode::All;
+  size_t  max_hits = 1;  // FirstK only
+  // Run the batch in Morton order of the query centres, so consecutive
+  // queries walk the same nodes. The results are in batch order either way.
+  bool morton_order = true;
+};
+
+// Scene indexes hit by each query of a batch, ascending: those of query i
+// are objects[offsets[i]] .. objects[offsets[i + 1] - 1].
+template <typename Index>
+struct QueryHits {
+  std::vector<size_t> offsets;  // one more than the queries
+  std::vector<Index>  objects;
+
+  [[nodiscard]] size_t size() const {
+    return offsets.empty() ? 0 : offsets.size() - 1;
+  }
+  [[nodiscard]] std::span<const Index> operator[](const size_t i) const {
+    return {objects.data() + offsets[i], offsets[i + 1] - offsets[i]};
+  }
+};
+
+// OpenCL profiling times of a build or query, in microseconds of device
+// clock; all zero when nothing ran on a device.
+struct DeviceTimings {
+  double upload_us   = 0.0;  // host to device copies
+  double kernel_us   = 0.0;  // kernels and buffer fills
+  double readback_us = 0.0;  // device to host copies
+  double span_us     = 0.0;  // first command start to last command end
+
+  // Copy time hidden behind other commands.
+  [[nodiscard]] double overlap_us() const {
+    return std::max(0.0, upload_us + kernel_us + readback_us - span_us);
+  }
+
+  void merge(const DeviceTimings& other);
+};
+
+struct QueryStats {
+  size_t n_queries     = 0;
+  size_t n_candidates  = 0;  // pairs whose boxes overlap
+  size_t n_sat_tests   = 0;  // triangle-vs-box separating axis tests
+  size_t n_sat_culled  = 0;  // candidates dropped by the SAT stage
+  size_t n_narrowphase = 0;  // exact tests actually run
+  size_t n_hits        = 0;  // exact tests that reported an intersection
+
+  // Device queries re-run on the host: degenerate or undecided pairs.
+  size_t n_host_fallbacks = 0;
+
+  DeviceTimings device;
+
+  [[nodiscard]] double hit_ratio() const {
+    return n_candidates ? static_cast<double>(n_hits) / n_candidates : 0.0;
+  }
+
+  void merge(const QueryStats& other);
+};
+
+template <typename Index>
+struct CandidatePair {
+  Index query     = 0;
+  Index candidate = 0;
+};
+
+// Fixed-size staging area between the broadphase and the narrowphase. Each
+// traversing thread owns one, so the hot loop never touches the heap.
+template <typename Index>
+struct CandidateBuffer {
+  std::array<CandidatePair<Index>, candidate_buffer_cap> pairs;
+  size_t                                                 size = 0;
+
+  [[nodiscard]] bool is_full() const { return size == pairs.size(); }
+  [[nodiscard]] bool is_empty() const { return size == 0; }
+
+  void push(const Index query, const Index candidate) {
+    assert(!is_full());
+    pairs[size++] = {query, candidate};
+  }
+  void clear() { size = 0; }
+};
+
+namespace detail {
+
+// Vector that can instead view a read-only array owned by `keeper`, such as
+// a mapped file, so loaded trees use their arrays in place. Resizing or
+// make_owned() switches a view to an owned copy; writing through a view is
+// a bug.
+template <typename T>
+class TreeArray {
+ public:
+  [[nodiscard]] bool is_view() const { return viewed != nullptr; }
+
+  void view(const T* data, const size_t size,
+      std::shared_ptr<const void> keeper) {
+    owned.clear();
+    viewed   = data;
+    n_viewed = size;
+    keep     = std::move(keeper);
+  }
+  void make_owned() {
+    if (!is_view()) { return; }
+    owned.assign(viewed, viewed + n_viewed);
+    viewed = nullptr;
+    keep.reset();
+  }
+
+  [[nodiscard]] size_t size() const {
+    return is_view() ? n_viewed : owned.size();
+  }
+  [[nodiscard]] bool     empty() const { return size() == 0; }
+  [[nodiscard]] const T* data() const {
+    return is_view() ? viewed : owned.data();
+  }
+  [[nodiscard]] const T* begin() const { return data(); }
+  [[nodiscard]] const T* end() const { return data() + size(); }
+  [[nodiscard]] const T& operator[](const size_t i) const { return data()[i]; }
+
+  [[nodiscard]] T* begin() {
+    assert(!is_view());
+    return owned.data();
+  }
+  [[nodiscard]] T* end() { return begin() + owned.size(); }
+  [[nodiscard]] T& operator[](const size_t i) {
+    assert(!is_view());
+    return owned[i];
+  }
+
+  void resize(const size_t size) {
+    make_owned();
+    owned.resize(size);
+  }
+  void clear() {
+    owned.clear();
+    viewed = nullptr;
+    keep.reset();
+  }
+
+ private:
+  std::vector<T>              owned;
+  const T*                    viewed   = nullptr;
+  size_t                      n_viewed = 0;
+  std::shared_ptr<const void> keep;
+};
+
+// Node counts of median-split subtrees by (object count, depth). With them
+// the CPU builder gives every subtree its preorder slot range up front, so
+// both halves of a split can be built in parallel into one node array, in
+// the same layout a serial build produces.
+class SubtreeSizes {
+ public:
+  explicit SubtreeSizes(const size_t n_objs);
+
+  [[nodiscard]] size_t operator()(
+      const size_t n_objs, const size_t depth) const {
+    return sizes.at({n_objs, depth});
+  }
+  [[nodiscard]] size_t max_depth() const { return deepest; }
+
+ private:
+  std::map<std::pair<size_t, size_t>, size_t> sizes;
+  size_t                                       deepest = 0;
+
+  size_t count(const size_t n_objs, const size_t depth);
+};
+
+// Objects and bounds of one centroid bin of the SAH builder.
+struct SAHBin {
+  AABB   box;
+  size_t count = 0;
+
+  void add(const AABB& obj_box) {
+    if (count++ == 0) {
+      box = obj_box;
+    } else {
+      box.merge(obj_box);
+    }
+  }
+  void merge(const SAHBin& other) {
+    if (other.count == 0) { return; }
+    box    = count ? acceleration::merge(box, other.box) : other.box;
+    count += other.count;
+  }
+  [[nodiscard]] double cost() const {
+    return count ? box.surface_area() * count : 0.0;
+  }
+};
+
+// Triangle vertices for the linear BVH builders, 9 floats per object:
+// `lower` rounded down and `upper` rounded up from the input, so the leaf
+// boxes equal AABB's. Float input is exact and leaves `upper` empty.
+struct LBVHInput {
+  std::pmr::vector<float> lower;
+  std::pmr::vector<float> upper;
+
+  [[nodiscard]] size_t size() const { return lower.size() / 9; }
+  [[nodiscard]] const std::pmr::vector<float>& upper_bounds() const {
+    return upper.empty() ? lower : upper;
+  }
+};
+
+// Morton code of the cell of `point` in a grid_resolution^3 grid over the
+// box [lo, hi], as the linear BVH builders order their objects.
+[[nodiscard]] uint32_t morton_code(
+    const float point[3], const float lo[3], const float hi[3]);
+
+// Linear BVH node in the layout the device writes (see lbvh.cl, built with
+// INDEX_BITS of `Index`): exact, not loosened float box; internal nodes in
+// slots 0..n-2, then one leaf per object in Morton order.
+template <typename Index>
+struct LBVHNode {
+  static constexpr Index no_child = std::numeric_limits<Index>::max();
+
+  float min[4];
+  float max[4];
+  Index left_idx;
+  Index right_idx;
+  Index object;
+  Index pad;
+};
+static_assert(sizeof(LBVHNode<uint32_t>) == 48);
+static_assert(sizeof(LBVHNode<uint64_t>) == 64);
+
+// Host build with the same float arithmetic and layout as the device one:
+// the reference the device pipeline is checked against. The nodes and all
+// temporaries come from `scratch`. Instantiated for uint32_t and uint64_t.
+template <typename Index>
+[[nodiscard]] std::pmr::vector<LBVHNode<Index>> build_lbvh_cpu(
+    const LBVHInput&           input,
+    std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+
+#ifdef USE_OPENCL
+// Morton codes, radix sort, splits and refit all stay on the device; only
+// the node array is read back, into `scratch`.
+template <typename Index>
+[[nodiscard]] std::pmr::vector<LBVHNode<Index>> build_lbvh_gpu(
+    const LBVHInput&           input,
+    DeviceTimings*             timings = nullptr,
+    std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+#endif  // USE_OPENCL
+
+// BVHNode in the layout the device query reads (see query.cl).
+template <typename Index>
+struct QueryNode {
+  float min[4];
+  float max[4];
+  Index left_idx;
+  Index right_idx;
+  Index start;
+  Index n_objs;
+};
+static_assert(sizeof(QueryNode<uint32_t>) == 48);
+static_assert(sizeof(QueryNode<uint64_t>) == 64);
+
+// What the device query needs, per object: the query box (8 floats), the
+// vertices in double (9 per object) and whether the triangle is degenerate.
+template <typename Index>
+struct DeviceSceneData {
+  std::vector<QueryNode<Index>> nodes;
+  std::vector<Index>            indexes;
+  std::vector<float>            boxes;
+  std::vector<double>           vertices;
+  std::vector<uint8_t>          degenerate;
+};
+
+[[nodiscard]] inline bool is_degenerate(const geometry::Triangle& tri) {
+  return tri.is_point() || tri.is_section();
+}
+[[nodiscard]] inline bool is_degenerate(const geometry::TriangleF& tri) {
+  return tri.is_degenerate();
+}
+
+#ifdef USE_OPENCL
+// Device copy of a DeviceSceneData, kept for repeated queries.
+template <typename Index>
+class DeviceScene;
+
+// The copies are only enqueued; the first query waits for them.
+template <typename Index>
+[[nodiscard]] std::shared_ptr<DeviceScene<Index>> upload_scene(
+    DeviceSceneData<Index> data);
+// One fused query per object. Both outputs are bitsets of 32 objects per
+// word: the objects found intersecting, and the queries the host must redo.
+template <typename Index>
+void query_any_hit(DeviceScene<Index>& scene, std::vector<uint32_t>& hits,
+    std::vector<uint32_t>& host_queries, DeviceTimings* timings = nullptr);
+#endif  // USE_OPENCL
+
+}  // namespace detail
+
+// `Index` is the width of the node and object indexes: uint32_t keeps nodes
+// at 48 bytes and indexes at 4, uint64_t lifts the max_tree_objects limit.
+// Building over more objects than `Index` allows throws std::length_error.
+template <typename ObjT, typename Index = uint32_t>
 class BVHTree {
+  static_assert(is_tree_index_v<Index>, "indexes are uint32_t or uint64_t");
+
  public:
+  using Node = BVHNode<Index>;
+
   BVHTree() = delete;
-  explicit BVHTree(std::vector<ObjT>& input) : input(input) { build(); }
+  // `input` is viewed, not copied (see ObjectView): a vector, an array or
+  // vertex buffers. The pool runs the CPU build and parallel queries.
+  explicit BVHTree(ObjectView<ObjT> input,
+      utils::ThreadPool& pool = utils::ThreadPool::instance())
+      : BVHTree(input, BuildEngine::Auto, pool) {}
+  BVHTree(ObjectView<ObjT> input, const BuildEngine engine,
+      utils::ThreadPool& pool = utils::ThreadPool::instance())
+      : input(input), pool(pool), requested_engine(engine) {
+    build();
+  }
+  // Builds, and rebuilds later, with the temporaries in `scratch`, which is
+  // reset at the start of each build and must outlive the tree. Sharing one
+  // arena between trees built one at a time spares repeated builds the
+  // heap.
+  BVHTree(ObjectView<ObjT> input, const BuildEngine engine,
+      utils::Arena& scratch,
+      utils::ThreadPool& pool = utils::ThreadPool::instance())
+      : input(input), pool(pool), requested_engine(engine), arena(&scratch) {
+    build();
+  }
+  // Loads a tree that save() wrote for this same input, without a build:
+  // the node and index arrays are mapped read-only and used in place until
+  // a refit or rebuild copies them. Throws std::runtime_error if the file
+  // can't be read, comes from another version, byte order or object type,
+  // or was saved for a different input.
+  BVHTree(ObjectView<ObjT> input, const std::filesystem::path& saved,
+      utils::ThreadPool& pool = utils::ThreadPool::instance());
 
-  size_t max_depth_reached;
+  size_t max_depth_reached = 0;
 
   void dump_to_dot(const std::string& filename) const;
   void dump_node_dot(std::ostream& out, size_t idx) const;
 
-  [[nodiscard]] std::vector<bool> get_intersections() const;
-  [[nodiscard]] bool              validate_tree() const;
+  [[nodiscard]] std::vector<bool> get_intersections(
+      const QueryOptions& options = {}, QueryStats* stats = nullptr) const;
+  // Allocation-free variant for repeated queries: skips tree validation and
+  // reuses the caller's buffer once it has been sized to the input.
+  void get_intersections(std::vector<bool>& ever_intersected,
+      const QueryOptions& options = {}, QueryStats* stats = nullptr) const;
+  [[nodiscard]] bool validate_tree() const;
+
+  // Whether `query`, which need not be part of the input, intersects any
+  // object of the tree. Safe to call concurrently.
+  [[nodiscard]] bool intersects_any(const ObjT& query) const;
+  // The objects of the tree each of `queries` intersects; the queries need
+  // not be part of the input. Batches run on the tree's pool. Safe to call
+  // concurrently.
+  [[nodiscard]] QueryHits<Index> find_hits(
+      ObjectView<ObjT> queries, const HitOptions& options = {}) const;
+  [[nodiscard]] std::vector<Index> find_hits(
+      const ObjT& query, const HitOptions& options = {}) const;
+
+  // Recomputes the node boxes bottom-up from the objects as they are now,
+  // keeping the topology and `indexes`: for inputs whose objects moved but
+  // weren't added or removed. Rebuilds the tree instead if that made
+  // cost_growth() exceed `max_cost_growth`, and returns whether it did.
+  // Throws std::length_error if the input was resized since the build. Not
+  // safe to call concurrently with queries.
+  bool refit(const double max_cost_growth = refit_max_cost_growth);
+  // Full build with the engine the tree was constructed with.
+  void rebuild() { build(); }
+
+  // Writes the tree and a checksum of the input to `path` (atomically),
+  // with the objects themselves if `with_input`; false if that fails.
+  bool save(const std::filesystem::path& path,
+      const bool with_input = false) const;
+  // The objects stored by save(..., true). Throws std::runtime_error if the
+  // file doesn't hold them or can't be read.
+  [[nodiscard]] static std::vector<ObjT> load_input(
+      const std::filesystem::path& path);
+
+  // Surface area heuristic: internal node areas plus leaf areas times their
+  // object counts, over the root area.
+  [[nodiscard]] double sah_cost() const { return cost; }
+  // sah_cost() over its value right after the last build.
+  [[nodiscard]] double cost_growth() const {
+    return built_cost > 0.0 ? cost / built_cost : 1.0;
+  }
 
- private:
-  std::vector<BVHNode>  nodes;
-  std::vector<ObjT>&    input;
-  std::vector<size_t>   indexes;
-  std::vector<uint32_t> morton_codes;
+  // The engine that built the tree: Auto resolved, failed OpenCL builds
+  // reported as the Median fallback.
+  [[nodiscard]] BuildEngine build_engine() const { return engine; }
+  // Profiling times of the OpenCL build; zero for host builds.
+  [[nodiscard]] const DeviceTimings& device_build_timings() const {
+    return build_timings;
+  }
+  // Scratch of the last build: allocations, peak bytes and the blocks the
+  // arena had to take from the system. Zero for loaded trees.
+  [[nodiscard]] const utils::ArenaStats& build_memory_stats() const {
+    return build_memory;
+  }
 
-  [[nodiscard]] std::vector<geometry::Vector3D> find_centroids() const;
+ private:
+  detail::TreeArray<Node>  nodes;
+  ObjectView<ObjT>         input;
+  utils::ThreadPool&       pool;
+  detail::TreeArray<Index> indexes;
+  BuildEngine              requested_engine;
+  BuildEngine              engine = BuildEngine::Median;
+  DeviceTimings            build_timings;
+  utils::Arena*            arena = nullptr;  // the caller's, if any
+  utils::ArenaStats        build_memory;
+  double                   cost       = 0.0;
+  double                   built_cost = 0.0;
+
+  // Node indexes by height above the leaves, in index order within one
+  // height, and where each height starts in it, plus the end: planned by the
+  // first refit after a build.
+  std::vector<Index>  refit_order;
+  std::vector<size_t> refit_levels;
 
   [[nodiscard]] AABB compute_box(const size_t start, const size_t n_objs) const;
   [[nodiscard]] size_t partition_by_median(
@@ -76,167 +560,638 @@ class BVHTree {
   [[nodiscard]] bool validate_node_rec(const size_t node_idx,
       size_t& total_leaf_objects, std::vector<bool>& visited) const;
 
-  void   build();
-  void   build_cpu();
-  void   sort_input_cpu(const size_t start, const size_t n_objs,
-        const math::Axis wildest_axis, const size_t mid_idx);
-  size_t build_node_rec_cpu(
-      const size_t start, const size_t n_objs, const size_t depth);
-  bool get_intersections_rec(const size_t node_idx, const size_t query,
-      std::vector<bool>& ever_intersected, const AABB& query_box) const;
+  void build();
+  void build_nodes(std::pmr::memory_resource& scratch);
+  void build_cpu();
+  void sort_input_cpu(const size_t start, const size_t n_objs,
+      const math::Axis wildest_axis, const size_t mid_idx);
+  void build_node_rec_cpu(const size_t node_idx, const size_t start,
+      const size_t n_objs, const size_t depth,
+      const detail::SubtreeSizes& subtree_sizes);
+
+  void build_sah_cpu(std::pmr::memory_resource& scratch);
+  [[nodiscard]] size_t partition_by_sah(const size_t start,
+      const size_t n_objs, std::span<const AABB> boxes);
+  void build_node_rec_sah(const size_t node_idx, const size_t start,
+      const size_t n_objs, const size_t depth, std::span<const AABB> boxes,
+      std::atomic<size_t>& next_node);
+  void update_max_depth();
+
+  // Checks everything in the header but the input checksum.
+  [[nodiscard]] static detail::BVHFileHeader saved_header(
+      const detail::MappedFile& file, const std::filesystem::path& path);
+
+  void plan_refit();
+  void refit_node(const size_t node_idx);
+  [[nodiscard]] double compute_sah_cost() const;
+
+  // Flags live in the caller's vector for serial queries and in a shared
+  // byte array for parallel ones, where vector<bool> bits can't be written
+  // concurrently.
+  struct QueryState {
+    const QueryOptions&    options;
+    std::vector<bool>&     ever_intersected;
+    std::atomic<uint8_t>*  shared_flags = nullptr;
+    QueryStats             stats;
+    CandidateBuffer<Index> buffer;
+
+    [[nodiscard]] bool is_flagged(const size_t idx) const {
+      return shared_flags ? shared_flags[idx].load(std::memory_order_relaxed)
+                          : ever_intersected[idx];
+    }
+    void flag(const size_t idx) {
+      if (shared_flags) {
+        shared_flags[idx].store(1, std::memory_order_relaxed);
+      } else {
+        ever_intersected[idx] = true;
+      }
+    }
+  };
+
+  void run_queries(
+      const size_t first, const size_t last, QueryState& state) const;
+  void get_intersections_parallel(std::vector<bool>& ever_intersected,
+      const QueryOptions& options, QueryStats* stats) const;
 
+  bool get_intersections_rec(const size_t node_idx, const size_t query,
+      const AABB& query_box, QueryState& state) const;
+  void collect_candidates_rec(const size_t node_idx, const size_t query,
+      const AABB& query_box, QueryState& state) const;
+  void flush_candidates(QueryState& state) const;
+  [[nodiscard]] bool intersects_any_rec(const size_t node_idx,
+      const ObjT& query, const AABB& query_box) const;
+  // Appends the hits of `query` to `hits` until it holds `limit`; returns
+  // whether it does.
+  bool find_hits_rec(const size_t node_idx, const ObjT& query,
+      const AABB& query_box, const size_t limit,
+      std::vector<Index>& hits) const;
+
+  [[nodiscard]] bool sat_overlaps(const size_t query, const AABB& box,
+      const double pad, QueryState& state) const;
+
+  [[nodiscard]] detail::LBVHInput lbvh_input(
+      std::pmr::memory_resource& scratch) const;
+  void adopt_lbvh(std::span<const detail::LBVHNode<Index>> lbvh);
 #ifdef USE_OPENCL
-  void build_gpu();
+  void build_gpu(std::pmr::memory_resource& scratch);
 
-  [[nodiscard]] AABB compute_global_box(
-      const std::vector<geometry::Vector3D> centroids);
+  // Uploaded on the first device query and dropped by build().
+  mutable std::mutex                                  device_mutex;
+  mutable std::shared_ptr<detail::DeviceScene<Index>> device_scene;
 
-  void sort_input_gpu();
-  void compute_boxes(const size_t node_idx, const size_t n_internals);
+  [[nodiscard]] detail::DeviceSceneData<Index> device_scene_data() const;
+  void get_intersections_device(std::vector<bool>& ever_intersected,
+      const QueryOptions& options, QueryStats* stats) const;
 #endif
 };
 
-template <typename ObjT>
-void BVHTree<ObjT>::build() {
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::build() {
+  utils::Arena  own_scratch;
+  utils::Arena& scratch = arena ? *arena : own_scratch;
+  scratch.reset();
+  build_nodes(scratch);
+  build_memory = scratch.stats();
+
+  refit_order.clear();
+  refit_levels.clear();
+  cost = built_cost = compute_sah_cost();
+}
+
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::build_nodes(std::pmr::memory_resource& scratch) {
+  if (input.size() > max_tree_objects<Index>) {
+    throw std::length_error("Too many objects for " +
+                            std::to_string(8 * sizeof(Index)) +
+                            "-bit indexes");
+  }
+
   nodes.clear();
   indexes.resize(input.size());
-  std::iota(indexes.begin(), indexes.end(), 0);
+  std::iota(indexes.begin(), indexes.end(), Index{0});
 
 #ifdef USE_OPENCL
-  try {
-    build_gpu();
-    LOG_INFO("GPU build sccessful");
-    return;
-  } catch (const std::exception& e) {
-    LOG_WARN("GPU build failed ({}). Falling back to CPU.", e.what());
-    nodes.clear();
-    indexes.resize(input.size());
-    std::iota(indexes.begin(), indexes.end(), 0);
+  {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    device_scene.reset();
   }
 #endif  // USE_OPENCL
 
+  build_timings = {};
+  engine        = requested_engine == BuildEngine::Auto
+                      ? Dispatcher::instance().choose_build(input.size())
+                      : requested_engine;
+
+  switch (engine) {
+    case BuildEngine::SAH:
+      build_sah_cpu(scratch);
+      return;
+    case BuildEngine::LBVH:
+      adopt_lbvh(detail::build_lbvh_cpu<Index>(lbvh_input(scratch), &scratch));
+      return;
+    case BuildEngine::OpenCL:
+#ifdef USE_OPENCL
+      try {
+        build_gpu(scratch);
+        Dispatcher::instance().mark_device_warm();
+        LOG_INFO("GPU build sccessful");
+        return;
+      } catch (const std::exception& e) {
+        LOG_WARN("GPU build failed ({}). Falling back to CPU.", e.what());
+        nodes.clear();
+        indexes.resize(input.size());
+        std::iota(indexes.begin(), indexes.end(), Index{0});
+      }
+#endif  // USE_OPENCL
+      engine = BuildEngine::Median;
+      break;
+    default:
+      break;
+  }
+
   build_cpu();
 }
 
-template <typename ObjT>
-[[nodiscard]] std::vector<geometry::Vector3D> BVHTree<ObjT>::find_centroids()
-    const {
-  std::vector<geometry::Vector3D> centroids;
+template <typename ObjT, typename Index>
+detail::LBVHInput BVHTree<ObjT, Index>::lbvh_input(
+    std::pmr::memory_resource& scratch) const {
+  using Coord = typename ObjectView<ObjT>::Coord;
+  constexpr bool is_float = std::is_same_v<Coord, float>;
+
+  detail::LBVHInput packed{std::pmr::vector<float>(&scratch),
+      std::pmr::vector<float>(&scratch)};
+  packed.lower.resize(9 * input.size());
+  if constexpr (!is_float) { packed.upper.resize(9 * input.size()); }
+
+  pool.parallel_for(0, input.size(), parallel_build_grain,
+      [&](const size_t first, const size_t last) {
+        for (size_t i = first; i < last; ++i) {
+          const ObjT object = input[i];
+          assert(object.is_valid());
+          size_t k = 9 * i;
+          for (const auto* vertex : {&object.a, &object.b, &object.c}) {
+            for (size_t axis = 0; axis < 3; ++axis, ++k) {
+              if constexpr (is_float) {
+                packed.lower[k] = (*vertex)[axis];
+              } else {
+                packed.lower[k] = detail::round_down((*vertex)[axis]);
+                packed.upper[k] = detail::round_up((*vertex)[axis]);
+              }
+            }
+          }
+        }
+      });
+  return packed;
+}
 
-  for (size_t i = 0; i < input.size(); ++i) {
-    assert(input[i].is_valid());
-    const geometry::Vector3D centroid = input[i].get_centre();
-    centroids.emplace_back(centroid);
+// Leaves point at their object directly, so `indexes` stays the identity.
+// Boxes are loosened here rather than before the refit: loosening commutes
+// with the merge, so the result is the same.
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::adopt_lbvh(
+    std::span<const detail::LBVHNode<Index>> lbvh) {
+  nodes.resize(lbvh.size());
+  std::iota(indexes.begin(), indexes.end(), Index{0});
+
+  pool.parallel_for(0, lbvh.size(), parallel_build_grain,
+      [&](const size_t first, const size_t last) {
+        for (size_t i = first; i < last; ++i) {
+          const detail::LBVHNode<Index>& src = lbvh[i];
+          const AABB box = AABB{{src.min[0], src.min[1], src.min[2]},
+              {src.max[0], src.max[1], src.max[2]}}
+                               .loosened();
+
+          if (src.left_idx == detail::LBVHNode<Index>::no_child) {
+            nodes[i].init_leaf(box, src.object, 1);
+          } else {
+            nodes[i].init_internal(box, src.left_idx, src.right_idx);
+          }
+        }
+      });
+
+  update_max_depth();
+}
+
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::update_max_depth() {
+  max_depth_reached = 0;
+  std::vector<std::pair<size_t, size_t>> stack;
+  if (!nodes.empty()) { stack.emplace_back(0, 1); }
+  while (!stack.empty()) {
+    const auto [node_idx, depth] = stack.back();
+    stack.pop_back();
+
+    max_depth_reached = std::max(max_depth_reached, depth);
+    if (!nodes[node_idx].is_leaf()) {
+      stack.emplace_back(nodes[node_idx].left_idx, depth + 1);
+      stack.emplace_back(nodes[node_idx].right_idx, depth + 1);
+    }
   }
-  return centroids;
 }
 
-#ifdef USE_OPENCL
-namespace detail {
+// Nodes are refit by height, leaves first, each height in parallel: parents
+// can sit below their children in LBVH layouts, so plain index order won't
+// do, and index order within a height keeps the leaves' reads sequential.
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::refit(const double max_cost_growth) {
+  if (input.size() != indexes.size()) {
+    throw std::length_error("Run refit(): input was resized since the build");
+  }
+  if (nodes.empty()) { return false; }
 
-struct SplitInfo {
-  std::vector<int32_t> splits;
-  std::vector<int32_t> starts;
-  std::vector<int32_t> n_objs;
-};
+#ifdef USE_OPENCL
+  {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    device_scene.reset();
+  }
+#endif  // USE_OPENCL
 
-[[nodiscard]] SplitInfo get_split_info(
-    const std::vector<uint32_t>& morton_codes);
+  nodes.make_owned();
+  if (refit_levels.empty()) { plan_refit(); }
+  for (size_t level = 0; level + 1 < refit_levels.size(); ++level) {
+    pool.parallel_for(refit_levels[level], refit_levels[level + 1],
+        refit_grain, [&](const size_t first, const size_t last) {
+          for (size_t i = first; i < last; ++i) { refit_node(refit_order[i]); }
+        });
+  }
 
-void fill_node_idx(std::vector<BVHNode>& nodes, const SplitInfo& split_info);
+  cost = compute_sah_cost();
+  if (cost_growth() <= max_cost_growth) { return false; }
 
-[[nodiscard]] std::vector<uint32_t> get_morton_code(
-    const std::vector<geometry::Vector3D>& centroids,
-    const acceleration::AABB&              box) noexcept;
+  LOG_INFO("Refit cost grew {}x, rebuilding", cost_growth());
+  build();
+  return true;
+}
 
-}  // namespace detail
+// Heights come from a breadth-first order walked backwards, children before
+// parents; a counting sort then groups the nodes by height.
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::plan_refit() {
+  constexpr size_t unreached = std::numeric_limits<size_t>::max();
+
+  std::vector<Index> order{0};
+  for (size_t i = 0; i < order.size(); ++i) {
+    const Node& node = nodes[order[i]];
+    if (!node.is_leaf()) {
+      order.push_back(node.left_idx);
+      order.push_back(node.right_idx);
+    }
+  }
 
-template <typename ObjT>
-AABB BVHTree<ObjT>::compute_global_box(
-    const std::vector<geometry::Vector3D> centroids) {
-  if (centroids.empty()) { return AABB(); }
+  std::vector<size_t> height(nodes.size(), unreached);
+  size_t              max_height = 0;
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    const Node& node = nodes[*it];
+    height[*it] = node.is_leaf() ? 0
+                                 : 1 + std::max(height[node.left_idx],
+                                           height[node.right_idx]);
+    max_height  = std::max(max_height, height[*it]);
+  }
 
-  geometry::Vector3D min = centroids[0];
-  geometry::Vector3D max = centroids[0];
+  refit_levels.assign(max_height + 2, 0);
+  for (const size_t h : height) {
+    if (h != unreached) { ++refit_levels[h + 1]; }
+  }
+  std::partial_sum(
+      refit_levels.begin(), refit_levels.end(), refit_levels.begin());
 
-  for (size_t i = 1; i < centroids.size(); ++i) {
-    for (size_t j = 0; j < 3; ++j) {
-      const geometry::Vector3D& centroid = centroids[i];
+  refit_order.resize(order.size());
+  std::vector<size_t> next(refit_levels.begin(), refit_levels.end() - 1);
+  for (size_t idx = 0; idx < nodes.size(); ++idx) {
+    if (height[idx] != unreached) { refit_order[next[height[idx]]++] = idx; }
+  }
+  std::sort(refit_order.begin(), refit_order.begin() + refit_levels[1],
+      [&](const Index a, const Index b) {
+        return nodes[a].start < nodes[b].start;
+      });
+}
 
-      if (centroid[j] < min[j]) { min[j] = centroid[j]; }
-      if (centroid[j] > max[j]) { max[j] = centroid[j]; }
-    }
+// Same boxes as the builders: loosened leaf bounds, merged upwards.
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::refit_node(const size_t node_idx) {
+  Node& node = nodes[node_idx];
+  if (node.is_leaf()) {
+    node.box = compute_box(node.start, node.n_objs).loosened();
+  } else {
+    node.box = merge(nodes[node.left_idx].box, nodes[node.right_idx].box);
   }
-  return {min, max};
 }
 
-template <typename ObjT>
-void BVHTree<ObjT>::sort_input_gpu() {
-  const size_t num_obj = input.size();
-  if (num_obj == 0) return;
+// Summed per fixed block of nodes, so the result doesn't depend on the
+// schedule.
+template <typename ObjT, typename Index>
+double BVHTree<ObjT, Index>::compute_sah_cost() const {
+  if (nodes.empty()) { return 0.0; }
+
+  std::vector<double> partial((nodes.size() + refit_grain - 1) / refit_grain);
+  pool.parallel_for(0, nodes.size(), refit_grain,
+      [&](const size_t first, const size_t last) {
+        double area = 0.0;
+        for (size_t i = first; i < last; ++i) {
+          const Node& node = nodes[i];
+          area += node.box.surface_area() *
+                  static_cast<double>(node.is_leaf() ? node.n_objs : 1);
+        }
+        partial[first / refit_grain] = area;
+      });
+  return std::accumulate(partial.begin(), partial.end(), 0.0) /
+         nodes[0].box.surface_area();
+}
 
-  std::vector<std::pair<uint32_t, size_t>> morton_pairs;
-  morton_pairs.reserve(num_obj);
+template <typename ObjT, typename Index>
+BVHTree<ObjT, Index>::BVHTree(ObjectView<ObjT> input,
+    const std::filesystem::path& saved, utils::ThreadPool& pool)
+    : input(input), pool(pool), requested_engine(BuildEngine::Auto) {
+  auto file = std::make_shared<const detail::MappedFile>(saved);
+  const detail::BVHFileHeader header = saved_header(*file, saved);
+  auto fail = [&](const std::string& why) {
+    return std::runtime_error("Can't load " + saved.string() + ": " + why);
+  };
+
+  if (header.n_objects != input.size() ||
+      header.input_checksum != detail::input_checksum(input, pool)) {
+    throw fail("saved for a different input");
+  }
 
-  for (size_t i = 0; i < num_obj; ++i) {
-    morton_pairs.emplace_back(morton_codes[i], indexes[i]);
+  const std::byte* const base = file->data();
+  nodes.view(reinterpret_cast<const Node*>(base + header.nodes_offset),
+      header.n_nodes, file);
+  indexes.view(reinterpret_cast<const Index*>(base + header.indexes_offset),
+      header.n_objects, std::move(file));
+
+  requested_engine  = static_cast<BuildEngine>(header.engine);
+  engine            = requested_engine;
+  max_depth_reached = header.max_depth;
+  cost              = header.cost;
+  built_cost        = header.built_cost;
+
+  // Nothing below trusts the arrays, so a damaged file fails here: the
+  // indexes must be in range and the leaves must split [0, n) into
+  // disjoint ranges.
+  const auto& mapped_indexes = std::as_const(indexes);
+  const bool  in_range =
+      std::all_of(mapped_indexes.begin(), mapped_indexes.end(),
+          [&](const size_t idx) { return idx < input.size(); });
+
+  std::vector<std::pair<size_t, size_t>> leaves;  // start, n_objs
+  for (const Node& node : std::as_const(nodes)) {
+    if (node.is_leaf()) { leaves.emplace_back(node.start, node.n_objs); }
+  }
+  std::sort(leaves.begin(), leaves.end());
+  size_t covered = 0;
+  for (const auto& [start, n_objs] : leaves) {
+    if (start != covered || n_objs > input.size() - covered) {
+      throw fail("the tree is damaged");
+    }
+    covered += n_objs;
   }
 
-  std::sort(morton_pairs.begin(), morton_pairs.end());
+  if (!in_range || covered != input.size() || !validate_tree()) {
+    throw fail("the tree is damaged");
+  }
+}
 
-  std::vector<uint32_t> sorted_codes;
-  sorted_codes.reserve(num_obj);
+template <typename ObjT, typename Index>
+detail::BVHFileHeader BVHTree<ObjT, Index>::saved_header(
+    const detail::MappedFile& file, const std::filesystem::path& path) {
+  using Coord = typename ObjectView<ObjT>::Coord;
+  auto fail = [&](const std::string& why) {
+    return std::runtime_error("Can't load " + path.string() + ": " + why);
+  };
+
+  detail::BVHFileHeader header;
+  if (file.size() < sizeof(header)) { throw fail("the file is truncated"); }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, detail::bvh_file_magic,
+          sizeof(header.magic)) != 0) {
+    throw fail("not a saved BVH");
+  }
+  if (header.endian_tag != detail::bvh_endian_tag) {
+    throw fail("saved with another byte order");
+  }
+  if (header.version != bvh_file_version) {
+    throw fail("format version " + std::to_string(header.version) +
+               ", expected " + std::to_string(bvh_file_version));
+  }
+  if (header.index_size != sizeof(Index)) {
+    throw fail("saved with " + std::to_string(8 * header.index_size) +
+               "-bit indexes, expected " + std::to_string(8 * sizeof(Index)));
+  }
+  if (header.node_size != sizeof(Node) ||
+      header.object_size != sizeof(ObjT) ||
+      header.coord_size != sizeof(Coord) ||
+      header.engine > static_cast<uint32_t>(BuildEngine::OpenCL)) {
+    throw fail("saved for another object type or layout");
+  }
 
-  for (size_t i = 0; i < num_obj; ++i) {
-    sorted_codes.push_back(morton_pairs[i].first);
-    indexes[i] = morton_pairs[i].second;
+  auto fits = [&](const uint64_t offset, const uint64_t count,
+                  const size_t item_size) {
+    return offset % detail::bvh_file_alignment == 0 && offset <= file.size() &&
+           count <= (file.size() - offset) / item_size;
+  };
+  if (!fits(header.nodes_offset, header.n_nodes, sizeof(Node)) ||
+      !fits(header.indexes_offset, header.n_objects, sizeof(Index)) ||
+      (header.objects_offset &&
+          !fits(header.objects_offset, header.n_objects, sizeof(ObjT)))) {
+    throw fail("the file is truncated");
   }
+  return header;
+}
 
-  morton_codes = std::move(sorted_codes);
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::save(
+    const std::filesystem::path& path, const bool with_input) const {
+  static_assert(std::is_trivially_copyable_v<Node>);
+  static_assert(std::is_trivially_copyable_v<ObjT>);
+  using Coord = typename ObjectView<ObjT>::Coord;
+
+  detail::BVHFileHeader header;
+  std::memcpy(header.magic, detail::bvh_file_magic, sizeof(header.magic));
+  header.version     = bvh_file_version;
+  header.endian_tag  = detail::bvh_endian_tag;
+  header.node_size   = sizeof(Node);
+  header.index_size  = sizeof(Index);
+  header.object_size = sizeof(ObjT);
+  header.coord_size  = sizeof(Coord);
+  header.engine      = static_cast<uint32_t>(engine);
+  header.max_depth   = static_cast<uint32_t>(max_depth_reached);
+
+  header.n_objects      = input.size();
+  header.n_nodes        = nodes.size();
+  header.input_checksum = detail::input_checksum(input, pool);
+  header.nodes_offset   = detail::align_file_offset(sizeof(header));
+  header.indexes_offset = detail::align_file_offset(
+      header.nodes_offset + nodes.size() * sizeof(Node));
+  if (with_input) {
+    header.objects_offset = detail::align_file_offset(
+        header.indexes_offset + indexes.size() * sizeof(Index));
+  }
+  header.cost       = cost;
+  header.built_cost = built_cost;
+
+  return utils::write_file_atomic(path, [&](std::ostream& out) {
+    static constexpr char zeros[detail::bvh_file_alignment] = {};
+    uint64_t              written                           = 0;
+    auto write_at = [&](const uint64_t offset, const void* data,
+                        const size_t size) {
+      out.write(zeros, static_cast<std::streamsize>(offset - written));
+      out.write(static_cast<const char*>(data),
+          static_cast<std::streamsize>(size));
+      written = offset + size;
+    };
+
+    write_at(0, &header, sizeof(header));
+    write_at(header.nodes_offset, nodes.data(), nodes.size() * sizeof(Node));
+    write_at(header.indexes_offset, indexes.data(),
+        indexes.size() * sizeof(Index));
+    if (with_input && input.data()) {
+      write_at(header.objects_offset, input.data(),
+          input.size() * sizeof(ObjT));
+    } else if (with_input) {
+      // Vertex buffers: assembled and written a block at a time.
+      std::vector<ObjT> block;
+      for (size_t first = 0; first < input.size();
+           first += parallel_build_grain) {
+        const size_t last =
+            std::min(first + parallel_build_grain, input.size());
+        block.clear();
+        for (size_t i = first; i < last; ++i) { block.push_back(input[i]); }
+        write_at(first == 0 ? header.objects_offset : written, block.data(),
+            block.size() * sizeof(ObjT));
+      }
+    }
+  });
 }
 
-template <typename ObjT>
-void BVHTree<ObjT>::compute_boxes(
-    const size_t node_idx, const size_t n_internals) {
-  if (node_idx >= n_internals) {
-    const size_t obj_idx = nodes[node_idx].start;
-    nodes[node_idx].box  = AABB{input[indexes[obj_idx]]};
-    return;
+template <typename ObjT, typename Index>
+std::vector<ObjT> BVHTree<ObjT, Index>::load_input(
+    const std::filesystem::path& path) {
+  const detail::MappedFile    file(path);
+  const detail::BVHFileHeader header = saved_header(file, path);
+  if (header.objects_offset == 0) {
+    throw std::runtime_error(
+        "Can't load " + path.string() + ": the objects weren't saved");
   }
 
-  const size_t left_idx  = nodes[node_idx].left_idx;
-  const size_t right_idx = nodes[node_idx].right_idx;
+  const auto* const first =
+      reinterpret_cast<const ObjT*>(file.data() + header.objects_offset);
+  std::vector<ObjT> objects(first, first + header.n_objects);
+  if (detail::input_checksum(objects, utils::ThreadPool::instance()) !=
+      header.input_checksum) {
+    throw std::runtime_error(
+        "Can't load " + path.string() + ": the objects are damaged");
+  }
+  return objects;
+}
 
-  compute_boxes(left_idx, n_internals);
-  compute_boxes(right_idx, n_internals);
+#ifdef USE_OPENCL
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::build_gpu(std::pmr::memory_resource& scratch) {
+  adopt_lbvh(detail::build_lbvh_gpu<Index>(
+      lbvh_input(scratch), &build_timings, &scratch));
+}
+
+template <typename ObjT, typename Index>
+detail::DeviceSceneData<Index> BVHTree<ObjT, Index>::device_scene_data()
+    const {
+  detail::DeviceSceneData<Index> data;
+  data.nodes.resize(nodes.size());
+  data.indexes.assign(indexes.begin(), indexes.end());
+  data.boxes.resize(8 * input.size());
+  data.vertices.resize(9 * input.size());
+  data.degenerate.resize(input.size());
+
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const Node&               node = nodes[i];
+    detail::QueryNode<Index>& dst  = data.nodes[i];
+    std::copy_n(&node.box.min.x, 4, dst.min);
+    std::copy_n(&node.box.max.x, 4, dst.max);
+    dst.left_idx  = node.left_idx;
+    dst.right_idx = node.right_idx;
+    dst.start     = node.start;
+    dst.n_objs    = node.n_objs;
+  }
 
-  nodes[node_idx].box = merge(nodes[left_idx].box, nodes[right_idx].box);
+  pool.parallel_for(0, input.size(), parallel_build_grain,
+      [&](const size_t first, const size_t last) {
+        for (size_t i = first; i < last; ++i) {
+          const ObjT object = input[i];
+          const AABB box{object};
+          std::copy_n(&box.min.x, 4, &data.boxes[8 * i]);
+          std::copy_n(&box.max.x, 4, &data.boxes[8 * i + 4]);
+
+          size_t k = 9 * i;
+          for (const auto* vertex : {&object.a, &object.b, &object.c}) {
+            for (size_t axis = 0; axis < 3; ++axis) {
+              data.vertices[k++] = static_cast<double>((*vertex)[axis]);
+            }
+          }
+          data.degenerate[i] = detail::is_degenerate(object);
+        }
+      });
+  return data;
 }
 
-template <typename ObjT>
-void BVHTree<ObjT>::build_gpu() {
-  const std::vector<geometry::Vector3D> centroids = find_centroids();
-  const AABB global_box = compute_global_box(centroids);
+// The device decides every query it can; the ones it marks are re-run here
+// with the fused traversal, which handles degenerate triangles and calls the
+// exact predicates.
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::get_intersections_device(
+    std::vector<bool>& ever_intersected, const QueryOptions& options,
+    QueryStats* stats) const {
+  if (max_depth_reached > query_stack_size) {
+    throw std::runtime_error("tree is too deep for the device stack");
+  }
+
+  std::shared_ptr<detail::DeviceScene<Index>> scene;
+  {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if (!device_scene) {
+      device_scene = detail::upload_scene<Index>(device_scene_data());
+    }
+    scene = device_scene;
+  }
 
-  this->morton_codes = detail::get_morton_code(centroids, global_box);
-  this->sort_input_gpu();
+  std::vector<uint32_t> hits;
+  std::vector<uint32_t> host_queries;
+  QueryState state{options, ever_intersected, nullptr, {}, {}};
+  detail::query_any_hit<Index>(
+      *scene, hits, host_queries, &state.stats.device);
 
-  detail::SplitInfo split_info = detail::get_split_info(this->morton_codes);
+  for (size_t i = 0; i < input.size(); ++i) {
+    ever_intersected[i] = (hits[i / 32] >> (i % 32)) & 1u;
+  }
 
-  detail::fill_node_idx(nodes, split_info);
-  compute_boxes(0, split_info.splits.size());
-}
+  state.stats.n_queries = input.size();
+  for (size_t query_idx = 0; query_idx < input.size(); ++query_idx) {
+    if (!((host_queries[query_idx / 32] >> (query_idx % 32)) & 1u) ||
+        state.is_flagged(query_idx)) {
+      continue;
+    }
 
+    ++state.stats.n_host_fallbacks;
+    get_intersections_rec(0, query_idx, AABB{input[query_idx]}, state);
+  }
+
+  if (stats) { stats->merge(state.stats); }
+}
 #endif  // USE_OPENCL
 
-template <typename ObjT>
-void BVHTree<ObjT>::build_cpu() {
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::build_cpu() {
   if (input.empty()) return;
-  build_node_rec_cpu(0, input.size(), 1);
+
+  const detail::SubtreeSizes subtree_sizes(input.size());
+  max_depth_reached = subtree_sizes.max_depth();
+
+  nodes.resize(subtree_sizes(input.size(), 1));
+  build_node_rec_cpu(0, 0, input.size(), 1, subtree_sizes);
 }
 
-template <typename ObjT>
-AABB BVHTree<ObjT>::compute_box(const size_t start, const size_t n_objs) const {
+template <typename ObjT, typename Index>
+AABB BVHTree<ObjT, Index>::compute_box(
+    const size_t start, const size_t n_objs) const {
   if (n_objs == 0) { return AABB(); }
 
   AABB box{input[indexes[start]]};
@@ -247,8 +1202,8 @@ AABB BVHTree<ObjT>::compute_box(const size_t start, const size_t n_objs) const {
   return box;
 }
 
-template <typename ObjT>
-size_t BVHTree<ObjT>::partition_by_median(
+template <typename ObjT, typename Index>
+size_t BVHTree<ObjT, Index>::partition_by_median(
     const size_t start, const size_t n_objs) {
   const AABB& box = compute_box(start, n_objs);
 
@@ -268,10 +1223,10 @@ size_t BVHTree<ObjT>::partition_by_median(
   return mid_idx;
 }
 
-template <typename ObjT>
-void BVHTree<ObjT>::sort_input_cpu(const size_t start, const size_t n_objs,
-    const math::Axis wildest_axis, const size_t mid_idx) {
-  using IdxIt = std::vector<size_t>::iterator;
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::sort_input_cpu(const size_t start,
+    const size_t n_objs, const math::Axis wildest_axis, const size_t mid_idx) {
+  using IdxIt = Index*;
 
   IdxIt begin = indexes.begin() + start;
   IdxIt mid   = indexes.begin() + mid_idx;
@@ -302,35 +1257,176 @@ void BVHTree<ObjT>::sort_input_cpu(const size_t start, const size_t n_objs,
   }
 }
 
-template <typename ObjT>
-size_t BVHTree<ObjT>::build_node_rec_cpu(
-    const size_t start, const size_t n_objs, const size_t depth) {
-  size_t node_idx = nodes.size();
-  nodes.emplace_back();
+// Preorder layout: the left child follows its parent, the right child follows
+// the whole left subtree. Big subtrees build their left half as a forked task.
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::build_node_rec_cpu(const size_t node_idx,
+    const size_t start, const size_t n_objs, const size_t depth,
+    const detail::SubtreeSizes& subtree_sizes) {
+  if (n_objs <= max_leaf_cap_for_cpu || depth >= tree_max_depth) {
+    nodes[node_idx].init_leaf(
+        compute_box(start, n_objs).loosened(), start, n_objs);
+    return;
+  }
 
-  if (depth > max_depth_reached) { max_depth_reached = depth; }
+  const size_t mid_idx = partition_by_median(start, n_objs);
 
-  if (n_objs <= max_leaf_cap_for_cpu || depth >= tree_max_depth) {
-    nodes[node_idx].init_leaf(compute_box(start, n_objs), start, n_objs);
-    return node_idx;
+  const size_t left_n_objs  = mid_idx - start;
+  const size_t right_n_objs = n_objs - left_n_objs;
+
+  const size_t left_idx  = node_idx + 1;
+  const size_t right_idx = left_idx + subtree_sizes(left_n_objs, depth + 1);
+
+  if (n_objs >= parallel_build_grain && !pool.is_serial()) {
+    utils::TaskGroup group(pool);
+    group.run([&] {
+      build_node_rec_cpu(
+          left_idx, start, left_n_objs, depth + 1, subtree_sizes);
+    });
+    build_node_rec_cpu(
+        right_idx, mid_idx, right_n_objs, depth + 1, subtree_sizes);
+    group.wait();
+  } else {
+    build_node_rec_cpu(left_idx, start, left_n_objs, depth + 1, subtree_sizes);
+    build_node_rec_cpu(
+        right_idx, mid_idx, right_n_objs, depth + 1, subtree_sizes);
   }
 
-  const int mid_idx = partition_by_median(start, n_objs);
+  nodes[node_idx].init_internal(
+      merge(nodes[left_idx].box, nodes[right_idx].box), left_idx, right_idx);
+}
+
+// Children are allocated in pairs from a shared counter, so the numbering
+// depends on the schedule; the tree itself doesn't.
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::build_sah_cpu(std::pmr::memory_resource& scratch) {
+  if (input.empty()) return;
+
+  std::pmr::vector<AABB> boxes(input.size(), &scratch);
+  pool.parallel_for(0, input.size(), parallel_build_grain,
+      [&](const size_t first, const size_t last) {
+        for (size_t i = first; i < last; ++i) { boxes[i] = AABB{input[i]}; }
+      });
+
+  nodes.resize(2 * input.size() - 1);
+  std::atomic<size_t> next_node{1};
+  build_node_rec_sah(0, 0, input.size(), 1, boxes, next_node);
+
+  nodes.resize(next_node.load());
+  update_max_depth();
+}
+
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::build_node_rec_sah(const size_t node_idx,
+    const size_t start, const size_t n_objs, const size_t depth,
+    std::span<const AABB> boxes, std::atomic<size_t>& next_node) {
+  if (n_objs <= max_leaf_cap_for_cpu || depth >= tree_max_depth) {
+    AABB box = boxes[indexes[start]];
+    for (size_t i = start + 1; i < start + n_objs; ++i) {
+      box.merge(boxes[indexes[i]]);
+    }
+    nodes[node_idx].init_leaf(box.loosened(), start, n_objs);
+    return;
+  }
 
+  const size_t mid_idx      = partition_by_sah(start, n_objs, boxes);
   const size_t left_n_objs  = mid_idx - start;
   const size_t right_n_objs = n_objs - left_n_objs;
 
-  const int left_idx  = build_node_rec_cpu(start, left_n_objs, depth + 1);
-  const int right_idx = build_node_rec_cpu(mid_idx, right_n_objs, depth + 1);
+  const size_t left_idx  = next_node.fetch_add(2);
+  const size_t right_idx = left_idx + 1;
+
+  if (n_objs >= parallel_build_grain && !pool.is_serial()) {
+    utils::TaskGroup group(pool);
+    group.run([&] {
+      build_node_rec_sah(
+          left_idx, start, left_n_objs, depth + 1, boxes, next_node);
+    });
+    build_node_rec_sah(
+        right_idx, mid_idx, right_n_objs, depth + 1, boxes, next_node);
+    group.wait();
+  } else {
+    build_node_rec_sah(
+        left_idx, start, left_n_objs, depth + 1, boxes, next_node);
+    build_node_rec_sah(
+        right_idx, mid_idx, right_n_objs, depth + 1, boxes, next_node);
+  }
 
   nodes[node_idx].init_internal(
       merge(nodes[left_idx].box, nodes[right_idx].box), left_idx, right_idx);
+}
+
+// Binned SAH: box centroids are binned on every axis and the objects split
+// at the bin boundary with the least left area * count + right area * count.
+// Objects whose centroids all coincide are split in half.
+template <typename ObjT, typename Index>
+size_t BVHTree<ObjT, Index>::partition_by_sah(
+    const size_t start, const size_t n_objs, std::span<const AABB> boxes) {
+  auto centre = [&](const size_t obj, const size_t axis) {
+    return 0.5f * (boxes[obj].min[axis] + boxes[obj].max[axis]);
+  };
+
+  std::array<float, 3> lo;
+  std::array<float, 3> hi;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    lo[axis] = hi[axis] = centre(indexes[start], axis);
+  }
+  for (size_t i = start + 1; i < start + n_objs; ++i) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      lo[axis] = std::min(lo[axis], centre(indexes[i], axis));
+      hi[axis] = std::max(hi[axis], centre(indexes[i], axis));
+    }
+  }
+
+  auto bin_of = [&](const size_t obj, const size_t axis) {
+    const float scaled =
+        (centre(obj, axis) - lo[axis]) / (hi[axis] - lo[axis]) * sah_bin_count;
+    return std::min(static_cast<size_t>(scaled), sah_bin_count - 1);
+  };
+
+  double best_cost  = std::numeric_limits<double>::infinity();
+  size_t best_axis  = 3;
+  size_t best_split = 0;  // last bin on the left
+
+  for (size_t axis = 0; axis < 3; ++axis) {
+    if (!(hi[axis] > lo[axis])) { continue; }
+
+    std::array<detail::SAHBin, sah_bin_count> bins;
+    for (size_t i = start; i < start + n_objs; ++i) {
+      bins[bin_of(indexes[i], axis)].add(boxes[indexes[i]]);
+    }
+
+    std::array<double, sah_bin_count> right_cost{};
+    detail::SAHBin                    right;
+    for (size_t b = sah_bin_count - 1; b > 0; --b) {
+      right.merge(bins[b]);
+      right_cost[b] = right.cost();
+    }
+
+    detail::SAHBin left;
+    for (size_t b = 0; b + 1 < sah_bin_count; ++b) {
+      left.merge(bins[b]);
+      if (left.count == 0 || left.count == n_objs) { continue; }
+
+      const double cost = left.cost() + right_cost[b + 1];
+      if (cost < best_cost) {
+        best_cost  = cost;
+        best_axis  = axis;
+        best_split = b;
+      }
+    }
+  }
 
-  return node_idx;
+  if (best_axis == 3) { return start + n_objs / 2; }
+
+  const auto first = indexes.begin() + start;
+  const auto mid   = std::partition(first, first + n_objs,
+        [&](const size_t obj) { return bin_of(obj, best_axis) <= best_split; });
+  return start + static_cast<size_t>(mid - first);
 }
 
-template <typename ObjT>
-bool BVHTree<ObjT>::validate_tree() const {
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::validate_tree() const {
   if (nodes.empty()) return input.empty();
   const size_t root_idx           = 0;
   size_t       leaf_objects_count = 0;
@@ -348,8 +1444,8 @@ bool BVHTree<ObjT>::validate_tree() const {
   return is_valid;
 }
 
-template <typename ObjT>
-bool BVHTree<ObjT>::validate_node_rec(const size_t node_idx,
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::validate_node_rec(const size_t node_idx,
     size_t& total_leaf_objects, std::vector<bool>& visited) const {
   if (node_idx >= nodes.size()) {
     LOG_ERR("Validation failed: Index out of bounds.");
@@ -366,7 +1462,7 @@ bool BVHTree<ObjT>::validate_node_rec(const size_t node_idx,
   }
   visited[node_idx] = true;
 
-  const BVHNode& node = nodes[node_idx];
+  const Node& node = nodes[node_idx];
 
   if (!node.box.is_valid()) {
     LOG_ERR("Validation failed: Node {} gets invalid AABB.", node_idx);
@@ -380,7 +1476,6 @@ bool BVHTree<ObjT>::validate_node_rec(const size_t node_idx,
   }
 
   if (node.left_idx == node_idx || node.right_idx == node_idx ||
-      node.left_idx < 0 || node.right_idx < 0 ||
       node.left_idx >= nodes.size() || node.right_idx >= nodes.size()) {
     LOG_ERR(
         "Validation failed: Node {} has corrupted children indices ({}, {}).",
@@ -388,8 +1483,8 @@ bool BVHTree<ObjT>::validate_node_rec(const size_t node_idx,
     return false;
   }
 
-  const BVHNode& left  = nodes[node.left_idx];
-  const BVHNode& right = nodes[node.right_idx];
+  const Node& left  = nodes[node.left_idx];
+  const Node& right = nodes[node.right_idx];
 
   AABB merged = merge(left.box, right.box);
 
@@ -409,8 +1504,9 @@ bool BVHTree<ObjT>::validate_node_rec(const size_t node_idx,
   return left_valid && right_valid;
 }
 
-template <typename ObjT>
-std::vector<bool> BVHTree<ObjT>::get_intersections() const {
+template <typename ObjT, typename Index>
+std::vector<bool> BVHTree<ObjT, Index>::get_intersections(
+    const QueryOptions& options, QueryStats* stats) const {
   std::vector<bool> ever_intersected(input.size(), false);
 
   if (nodes.empty()) { return ever_intersected; }
@@ -418,51 +1514,371 @@ std::vector<bool> BVHTree<ObjT>::get_intersections() const {
     throw std::runtime_error("Run get_intersections(): tree is invalid");
   }
 
-  for (size_t query_idx = 0; query_idx < input.size(); ++query_idx) {
-    if (ever_intersected[query_idx]) { continue; }
+  get_intersections(ever_intersected, options, stats);
+  return ever_intersected;
+}
+
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::get_intersections(
+    std::vector<bool>& ever_intersected, const QueryOptions& options,
+    QueryStats* stats) const {
+  ever_intersected.assign(input.size(), false);
 
-    AABB query_box{input[query_idx]};
-    get_intersections_rec(0, query_idx, ever_intersected, query_box);
+  if (nodes.empty()) { return; }
+
+  if (options.mode == QueryMode::Auto) {
+    QueryOptions resolved = options;
+    resolved.mode         = QueryMode::Pipelined;
+    resolved.parallel     = true;
+#ifdef USE_OPENCL
+    if (Dispatcher::instance().choose_device_query(input.size(), engine)) {
+      resolved.mode = QueryMode::Device;
+    }
+#endif  // USE_OPENCL
+    get_intersections(ever_intersected, resolved, stats);
+    return;
   }
 
-  return ever_intersected;
+#ifdef USE_OPENCL
+  if (options.mode == QueryMode::Device) {
+    try {
+      get_intersections_device(ever_intersected, options, stats);
+      Dispatcher::instance().mark_device_warm();
+      return;
+    } catch (const std::exception& e) {
+      LOG_WARN("Device query failed ({}). Falling back to the host.", e.what());
+      ever_intersected.assign(input.size(), false);
+    }
+  }
+#endif  // USE_OPENCL
+
+  if (options.parallel && !pool.is_serial()) {
+    get_intersections_parallel(ever_intersected, options, stats);
+    return;
+  }
+
+  QueryState state{options, ever_intersected, nullptr, {}, {}};
+  run_queries(0, input.size(), state);
+
+  if (stats) { stats->merge(state.stats); }
 }
 
-template <typename ObjT>
-bool BVHTree<ObjT>::get_intersections_rec(const size_t node_idx,
-    const size_t query_idx, std::vector<bool>& ever_intersected,
-    const AABB& query_box) const {
-  const BVHNode& node     = nodes[node_idx];
-  const AABB&    node_box = node.box;
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::get_intersections_parallel(
+    std::vector<bool>& ever_intersected, const QueryOptions& options,
+    QueryStats* stats) const {
+  const size_t n_objs = input.size();
+
+  std::unique_ptr<std::atomic<uint8_t>[]> flags(
+      new std::atomic<uint8_t>[n_objs]());
+  QueryStats total;
+  std::mutex total_mutex;
 
-  if (!query_box.is_intersect(node_box)) { return false; }
+  const size_t grain = std::max(
+      min_query_grain, n_objs / (pool.size() * query_ranges_per_worker));
+
+  pool.parallel_for(0, n_objs, grain, [&](const size_t lo, const size_t hi) {
+    QueryState state{options, ever_intersected, flags.get(), {}, {}};
+    run_queries(lo, hi, state);
+
+    std::lock_guard<std::mutex> lock(total_mutex);
+    total.merge(state.stats);
+  });
+
+  for (size_t i = 0; i < n_objs; ++i) {
+    ever_intersected[i] = flags[i].load(std::memory_order_relaxed) != 0;
+  }
+  if (stats) { stats->merge(total); }
+}
+
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::run_queries(
+    const size_t first, const size_t last, QueryState& state) const {
+  if (state.options.mode == QueryMode::Pipelined) {
+    for (size_t query_idx = first; query_idx < last; ++query_idx) {
+      AABB query_box{input[query_idx]};
+      ++state.stats.n_queries;
+      collect_candidates_rec(0, query_idx, query_box, state);
+    }
+    flush_candidates(state);
+  } else {
+    for (size_t query_idx = first; query_idx < last; ++query_idx) {
+      if (state.is_flagged(query_idx)) { continue; }
+
+      AABB query_box{input[query_idx]};
+      ++state.stats.n_queries;
+      get_intersections_rec(0, query_idx, query_box, state);
+    }
+  }
+}
+
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::intersects_any(const ObjT& query) const {
+  return !nodes.empty() && intersects_any_rec(0, query, AABB{query});
+}
+
+template <typename ObjT, typename Index>
+QueryHits<Index> BVHTree<ObjT, Index>::find_hits(
+    ObjectView<ObjT> queries, const HitOptions& options) const {
+  const size_t n     = queries.size();
+  const size_t limit = options.mode == HitMode::Any      ? 1
+                       : options.mode == HitMode::FirstK ? options.max_hits
+                                                         : input.size();
+
+  std::vector<uint64_t> order(n);
+  std::iota(order.begin(), order.end(), uint64_t{0});
+  if (options.morton_order && n > 1) {
+    std::vector<float> centres(3 * n);
+    float              lo[3] = {INFINITY, INFINITY, INFINITY};
+    float              hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t i = 0; i < n; ++i) {
+      const AABB box{queries[i]};
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const float c = static_cast<float>((box.min[axis] + box.max[axis]) / 2);
+        centres[3 * i + axis] = c;
+        lo[axis]              = std::min(lo[axis], c);
+        hi[axis]              = std::max(hi[axis], c);
+      }
+    }
+
+    std::vector<std::pair<uint32_t, uint64_t>> keys(n);
+    for (size_t i = 0; i < n; ++i) {
+      keys[i] = {detail::morton_code(&centres[3 * i], lo, hi), i};
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < n; ++i) { order[i] = keys[i].second; }
+  }
+
+  // Each range of the ordered batch keeps its hits apart; `found` holds
+  // where those of every query start and end in them.
+  const size_t grain = std::max(
+      min_query_grain, n / (pool.size() * query_ranges_per_worker));
+  const size_t n_ranges = (n + grain - 1) / grain;
+  std::vector<std::vector<Index>>        range_hits(n_ranges);
+  std::vector<std::pair<size_t, size_t>> found(n);
+  pool.parallel_for(0, n_ranges, 1, [&](const size_t lo, const size_t hi) {
+    for (size_t k = lo; k < hi; ++k) {
+      std::vector<Index>& hits = range_hits[k];
+      for (size_t i = k * grain; i < std::min(n, (k + 1) * grain); ++i) {
+        const ObjT&  query = queries[order[i]];
+        const size_t first = hits.size();
+        if (!nodes.empty() && limit > 0) {
+          (void)find_hits_rec(0, query, AABB{query}, first + limit, hits);
+        }
+        std::sort(hits.begin() + static_cast<ptrdiff_t>(first), hits.end());
+        found[order[i]] = {first, hits.size()};
+      }
+    }
+  });
+
+  QueryHits<Index> result;
+  result.offsets.assign(n + 1, 0);
+  for (size_t i = 0; i < n; ++i) {
+    result.offsets[i + 1] =
+        result.offsets[i] + (found[i].second - found[i].first);
+  }
+  result.objects.resize(result.offsets[n]);
+  pool.parallel_for(0, n_ranges, 1, [&](const size_t lo, const size_t hi) {
+    for (size_t k = lo; k < hi; ++k) {
+      for (size_t i = k * grain; i < std::min(n, (k + 1) * grain); ++i) {
+        const auto [first, last] = found[order[i]];
+        std::copy(range_hits[k].begin() + static_cast<ptrdiff_t>(first),
+            range_hits[k].begin() + static_cast<ptrdiff_t>(last),
+            result.objects.begin() +
+                static_cast<ptrdiff_t>(result.offsets[order[i]]));
+      }
+    }
+  });
+  return result;
+}
+
+template <typename ObjT, typename Index>
+std::vector<Index> BVHTree<ObjT, Index>::find_hits(
+    const ObjT& query, const HitOptions& options) const {
+  HitOptions single   = options;
+  single.morton_order = false;
+  return find_hits(ObjectView<ObjT>(std::span<const ObjT>(&query, 1)), single)
+      .objects;
+}
+
+// Same culling as intersects_any_rec.
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::find_hits_rec(const size_t node_idx,
+    const ObjT& query, const AABB& query_box, const size_t limit,
+    std::vector<Index>& hits) const {
+  const Node& node = nodes[node_idx];
+  if (!query_box.is_overlap(node.box)) { return false; }
+
+  if (!node.is_leaf()) {
+    return find_hits_rec(node.left_idx, query, query_box, limit, hits) ||
+           find_hits_rec(node.right_idx, query, query_box, limit, hits);
+  }
+  if (!node.box.is_intersect(query, 0.0)) { return false; }
+
+  for (size_t i = node.start; i < node.start + node.n_objs; ++i) {
+    const ObjT& other = input[indexes[i]];
+    if (node.n_objs > 1 && !AABB{other}.is_intersect(query, math::eps)) {
+      continue;
+    }
+    if (query.is_intersect(other)) {
+      hits.push_back(indexes[i]);
+      if (hits.size() == limit) { return true; }
+    }
+  }
+  return false;
+}
+
+// Same culling as the fused query, without the statistics.
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::intersects_any_rec(const size_t node_idx,
+    const ObjT& query, const AABB& query_box) const {
+  const Node& node = nodes[node_idx];
+  if (!query_box.is_overlap(node.box)) { return false; }
+
+  if (!node.is_leaf()) {
+    return intersects_any_rec(node.left_idx, query, query_box) ||
+           intersects_any_rec(node.right_idx, query, query_box);
+  }
+  if (!node.box.is_intersect(query, 0.0)) { return false; }
+
+  for (size_t i = node.start; i < node.start + node.n_objs; ++i) {
+    const ObjT& other = input[indexes[i]];
+    if (node.n_objs > 1 && !AABB{other}.is_intersect(query, math::eps)) {
+      continue;
+    }
+    if (query.is_intersect(other)) { return true; }
+  }
+  return false;
+}
+
+// `pad` is 0 for loose node boxes and math::eps for exact object boxes.
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::sat_overlaps(const size_t query_idx, const AABB& box,
+    const double pad, QueryState& state) const {
+  if (!state.options.sat_culling) { return true; }
+
+  ++state.stats.n_sat_tests;
+  return box.is_intersect(input[query_idx], pad);
+}
+
+template <typename ObjT, typename Index>
+bool BVHTree<ObjT, Index>::get_intersections_rec(const size_t node_idx,
+    const size_t query_idx, const AABB& query_box, QueryState& state) const {
+  const Node& node     = nodes[node_idx];
+  const AABB& node_box = node.box;
+
+  if (!query_box.is_overlap(node_box)) { return false; }
 
   if (node.is_leaf()) {
+    const bool leaf_overlaps = sat_overlaps(query_idx, node_box, 0.0, state);
+
     for (size_t i = node.start; i < node.start + node.n_objs; ++i) {
       size_t real_id = indexes[i];
-      if (real_id != query_idx &&
-          input[query_idx].is_intersect(input[real_id])) {
-        ever_intersected[query_idx] = true;
-        ever_intersected[real_id]   = true;
+      if (real_id == query_idx) { continue; }
+
+      ++state.stats.n_candidates;
+      if (!leaf_overlaps ||
+          (node.n_objs > 1 &&
+              !sat_overlaps(
+                  query_idx, AABB{input[real_id]}, math::eps, state))) {
+        ++state.stats.n_sat_culled;
+        continue;
+      }
+
+      ++state.stats.n_narrowphase;
+      if (input[query_idx].is_intersect(input[real_id])) {
+        ++state.stats.n_hits;
+        state.flag(query_idx);
+        state.flag(real_id);
         return true;
       }
     }
     return false;
   }
-  if (get_intersections_rec(
-          node.left_idx, query_idx, ever_intersected, query_box)) {
+  if (get_intersections_rec(node.left_idx, query_idx, query_box, state)) {
     return true;
   }
-  if (get_intersections_rec(
-          node.right_idx, query_idx, ever_intersected, query_box)) {
+  if (get_intersections_rec(node.right_idx, query_idx, query_box, state)) {
     return true;
   }
 
   return false;
 }
 
-template <typename ObjT>
-void BVHTree<ObjT>::dump_to_dot(const std::string& filename) const {
+// Pipelined broadphase: every unordered pair is emitted once (candidate >
+// query), so the traversal can't skip already flagged queries the way the
+// fused path does, but the narrowphase skips pairs that can't flip a flag.
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::collect_candidates_rec(const size_t node_idx,
+    const size_t query_idx, const AABB& query_box, QueryState& state) const {
+  const Node& node = nodes[node_idx];
+
+  if (!query_box.is_overlap(node.box)) { return; }
+
+  if (node.is_leaf()) {
+    const size_t last_id        = node.start + node.n_objs;
+    bool         has_candidates = false;
+
+    for (size_t i = node.start; i < last_id && !has_candidates; ++i) {
+      has_candidates = indexes[i] > query_idx;
+    }
+    if (!has_candidates) { return; }
+
+    const bool leaf_overlaps = sat_overlaps(query_idx, node.box, 0.0, state);
+
+    for (size_t i = node.start; i < last_id; ++i) {
+      const size_t real_id = indexes[i];
+      if (real_id <= query_idx) { continue; }
+
+      ++state.stats.n_candidates;
+      if (!leaf_overlaps ||
+          (node.n_objs > 1 &&
+              !sat_overlaps(
+                  query_idx, AABB{input[real_id]}, math::eps, state))) {
+        ++state.stats.n_sat_culled;
+        continue;
+      }
+
+      state.buffer.push(query_idx, real_id);
+      if (state.buffer.is_full()) { flush_candidates(state); }
+    }
+    return;
+  }
+
+  collect_candidates_rec(node.left_idx, query_idx, query_box, state);
+  collect_candidates_rec(node.right_idx, query_idx, query_box, state);
+}
+
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::flush_candidates(QueryState& state) const {
+  CandidateBuffer<Index>& buffer = state.buffer;
+
+  // Bucket by candidate so each scene triangle is pulled into cache once per
+  // batch; the query side of a batch spans only a few consecutive triangles.
+  std::sort(buffer.pairs.begin(), buffer.pairs.begin() + buffer.size,
+      [](const CandidatePair<Index>& lhs, const CandidatePair<Index>& rhs) {
+        return lhs.candidate < rhs.candidate ||
+               (lhs.candidate == rhs.candidate && lhs.query < rhs.query);
+      });
+
+  for (size_t i = 0; i < buffer.size; ++i) {
+    const CandidatePair<Index>& pair = buffer.pairs[i];
+    if (state.is_flagged(pair.query) && state.is_flagged(pair.candidate)) {
+      continue;
+    }
+
+    ++state.stats.n_narrowphase;
+    if (input[pair.query].is_intersect(input[pair.candidate])) {
+      ++state.stats.n_hits;
+      state.flag(pair.query);
+      state.flag(pair.candidate);
+    }
+  }
+  buffer.clear();
+}
+
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::dump_to_dot(const std::string& filename) const {
   std::ofstream out(filename);
   out << "digraph BVH {\n";
   out << "  node [shape=record];\n";
@@ -472,8 +1888,8 @@ void BVHTree<ObjT>::dump_to_dot(const std::string& filename) const {
   out << "}\n";
 }
 
-template <typename ObjT>
-void BVHTree<ObjT>::dump_node_dot(std::ostream& out, size_t idx) const {
+template <typename ObjT, typename Index>
+void BVHTree<ObjT, Index>::dump_node_dot(std::ostream& out, size_t idx) const {
   const auto& node = nodes[idx];
 
   out << "  node" << idx << " [label=\"{ID: " << idx;
@@ -490,6 +1906,49 @@ void BVHTree<ObjT>::dump_node_dot(std::ostream& out, size_t idx) const {
   }
 }
 
+namespace detail {
+
+template <typename Index, typename ObjT>
+[[nodiscard]] BVHTree<ObjT, Index> load_or_build(std::vector<ObjT>& input,
+    utils::ThreadPool& pool, const std::filesystem::path& saved) {
+  if (!saved.empty()) {
+    try {
+      BVHTree<ObjT, Index> tree(input, saved, pool);
+      LOG_INFO("Loaded the tree from {}", saved.string());
+      return tree;
+    } catch (const std::exception& e) {
+      LOG_INFO("Building the tree: {}", e.what());
+    }
+  }
+  BVHTree<ObjT, Index> tree(input, pool);
+  if (!saved.empty() && !tree.save(saved)) {
+    LOG_WARN("Couldn't save the tree to {}", saved.string());
+  }
+  return tree;
+}
+
+template <typename Index, typename ObjT>
+[[nodiscard]] std::vector<bool> find_all_intersections(std::vector<ObjT>& input,
+    utils::ThreadPool& pool, const std::filesystem::path& saved) {
+  return load_or_build<Index>(input, pool, saved)
+      .get_intersections(default_query_options());
+}
+
+}  // namespace detail
+
+// Flags of `input` as triangles.x finds them: a tree with 32-bit indexes
+// unless the input needs 64, queried with default_query_options(). With a
+// `saved` path, the tree saved there is mapped if it was built for this
+// input; otherwise the tree is built and saved there for the next call.
+template <typename ObjT>
+[[nodiscard]] std::vector<bool> find_all_intersections(std::vector<ObjT>& input,
+    utils::ThreadPool&           pool  = utils::ThreadPool::instance(),
+    const std::filesystem::path& saved = {}) {
+  return input.size() > max_tree_objects<uint32_t>
+             ? detail::find_all_intersections<uint64_t>(input, pool, saved)
+             : detail::find_all_intersections<uint32_t>(input, pool, saved);
+}
+
 }  // namespace acceleration
 
 //   BVHTree(std::vector<geometry::Triangle>& input);
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace acceleration {
+
+enum class BuildEngine {
+  Auto,    // picked by the Dispatcher from the input size and the hardware
+  Median,  // object median split on the host
+  SAH,     // binned surface area heuristic on the host
+  LBVH,    // linear BVH on the host, same tree as the device builds
+  OpenCL,  // linear BVH on the OpenCL device; Median without one
+};
+
+[[nodiscard]] std::string_view to_string(const BuildEngine engine);
+// Names as printed by to_string(), lower case; nullopt for anything else.
+[[nodiscard]] std::optional<BuildEngine> parse_build_engine(
+    std::string_view name);
+
+// Inputs below this size are built with Median and queried on the host
+// without consulting (or running) the calibration.
+inline constexpr size_t dispatch_min_objects = 2048;
+
+// Linear fit of a time in microseconds over n * log2(n).
+struct CostModel {
+  double fixed_us = 0.0;
+  double scale_us = 0.0;
+
+  [[nodiscard]] double operator()(const size_t n) const {
+    return fixed_us + scale_us * work(n);
+  }
+  [[nodiscard]] static double work(const size_t n) {
+    return n < 2 ? 1.0 : n * std::log2(static_cast<double>(n));
+  }
+  // Line through two measurements, clamped to non-negative terms.
+  [[nodiscard]] static CostModel fit(
+      const size_t n1, const double us1, const size_t n2, const double us2);
+};
+
+// Measured costs of each engine on this machine. The OpenCL models are only
+// meaningful when `has_device` is set.
+struct Calibration {
+  CostModel median_build;
+  CostModel sah_build;
+  CostModel lbvh_build;
+  CostModel opencl_build;
+
+  // Parallel pipelined host queries over each engine's tree; OpenCL builds
+  // the LBVH tree, so it shares lbvh_query.
+  CostModel median_query;
+  CostModel sah_query;
+  CostModel lbvh_query;
+  CostModel device_query;  // upload and kernel, host fallbacks included
+
+  // Context creation and program load paid by the first OpenCL use.
+  double opencl_setup_us = 0.0;
+
+  bool        has_device       = false;
+  bool        has_device_query = false;  // device with fp64
+  std::string device_type;               // "gpu", "cpu" or "other"
+  std::string device_name;
+
+  [[nodiscard]] std::string serialize(std::string_view key) const;
+  // nullopt when the text is malformed or was written under another key.
+  [[nodiscard]] static std::optional<Calibration> parse(
+      std::string_view text, std::string_view key);
+};
+
+// Chooses build and query engines with a cost model: the estimated build
+// plus query time of every available engine at the given input size. The
+// models come from a micro-benchmark run once per machine and cached in
+// TRIANGLES_CALIBRATION (default $XDG_CACHE_HOME/triangles/calibration; an
+// empty value keeps it in memory). TRIANGLES_BUILD forces a build engine.
+class Dispatcher {
+ public:
+  Dispatcher(const Dispatcher&)            = delete;
+  Dispatcher& operator=(const Dispatcher&) = delete;
+
+  static Dispatcher& instance();
+
+  // Loaded or measured on the first call.
+  [[nodiscard]] const Calibration& calibration();
+
+  [[nodiscard]] BuildEngine choose_build(const size_t n_objs);
+  // Whether a tree built by `built` should be queried on the device.
+  [[nodiscard]] bool choose_device_query(
+      const size_t n_objs, const BuildEngine built);
+
+  // Called after a successful device build or query: the setup is paid.
+  void mark_device_warm() { device_warm.store(true); }
+
+  // The decisions themselves, without state, so they can be tested.
+  [[nodiscard]] static BuildEngine pick_build(const Calibration& cal,
+      const size_t n_objs, const bool warm, std::string* reason = nullptr);
+  [[nodiscard]] static bool pick_device_query(const Calibration& cal,
+      const size_t n_objs, const BuildEngine built, const bool warm,
+      std::string* reason = nullptr);
+
+  // Runs the micro-benchmark: a few hundred milliseconds.
+  [[nodiscard]] static Calibration calibrate();
+  // Identifies the hardware and settings a calibration is valid for.
+  [[nodiscard]] static std::string calibration_key();
+  [[nodiscard]] static std::filesystem::path calibration_path();
+
+ private:
+  Dispatcher() = default;
+
+  std::once_flag    loaded;
+  Calibration       cal;
+  std::atomic<bool> device_warm{false};
+};
+
+}  // namespace acceleration
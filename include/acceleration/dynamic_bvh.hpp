@@ -0,0 +1,559 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "acceleration/AABB.hpp"
+#include "acceleration/bvh_tree.hpp"
+#include "utils/thread_pool.hpp"
+
+namespace acceleration {
+
+// Leaves of a DynamicBVH are grown by this fraction of the object's largest
+// extent, so an object moving less than that leaves the tree untouched.
+inline constexpr double dynamic_fat_margin = 0.1;
+
+// BVH over objects that are inserted, erased and moved one at a time, kept
+// in shape the way dynamic AABB trees are: one object per leaf, a new leaf
+// goes next to the node whose box it grows the least counting the growth of
+// all ancestors (a branch and bound search), and every ancestor refitted on
+// the way up swaps a child with a grandchild when that shrinks it. Leaves
+// hold fat boxes. Objects are copied in and keep their id until erased;
+// erased ids are reused by later inserts.
+//
+// Queries may run concurrently with each other, not with edits.
+template <typename ObjT>
+class DynamicBVH {
+ public:
+  using Id = size_t;
+
+  static constexpr Id no_id = std::numeric_limits<Id>::max();
+
+  explicit DynamicBVH(utils::ThreadPool& pool = utils::ThreadPool::instance())
+      : pool(pool) {}
+  // Top-down median build, far faster than inserting one by one; object i
+  // gets id i.
+  explicit DynamicBVH(const std::vector<ObjT>& input,
+      utils::ThreadPool& pool = utils::ThreadPool::instance());
+
+  Id insert(const ObjT& object);
+  // Both throw std::out_of_range for an id that isn't in the tree.
+  void erase(const Id id);
+  void move(const Id id, const ObjT& object);
+
+  [[nodiscard]] size_t size() const { return n_objects; }
+  // Every id in use is below this.
+  [[nodiscard]] size_t id_bound() const { return leaf_of.size(); }
+  [[nodiscard]] bool   contains(const Id id) const {
+    return id < leaf_of.size() && leaf_of[id] != null_node;
+  }
+  [[nodiscard]] const ObjT& object(const Id id) const { return objects[id]; }
+
+  // Whether `query` intersects any object but `skip`.
+  [[nodiscard]] bool intersects_any(
+      const ObjT& query, const Id skip = no_id) const;
+  // Calls fn(id) for every object whose leaf box overlaps `box`: the
+  // broadphase, for callers that run their own exact test.
+  template <typename Fn>
+  void for_each_overlap(const AABB& box, Fn&& fn) const;
+  // Indexed by id, as BVHTree::get_intersections() is by input index: set
+  // for objects intersecting another one, never for unused ids.
+  [[nodiscard]] std::vector<bool> get_intersections() const;
+
+  [[nodiscard]] size_t height() const {
+    return root == null_node ? 0 : nodes[root].height;
+  }
+  // Surface area of the internal nodes over that of the root: how many of
+  // them a random ray through the scene visits on average.
+  [[nodiscard]] double sah_cost() const;
+  [[nodiscard]] bool   validate_tree() const;
+
+ private:
+  using NodeIdx = uint32_t;
+
+  static constexpr NodeIdx null_node = std::numeric_limits<NodeIdx>::max();
+
+  struct Node {
+    AABB    box;                 // fat object box in leaves
+    NodeIdx parent = null_node;  // next free node while on the free list
+    NodeIdx left   = null_node;  // null_node in leaves
+    NodeIdx right  = null_node;
+    NodeIdx object = null_node;  // leaves only
+    NodeIdx height = 0;
+
+    [[nodiscard]] bool is_leaf() const { return left == null_node; }
+  };
+
+  utils::ThreadPool& pool;
+  std::vector<Node>  nodes;
+  NodeIdx            root      = null_node;
+  NodeIdx            free_list = null_node;
+
+  std::vector<ObjT>    objects;  // by id, stale for unused ids
+  std::vector<NodeIdx> leaf_of;  // by id, null_node for unused ids
+  std::vector<Id>      free_ids;
+  size_t               n_objects = 0;
+
+  // Scratch of the sibling search, kept to spare an allocation per insert.
+  std::vector<std::pair<NodeIdx, double>> search_stack;
+
+  [[nodiscard]] static AABB fat_box(const ObjT& object);
+
+  [[nodiscard]] NodeIdx allocate_node();
+  void                  free_node(const NodeIdx idx);
+  void                  check_id(const Id id) const;
+
+  void build_rec(const NodeIdx idx, const NodeIdx parent, NodeIdx* ids,
+      const size_t n_ids, const std::vector<AABB>& boxes);
+
+  void insert_leaf(const NodeIdx leaf);
+  void remove_leaf(const NodeIdx leaf);
+  void replace_child(
+      const NodeIdx parent, const NodeIdx old_child, const NodeIdx new_child);
+  void refit(const NodeIdx idx);
+  void refit_up(NodeIdx idx);
+  void rotate(const NodeIdx idx);
+};
+
+template <typename ObjT>
+DynamicBVH<ObjT>::DynamicBVH(
+    const std::vector<ObjT>& input, utils::ThreadPool& pool)
+    : pool(pool), objects(input) {
+  const size_t n = input.size();
+  if (2 * n >= null_node) { throw std::length_error("Too many objects"); }
+
+  n_objects = n;
+  leaf_of.assign(n, null_node);
+  if (n == 0) { return; }
+
+  std::vector<AABB> boxes(n);
+  pool.parallel_for(0, n, parallel_build_grain,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) { boxes[i] = fat_box(input[i]); }
+      });
+
+  std::vector<NodeIdx> ids(n);
+  std::iota(ids.begin(), ids.end(), NodeIdx{0});
+
+  nodes.resize(2 * n - 1);
+  build_rec(0, null_node, ids.data(), n, boxes);
+  root = 0;
+}
+
+// A subtree over m objects takes exactly 2m - 1 consecutive nodes, so the
+// halves are built into known slots and can run in parallel.
+template <typename ObjT>
+void DynamicBVH<ObjT>::build_rec(const NodeIdx idx, const NodeIdx parent,
+    NodeIdx* ids, const size_t n_ids, const std::vector<AABB>& boxes) {
+  Node& node  = nodes[idx];
+  node.parent = parent;
+
+  if (n_ids == 1) {
+    node.box        = boxes[ids[0]];
+    node.object     = ids[0];
+    leaf_of[ids[0]] = idx;
+    return;
+  }
+
+  auto centre = [&](const NodeIdx obj, const size_t axis) {
+    return 0.5f * (boxes[obj].min[axis] + boxes[obj].max[axis]);
+  };
+
+  std::array<float, 3> lo;
+  std::array<float, 3> hi;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    lo[axis] = hi[axis] = centre(ids[0], axis);
+  }
+  for (size_t i = 1; i < n_ids; ++i) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      lo[axis] = std::min(lo[axis], centre(ids[i], axis));
+      hi[axis] = std::max(hi[axis], centre(ids[i], axis));
+    }
+  }
+  size_t axis = 0;
+  for (size_t a = 1; a < 3; ++a) {
+    if (hi[a] - lo[a] > hi[axis] - lo[axis]) { axis = a; }
+  }
+
+  const size_t half = n_ids / 2;
+  std::nth_element(ids, ids + half, ids + n_ids,
+      [&](const NodeIdx a, const NodeIdx b) {
+        return centre(a, axis) < centre(b, axis);
+      });
+
+  node.left  = idx + 1;
+  node.right = static_cast<NodeIdx>(idx + 2 * half);
+
+  if (n_ids >= parallel_build_grain && !pool.is_serial()) {
+    utils::TaskGroup group(pool);
+    group.run([&] { build_rec(node.left, idx, ids, half, boxes); });
+    build_rec(node.right, idx, ids + half, n_ids - half, boxes);
+    group.wait();
+  } else {
+    build_rec(node.left, idx, ids, half, boxes);
+    build_rec(node.right, idx, ids + half, n_ids - half, boxes);
+  }
+  refit(idx);
+}
+
+template <typename ObjT>
+AABB DynamicBVH<ObjT>::fat_box(const ObjT& object) {
+  const AABB box{object};
+
+  double extent = 0.0;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    extent = std::max(
+        extent, static_cast<double>(box.max[axis]) - box.min[axis]);
+  }
+  return box.loosened(math::eps + dynamic_fat_margin * extent);
+}
+
+template <typename ObjT>
+typename DynamicBVH<ObjT>::NodeIdx DynamicBVH<ObjT>::allocate_node() {
+  if (free_list != null_node) {
+    const NodeIdx idx = free_list;
+    free_list         = nodes[idx].parent;
+    nodes[idx]        = Node{};
+    return idx;
+  }
+  if (nodes.size() >= null_node) {
+    throw std::length_error("Too many objects");
+  }
+  nodes.emplace_back();
+  return static_cast<NodeIdx>(nodes.size() - 1);
+}
+
+template <typename ObjT>
+void DynamicBVH<ObjT>::free_node(const NodeIdx idx) {
+  nodes[idx].parent = free_list;
+  free_list         = idx;
+}
+
+template <typename ObjT>
+void DynamicBVH<ObjT>::check_id(const Id id) const {
+  if (!contains(id)) {
+    throw std::out_of_range("No object with id " + std::to_string(id));
+  }
+}
+
+template <typename ObjT>
+typename DynamicBVH<ObjT>::Id DynamicBVH<ObjT>::insert(const ObjT& object) {
+  Id id = no_id;
+  if (!free_ids.empty()) {
+    id = free_ids.back();
+    free_ids.pop_back();
+    objects[id] = object;
+  } else {
+    if (objects.size() >= null_node) {
+      throw std::length_error("Too many objects");
+    }
+    id = objects.size();
+    objects.push_back(object);
+    leaf_of.push_back(null_node);
+  }
+
+  const NodeIdx leaf = allocate_node();
+  nodes[leaf].box    = fat_box(object);
+  nodes[leaf].object = static_cast<NodeIdx>(id);
+  leaf_of[id]        = leaf;
+  insert_leaf(leaf);
+
+  ++n_objects;
+  return id;
+}
+
+template <typename ObjT>
+void DynamicBVH<ObjT>::erase(const Id id) {
+  check_id(id);
+
+  remove_leaf(leaf_of[id]);
+  free_node(leaf_of[id]);
+  leaf_of[id] = null_node;
+  free_ids.push_back(id);
+  --n_objects;
+}
+
+// The leaf is only reinserted once the object leaves its fat box.
+template <typename ObjT>
+void DynamicBVH<ObjT>::move(const Id id, const ObjT& object) {
+  check_id(id);
+
+  objects[id]        = object;
+  const NodeIdx leaf = leaf_of[id];
+  if (nodes[leaf].box.is_contains(AABB{object}.loosened())) { return; }
+
+  remove_leaf(leaf);
+  nodes[leaf].box = fat_box(object);
+  insert_leaf(leaf);
+}
+
+// Best sibling by branch and bound: placing the leaf next to a node costs
+// the area of their union plus the growth of every ancestor, and a subtree
+// is searched only while the leaf's own area plus the growth already forced
+// on its ancestors can still beat the best cost found.
+template <typename ObjT>
+void DynamicBVH<ObjT>::insert_leaf(const NodeIdx leaf) {
+  if (root == null_node) {
+    root               = leaf;
+    nodes[leaf].parent = null_node;
+    return;
+  }
+
+  const AABB   leaf_box  = nodes[leaf].box;
+  const double leaf_area = leaf_box.surface_area();
+
+  NodeIdx best      = root;
+  double  best_cost = merge(leaf_box, nodes[root].box).surface_area();
+
+  search_stack.clear();
+  search_stack.emplace_back(root, 0.0);
+  while (!search_stack.empty()) {
+    const auto [idx, inherited] = search_stack.back();
+    search_stack.pop_back();
+
+    const Node&  node   = nodes[idx];
+    const double direct = merge(leaf_box, node.box).surface_area();
+    if (direct + inherited < best_cost) {
+      best_cost = direct + inherited;
+      best      = idx;
+    }
+    if (node.is_leaf()) { continue; }
+
+    const double child_inherited =
+        inherited + direct - node.box.surface_area();
+    if (leaf_area + child_inherited < best_cost) {
+      // The child nearer the leaf is searched first, to tighten the bound.
+      const bool left_first =
+          merge(leaf_box, nodes[node.left].box).surface_area() <
+          merge(leaf_box, nodes[node.right].box).surface_area();
+      search_stack.emplace_back(
+          left_first ? node.right : node.left, child_inherited);
+      search_stack.emplace_back(
+          left_first ? node.left : node.right, child_inherited);
+    }
+  }
+
+  const NodeIdx old_parent = nodes[best].parent;
+  const NodeIdx parent     = allocate_node();
+  nodes[parent].parent     = old_parent;
+  nodes[parent].left       = best;
+  nodes[parent].right      = leaf;
+  nodes[best].parent       = parent;
+  nodes[leaf].parent       = parent;
+
+  if (old_parent == null_node) {
+    root = parent;
+  } else {
+    replace_child(old_parent, best, parent);
+  }
+  refit_up(parent);
+}
+
+// The leaf's parent is freed and its sibling takes its place.
+template <typename ObjT>
+void DynamicBVH<ObjT>::remove_leaf(const NodeIdx leaf) {
+  if (leaf == root) {
+    root = null_node;
+    return;
+  }
+
+  const NodeIdx parent  = nodes[leaf].parent;
+  const NodeIdx grand   = nodes[parent].parent;
+  const NodeIdx sibling = nodes[parent].left == leaf ? nodes[parent].right
+                                                     : nodes[parent].left;
+  nodes[leaf].parent = null_node;
+  free_node(parent);
+
+  nodes[sibling].parent = grand;
+  if (grand == null_node) {
+    root = sibling;
+  } else {
+    replace_child(grand, parent, sibling);
+    refit_up(grand);
+  }
+}
+
+template <typename ObjT>
+void DynamicBVH<ObjT>::replace_child(
+    const NodeIdx parent, const NodeIdx old_child, const NodeIdx new_child) {
+  Node& node = nodes[parent];
+  (node.left == old_child ? node.left : node.right) = new_child;
+}
+
+template <typename ObjT>
+void DynamicBVH<ObjT>::refit(const NodeIdx idx) {
+  Node&       node  = nodes[idx];
+  const Node& left  = nodes[node.left];
+  const Node& right = nodes[node.right];
+  node.box          = merge(left.box, right.box);
+  node.height       = 1 + std::max(left.height, right.height);
+}
+
+template <typename ObjT>
+void DynamicBVH<ObjT>::refit_up(NodeIdx idx) {
+  while (idx != null_node) {
+    refit(idx);
+    rotate(idx);
+    idx = nodes[idx].parent;
+  }
+}
+
+// Tree rotation of node A with children B and C: a child of A is swapped
+// with a grandchild under its sibling when that shrinks the sibling's box
+// the most. A's own box doesn't change.
+template <typename ObjT>
+void DynamicBVH<ObjT>::rotate(const NodeIdx idx) {
+  const NodeIdx children[2] = {nodes[idx].left, nodes[idx].right};
+
+  double  best_gain  = 0.0;
+  NodeIdx best_child = null_node;  // moves down
+  NodeIdx best_grand = null_node;  // moves up
+
+  for (size_t side = 0; side < 2; ++side) {
+    const NodeIdx child   = children[side];
+    const Node&   sibling = nodes[children[1 - side]];
+    if (sibling.is_leaf()) { continue; }
+
+    const double area = sibling.box.surface_area();
+    for (const auto& [grand, kept] : {std::pair{sibling.left, sibling.right},
+             std::pair{sibling.right, sibling.left}}) {
+      const double gain =
+          area - merge(nodes[child].box, nodes[kept].box).surface_area();
+      if (gain > best_gain) {
+        best_gain  = gain;
+        best_child = child;
+        best_grand = grand;
+      }
+    }
+  }
+  if (best_child == null_node) { return; }
+
+  const NodeIdx sibling = nodes[best_grand].parent;
+  replace_child(idx, best_child, best_grand);
+  replace_child(sibling, best_grand, best_child);
+  nodes[best_grand].parent = idx;
+  nodes[best_child].parent = sibling;
+  refit(sibling);
+  refit(idx);
+}
+
+template <typename ObjT>
+bool DynamicBVH<ObjT>::intersects_any(const ObjT& query, const Id skip) const {
+  if (root == null_node) { return false; }
+
+  const AABB           query_box{query};
+  std::vector<NodeIdx> stack{root};
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+    if (!query_box.is_overlap(node.box)) { continue; }
+
+    if (!node.is_leaf()) {
+      stack.push_back(node.right);
+      stack.push_back(node.left);
+    } else if (node.object != skip &&
+               query.is_intersect(objects[node.object])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename ObjT>
+template <typename Fn>
+void DynamicBVH<ObjT>::for_each_overlap(const AABB& box, Fn&& fn) const {
+  if (root == null_node) { return; }
+
+  std::vector<NodeIdx> stack{root};
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+    if (!box.is_overlap(node.box)) { continue; }
+
+    if (node.is_leaf()) {
+      fn(Id{node.object});
+    } else {
+      stack.push_back(node.right);
+      stack.push_back(node.left);
+    }
+  }
+}
+
+template <typename ObjT>
+std::vector<bool> DynamicBVH<ObjT>::get_intersections() const {
+  std::vector<uint8_t> hits(id_bound());
+  pool.parallel_for(0, id_bound(), min_query_grain,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t id = lo; id < hi; ++id) {
+          hits[id] = contains(id) && intersects_any(objects[id], id);
+        }
+      });
+  return std::vector<bool>(hits.begin(), hits.end());
+}
+
+template <typename ObjT>
+double DynamicBVH<ObjT>::sah_cost() const {
+  if (root == null_node || nodes[root].is_leaf()) { return 0.0; }
+
+  double               area = 0.0;
+  std::vector<NodeIdx> stack{root};
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+    if (node.is_leaf()) { continue; }
+
+    area += node.box.surface_area();
+    stack.push_back(node.left);
+    stack.push_back(node.right);
+  }
+  return area / nodes[root].box.surface_area();
+}
+
+// Links, heights and boxes of every reachable node, and the id <-> leaf
+// mapping both ways.
+template <typename ObjT>
+bool DynamicBVH<ObjT>::validate_tree() const {
+  if (root == null_node) { return n_objects == 0; }
+  if (nodes[root].parent != null_node) { return false; }
+
+  size_t               n_leaves = 0;
+  std::vector<NodeIdx> stack{root};
+  while (!stack.empty()) {
+    const NodeIdx idx  = stack.back();
+    const Node&   node = nodes[idx];
+    stack.pop_back();
+
+    if (node.is_leaf()) {
+      if (node.height != 0 || node.object >= id_bound() ||
+          leaf_of[node.object] != idx ||
+          !node.box.is_contains(AABB{objects[node.object]})) {
+        return false;
+      }
+      ++n_leaves;
+      continue;
+    }
+
+    for (const NodeIdx child : {node.left, node.right}) {
+      if (child >= nodes.size() || nodes[child].parent != idx ||
+          !node.box.is_contains(nodes[child].box)) {
+        return false;
+      }
+      stack.push_back(child);
+    }
+    if (node.height != 1 + std::max(nodes[node.left].height,
+                               nodes[node.right].height)) {
+      return false;
+    }
+  }
+  return n_leaves == n_objects;
+}
+
+}  // namespace acceleration
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "acceleration/AABB.hpp"
+#include "acceleration/bvh_tree.hpp"
+#include "acceleration/dynamic_bvh.hpp"
+#include "utils/thread_pool.hpp"
+
+namespace acceleration {
+
+// Intersection flags of a scene edited one object at a time. Every object
+// keeps the number of objects it intersects; an edit re-queries only the
+// edited object, before and after, and updates the counts of the partners
+// it gained or lost. An edit costs two local DynamicBVH queries, however
+// large the scene.
+//
+// Pairs are always tested with the lower id on the left, so the counts stay
+// consistent even where is_intersect isn't exactly symmetric.
+template <typename ObjT>
+class IncrementalIntersections {
+ public:
+  using Id = typename DynamicBVH<ObjT>::Id;
+
+  explicit IncrementalIntersections(
+      utils::ThreadPool& pool = utils::ThreadPool::instance())
+      : bvh(pool) {}
+  // Bulk build of the tree and one full, parallel count; object i gets id i.
+  explicit IncrementalIntersections(const std::vector<ObjT>& input,
+      utils::ThreadPool& pool = utils::ThreadPool::instance());
+
+  // Each edit fills `flipped`, if given, with the ids whose flag changed, in
+  // ascending order. A new object is in it if it intersects anything, an
+  // erased one if it did. erase() and move() throw std::out_of_range for an
+  // id that isn't in the scene.
+  Id   insert(const ObjT& object, std::vector<Id>* flipped = nullptr);
+  void erase(const Id id, std::vector<Id>* flipped = nullptr);
+  void move(
+      const Id id, const ObjT& object, std::vector<Id>* flipped = nullptr);
+
+  [[nodiscard]] bool is_intersecting(const Id id) const {
+    return id < partner_counts.size() && partner_counts[id] > 0;
+  }
+  // Objects this one intersects; 0 for unused ids.
+  [[nodiscard]] size_t partner_count(const Id id) const {
+    return id < partner_counts.size() ? partner_counts[id] : 0;
+  }
+  // Same flags as DynamicBVH::get_intersections(), without a query.
+  [[nodiscard]] std::vector<bool> get_intersections() const;
+
+  // The objects, by id.
+  [[nodiscard]] const DynamicBVH<ObjT>& tree() const { return bvh; }
+
+ private:
+  DynamicBVH<ObjT>      bvh;
+  std::vector<uint32_t> partner_counts;  // by id
+
+  // Scratch of the edits, kept to spare allocations: partners before and
+  // after, and the ids an edit touched with their flag before it.
+  std::vector<Id>                  lost;
+  std::vector<Id>                  gained;
+  std::vector<std::pair<Id, bool>> touched;
+
+  [[nodiscard]] bool pair_intersects(
+      const Id id, const ObjT& object, const Id other) const;
+  // Ids of the objects `object`, standing for `id`, intersects.
+  void find_partners(
+      const Id id, const ObjT& object, std::vector<Id>& partners) const;
+
+  void begin_edit(const Id id);
+  void finish_edit(std::vector<Id>* flipped);
+};
+
+template <typename ObjT>
+IncrementalIntersections<ObjT>::IncrementalIntersections(
+    const std::vector<ObjT>& input, utils::ThreadPool& pool)
+    : bvh(input, pool), partner_counts(input.size()) {
+  pool.parallel_for(0, input.size(), min_query_grain,
+      [&](const size_t first, const size_t last) {
+        std::vector<Id> partners;
+        for (size_t id = first; id < last; ++id) {
+          find_partners(id, input[id], partners);
+          partner_counts[id] = static_cast<uint32_t>(partners.size());
+        }
+      });
+}
+
+template <typename ObjT>
+typename IncrementalIntersections<ObjT>::Id
+IncrementalIntersections<ObjT>::insert(
+    const ObjT& object, std::vector<Id>* flipped) {
+  const Id id = bvh.insert(object);
+  if (id >= partner_counts.size()) { partner_counts.resize(id + 1); }
+
+  begin_edit(id);
+  lost.clear();
+  find_partners(id, object, gained);
+  finish_edit(flipped);
+  return id;
+}
+
+template <typename ObjT>
+void IncrementalIntersections<ObjT>::erase(
+    const Id id, std::vector<Id>* flipped) {
+  if (!bvh.contains(id)) {
+    throw std::out_of_range("No object with id " + std::to_string(id));
+  }
+
+  begin_edit(id);
+  find_partners(id, bvh.object(id), lost);
+  gained.clear();
+  bvh.erase(id);
+  finish_edit(flipped);
+}
+
+template <typename ObjT>
+void IncrementalIntersections<ObjT>::move(
+    const Id id, const ObjT& object, std::vector<Id>* flipped) {
+  if (!bvh.contains(id)) {
+    throw std::out_of_range("No object with id " + std::to_string(id));
+  }
+
+  begin_edit(id);
+  find_partners(id, bvh.object(id), lost);
+  bvh.move(id, object);
+  find_partners(id, object, gained);
+  finish_edit(flipped);
+}
+
+template <typename ObjT>
+std::vector<bool> IncrementalIntersections<ObjT>::get_intersections() const {
+  std::vector<bool> flags(partner_counts.size());
+  for (size_t id = 0; id < partner_counts.size(); ++id) {
+    flags[id] = partner_counts[id] > 0;
+  }
+  return flags;
+}
+
+template <typename ObjT>
+bool IncrementalIntersections<ObjT>::pair_intersects(
+    const Id id, const ObjT& object, const Id other) const {
+  const ObjT& other_object = bvh.object(other);
+  return id < other ? object.is_intersect(other_object)
+                    : other_object.is_intersect(object);
+}
+
+template <typename ObjT>
+void IncrementalIntersections<ObjT>::find_partners(
+    const Id id, const ObjT& object, std::vector<Id>& partners) const {
+  partners.clear();
+  bvh.for_each_overlap(AABB{object}, [&](const Id other) {
+    if (other != id && pair_intersects(id, object, other)) {
+      partners.push_back(other);
+    }
+  });
+  std::sort(partners.begin(), partners.end());
+}
+
+template <typename ObjT>
+void IncrementalIntersections<ObjT>::begin_edit(const Id id) {
+  touched.clear();
+  touched.emplace_back(id, is_intersecting(id));
+}
+
+// Partners in both lists keep their count; the rest lose or gain one.
+template <typename ObjT>
+void IncrementalIntersections<ObjT>::finish_edit(std::vector<Id>* flipped) {
+  const Id id = touched.front().first;
+
+  auto lost_it   = lost.begin();
+  auto gained_it = gained.begin();
+  while (lost_it != lost.end() || gained_it != gained.end()) {
+    if (gained_it == gained.end() ||
+        (lost_it != lost.end() && *lost_it < *gained_it)) {
+      touched.emplace_back(*lost_it, is_intersecting(*lost_it));
+      --partner_counts[*lost_it++];
+    } else if (lost_it == lost.end() || *gained_it < *lost_it) {
+      touched.emplace_back(*gained_it, is_intersecting(*gained_it));
+      ++partner_counts[*gained_it++];
+    } else {
+      ++lost_it;
+      ++gained_it;
+    }
+  }
+  partner_counts[id] =
+      bvh.contains(id) ? static_cast<uint32_t>(gained.size()) : 0;
+
+  if (!flipped) { return; }
+  flipped->clear();
+  for (const auto& [other, was_intersecting] : touched) {
+    if (is_intersecting(other) != was_intersecting) {
+      flipped->push_back(other);
+    }
+  }
+  std::sort(flipped->begin(), flipped->end());
+}
+
+}  // namespace acceleration
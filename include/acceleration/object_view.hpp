@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace acceleration {
+
+// Where vertex buffers keep the positions: coordinate `axis` of vertex v is
+// at axes[axis] + v * stride bytes, unaligned reads allowed. Interleaved
+// buffers and separate per-axis (SoA) arrays differ only in these.
+template <typename Coord>
+struct VertexLayout {
+  const std::byte* axes[3]    = {};
+  size_t           stride     = 0;  // bytes
+  size_t           n_vertices = 0;
+
+  // x, y and z next to each other at `position`, a vertex every `stride`
+  // bytes: the position attribute of a vertex buffer.
+  [[nodiscard]] static VertexLayout interleaved(const void* position,
+      const size_t stride, const size_t n_vertices) {
+    const auto* base = static_cast<const std::byte*>(position);
+    return {{base, base + sizeof(Coord), base + 2 * sizeof(Coord)}, stride,
+        n_vertices};
+  }
+  [[nodiscard]] static VertexLayout soa(const Coord* x, const Coord* y,
+      const Coord* z, const size_t n_vertices) {
+    return {{reinterpret_cast<const std::byte*>(x),
+                reinterpret_cast<const std::byte*>(y),
+                reinterpret_cast<const std::byte*>(z)},
+        sizeof(Coord), n_vertices};
+  }
+};
+
+// Non-owning input of a BVHTree: the objects of a vector, of any contiguous
+// array, or triangles assembled from vertex buffers and an optional index
+// buffer (three indexes a triangle). Nothing is copied; the viewed memory
+// must outlive the tree and keep its size.
+//
+// Objects of vertex buffers are rebuilt on every access, so queries over
+// them pay for the assembly to spare the copy of the scene.
+template <typename ObjT>
+class ObjectView {
+ public:
+  using Vertex = std::remove_cvref_t<decltype(std::declval<ObjT>().a)>;
+  using Coord  = std::remove_cvref_t<decltype(std::declval<ObjT>().a.x)>;
+
+  // Follows the vector as it is now: refit() notices it was resized.
+  ObjectView(std::vector<ObjT>& objects) : vector(&objects) {}
+  explicit ObjectView(std::span<const ObjT> objects)
+      : objects(objects.data()), n_objects(objects.size()) {}
+  // Triangle t is indices[3t..3t+2] or, without indices, vertices 3t..3t+2.
+  // Throws std::length_error if the count isn't a multiple of 3 and
+  // std::out_of_range for an index past the vertices.
+  explicit ObjectView(const VertexLayout<Coord>& vertices,
+      std::span<const uint32_t> indices = {});
+
+  [[nodiscard]] size_t size() const {
+    return vector ? vector->size() : n_objects;
+  }
+  [[nodiscard]] bool empty() const { return size() == 0; }
+
+  [[nodiscard]] ObjT operator[](const size_t i) const {
+    if (vector) { return (*vector)[i]; }
+    if (objects) { return objects[i]; }
+    return assemble(i);
+  }
+
+  // The objects as one array; nullptr for vertex buffers.
+  [[nodiscard]] const ObjT* data() const {
+    return vector ? vector->data() : objects;
+  }
+
+ private:
+  const std::vector<ObjT>* vector    = nullptr;
+  const ObjT*              objects   = nullptr;
+  size_t                   n_objects = 0;
+  VertexLayout<Coord>      layout;
+  const uint32_t*          indices = nullptr;
+
+  [[nodiscard]] Vertex vertex(const size_t v) const {
+    Coord xyz[3];
+    for (size_t axis = 0; axis < 3; ++axis) {
+      std::memcpy(&xyz[axis], layout.axes[axis] + v * layout.stride,
+          sizeof(Coord));
+    }
+    return Vertex{xyz[0], xyz[1], xyz[2]};
+  }
+  [[nodiscard]] ObjT assemble(const size_t i) const {
+    if (!indices) {
+      return ObjT(vertex(3 * i), vertex(3 * i + 1), vertex(3 * i + 2));
+    }
+    return ObjT(vertex(indices[3 * i]), vertex(indices[3 * i + 1]),
+        vertex(indices[3 * i + 2]));
+  }
+};
+
+template <typename ObjT>
+ObjectView<ObjT>::ObjectView(
+    const VertexLayout<Coord>& vertices, std::span<const uint32_t> indices)
+    : layout(vertices), indices(indices.empty() ? nullptr : indices.data()) {
+  const size_t n_corners = indices.empty() ? vertices.n_vertices
+                                           : indices.size();
+  if (n_corners % 3 != 0) {
+    throw std::length_error(
+        std::to_string(n_corners) + " vertices don't make whole triangles");
+  }
+  for (const uint32_t index : indices) {
+    if (index >= vertices.n_vertices) {
+      throw std::out_of_range("Index " + std::to_string(index) + " past " +
+                              std::to_string(vertices.n_vertices) +
+                              " vertices");
+    }
+  }
+  n_objects = n_corners / 3;
+}
+
+}  // namespace acceleration
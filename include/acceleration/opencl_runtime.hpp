@@ -0,0 +1,251 @@
+#pragma once
+
+#ifdef USE_OPENCL
+
+#include <CL/opencl.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace acceleration {
+
+struct CLMem;
+struct CLKernel;
+struct CLEvent;
+struct CLPinned;
+
+// Counters of CLRuntime::build_program() outcomes, for tests and logs.
+struct CLProgramCacheStats {
+  size_t n_disk_hits     = 0;  // loaded from a cached binary
+  size_t n_source_builds = 0;  // compiled from source
+  size_t n_disk_writes   = 0;  // binaries stored after a source build
+};
+
+// Process-wide OpenCL device, context and queues, set up once on first use
+// instead of on every build. Kernels run on queue(), copies on
+// transfer_queue(), so a copy can overlap a kernel it doesn't depend on;
+// both queues record profiling times. Programs are compiled once per
+// process and their binaries are kept on disk, keyed by device, driver and
+// source, so later runs skip the compiler.
+//
+// TRIANGLES_CL_DEVICE picks the device type: "auto" (default: a GPU, else
+// a CPU device), "gpu", "cpu" or "any". TRIANGLES_CL_CACHE overrides the
+// binary cache directory, an empty value disables it; the default is
+// $XDG_CACHE_HOME/triangles/opencl or ~/.cache/triangles/opencl.
+class CLRuntime {
+ public:
+  ~CLRuntime();
+
+  CLRuntime(const CLRuntime&)            = delete;
+  CLRuntime& operator=(const CLRuntime&) = delete;
+
+  // Never throws: a setup that failed is remembered and reported by
+  // require(), so a machine without a device pays for the probe only once.
+  static CLRuntime& instance();
+  // instance(), or std::runtime_error with the reason it is unusable.
+  static CLRuntime& require();
+
+  [[nodiscard]] bool               is_available() const { return valid; }
+  [[nodiscard]] const std::string& error() const { return setup_error; }
+  [[nodiscard]] const std::string& device_name() const { return name; }
+  // "gpu", "cpu" or "other".
+  [[nodiscard]] const std::string& device_type() const { return type_name; }
+
+  [[nodiscard]] cl_context       context() const { return cl_ctx; }
+  [[nodiscard]] cl_command_queue queue() const { return cl_queue; }
+  [[nodiscard]] cl_command_queue transfer_queue() const {
+    return cl_copy_queue;
+  }
+  [[nodiscard]] cl_device_id device() const { return cl_device; }
+
+  // Whether `-cl-fp32-correctly-rounded-divide-sqrt` may be passed, so float
+  // division matches the host bit for bit.
+  [[nodiscard]] bool has_correctly_rounded_divide() const {
+    return correctly_rounded_divide;
+  }
+  [[nodiscard]] bool has_fp64() const { return fp64; }
+
+  // All of the below throw std::runtime_error on failure, and all but
+  // buffer() enqueue, so call them with the queue lock held.
+  [[nodiscard]] CLMem buffer(
+      cl_mem_flags flags, const size_t bytes, const void* host = nullptr);
+  // One-dimensional launch of work-items offset .. offset + n_items - 1,
+  // local size left to the driver, after the `wait` events.
+  CLEvent run(const CLKernel& kernel, const size_t n_items,
+      const std::vector<cl_event>& wait = {}, const size_t offset = 0);
+  // Non-blocking copies on the transfer queue; `host` must stay untouched
+  // until the event completes. Pinned `host` memory makes them DMA copies.
+  CLEvent write(const CLMem& dst, const size_t offset, const size_t bytes,
+      const void* host, const std::vector<cl_event>& wait = {});
+  CLEvent read(const CLMem& src, const size_t offset, const size_t bytes,
+      void* host, const std::vector<cl_event>& wait = {});
+  CLEvent fill_zero(const CLMem& dst, const size_t bytes);
+
+  // Pinned staging memory of at least `bytes`, kept across builds so
+  // repeated transfers don't pin pages again. Slots are independent; their
+  // contents are the caller's until it releases the queue lock.
+  [[nodiscard]] CLPinned& staging(const size_t slot, const size_t bytes);
+
+  // Held while enqueueing on queue(): builds may run on several threads.
+  [[nodiscard]] std::unique_lock<std::mutex> lock_queue() {
+    return std::unique_lock<std::mutex>(queue_mutex);
+  }
+
+  // Program for `source`, built on the first request and shared afterwards.
+  // Owned by the runtime.
+  [[nodiscard]] cl_program program(
+      std::string_view source, const std::string& options = "");
+  // Fresh program from the disk cache or, on a miss, from source; the
+  // binary is stored for the next run. The caller releases it.
+  [[nodiscard]] cl_program build_program(
+      std::string_view source, const std::string& options = "");
+
+  [[nodiscard]] std::filesystem::path cache_dir() const;
+  void set_cache_dir(const std::filesystem::path& dir);
+
+  [[nodiscard]] CLProgramCacheStats cache_stats() const;
+
+ private:
+  CLRuntime();
+
+  cl_context       cl_ctx        = nullptr;
+  cl_command_queue cl_queue      = nullptr;
+  cl_command_queue cl_copy_queue = nullptr;
+  cl_device_id     cl_device     = nullptr;
+
+  bool        valid                    = false;
+  bool        correctly_rounded_divide = false;
+  bool        fp64                     = false;
+  std::string setup_error;
+  std::string name;
+  std::string type_name;
+  // Platform and driver versions: part of every cache key.
+  std::string device_signature;
+
+  std::mutex                             queue_mutex;
+  std::vector<std::unique_ptr<CLPinned>> staging_buffers;  // queue_mutex
+  std::mutex                             program_mutex;  // guards `programs`
+  std::map<std::string, cl_program>      programs;
+  mutable std::mutex                     stats_mutex;  // guards the two below
+  std::filesystem::path                  binary_dir;
+  CLProgramCacheStats                    stats;
+
+  void setup();
+  [[nodiscard]] std::string program_key(
+      std::string_view source, const std::string& options) const;
+};
+
+// Owning handles for the objects a kernel launch creates.
+struct CLMem {
+  cl_mem handle = nullptr;
+
+  CLMem(cl_mem h) : handle(h) {}
+  CLMem(CLMem&& other) noexcept
+      : handle(std::exchange(other.handle, nullptr)) {}
+  CLMem& operator=(CLMem&& other) noexcept {
+    std::swap(handle, other.handle);
+    return *this;
+  }
+  ~CLMem() {
+    if (handle) clReleaseMemObject(handle);
+  }
+
+  CLMem(const CLMem&)            = delete;
+  CLMem& operator=(const CLMem&) = delete;
+};
+
+struct CLEvent {
+  cl_event handle = nullptr;
+
+  CLEvent() = default;
+  explicit CLEvent(cl_event h) : handle(h) {}
+  CLEvent(CLEvent&& other) noexcept
+      : handle(std::exchange(other.handle, nullptr)) {}
+  CLEvent& operator=(CLEvent&& other) noexcept {
+    std::swap(handle, other.handle);
+    return *this;
+  }
+  ~CLEvent() {
+    if (handle) clReleaseEvent(handle);
+  }
+
+  CLEvent(const CLEvent&)            = delete;
+  CLEvent& operator=(const CLEvent&) = delete;
+
+  // Blocks until the command has completed; throws if it failed.
+  void wait() const;
+  // Device clock at the start and end of a completed command, in ns.
+  [[nodiscard]] uint64_t start_ns() const;
+  [[nodiscard]] uint64_t end_ns() const;
+};
+
+// Page-locked host memory: a CL_MEM_ALLOC_HOST_PTR buffer mapped for its
+// whole life. Only its host side is used, as the source or target of
+// copies into device buffers.
+struct CLPinned {
+  CLMem            mem;
+  cl_command_queue queue = nullptr;
+  void*            host  = nullptr;
+  size_t           bytes = 0;
+
+  CLPinned(CLRuntime& runtime, const size_t bytes_);
+  ~CLPinned();
+
+  CLPinned(const CLPinned&)            = delete;
+  CLPinned& operator=(const CLPinned&) = delete;
+
+  [[nodiscard]] std::byte* data() const {
+    return static_cast<std::byte*>(host);
+  }
+};
+
+struct CLKernel {
+  cl_kernel handle = nullptr;
+
+  CLKernel(cl_program program, const char* name);
+  ~CLKernel() {
+    if (handle) clReleaseKernel(handle);
+  }
+
+  CLKernel(const CLKernel&)            = delete;
+  CLKernel& operator=(const CLKernel&) = delete;
+
+  // Sets the arguments in order: cl_mem handles and scalars by value.
+  template <typename... Args>
+  void set_args(const Args&... args) const;
+
+ private:
+  void set_arg(const cl_uint idx, const size_t size, const void* value) const;
+};
+
+template <typename... Args>
+void CLKernel::set_args(const Args&... args) const {
+  cl_uint idx = 0;
+  (set_arg(idx++, sizeof(Args), &args), ...);
+}
+
+namespace detail {
+
+// FNV-1a, 64 bit: stable across runs and platforms, used for cache names.
+[[nodiscard]] constexpr uint64_t fnv1a(
+    std::string_view data, uint64_t hash = 0xcbf29ce484222325ull) {
+  for (const char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+}  // namespace detail
+
+}  // namespace acceleration
+
+#endif  // USE_OPENCL
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <vector>
+
+#include "utils/thread_pool.hpp"
+
+namespace acceleration {
+
+struct OutOfCoreConfig {
+  size_t                memory_budget = size_t{1} << 30;  // bytes per tile
+  std::filesystem::path spill_dir;  // empty: the system temporary directory
+  size_t                max_depth = 4;  // re-tiling rounds of a large tile
+};
+
+struct OutOfCoreStats {
+  size_t n_triangles        = 0;
+  size_t n_tiles            = 0;  // tiles queried
+  size_t n_spilled          = 0;  // records written, duplicates included
+  size_t max_tile_triangles = 0;
+  size_t n_oversized        = 0;  // tiles queried over the budget
+};
+
+// Rough memory of querying `n_triangles` in one tile: the triangles, their
+// global indexes, the tree and the build scratch.
+[[nodiscard]] size_t tile_memory(size_t n_triangles);
+
+// Intersection flags of the scene in `in` (the read_triangles() format)
+// without holding all of it at once. A scene within the budget is queried
+// in memory. Otherwise a first streaming pass spills the triangles to disk
+// and takes their bounds. The spill is cut into a grid of tiles, and each
+// triangle is written to every tile its box touches. A tile over the budget
+// is cut again, up to `max_depth` times or while cutting still shrinks it.
+// The tiles are built and queried one at a time, and their flags are merged
+// into the global ones. Intersecting triangles share a tile, so the flags
+// are the in-memory ones. Throws std::runtime_error if the spill can't be
+// written.
+[[nodiscard]] std::vector<bool> find_intersections_out_of_core(
+    std::istream& in, const OutOfCoreConfig& config = {},
+    OutOfCoreStats*    stats = nullptr,
+    utils::ThreadPool& pool  = utils::ThreadPool::instance());
+
+// The triangles.x configuration: set by TRIANGLES_MEMORY_BUDGET (bytes,
+// with an optional K, M or G suffix) and TRIANGLES_SPILL_DIR; empty when
+// the budget isn't set.
+[[nodiscard]] std::optional<OutOfCoreConfig> default_out_of_core_config();
+
+}  // namespace acceleration
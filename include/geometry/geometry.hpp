@@ -1,7 +1,9 @@
 #pragma once
 
-#include "line.hpp"       // IWYU pragma: export
-#include "plane.hpp"      // IWYU pragma: export
-#include "section.hpp"    // IWYU pragma: export
-#include "triangle.hpp"   // IWYU pragma: export
-#include "vector_3d.hpp"  // IWYU pragma: export
\ No newline at end of file
+#include "line.hpp"        // IWYU pragma: export
+#include "plane.hpp"       // IWYU pragma: export
+#include "predicates.hpp"  // IWYU pragma: export
+#include "section.hpp"     // IWYU pragma: export
+#include "triangle.hpp"    // IWYU pragma: export
+#include "triangle_f.hpp"  // IWYU pragma: export
+#include "vector_3d.hpp"   // IWYU pragma: export
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+
+#include "vector_3d.hpp"
+
+namespace geometry {
+
+// Orientation determinants evaluated in floating point together with a bound
+// on their rounding error (Shewchuk's stage A bounds). The sign of `det` is
+// exact whenever is_certain() holds.
+struct FilteredDet {
+  double det   = 0.0;
+  double error = 0.0;
+
+  [[nodiscard]] bool is_certain() const { return std::fabs(det) > error; }
+};
+
+// orient2d > 0 when (a, b, c) turn counterclockwise, < 0 clockwise, 0 when
+// collinear.
+[[nodiscard]] FilteredDet orient2d_filter(const double ax, const double ay,
+    const double bx, const double by, const double cx, const double cy);
+
+// orient3d = (a - d) . ((b - d) x (c - d)): > 0 when d lies below the plane
+// through a, b, c seen counterclockwise from above, 0 when coplanar.
+[[nodiscard]] FilteredDet orient3d_filter(
+    const Vector3D& a, const Vector3D& b, const Vector3D& c, const Vector3D& d);
+
+// Filtered predicates with an exact fallback: the floating-point value is
+// returned when the filter proves its sign, otherwise the determinant is
+// re-evaluated in exact expansion arithmetic. The sign is always exact, the
+// magnitude only approximates the determinant.
+[[nodiscard]] double orient2d(const double ax, const double ay,
+    const double bx, const double by, const double cx, const double cy);
+[[nodiscard]] double orient3d(
+    const Vector3D& a, const Vector3D& b, const Vector3D& c, const Vector3D& d);
+
+}  // namespace geometry
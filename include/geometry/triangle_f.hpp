@@ -0,0 +1,34 @@
+#pragma once
+
+#include "triangle.hpp"
+#include "vector_3d.hpp"
+
+namespace geometry {
+
+// Compact float32 copy of a Triangle for the BVH input: half the footprint,
+// so traversal and leaf scans move half the bytes. The narrowphase runs a
+// float-precision separating-plane filter first and promotes the pair to
+// double Triangles only when the filter can't decide, so the answers are the
+// same as for the double triangles built from the same coordinates.
+class TriangleF {
+ public:
+  Vector3F a;
+  Vector3F b;
+  Vector3F c;
+
+  TriangleF(const Vector3F& a, const Vector3F& b, const Vector3F& c);
+
+  [[nodiscard]] Triangle to_triangle() const;
+  [[nodiscard]] Vector3D get_centre() const;
+
+  [[nodiscard]] bool is_valid() const;
+  [[nodiscard]] bool is_degenerate() const { return degenerate; }
+  [[nodiscard]] bool is_intersect(const TriangleF& other) const;
+
+ private:
+  // The double Triangle is a point or a section: such pairs take other
+  // branches of Triangle::is_intersect, so they always go to the double test.
+  bool degenerate = false;
+};
+
+}  // namespace geometry
@@ -1,38 +1,215 @@
 #pragma once
 
 #include <cassert>
+#include <cmath>
 #include <cstddef>
+#include <iostream>
+#include <type_traits>
+
+#include "math/math.hpp"
 
 namespace geometry {
 
-struct Vector3D {
-  double x = 0.0;
-  double y = 0.0;
-  double z = 0.0;
+// Checking policies of BasicVector3D. CheckedPolicy asserts that every
+// operand is finite, UncheckedPolicy compiles the checks away so the
+// arithmetic inlines down to plain floating-point operations.
+struct CheckedPolicy {
+  static constexpr bool enabled = true;
+
+  static constexpr void check(const bool is_ok) {
+    assert(is_ok);
+    (void)is_ok;
+  }
+};
+
+struct UncheckedPolicy {
+  static constexpr bool enabled = false;
+
+  static constexpr void check(const bool) {}
+};
+
+#ifdef NDEBUG
+using DefaultCheckPolicy = UncheckedPolicy;
+#else
+using DefaultCheckPolicy = CheckedPolicy;
+#endif  // NDEBUG
+
+// Storage scalar is a template parameter: double for the narrowphase, float
+// for the compact copies the BVH keeps (see TriangleF and AABB).
+template <typename T, typename CheckPolicy = DefaultCheckPolicy>
+struct BasicVector3D {
+  static_assert(std::is_floating_point_v<T>);
+
+  T x = 0;
+  T y = 0;
+  T z = 0;
 
-  Vector3D() = default;
-  Vector3D(double x, double y, double z) : x(x), y(y), z(z) {}
+  constexpr BasicVector3D() = default;
+  constexpr BasicVector3D(T x, T y, T z) : x(x), y(y), z(z) {}
 
-  [[nodiscard]] bool is_valid() const;
+  // Widening or narrowing copy; float -> double is exact.
+  template <typename U, typename P>
+  constexpr explicit BasicVector3D(const BasicVector3D<U, P>& other)
+      : x(static_cast<T>(other.x)),
+        y(static_cast<T>(other.y)),
+        z(static_cast<T>(other.z)) {}
+
+  [[nodiscard]] constexpr bool is_valid() const {
+    return std::isfinite(x) && std::isfinite(y) && std::isfinite(z);
+  }
   [[nodiscard]] bool is_zero(double scale = 1.0) const;
-  [[nodiscard]] bool is_collinear(const Vector3D& other) const;
-  [[nodiscard]] bool is_codirected(const Vector3D& other) const;
-  [[nodiscard]] bool is_match(const Vector3D& other) const;
+  [[nodiscard]] bool is_collinear(const BasicVector3D& other) const;
+  [[nodiscard]] bool is_codirected(const BasicVector3D& other) const;
+  [[nodiscard]] bool is_match(const BasicVector3D& other) const;
+
+  [[nodiscard]] T           length() const;
+  [[nodiscard]] constexpr T scalar(const BasicVector3D& other) const;
+
+  constexpr T&       operator[](size_t idx);
+  constexpr const T& operator[](size_t idx) const;
+
+  [[nodiscard]] constexpr BasicVector3D cross(const BasicVector3D& other) const;
 
-  [[nodiscard]] double length() const;
-  [[nodiscard]] double scalar(const Vector3D& other) const;
+  void print() const;
+};
+
+// Four-lane layout for acceleration structures: the vector is padded with a
+// zero lane and aligned to the lane block, so SIMD code can move it with a
+// single aligned load. Arithmetic goes through the BasicVector3D base.
+template <typename T, typename CheckPolicy = DefaultCheckPolicy>
+struct alignas(4 * sizeof(T)) BasicPaddedVector3D
+    : BasicVector3D<T, CheckPolicy> {
+  using BasicVector3D<T, CheckPolicy>::BasicVector3D;
 
-  double&       operator[](size_t idx);
-  const double& operator[](size_t idx) const;
+  constexpr BasicPaddedVector3D() = default;
+  constexpr BasicPaddedVector3D(const BasicVector3D<T, CheckPolicy>& v)
+      : BasicVector3D<T, CheckPolicy>(v) {}
 
-  [[nodiscard]] Vector3D cross(const Vector3D& other) const;
+  T pad = 0;
 };
 
-Vector3D operator+(const Vector3D& lhs, const Vector3D& rhs);
-Vector3D operator-(const Vector3D& lhs, const Vector3D& rhs);
-Vector3D operator*(const Vector3D& v, double scalar);
-Vector3D operator*(double scalar, const Vector3D& v);
-Vector3D operator/(const Vector3D& v, double scalar);
-Vector3D operator/(double scalar, const Vector3D& v);
+using Vector3D       = BasicVector3D<double>;
+using Vector3F       = BasicVector3D<float>;
+using PaddedVector3F = BasicPaddedVector3D<float>;
+
+template <typename T, typename P>
+constexpr BasicVector3D<T, P> operator+(
+    const BasicVector3D<T, P>& lhs, const BasicVector3D<T, P>& rhs) {
+  P::check(lhs.is_valid() && rhs.is_valid());
+  return {lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z};
+}
+
+template <typename T, typename P>
+constexpr BasicVector3D<T, P> operator-(
+    const BasicVector3D<T, P>& lhs, const BasicVector3D<T, P>& rhs) {
+  P::check(lhs.is_valid() && rhs.is_valid());
+  return {lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z};
+}
+
+template <typename T, typename P>
+constexpr BasicVector3D<T, P> operator*(
+    const BasicVector3D<T, P>& v, std::type_identity_t<T> scalar) {
+  P::check(v.is_valid());
+  return {v.x * scalar, v.y * scalar, v.z * scalar};
+}
+
+template <typename T, typename P>
+constexpr BasicVector3D<T, P> operator*(
+    std::type_identity_t<T> scalar, const BasicVector3D<T, P>& v) {
+  P::check(v.is_valid());
+  return {v.x * scalar, v.y * scalar, v.z * scalar};
+}
+
+template <typename T, typename P>
+constexpr BasicVector3D<T, P> operator/(
+    const BasicVector3D<T, P>& v, std::type_identity_t<T> scalar) {
+  P::check(v.is_valid() && !math::is_zero(scalar));
+  return v * (T{1} / scalar);
+}
+
+template <typename T, typename P>
+constexpr BasicVector3D<T, P> operator/(
+    std::type_identity_t<T> scalar, const BasicVector3D<T, P>& v) {
+  P::check(v.is_valid() && !math::is_zero(scalar));
+  return v * (T{1} / scalar);
+}
+
+template <typename T, typename P>
+constexpr T& BasicVector3D<T, P>::operator[](size_t idx) {
+  P::check(this->is_valid());
+  assert(idx < 3);
+  if (idx == 0) { return x; }
+  if (idx == 1) { return y; }
+  return z;
+}
+
+template <typename T, typename P>
+constexpr const T& BasicVector3D<T, P>::operator[](size_t idx) const {
+  P::check(this->is_valid());
+  assert(idx < 3);
+  if (idx == 0) { return x; }
+  if (idx == 1) { return y; }
+  return z;
+}
+
+template <typename T, typename P>
+bool BasicVector3D<T, P>::is_collinear(const BasicVector3D& other) const {
+  P::check(this->is_valid());
+  P::check(other.is_valid());
+
+  const double scale = this->length() * other.length();
+  return ((this->cross(other)).is_zero(scale));
+}
+
+template <typename T, typename P>
+bool BasicVector3D<T, P>::is_codirected(const BasicVector3D& other) const {
+  P::check(this->is_valid());
+  P::check(other.is_valid());
+  return (is_collinear(other) && this->scalar(other) >= 0.0f);
+}
+
+template <typename T, typename P>
+bool BasicVector3D<T, P>::is_match(const BasicVector3D& other) const {
+  P::check(this->is_valid());
+  P::check(other.is_valid());
+  return ((*this - other).is_zero());
+}
+
+template <typename T, typename P>
+bool BasicVector3D<T, P>::is_zero(double scale) const {
+  P::check(this->is_valid());
+  return (math::is_zero(length(), scale));
+}
+
+template <typename T, typename P>
+T BasicVector3D<T, P>::length() const {
+  P::check(this->is_valid());
+  return (std::sqrt(x * x + y * y + z * z));
+}
+
+template <typename T, typename P>
+constexpr T BasicVector3D<T, P>::scalar(const BasicVector3D& other) const {
+  P::check(this->is_valid());
+  P::check(other.is_valid());
+  return (x * other.x + y * other.y + z * other.z);
+}
+
+template <typename T, typename P>
+constexpr BasicVector3D<T, P> BasicVector3D<T, P>::cross(
+    const BasicVector3D& other) const {
+  P::check(this->is_valid());
+  P::check(other.is_valid());
+
+  T i = (y * other.z) - (z * other.y);
+  T j = (z * other.x) - (x * other.z);
+  T k = (x * other.y) - (y * other.x);
+
+  return {i, j, k};
+}
+
+template <typename T, typename P>
+void BasicVector3D<T, P>::print() const {
+  std::cout << "(" << x << ", " << y << ", " << z << ")";
+}
 
-}  // namespace geometry
\ No newline at end of file
+}  // namespace geometry
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace server::detail {
+
+// Smallest step by which read_bytes() grows its output.
+inline constexpr size_t min_read_growth = size_t{1} << 20;
+
+// Buffered reads and complete writes on a stream: a connected socket, or a
+// pipe. `buffer` holds what was received past the last line or payload.
+class Channel {
+ public:
+  Channel(const int fd_, std::string& buffer_) : fd(fd_), buffer(buffer_) {}
+
+  // The next line without its '\n'; false at the end of the stream, on an
+  // error or when no '\n' comes within `max_line` bytes.
+  bool read_line(std::string& line, const size_t max_line) {
+    size_t end = 0;
+    while ((end = buffer.find('\n')) == std::string::npos) {
+      if (buffer.size() > max_line || !fill()) { return false; }
+    }
+    line.assign(buffer, 0, end);
+    buffer.erase(0, end + 1);
+    return true;
+  }
+
+  // Large payloads are received straight into `out`, which grows with what
+  // has arrived rather than with what the peer announced.
+  bool read_bytes(const size_t n, std::string& out) {
+    out = std::move(buffer);
+    buffer.clear();
+    if (out.size() >= n) {
+      buffer.assign(out, n);
+      out.resize(n);
+      return true;
+    }
+
+    size_t have = out.size();
+    while (have < n) {
+      if (have == out.size()) {
+        out.resize(std::min(n, std::max(2 * have, min_read_growth)));
+      }
+      const ssize_t got = ::read(fd, out.data() + have, out.size() - have);
+      if (got < 0 && errno == EINTR) { continue; }
+      if (got <= 0) { return false; }
+      have += static_cast<size_t>(got);
+    }
+    return true;
+  }
+
+  // A closed peer is an error, not a SIGPIPE: sockets are written with
+  // MSG_NOSIGNAL, and only pipes with plain write().
+  bool write_all(std::string_view data) {
+    while (!data.empty()) {
+      ssize_t sent = 0;
+      if (is_socket) {
+        sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0 && errno == ENOTSOCK) {
+          is_socket = false;
+          continue;
+        }
+      } else {
+        sent = ::write(fd, data.data(), data.size());
+      }
+      if (sent < 0 && errno == EINTR) { continue; }
+      if (sent <= 0) { return false; }
+      data.remove_prefix(static_cast<size_t>(sent));
+    }
+    return true;
+  }
+
+ private:
+  int          fd;
+  std::string& buffer;
+  bool         is_socket = true;
+
+  bool fill() {
+    char chunk[1 << 16];
+    while (true) {
+      const ssize_t got = ::read(fd, chunk, sizeof(chunk));
+      if (got < 0 && errno == EINTR) { continue; }
+      if (got <= 0) { return false; }
+      buffer.append(chunk, static_cast<size_t>(got));
+      return true;
+    }
+  }
+};
+
+}  // namespace server::detail
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "utils/arena.hpp"
+#include "utils/thread_pool.hpp"
+
+namespace server {
+
+// Text protocol over a Unix stream socket. A request is one line,
+// `COMMAND [payload bytes]`, followed by exactly that many bytes of payload.
+// A reply is `OK <k>` followed by k lines, or a single `ERR <message>` line.
+//   LOAD <bytes>   payload in the triangles.x input format; replaces the
+//                  scene, the one line is its triangle count
+//   QUERY <bytes>  same format; indexes of the given triangles that
+//                  intersect the scene
+//   FLAGS          scene triangles intersecting another one, i.e. the
+//                  triangles.x output
+//   STATS          `name value` lines
+//   PING           nothing
+//   SHUTDOWN       nothing; the server stops after replying
+// Payloads over max_payload_bytes end the connection; buffers grow with
+// the bytes that actually arrive, not with the size a request announces.
+inline constexpr size_t max_request_line  = 256;
+inline constexpr size_t max_payload_bytes = size_t{1} << 30;
+
+// TRIANGLES_SOCKET, else triangles.sock in $XDG_RUNTIME_DIR, else in the
+// temporary directory.
+[[nodiscard]] std::filesystem::path default_socket_path();
+
+struct Reply {
+  bool                     ok = false;
+  std::string              error;  // set when !ok
+  std::vector<std::string> lines;
+};
+
+class Scene;
+
+// Keeps one scene (its triangles, BVH and intersection flags) resident and
+// answers requests from any number of local clients. Each connection is
+// served on its own thread; the queries themselves run on the pool. LOAD
+// swaps in a new scene while requests on the old one finish.
+class SceneServer {
+ public:
+  // Listens on `socket_path`, replacing a stale socket file there. Throws
+  // std::runtime_error if the socket can't be set up.
+  explicit SceneServer(std::filesystem::path socket_path,
+      utils::ThreadPool& pool = utils::ThreadPool::instance());
+  // run() must have returned.
+  ~SceneServer();
+
+  SceneServer(const SceneServer&)            = delete;
+  SceneServer& operator=(const SceneServer&) = delete;
+
+  // Accepts connections until stop() or a SHUTDOWN request, then removes
+  // the socket, closes the connections and returns.
+  void run();
+  // Async-signal-safe: only sets a flag and wakes run().
+  void stop();
+
+  [[nodiscard]] const std::filesystem::path& path() const {
+    return socket_path;
+  }
+
+ private:
+  struct Connection {
+    int               fd = -1;
+    std::thread       thread;
+    std::atomic<bool> done{false};
+  };
+
+  std::filesystem::path socket_path;
+  utils::ThreadPool&    pool;
+  int                   listen_fd   = -1;
+  int                   wake_fds[2] = {-1, -1};
+  std::atomic<bool>     stopping{false};
+
+  std::mutex                   scene_mutex;
+  std::shared_ptr<const Scene> scene;  // scene_mutex
+
+  // LOADs build one at a time, with the scratch kept between them.
+  std::mutex   build_mutex;
+  utils::Arena build_arena;
+
+  std::list<Connection> connections;  // touched by run() only
+
+  const std::chrono::steady_clock::time_point started =
+      std::chrono::steady_clock::now();
+  std::atomic<size_t> n_connections{0};
+  std::atomic<size_t> n_requests{0};
+  std::atomic<size_t> n_loads{0};
+  std::atomic<size_t> n_queries{0};  // query triangles answered
+
+  void close_listener();
+  void serve(Connection& connection);
+  // The reply to one request, serialized.
+  [[nodiscard]] std::string handle(
+      std::string_view command, std::string_view payload);
+  [[nodiscard]] std::shared_ptr<const Scene> current_scene();
+};
+
+// Blocking client of a SceneServer, one request at a time.
+class SceneClient {
+ public:
+  // Throws std::runtime_error if nothing listens on `socket_path`.
+  explicit SceneClient(const std::filesystem::path& socket_path);
+  ~SceneClient();
+
+  SceneClient(const SceneClient&)            = delete;
+  SceneClient& operator=(const SceneClient&) = delete;
+
+  // Sends `command` with `payload` (if any) and waits for the reply. Throws
+  // std::runtime_error if the connection breaks; ERR replies are returned.
+  [[nodiscard]] Reply request(
+      std::string_view command, std::string_view payload = {});
+
+ private:
+  int         fd = -1;
+  std::string buffer;  // bytes received past the last reply
+};
+
+}  // namespace server
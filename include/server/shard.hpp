@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "geometry/triangle_f.hpp"
+#include "utils/thread_pool.hpp"
+
+namespace server {
+
+// Binary protocol between a shard coordinator and its workers, over any
+// byte stream: a socket pair to a local process here, a TCP connection to
+// another machine just as well. A message is a line `COMMAND <bytes>`
+// followed by exactly that many bytes of payload.
+//   SHARD <bytes>  to a worker: a ShardHeader, then 9 floats per triangle,
+//                  the owned triangles first and their ghosts after
+//   FLAGS <bytes>  the reply: one bit per owned triangle, bit i % 8 of
+//                  byte i / 8
+//   ERR <bytes>    the reply when the shard couldn't be queried: a message
+// Numbers are in the coordinator's byte order; a worker of the other order
+// sees a wrong magic and refuses the shard. A worker serves shards until
+// its input ends.
+inline constexpr uint32_t shard_magic            = 0x44524853;  // "SHRD"
+inline constexpr uint32_t shard_protocol_version = 1;
+inline constexpr size_t   max_shard_line         = 256;
+// Larger messages break the stream: 64 GiB, about 1.9e9 triangles.
+inline constexpr size_t   max_shard_bytes        = size_t{1} << 36;
+
+struct ShardHeader {
+  uint32_t magic    = shard_magic;
+  uint32_t version  = shard_protocol_version;
+  uint64_t n_owned  = 0;
+  uint64_t n_ghosts = 0;
+};
+static_assert(sizeof(ShardHeader) == 24);
+
+struct ShardConfig {
+  size_t n_shards = 2;
+  // argv of a worker process; empty: this executable with --shard-worker.
+  std::vector<std::string> worker_command;
+  // TRIANGLES_THREADS of each worker; 0: the hardware threads split evenly.
+  size_t threads_per_worker = 0;
+};
+
+struct ShardStats {
+  size_t n_shards            = 0;
+  size_t n_ghosts            = 0;  // over all shards
+  size_t max_shard_triangles = 0;  // owned and ghosts
+};
+
+namespace detail {
+
+// Scene indexes of the triangles each shard owns and of its ghosts.
+struct ShardPlan {
+  std::vector<std::vector<uint64_t>> owned;
+  std::vector<std::vector<uint64_t>> ghosts;
+};
+
+// Shards of about equal size, split at the median centroid along the
+// longest side, recursively. A shard's ghosts are the other triangles whose
+// eps-grown boxes overlap the grown boxes of its own, so every pair the
+// tree could report for an owned triangle is inside its shard.
+[[nodiscard]] ShardPlan plan_shards(
+    const std::vector<geometry::TriangleF>& scene, size_t n_shards,
+    utils::ThreadPool& pool = utils::ThreadPool::instance());
+
+}  // namespace detail
+
+// Intersection flags of `scene` from worker processes, one per shard. Each
+// builds a BVHTree over its shard and the ghosts and sends back the flags
+// of the triangles it owns, which the coordinator merges; every triangle
+// has one owner, so the flags are those of a single tree. Throws
+// std::runtime_error if a worker can't be started or fails.
+[[nodiscard]] std::vector<bool> find_intersections_sharded(
+    const std::vector<geometry::TriangleF>& scene, const ShardConfig& config,
+    ShardStats*        stats = nullptr,
+    utils::ThreadPool& pool  = utils::ThreadPool::instance());
+
+// The worker side: answers SHARD messages read from `in_fd` on `out_fd`
+// until the input ends. Returns 0, or 1 if the stream broke off mid-message
+// or had a malformed line or a message over max_shard_bytes.
+int serve_shards(int in_fd, int out_fd,
+    utils::ThreadPool& pool = utils::ThreadPool::instance());
+
+// The triangles.x configuration: TRIANGLES_SHARDS worker processes; empty
+// when unset.
+[[nodiscard]] std::optional<ShardConfig> default_shard_config();
+
+}  // namespace server
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace utils {
+
+// Huge pages are 2 MiB on the platforms we run on; huge-page blocks are
+// rounded up to them.
+inline constexpr size_t huge_page_size  = size_t{2} << 20;
+inline constexpr size_t min_arena_block = size_t{64} << 10;
+
+struct ArenaConfig {
+  size_t initial_bytes = 0;      // first block, taken on first use
+  bool   huge_pages    = false;  // back blocks by huge pages where possible
+};
+
+// Since the last Arena::reset(). Nothing is freed in between, so the peak
+// is everything handed out.
+struct ArenaStats {
+  size_t n_allocations = 0;
+  size_t peak_bytes    = 0;  // alignment padding included
+  size_t n_blocks      = 0;  // blocks taken from the system
+  size_t capacity      = 0;  // bytes of all blocks held
+};
+
+// Monotonic memory resource for build scratch: allocation bumps a pointer,
+// deallocation is a no-op, and reset() takes everything back at once while
+// keeping the memory, merged into one block, so a process repeating builds
+// of similar size stops touching the heap after the first one. Allocation
+// is thread-safe; reset() must not race with it.
+class Arena final : public std::pmr::memory_resource {
+ public:
+  explicit Arena(const ArenaConfig& config = {});
+  ~Arena() override;
+
+  Arena(const Arena&)            = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Invalidates every allocation and starts new stats.
+  void reset();
+
+  [[nodiscard]] ArenaStats stats() const;
+  // Whether the blocks actually got huge pages (explicit or transparent).
+  [[nodiscard]] bool has_huge_pages() const;
+
+ private:
+  struct Block {
+    std::byte* data   = nullptr;
+    size_t     size   = 0;
+    bool       mapped = false;  // mmap'ed, else operator new
+    bool       huge   = false;
+  };
+
+  ArenaConfig        config;
+  mutable std::mutex mutex;
+  std::vector<Block> blocks;
+  size_t             used = 0;  // bytes of blocks.back()
+  ArenaStats         current;
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void  do_deallocate(void*, size_t, size_t) override {}
+  bool  do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  [[nodiscard]] Block allocate_block(size_t size) const;
+  static void         free_block(const Block& block);
+};
+
+}  // namespace utils
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string_view>
+
+namespace utils {
+
+// Per-user cache directory of the project: $XDG_CACHE_HOME/triangles or
+// ~/.cache/triangles; empty when neither variable is set.
+[[nodiscard]] std::filesystem::path cache_root();
+
+// Writes `data` through a temporary file and a rename, so a concurrent
+// reader never sees a half-written file. Creates the parent directories.
+bool write_file_atomic(
+    const std::filesystem::path& path, std::string_view data);
+// Same, with the contents streamed by `write`.
+bool write_file_atomic(const std::filesystem::path& path,
+    const std::function<void(std::ostream&)>& write);
+
+}  // namespace utils
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace utils {
+
+// Hint value meaning "no preference": the task goes to the submitting
+// worker's own deque, or round-robin when submitted from outside the pool.
+inline constexpr size_t any_worker = std::numeric_limits<size_t>::max();
+
+struct ThreadPoolConfig {
+  size_t n_workers   = 0;      // 0: one per hardware thread
+  bool   pin_workers = false;  // bind worker i to CPU i (Linux only)
+};
+
+// Worker count of ThreadPool::instance(): TRIANGLES_THREADS if it is set to a
+// positive number, the hardware concurrency otherwise.
+[[nodiscard]] size_t default_worker_count();
+
+class TaskGroup;
+
+// Work-stealing fork-join scheduler shared by the build, query and I/O
+// stages. Every worker owns a deque: forked tasks are pushed and popped at its
+// back, idle workers steal from the front of the others. A thread waiting on
+// a TaskGroup runs pending tasks instead of blocking, so fork-join nests
+// without deadlocks. A pool of one worker starts no threads at all and runs
+// every task on the submitting thread.
+class ThreadPool {
+ public:
+  explicit ThreadPool(const ThreadPoolConfig& config = {});
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&)            = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Process-wide pool, created on first use with default_worker_count().
+  static ThreadPool& instance();
+
+  [[nodiscard]] size_t size() const { return n_workers; }
+  [[nodiscard]] bool   is_serial() const { return threads.empty(); }
+
+  // Calls fn(lo, hi) for consecutive ranges of at most `grain` indices
+  // covering [begin, end) and returns when all of them are done. Range k is
+  // hinted to worker k * size() / n_ranges, so loops repeated over the same
+  // data keep each slice on the same worker.
+  template <typename Fn>
+  void parallel_for(
+      const size_t begin, const size_t end, const size_t grain, Fn&& fn);
+
+ private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> fn;
+    TaskGroup*            group = nullptr;
+  };
+
+  struct Queue {
+    std::mutex       mutex;
+    std::deque<Task> tasks;
+  };
+
+  size_t                              n_workers = 1;
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread>            threads;
+
+  std::atomic<size_t>     n_queued{0};
+  std::atomic<size_t>     next_queue{0};
+  std::mutex              sleep_mutex;
+  std::condition_variable wake_up;
+  std::condition_variable joiners;
+  bool                    stopping = false;
+
+  void push(Task task, const size_t hint);
+  // Runs one pending task, own deque first, then stealing. False if there
+  // was nothing to run.
+  bool try_run_one();
+  void worker_loop(const size_t worker_idx, const bool pin);
+  // Wakes the threads sleeping in TaskGroup::join().
+  void wake_joiners();
+};
+
+// Fork-join handle: run() forks a task into the pool, wait() joins all tasks
+// forked so far and rethrows the first exception one of them threw.
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool& pool = ThreadPool::instance()) : pool(pool) {}
+  ~TaskGroup() { join(); }
+
+  TaskGroup(const TaskGroup&)            = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  template <typename Fn>
+  void run(Fn&& fn, const size_t hint = any_worker);
+  void wait();
+
+ private:
+  friend class ThreadPool;
+
+  ThreadPool&             pool;
+  std::atomic<size_t>     pending{0};
+  std::mutex              mutex;
+  std::exception_ptr      error;
+
+  void join();
+  void finish(std::exception_ptr task_error);
+};
+
+template <typename Fn>
+void TaskGroup::run(Fn&& fn, const size_t hint) {
+  if (pool.is_serial()) {
+    try {
+      fn();
+    } catch (...) {
+      if (!error) { error = std::current_exception(); }
+    }
+    return;
+  }
+
+  pending.fetch_add(1, std::memory_order_relaxed);
+  pool.push({std::forward<Fn>(fn), this}, hint);
+}
+
+template <typename Fn>
+void ThreadPool::parallel_for(
+    const size_t begin, const size_t end, const size_t grain, Fn&& fn) {
+  if (begin >= end) { return; }
+
+  const size_t step     = std::max<size_t>(grain, 1);
+  const size_t n_ranges = (end - begin + step - 1) / step;
+
+  if (is_serial() || n_ranges == 1) {
+    for (size_t lo = begin; lo < end; lo += step) {
+      fn(lo, std::min(end, lo + step));
+    }
+    return;
+  }
+
+  TaskGroup group(*this);
+  for (size_t k = 0; k < n_ranges; ++k) {
+    const size_t lo = begin + k * step;
+    const size_t hi = std::min(end, lo + step);
+    group.run([&fn, lo, hi] { fn(lo, hi); }, k * size() / n_ranges);
+  }
+  group.wait();
+}
+
+}  // namespace utils
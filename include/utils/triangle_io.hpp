@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "geometry/triangle_f.hpp"
+#include "utils/thread_pool.hpp"
+
+namespace utils {
+
+// Reads the triangle count and then 9 coordinates per triangle. The stream
+// is read whole, then chunks of it are parsed and the triangles (whose
+// constructor classifies degenerate ones) are built on the pool. Missing or
+// malformed coordinates read as 0, as with operator>>.
+[[nodiscard]] std::vector<geometry::TriangleF> read_triangles(
+    std::istream& in, ThreadPool& pool = ThreadPool::instance());
+
+// The read_triangles() format a batch at a time, for scenes that don't fit
+// in memory: the stream is read in blocks of a few MiB, parsed in parallel
+// on the pool, and only the coordinates asked for are kept. Gives the same
+// coordinates as read_triangles(), zeros included.
+class TriangleReader {
+ public:
+  explicit TriangleReader(
+      std::istream& in, ThreadPool& pool = ThreadPool::instance());
+
+  // Triangles announced by the count, whether the stream has them or not.
+  [[nodiscard]] size_t size() const { return tri_num; }
+  [[nodiscard]] size_t remaining() const { return tri_num - n_read; }
+
+  // Appends 9 coordinates of each of the next `max_triangles` triangles (or
+  // of the rest) to `coords`; returns how many triangles that is.
+  size_t read(std::vector<float>& coords, size_t max_triangles);
+  // Same, as triangles built on the pool.
+  [[nodiscard]] std::vector<geometry::TriangleF> read_triangles(
+      size_t max_triangles);
+
+ private:
+  std::istream&      in;
+  ThreadPool&        pool;
+  size_t             tri_num = 0;
+  size_t             n_read  = 0;
+  bool               done    = false;  // end of stream or a malformed token
+  std::string        carry;            // token cut by the last block
+  std::vector<float> values;           // parsed, not yet handed out
+  size_t             next_value = 0;
+
+  void parse_block();
+};
+
+// Indexes of the flagged triangles, one per line, formatted in parallel
+// ranges and written in order.
+void write_intersections(std::ostream& out, const std::vector<bool>& flags,
+    ThreadPool& pool = ThreadPool::instance());
+
+}  // namespace utils
@@ -1,10 +1,20 @@
-#include <cstddef>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
 #include <iostream>
+#include <string_view>
 #include <vector>
 
 #include "acceleration/acceleration.hpp"
 #include "geometry/geometry.hpp"
+#include "server/scene_server.hpp"
+#include "server/shard.hpp"
 #include "utils/logger.hpp"
+#include "utils/thread_pool.hpp"
+#include "utils/triangle_io.hpp"
 
 #ifdef ENABLE_LOGGING
 #include <spdlog/sinks/basic_file_sink.h>
@@ -12,28 +22,36 @@
 
 using namespace geometry;
 
-std::vector<Triangle> read_triangles(std::istream& in) {
-  size_t tri_num = 0;
-  if (!(in >> tri_num)) { return {}; }
-
-  std::vector<Triangle> input;
-  input.reserve(tri_num);
-
-  for (size_t i = 0; i < tri_num; ++i) {
-    std::vector<Vector3D> points;
-    points.reserve(3);
-    for (size_t j = 0; j < 3; ++j) {
-      float coords[3] = {};
-      for (size_t k = 0; k < 3; ++k) { in >> coords[k]; }
-      points.emplace_back(Vector3D{coords[0], coords[1], coords[2]});
-    }
-    input.emplace_back(Triangle{points[0], points[1], points[2]});
-  }
+namespace {
+
+server::SceneServer* running_server = nullptr;
+
+void stop_server(int) { running_server->stop(); }
 
-  return input;
+// triangles.x --serve [socket]: keeps scenes resident for
+// triangles_client.x until SIGINT, SIGTERM or a SHUTDOWN request.
+int serve(const std::filesystem::path& socket_path) {
+  try {
+    server::SceneServer scene_server(socket_path);
+    running_server = &scene_server;
+    std::signal(SIGINT, stop_server);
+    std::signal(SIGTERM, stop_server);
+
+    scene_server.run();
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    running_server = nullptr;
+  } catch (const std::exception& e) {
+    std::cerr << "triangles.x: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
 }
 
-int main() {
+}  // namespace
+
+int main(int argc, char** argv) {
 #ifdef ENABLE_LOGGING
   auto file_logger = spdlog::basic_logger_mt("file_logger", "log/app.log");
   spdlog::set_level(spdlog::level::debug);
@@ -45,16 +63,42 @@ int main() {
 
   LOG_INFO("Program started");
 
-  std::vector<Triangle> input;
+  if (argc > 1 && std::string_view(argv[1]) == "--serve") {
+    return serve(argc > 2 ? argv[2] : server::default_socket_path());
+  }
+
+  utils::ThreadPool& pool = utils::ThreadPool::instance();
 
-  input = read_triangles(std::cin);
+  // triangles.x --shard-worker: answers a sharding coordinator on stdin and
+  // stdout.
+  if (argc > 1 && std::string_view(argv[1]) == "--shard-worker") {
+    return server::serve_shards(STDIN_FILENO, STDOUT_FILENO, pool);
+  }
+
+  // TRIANGLES_MEMORY_BUDGET: scenes over it are cut into tiles on disk.
+  if (const auto config = acceleration::default_out_of_core_config()) {
+    const std::vector<bool> output =
+        acceleration::find_intersections_out_of_core(
+            std::cin, *config, nullptr, pool);
+    utils::write_intersections(std::cout, output, pool);
+    LOG_INFO("Program finished");
+    return 0;
+  }
 
-  acceleration::BVHTree<Triangle> tree{input};
+  std::vector<TriangleF> input = utils::read_triangles(std::cin, pool);
 
-  std::vector<bool> output = tree.get_intersections();
-  for (size_t i = 0; i < output.size(); ++i) {
-    if (output[i]) { std::cout << i << std::endl; }
+  std::vector<bool> output;
+  if (const auto config = server::default_shard_config()) {
+    // TRIANGLES_SHARDS: split between worker processes.
+    output = server::find_intersections_sharded(input, *config, nullptr, pool);
+  } else {
+    // TRIANGLES_BVH_CACHE=<file>: maps the tree saved there if it was built
+    // for this input, otherwise builds it and saves it for the next run.
+    const char* saved = std::getenv("TRIANGLES_BVH_CACHE");
+    output            = acceleration::find_all_intersections(
+        input, pool, saved && *saved ? saved : "");
   }
+  utils::write_intersections(std::cout, output, pool);
 
   LOG_INFO("Program finished");
 
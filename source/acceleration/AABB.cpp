@@ -9,7 +9,33 @@
 
 namespace acceleration {
 
+namespace {
+
+using detail::round_down;
+using detail::round_up;
+
+geometry::Vector3F round_down(const geometry::Vector3D& v) {
+  return {round_down(v.x), round_down(v.y), round_down(v.z)};
+}
+
+geometry::Vector3F round_up(const geometry::Vector3D& v) {
+  return {round_up(v.x), round_up(v.y), round_up(v.z)};
+}
+
+}  // namespace
+
+AABB::AABB(const geometry::Vector3D& min_, const geometry::Vector3D& max_)
+    : min(round_down(min_)), max(round_up(max_)) {}
+
 AABB::AABB(const geometry::Triangle& tri)
+    : AABB({std::fmin(std::fmin(tri.a.x, tri.b.x), tri.c.x),
+               std::fmin(std::fmin(tri.a.y, tri.b.y), tri.c.y),
+               std::fmin(std::fmin(tri.a.z, tri.b.z), tri.c.z)},
+          {std::fmax(std::fmax(tri.a.x, tri.b.x), tri.c.x),
+              std::fmax(std::fmax(tri.a.y, tri.b.y), tri.c.y),
+              std::fmax(std::fmax(tri.a.z, tri.b.z), tri.c.z)}) {}
+
+AABB::AABB(const geometry::TriangleF& tri)
     : min{std::fmin(std::fmin(tri.a.x, tri.b.x), tri.c.x),
           std::fmin(std::fmin(tri.a.y, tri.b.y), tri.c.y),
           std::fmin(std::fmin(tri.a.z, tri.b.z), tri.c.z)},
@@ -26,38 +52,94 @@ bool AABB::is_intersect(const AABB& other) const {
   assert(this->is_valid());
   assert(other.is_valid());
 
-  const geometry::Vector3D& minA = this->min;
-  const geometry::Vector3D& maxA = this->max;
-  const geometry::Vector3D& minB = other.min;
-  const geometry::Vector3D& maxB = other.max;
+  const geometry::Vector3F& minA = this->min;
+  const geometry::Vector3F& maxA = this->max;
+  const geometry::Vector3F& minB = other.min;
+  const geometry::Vector3F& maxB = other.max;
 
   return (minA.x <= maxB.x + math::eps) && (math::eps + maxA.x >= minB.x) &&
          (minA.y <= maxB.y + math::eps) && (math::eps + maxA.y >= minB.y) &&
          (minA.z <= maxB.z + math::eps) && (math::eps + maxA.z >= minB.z);
 }
 
-void AABB::expand(const geometry::Vector3D& p) {
+bool AABB::is_intersect(
+    const geometry::Triangle& tri, const double pad) const {
   assert(this->is_valid());
-  assert(p.is_valid());
+  assert(tri.is_valid());
+
+  const geometry::Vector3D lo{min};
+  const geometry::Vector3D hi{max};
+
+  const geometry::Vector3D centre = (lo + hi) * 0.5;
+  const geometry::Vector3D half =
+      (hi - lo) * 0.5 + geometry::Vector3D{pad, pad, pad};
+
+  const geometry::Vector3D v0 = tri.a - centre;
+  const geometry::Vector3D v1 = tri.b - centre;
+  const geometry::Vector3D v2 = tri.c - centre;
+
+  auto is_separating = [&](const geometry::Vector3D& axis) {
+    const double p0 = axis.scalar(v0);
+    const double p1 = axis.scalar(v1);
+    const double p2 = axis.scalar(v2);
+    const double r  = half.x * std::fabs(axis.x) + half.y * std::fabs(axis.y) +
+                     half.z * std::fabs(axis.z);
+
+    return std::fmin(std::fmin(p0, p1), p2) > r ||
+           std::fmax(std::fmax(p0, p1), p2) < -r;
+  };
+
+  for (size_t i = 0; i < 3; ++i) {
+    if (std::fmin(std::fmin(v0[i], v1[i]), v2[i]) > half[i] ||
+        std::fmax(std::fmax(v0[i], v1[i]), v2[i]) < -half[i]) {
+      return false;
+    }
+  }
+
+  const geometry::Vector3D edges[3] = {v1 - v0, v2 - v1, v0 - v2};
 
-  for (size_t i = 0; i < 3; ++i) { min[i] = std::fmin(min[i], p[i]); }
+  if (is_separating(edges[0].cross(edges[1]))) { return false; }
+
+  for (const geometry::Vector3D& e : edges) {
+    if (is_separating({0.0, -e.z, e.y}) || is_separating({e.z, 0.0, -e.x}) ||
+        is_separating({-e.y, e.x, 0.0})) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool AABB::is_intersect(
+    const geometry::TriangleF& tri, const double pad) const {
+  return is_intersect(tri.to_triangle(), pad);
 }
 
-void AABB::merge(const AABB& other) {
+void AABB::expand(const geometry::Vector3D& p) {
   assert(this->is_valid());
-  assert(other.is_valid());
+  assert(p.is_valid());
 
   for (size_t i = 0; i < 3; ++i) {
-    min[i] = std::fmin(min[i], other.min[i]);
-    max[i] = std::fmax(max[i], other.max[i]);
+    min[i] = std::fmin(min[i], round_down(p[i]));
+    max[i] = std::fmax(max[i], round_up(p[i]));
   }
 }
 
-AABB merge(const AABB& a, const AABB& b) {
-  assert(a.is_valid() && b.is_valid());
-  AABB res = a;
-  res.merge(b);
-  return res;
+AABB AABB::loosened(const double pad) const {
+  assert(this->is_valid());
+  assert(pad >= 0.0);
+
+  const geometry::Vector3D offset{pad, pad, pad};
+  return {geometry::Vector3D{min} - offset, geometry::Vector3D{max} + offset};
+}
+
+double AABB::surface_area() const {
+  assert(this->is_valid());
+
+  const double dx = static_cast<double>(max.x) - min.x;
+  const double dy = static_cast<double>(max.y) - min.y;
+  const double dz = static_cast<double>(max.z) - min.z;
+  return 2.0 * (dx * dy + dy * dz + dz * dx);
 }
 
 bool AABB::is_inside(const AABB& other) const {
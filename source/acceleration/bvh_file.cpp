@@ -0,0 +1,42 @@
+#include "acceleration/bvh_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace acceleration::detail {
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error(
+        "Can't open " + path.string() + ": " + std::strerror(errno));
+  }
+
+  struct stat info {};
+  if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::close(fd);
+    throw std::runtime_error("Can't map " + path.string() + ": empty file");
+  }
+
+  length            = static_cast<size_t>(info.st_size);
+  void* const start = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (start == MAP_FAILED) {
+    throw std::runtime_error(
+        "Can't map " + path.string() + ": " + std::strerror(errno));
+  }
+  base = static_cast<const std::byte*>(start);
+}
+
+MappedFile::~MappedFile() {
+  ::munmap(const_cast<std::byte*>(base), length);
+}
+
+}  // namespace acceleration::detail
@@ -1,8 +1,96 @@
 #include "acceleration/bvh_tree.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <utility>
+
 namespace acceleration {
 
-BVHNode::BVHNode(const AABB& box_, const size_t first_, const size_t n_objs_)
+namespace {
+
+[[nodiscard]] uint32_t expand_bits(uint32_t v) {
+  v &= 0x000003ff;
+
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+// Length of the common prefix of codes i and j, with the index breaking ties
+// between equal codes; -1 when j is out of range. Same as in lbvh.cl, where
+// the index is as wide as `Index` too.
+template <typename Index>
+[[nodiscard]] int common_prefix(
+    std::span<const uint32_t> codes, const int64_t i, const int64_t j) {
+  const int64_t n = static_cast<int64_t>(codes.size());
+  if (j < 0 || j >= n) { return -1; }
+
+  if (codes[i] == codes[j]) {
+    return 32 + std::countl_zero(static_cast<Index>(i ^ j));
+  }
+  return std::countl_zero(codes[i] ^ codes[j]);
+}
+
+// Karras' split search for internal node idx, as find_splits in lbvh.cl.
+template <typename Index>
+void find_split(std::span<const uint32_t> codes, const int64_t idx,
+    std::span<detail::LBVHNode<Index>> nodes, std::span<Index> parents) {
+  const int prefix_left  = common_prefix<Index>(codes, idx, idx - 1);
+  const int prefix_right = common_prefix<Index>(codes, idx, idx + 1);
+
+  const int64_t d          = prefix_right > prefix_left ? 1 : -1;
+  const int     prefix_min = std::min(prefix_left, prefix_right);
+
+  int64_t l_max = 2;
+  while (common_prefix<Index>(codes, idx, idx + l_max * d) > prefix_min) {
+    l_max *= 2;
+  }
+
+  int64_t l = 0;
+  for (int64_t t = l_max / 2; t >= 1; t /= 2) {
+    if (common_prefix<Index>(codes, idx, idx + (l + t) * d) > prefix_min) {
+      l += t;
+    }
+  }
+  const int64_t edge        = idx + l * d;
+  const int     prefix_node = common_prefix<Index>(codes, idx, edge);
+
+  int64_t s    = 0;
+  int64_t step = l;
+  do {
+    step = (step + 1) >> 1;
+    if (common_prefix<Index>(codes, idx, idx + (s + step) * d) > prefix_node) {
+      s += step;
+    }
+  } while (step > 1);
+
+  const int64_t split       = idx + s * d + std::min<int64_t>(d, 0);
+  const int64_t start       = std::min(edge, idx);
+  const int64_t end         = std::max(edge, idx);
+  const int64_t n_internals = static_cast<int64_t>(codes.size()) - 1;
+
+  const int64_t left  = split == start ? n_internals + split : split;
+  const int64_t right = split + 1 == end ? n_internals + split + 1 : split + 1;
+
+  nodes[idx].left_idx  = static_cast<Index>(left);
+  nodes[idx].right_idx = static_cast<Index>(right);
+  parents[left]        = static_cast<Index>(idx);
+  parents[right]       = static_cast<Index>(idx);
+}
+
+}  // namespace
+
+template <typename Index>
+BVHNode<Index>::BVHNode(
+    const AABB& box_, const Index first_, const Index n_objs_)
     : box(box_), start(first_), n_objs(n_objs_) {
   // double min_x = box.min.x;
   // double min_y = box.min.y;
@@ -17,29 +105,32 @@ BVHNode::BVHNode(const AABB& box_, const size_t first_, const size_t n_objs_)
   assert(box_.is_valid());
 }
 
-bool BVHNode::is_valid() const {
+template <typename Index>
+bool BVHNode<Index>::is_valid() const {
   if (!box.is_valid()) { return false; }
 
   if (is_leaf()) {
-    return left_idx == -1 && right_idx == -1 && n_objs > 0 &&
+    return left_idx == no_child && right_idx == no_child && n_objs > 0 &&
            n_objs <= max_leaf_cap_for_cpu;
   } else {
-    return n_objs == 0 && left_idx > -1 && right_idx > -1 &&
+    return n_objs == 0 && left_idx != no_child && right_idx != no_child &&
            left_idx != right_idx;
   }
 }
 
-void BVHNode::init_leaf(
-    const AABB& box_, const size_t start_, const size_t n_objs_) {
+template <typename Index>
+void BVHNode<Index>::init_leaf(
+    const AABB& box_, const Index start_, const Index n_objs_) {
   box       = box_;
   start     = start_;
   n_objs    = n_objs_;
-  left_idx  = -1;
-  right_idx = -1;
+  left_idx  = no_child;
+  right_idx = no_child;
 }
 
-void BVHNode::init_internal(
-    const AABB& box_, const int left_idx_, const int right_idx_) {
+template <typename Index>
+void BVHNode<Index>::init_internal(
+    const AABB& box_, const Index left_idx_, const Index right_idx_) {
   box       = box_;
   start     = 0;
   n_objs    = 0;
@@ -47,4 +138,159 @@ void BVHNode::init_internal(
   right_idx = right_idx_;
 }
 
+template struct BVHNode<uint32_t>;
+template struct BVHNode<uint64_t>;
+
+namespace detail {
+
+SubtreeSizes::SubtreeSizes(const size_t n_objs) {
+  if (n_objs > 0) { count(n_objs, 1); }
+}
+
+// Mirrors the leaf rule and the median split of BVHTree::build_node_rec_cpu.
+// A level holds at most two distinct object counts, so the memo stays tiny.
+size_t SubtreeSizes::count(const size_t n_objs, const size_t depth) {
+  const auto key = std::make_pair(n_objs, depth);
+  if (const auto it = sizes.find(key); it != sizes.end()) { return it->second; }
+
+  deepest = std::max(deepest, depth);
+
+  size_t size = 1;
+  if (n_objs > max_leaf_cap_for_cpu && depth < tree_max_depth) {
+    const size_t left_n_objs = n_objs / 2;
+    size += count(left_n_objs, depth + 1);
+    size += count(n_objs - left_n_objs, depth + 1);
+  }
+
+  sizes.emplace(key, size);
+  return size;
+}
+
+uint32_t morton_code(
+    const float point[3], const float lo[3], const float hi[3]) {
+  uint32_t cell[3];
+  for (size_t axis = 0; axis < 3; ++axis) {
+    const float extent = hi[axis] - lo[axis];
+    const float scaled = extent > 0.0f
+                             ? (point[axis] - lo[axis]) / extent *
+                                   static_cast<float>(grid_resolution)
+                             : 0.0f;
+    cell[axis] = std::min(static_cast<uint32_t>(scaled),
+        static_cast<uint32_t>(grid_resolution - 1));
+  }
+  return (expand_bits(cell[0]) << 2) | (expand_bits(cell[1]) << 1) |
+         expand_bits(cell[2]);
+}
+
+template <typename Index>
+std::pmr::vector<LBVHNode<Index>> build_lbvh_cpu(
+    const LBVHInput& input, std::pmr::memory_resource* scratch) {
+  const size_t n = input.size();
+  if (n == 0) { return std::pmr::vector<LBVHNode<Index>>(scratch); }
+
+  const std::pmr::vector<float>& lower = input.lower;
+  const std::pmr::vector<float>& upper = input.upper_bounds();
+
+  std::pmr::vector<float> centroids(3 * n, scratch);
+  float                   lo[3] = {INFINITY, INFINITY, INFINITY};
+  float                   hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      const float c = (lower[9 * i + axis] + lower[9 * i + 3 + axis] +
+                          lower[9 * i + 6 + axis]) *
+                      (1.0f / 3.0f);
+      centroids[3 * i + axis] = c;
+      lo[axis]                = std::min(lo[axis], c);
+      hi[axis]                = std::max(hi[axis], c);
+    }
+  }
+
+  // Sorting (code, object) keys orders equal codes by object, as the
+  // device's stable LSD radix sort does, and unlike std::stable_sort needs
+  // no buffer off the scratch.
+  std::pmr::vector<std::pair<uint32_t, Index>> keys(n, scratch);
+  for (size_t i = 0; i < n; ++i) {
+    keys[i] = {morton_code(&centroids[3 * i], lo, hi), static_cast<Index>(i)};
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::pmr::vector<uint32_t> sorted_codes(n, scratch);
+  for (size_t i = 0; i < n; ++i) { sorted_codes[i] = keys[i].first; }
+
+  const size_t                      n_internals = n - 1;
+  std::pmr::vector<LBVHNode<Index>> nodes(n_internals + n, scratch);
+  std::pmr::vector<Index>           parents(nodes.size(), 0, scratch);
+  for (size_t i = 0; i < n_internals; ++i) {
+    find_split<Index>(sorted_codes, static_cast<int64_t>(i), nodes, parents);
+  }
+
+  std::pmr::vector<uint8_t> visits(n_internals, 0, scratch);
+  for (size_t i = 0; i < n; ++i) {
+    LBVHNode<Index>& leaf   = nodes[n_internals + i];
+    const Index      object = keys[i].second;
+    for (size_t axis = 0; axis < 3; ++axis) {
+      leaf.min[axis] = std::fmin(std::fmin(lower[9 * object + axis],
+                                     lower[9 * object + 3 + axis]),
+          lower[9 * object + 6 + axis]);
+      leaf.max[axis] = std::fmax(std::fmax(upper[9 * object + axis],
+                                     upper[9 * object + 3 + axis]),
+          upper[9 * object + 6 + axis]);
+    }
+    leaf.left_idx  = LBVHNode<Index>::no_child;
+    leaf.right_idx = LBVHNode<Index>::no_child;
+    leaf.object    = object;
+
+    // The second child to arrive merges, as in the device refit.
+    size_t node = n_internals + i;
+    while (node != 0) {
+      node = parents[node];
+      if (visits[node]++ == 0) { break; }
+
+      const LBVHNode<Index>& left  = nodes[nodes[node].left_idx];
+      const LBVHNode<Index>& right = nodes[nodes[node].right_idx];
+      for (size_t axis = 0; axis < 4; ++axis) {
+        nodes[node].min[axis] = std::fmin(left.min[axis], right.min[axis]);
+        nodes[node].max[axis] = std::fmax(left.max[axis], right.max[axis]);
+      }
+    }
+  }
+
+  return nodes;
+}
+
+template std::pmr::vector<LBVHNode<uint32_t>> build_lbvh_cpu<uint32_t>(
+    const LBVHInput& input, std::pmr::memory_resource* scratch);
+template std::pmr::vector<LBVHNode<uint64_t>> build_lbvh_cpu<uint64_t>(
+    const LBVHInput& input, std::pmr::memory_resource* scratch);
+
+}  // namespace detail
+
+QueryOptions default_query_options() {
+  const char*            env   = std::getenv("TRIANGLES_QUERY");
+  const std::string_view query = env ? env : "";
+  if (query == "device") { return QueryOptions{QueryMode::Device}; }
+  if (query == "host") {
+    return QueryOptions{QueryMode::Pipelined, false, true};
+  }
+  return QueryOptions{QueryMode::Auto};
+}
+
+void DeviceTimings::merge(const DeviceTimings& other) {
+  upload_us += other.upload_us;
+  kernel_us += other.kernel_us;
+  readback_us += other.readback_us;
+  span_us += other.span_us;
+}
+
+void QueryStats::merge(const QueryStats& other) {
+  n_queries += other.n_queries;
+  n_candidates += other.n_candidates;
+  n_sat_tests += other.n_sat_tests;
+  n_sat_culled += other.n_sat_culled;
+  n_narrowphase += other.n_narrowphase;
+  n_hits += other.n_hits;
+  n_host_fallbacks += other.n_host_fallbacks;
+  device.merge(other.device);
+}
+
 }  // namespace acceleration
\ No newline at end of file
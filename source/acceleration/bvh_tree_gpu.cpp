@@ -1,280 +1,444 @@
 #include <algorithm>
-#include <cassert>
 #include <cstddef>
-#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "acceleration/bvh_tree.hpp"
 
 #ifdef USE_OPENCL
-#include <CL/opencl.h>
+#include "acceleration/kernels.hpp"
+#include "acceleration/opencl_runtime.hpp"
 #endif  // USE_OPENCL
 
-#include "utils/logger.hpp"
-
 namespace acceleration {
 
 #ifdef USE_OPENCL
 
 namespace {
 
-[[nodiscard]] uint32_t expand_bits(uint32_t v) {
-  v &= 0x000003ff;
-
-  v = (v | (v << 16)) & 0x030000ff;
-  v = (v | (v << 8)) & 0x0300f00f;
-  v = (v | (v << 4)) & 0x030c30c3;
-  v = (v | (v << 2)) & 0x09249249;
-  return v;
+[[nodiscard]] size_t div_up(const size_t a, const size_t b) {
+  return (a + b - 1) / b;
 }
 
-}  // namespace
+// Kernel-side idx_t (see lbvh.cl and query.cl) of a host index type.
+template <typename Index>
+using DeviceIndex = std::conditional_t<sizeof(Index) == 4, cl_int, cl_long>;
 
-[[nodiscard]] std::vector<uint32_t> detail::get_morton_code(
-    const std::vector<geometry::Vector3D>& centroids,
-    const acceleration::AABB&              box) noexcept {
-  const double x_gap = std::max(box.max.x - box.min.x, 1e-9);
-  const double y_gap = std::max(box.max.y - box.min.y, 1e-9);
-  const double z_gap = std::max(box.max.z - box.min.z, 1e-9);
-
-  std::vector<uint32_t> morton_codes;
-
-  for (size_t i = 0; i < centroids.size(); ++i) {
-    const double norm_x =
-        ((centroids[i].x - box.min.x) / x_gap) * grid_resolution;
-    const double norm_y =
-        ((centroids[i].y - box.min.y) / y_gap) * grid_resolution;
-    const double norm_z =
-        ((centroids[i].z - box.min.z) / z_gap) * grid_resolution;
-
-    uint32_t ix = static_cast<uint32_t>(
-        std::clamp(norm_x, 0.0, static_cast<double>(grid_resolution - 1)));
-    uint32_t iy = static_cast<uint32_t>(
-        std::clamp(norm_y, 0.0, static_cast<double>(grid_resolution - 1)));
-    uint32_t iz = static_cast<uint32_t>(
-        std::clamp(norm_z, 0.0, static_cast<double>(grid_resolution - 1)));
-
-    const uint32_t morton_code =
-        (expand_bits(ix) << 2) | (expand_bits(iy) << 1) | (expand_bits(iz));
-    morton_codes.push_back(morton_code);
-  }
-
-  return morton_codes;
+template <typename Index>
+[[nodiscard]] std::string index_option() {
+  return " -DINDEX_BITS=" + std::to_string(8 * sizeof(Index));
 }
 
-namespace {
-
-struct CLContext {
-  cl_context       context = nullptr;
-  cl_command_queue queue   = nullptr;
-  cl_program       program = nullptr;
-  cl_device_id     device  = nullptr;
-
-  bool valid = false;
-
-  CLContext() = default;
-
-  CLContext(const CLContext&)            = delete;
-  CLContext& operator=(const CLContext&) = delete;
-
-  CLContext(CLContext&& other) noexcept
-      : context(other.context),
-        queue(other.queue),
-        program(other.program),
-        device(other.device),
-        valid(other.valid) {
-    other.context = nullptr;
-    other.queue   = nullptr;
-    other.program = nullptr;
+template <typename Index>
+[[nodiscard]] std::string lbvh_options(const CLRuntime& cl) {
+  std::string options = "-DGRID_RESOLUTION=" +
+                        std::to_string(grid_resolution) +
+                        " -DRADIX_BITS=" + std::to_string(lbvh_radix_bits) +
+                        " -DRADIX_CHUNK=" + std::to_string(lbvh_radix_chunk) +
+                        " -DSCAN_BLOCK=" + std::to_string(lbvh_scan_block) +
+                        index_option<Index>();
+  // Without it the Morton cells may differ from the host reference.
+  if (cl.has_correctly_rounded_divide()) {
+    options += " -cl-fp32-correctly-rounded-divide-sqrt";
   }
-  CLContext& operator=(CLContext&& other) noexcept = delete;
+  return options;
+}
 
-  ~CLContext() {
-    if (program) clReleaseProgram(program);
-    if (queue) clReleaseCommandQueue(queue);
-    if (context) clReleaseContext(context);
-  }
+struct LBVHKernels {
+  CLKernel centroid_bounds;
+  CLKernel morton_codes;
+  CLKernel radix_histogram;
+  CLKernel radix_scatter;
+  CLKernel scan_blocks;
+  CLKernel add_block_offsets;
+  CLKernel find_splits;
+  CLKernel refit;
+
+  explicit LBVHKernels(cl_program program)
+      : centroid_bounds(program, "centroid_bounds"),
+        morton_codes(program, "morton_codes"),
+        radix_histogram(program, "radix_histogram"),
+        radix_scatter(program, "radix_scatter"),
+        scan_blocks(program, "scan_blocks"),
+        add_block_offsets(program, "add_block_offsets"),
+        find_splits(program, "find_splits"),
+        refit(program, "refit") {}
 };
 
-struct CLMem {
-  cl_mem handle = nullptr;
+// Staging slots of CLRuntime::staging(): two alternating upload slots and
+// two alternating readback slots.
+inline constexpr size_t upload_slot   = 0;
+inline constexpr size_t readback_slot = 2;
 
-  CLMem(cl_mem h) : handle(h) {}
-  ~CLMem() {
-    if (handle) clReleaseMemObject(handle);
-  }
-
-  CLMem(const CLMem&)            = delete;
-  CLMem& operator=(const CLMem&) = delete;
-};
+// Commands of one build or query, kept until they complete and then summed
+// by kind into DeviceTimings.
+class Profile {
+ public:
+  enum Kind { Upload, Kernel, Readback };
 
-CLContext init_opencl() {
-  CLContext      cl;
-  cl_int         err;
-  cl_platform_id platform;
-
-  clGetPlatformIDs(1, &platform, NULL);
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &cl.device, NULL);
-  if (err != CL_SUCCESS) { throw std::runtime_error("OpenCL: GPU not found"); }
-  cl.context = clCreateContext(NULL, 1, &cl.device, NULL, NULL, &err);
-  cl.queue = clCreateCommandQueueWithProperties(cl.context, cl.device, 0, &err);
-
-  std::ifstream file(acceleration::opencl_file);
-  if (!file.is_open()) {
-    throw std::runtime_error(
-        "OpenCL: couldn't open the kernel file on the path " +
-        acceleration::opencl_file);
+  cl_event add(const Kind kind, CLEvent event) {
+    events.emplace_back(kind, std::move(event));
+    return events.back().second.handle;
   }
 
-  std::string source_code(
-      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-
-  const char*  source_str  = source_code.c_str();
-  const size_t source_size = source_code.length();
-
-  cl.program =
-      clCreateProgramWithSource(cl.context, 1, &source_str, &source_size, &err);
-  err = clBuildProgram(cl.program, 1, &cl.device, NULL, NULL, NULL);
-
-  if (err == CL_BUILD_PROGRAM_FAILURE) {
-    throw std::runtime_error("OpenCL: Kernel compilation error");
+  [[nodiscard]] DeviceTimings totals() const {
+    DeviceTimings timings;
+    uint64_t      first = std::numeric_limits<uint64_t>::max();
+    uint64_t      last  = 0;
+    for (const auto& [kind, event] : events) {
+      const uint64_t start = event.start_ns();
+      const uint64_t end   = std::max(event.end_ns(), start);
+      const double   us    = static_cast<double>(end - start) / 1000.0;
+
+      (kind == Upload   ? timings.upload_us
+          : kind == Kernel ? timings.kernel_us
+                           : timings.readback_us) += us;
+      first = std::min(first, start);
+      last  = std::max(last, end);
+    }
+    if (last > first) {
+      timings.span_us = static_cast<double>(last - first) / 1000.0;
+    }
+    return timings;
   }
 
-  cl.valid = true;
-  return cl;
-}
+ private:
+  std::vector<std::pair<Kind, CLEvent>> events;
+};
 
-detail::SplitInfo run_find_splits(
-    const CLContext& cl, const std::vector<uint32_t>& morton_codes) {
-  cl_int       err;
-  const size_t num_objects = morton_codes.size();
+// Exclusive prefix sum of `num_values` indexes in place. `block_sums[level]`
+// holds the per-block totals of each level of the recursion.
+template <typename Index>
+void scan_exclusive(CLRuntime& cl, const LBVHKernels& kernels,
+    const CLMem& data, const size_t num_values,
+    const std::vector<CLMem>& block_sums, Profile& profile,
+    const size_t level = 0) {
+  using DevIndex = DeviceIndex<Index>;
+  const size_t   num_blocks = div_up(num_values, lbvh_scan_block);
+  const DevIndex count      = static_cast<DevIndex>(num_values);
+  const cl_mem&  sums       = block_sums[level].handle;
+
+  kernels.scan_blocks.set_args(data.handle, sums, count);
+  profile.add(Profile::Kernel, cl.run(kernels.scan_blocks, num_blocks));
+  if (num_blocks == 1) { return; }
+
+  scan_exclusive<Index>(cl, kernels, block_sums[level], num_blocks,
+      block_sums, profile, level + 1);
+  kernels.add_block_offsets.set_args(data.handle, sums, count);
+  profile.add(Profile::Kernel, cl.run(kernels.add_block_offsets, num_values));
+}
 
-  if (num_objects > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
-    throw std::length_error("Too many objects");
-  }
-  const size_t bytes = num_objects * sizeof(uint32_t);
+}  // namespace
 
-  CLMem morton_codes_buf =
-      clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes,
-          const_cast<uint32_t*>(morton_codes.data()), &err);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("Failure to build a tree on the GPU");
+// Vertices go up in chunks through two pinned slots: while one chunk is
+// copied the previous one is already reduced by centroid_bounds, and the
+// host fills the other slot. The node array comes back the same way.
+template <typename Index>
+std::pmr::vector<detail::LBVHNode<Index>> detail::build_lbvh_gpu(
+    const LBVHInput& input, DeviceTimings* timings,
+    std::pmr::memory_resource* scratch) {
+  using Node     = LBVHNode<Index>;
+  using DevIndex = DeviceIndex<Index>;
+
+  const size_t n = input.size();
+  if (n < 2) { return build_lbvh_cpu<Index>(input, scratch); }
+  // The split search steps up to 2n past a node in signed idx_t.
+  if (2 * n > static_cast<size_t>(std::numeric_limits<DevIndex>::max())) {
+    throw std::length_error("Too many objects for " +
+                            std::to_string(8 * sizeof(Index)) +
+                            "-bit device indexes");
   }
 
-  CLMem splits_buf =
-      clCreateBuffer(cl.context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("Failure to build a tree on the GPU");
+  CLRuntime&        cl = CLRuntime::require();
+  const LBVHKernels kernels(cl.program(
+      acceleration::kernels::lbvh_source, lbvh_options<Index>(cl)));
+
+  const size_t   n_nodes    = 2 * n - 1;
+  const size_t   num_chunks = div_up(n, lbvh_radix_chunk);
+  const size_t   hist_size  = (size_t{1} << lbvh_radix_bits) * num_chunks;
+  const DevIndex num_objs   = static_cast<DevIndex>(n);
+  const DevIndex num_ch     = static_cast<DevIndex>(num_chunks);
+
+  const bool   has_upper    = !input.upper.empty();
+  const size_t vertex_bytes = input.lower.size() * sizeof(float);
+
+  CLMem lower = cl.buffer(CL_MEM_READ_ONLY, vertex_bytes);
+  CLMem upper = has_upper ? cl.buffer(CL_MEM_READ_ONLY, vertex_bytes)
+                          : CLMem(nullptr);
+  const cl_mem upper_handle = has_upper ? upper.handle : lower.handle;
+
+  const uint32_t no_bounds[6] = {~0u, ~0u, ~0u, 0u, 0u, 0u};
+  CLMem          bounds       = cl.buffer(
+      CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(no_bounds), no_bounds);
+
+  // Keys and ids are double-buffered for the radix passes. Codes stay 32
+  // bits; ids, offsets and parents are as wide as `Index`.
+  const cl_mem_flags rw        = CL_MEM_READ_WRITE;
+  const size_t       key_bytes = n * sizeof(uint32_t);
+  const size_t       id_bytes  = n * sizeof(Index);
+
+  CLMem centroids = cl.buffer(rw, 3 * n * sizeof(float));
+  CLMem codes[2]  = {cl.buffer(rw, key_bytes), cl.buffer(rw, key_bytes)};
+  CLMem ids[2]    = {cl.buffer(rw, id_bytes), cl.buffer(rw, id_bytes)};
+  CLMem histogram = cl.buffer(rw, hist_size * sizeof(Index));
+  CLMem parents   = cl.buffer(rw, n_nodes * sizeof(Index));
+  CLMem visits    = cl.buffer(rw, (n - 1) * sizeof(uint32_t));
+  CLMem nodes     = cl.buffer(rw, n_nodes * sizeof(Node));
+
+  std::vector<CLMem> block_sums;
+  for (size_t level = hist_size; level > 1;) {
+    level = div_up(level, lbvh_scan_block);
+    block_sums.push_back(cl.buffer(rw, level * sizeof(Index)));
   }
 
-  CLMem starts_buf =
-      clCreateBuffer(cl.context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("Failure to build a tree on the GPU");
+  Profile                            profile;
+  const std::unique_lock<std::mutex> queue_lock = cl.lock_queue();
+
+  const size_t chunk_bytes = 9 * lbvh_upload_chunk * sizeof(float);
+  CLPinned*    upload[2]   = {
+      &cl.staging(upload_slot, (has_upper ? 2 : 1) * chunk_bytes),
+      &cl.staging(upload_slot + 1, (has_upper ? 2 : 1) * chunk_bytes)};
+  cl_event              slot_busy[2] = {nullptr, nullptr};
+  std::vector<cl_event> upper_ready;
+
+  kernels.centroid_bounds.set_args(
+      lower.handle, centroids.handle, bounds.handle, num_objs);
+  for (size_t first = 0, k = 0; first < n; first += lbvh_upload_chunk, ++k) {
+    const size_t count  = std::min(lbvh_upload_chunk, n - first);
+    const size_t offset = 9 * first * sizeof(float);
+    const size_t bytes  = 9 * count * sizeof(float);
+    CLPinned&    slot   = *upload[k % 2];
+
+    if (slot_busy[k % 2]) { clWaitForEvents(1, &slot_busy[k % 2]); }
+
+    std::memcpy(slot.data(), input.lower.data() + 9 * first, bytes);
+    const cl_event lower_ready = profile.add(
+        Profile::Upload, cl.write(lower, offset, bytes, slot.data()));
+    profile.add(Profile::Kernel,
+        cl.run(kernels.centroid_bounds, count, {lower_ready}, first));
+    slot_busy[k % 2] = lower_ready;
+
+    if (has_upper) {
+      std::memcpy(
+          slot.data() + chunk_bytes, input.upper.data() + 9 * first, bytes);
+      slot_busy[k % 2] = profile.add(Profile::Upload,
+          cl.write(upper, offset, bytes, slot.data() + chunk_bytes));
+      upper_ready.push_back(slot_busy[k % 2]);
+    }
   }
 
-  CLMem n_objs_buf =
-      clCreateBuffer(cl.context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("Failure to build a tree on the GPU");
+  kernels.morton_codes.set_args(centroids.handle, bounds.handle,
+      codes[0].handle, ids[0].handle, num_objs);
+  profile.add(Profile::Kernel, cl.run(kernels.morton_codes, n));
+
+  // An even number of passes leaves the sorted keys in codes[0].
+  static_assert((morton_code_size / lbvh_radix_bits) % 2 == 0);
+  for (size_t shift = 0; shift < morton_code_size; shift += lbvh_radix_bits) {
+    const size_t src       = (shift / lbvh_radix_bits) % 2;
+    const cl_int shift_arg = static_cast<cl_int>(shift);
+
+    kernels.radix_histogram.set_args(
+        codes[src].handle, histogram.handle, num_objs, num_ch, shift_arg);
+    profile.add(Profile::Kernel, cl.run(kernels.radix_histogram, num_chunks));
+    scan_exclusive<Index>(
+        cl, kernels, histogram, hist_size, block_sums, profile);
+    kernels.radix_scatter.set_args(codes[src].handle, ids[src].handle,
+        codes[1 - src].handle, ids[1 - src].handle, histogram.handle,
+        num_objs, num_ch, shift_arg);
+    profile.add(Profile::Kernel, cl.run(kernels.radix_scatter, num_chunks));
   }
 
-  const cl_kernel kernel = clCreateKernel(cl.program, "find_splits", &err);
-
-  clSetKernelArg(kernel, 0, sizeof(cl_mem), &morton_codes_buf.handle);
-  clSetKernelArg(kernel, 1, sizeof(cl_mem), &splits_buf.handle);
-  clSetKernelArg(kernel, 2, sizeof(cl_mem), &starts_buf.handle);
-  clSetKernelArg(kernel, 3, sizeof(cl_mem), &n_objs_buf.handle);
-
-  const int32_t num_obj_int = static_cast<int32_t>(num_objects);
-  clSetKernelArg(kernel, 4, sizeof(int32_t), &num_obj_int);
-
-  size_t num_nodes = num_objects - 1;
-  clEnqueueNDRangeKernel(
-      cl.queue, kernel, 1, NULL, &num_nodes, NULL, 0, NULL, NULL);
-  ;
-
-  const size_t bytes_out = num_nodes * sizeof(uint32_t);
-
-  std::vector<int32_t> out_splits(num_nodes);
-  std::vector<int32_t> starts(num_nodes);
-  std::vector<int32_t> n_objs(num_nodes);
-
-  err = clEnqueueReadBuffer(cl.queue, splits_buf.handle, CL_TRUE, 0, bytes_out,
-      out_splits.data(), 0, NULL, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("OpenCL: Error copying splits back");
-  }
-  err = clEnqueueReadBuffer(cl.queue, starts_buf.handle, CL_TRUE, 0, bytes_out,
-      starts.data(), 0, NULL, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("OpenCL: Error copying splits back");
+  kernels.find_splits.set_args(
+      codes[0].handle, nodes.handle, parents.handle, num_objs);
+  profile.add(Profile::Kernel, cl.run(kernels.find_splits, n - 1));
+
+  profile.add(
+      Profile::Kernel, cl.fill_zero(visits, (n - 1) * sizeof(uint32_t)));
+  kernels.refit.set_args(lower.handle, upper_handle, ids[0].handle,
+      parents.handle, visits.handle, nodes.handle, num_objs);
+  const cl_event tree_ready =
+      profile.add(Profile::Kernel, cl.run(kernels.refit, n, upper_ready));
+
+  // Two chunks in flight: chunk i is copied out of its slot while chunk
+  // i + 1 is still on the way.
+  const size_t n_chunks       = div_up(n_nodes, lbvh_readback_chunk);
+  const size_t readback_bytes = lbvh_readback_chunk * sizeof(Node);
+  CLPinned*    readback[2]    = {&cl.staging(readback_slot, readback_bytes),
+            &cl.staging(readback_slot + 1, readback_bytes)};
+  std::vector<cl_event> chunk_ready(n_chunks);
+
+  auto enqueue_read = [&](const size_t chunk) {
+    const size_t first = chunk * lbvh_readback_chunk;
+    const size_t count = std::min(lbvh_readback_chunk, n_nodes - first);
+    chunk_ready[chunk] = profile.add(Profile::Readback,
+        cl.read(nodes, first * sizeof(Node), count * sizeof(Node),
+            readback[chunk % 2]->data(), {tree_ready}));
+  };
+
+  std::pmr::vector<Node> result(n_nodes, scratch);
+  for (size_t chunk = 0; chunk < std::min<size_t>(n_chunks, 2); ++chunk) {
+    enqueue_read(chunk);
   }
-  err = clEnqueueReadBuffer(cl.queue, n_objs_buf.handle, CL_TRUE, 0, bytes_out,
-      n_objs.data(), 0, NULL, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("OpenCL: Error copying splits back");
+  for (size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    if (clWaitForEvents(1, &chunk_ready[chunk]) != CL_SUCCESS) {
+      throw std::runtime_error("OpenCL: Error copying the tree back");
+    }
+    const size_t first = chunk * lbvh_readback_chunk;
+    const size_t count = std::min(lbvh_readback_chunk, n_nodes - first);
+    std::memcpy(result.data() + first, readback[chunk % 2]->data(),
+        count * sizeof(Node));
+    if (chunk + 2 < n_chunks) { enqueue_read(chunk + 2); }
   }
-  clReleaseKernel(kernel);
 
-  return detail::SplitInfo{out_splits, starts, n_objs};
+  if (timings) { timings->merge(profile.totals()); }
+  return result;
 }
 
-}  // namespace
-
-detail::SplitInfo detail::get_split_info(
-    const std::vector<uint32_t>& morton_codes) {
-  CLContext cl = init_opencl();
-
-  const detail::SplitInfo split_info = run_find_splits(cl, morton_codes);
+template std::pmr::vector<detail::LBVHNode<uint32_t>>
+detail::build_lbvh_gpu<uint32_t>(const LBVHInput& input,
+    DeviceTimings* timings, std::pmr::memory_resource* scratch);
+template std::pmr::vector<detail::LBVHNode<uint64_t>>
+detail::build_lbvh_gpu<uint64_t>(const LBVHInput& input,
+    DeviceTimings* timings, std::pmr::memory_resource* scratch);
+
+// `host` keeps the uploaded arrays alive until the first query has waited
+// for the copies in `uploads`. Until then the scene owns those events, and
+// a scene dropped earlier, by a failed upload or query, waits for them
+// before it frees `host`.
+template <typename Index>
+class detail::DeviceScene {
+ public:
+  DeviceScene(CLMem results_, const Index num_objects_,
+      DeviceSceneData<Index> host_)
+      : results(std::move(results_)),
+        num_objects(num_objects_),
+        host(std::move(host_)) {}
+
+  ~DeviceScene() {
+    for (const CLEvent& upload : uploads) {
+      clWaitForEvents(1, &upload.handle);
+    }
+  }
 
-  LOG_INFO("get_split_info successful)");
-  return split_info;
-}
+  DeviceScene(const DeviceScene&)            = delete;
+  DeviceScene& operator=(const DeviceScene&) = delete;
 
-void detail::fill_node_idx(
-    std::vector<BVHNode>& nodes, const detail::SplitInfo& split_info) {
-  const size_t n_internals = split_info.splits.size();
-  const size_t n_leafs     = n_internals + 1;
+  CLMem nodes{nullptr};
+  CLMem indexes{nullptr};
+  CLMem boxes{nullptr};
+  CLMem vertices{nullptr};
+  CLMem degenerate{nullptr};
+  CLMem results;  // hit bitset, then the host-query bitset
+  Index num_objects = 0;
 
-  nodes.resize(n_internals + n_leafs);
+  DeviceSceneData<Index> host;
+  std::vector<CLEvent>   uploads;
+};
 
-  LOG_INFO("resize succes");
+template <typename Index>
+std::shared_ptr<detail::DeviceScene<Index>> detail::upload_scene(
+    DeviceSceneData<Index> data) {
+  CLRuntime& cl = CLRuntime::require();
+  if (!cl.has_fp64()) {
+    throw std::runtime_error("OpenCL: the device has no double precision");
+  }
 
-  for (size_t i = 0; i < n_internals; ++i) {
-    int32_t left_idx  = -1;
-    int32_t right_idx = -1;
+  const size_t n_objects = data.degenerate.size();
+  const size_t n_words   = div_up(n_objects, 32);
 
-    const int32_t split = split_info.splits[i];
-    const int32_t start = split_info.starts[i];
-    const int32_t end   = start + split_info.n_objs[i] - 1;
+  auto scene = std::make_shared<DeviceScene<Index>>(
+      cl.buffer(CL_MEM_READ_WRITE,
+          std::max<size_t>(2 * n_words * sizeof(uint32_t), 1)),
+      static_cast<Index>(n_objects), std::move(data));
 
-    if (split == start) {
-      left_idx = n_internals + split;
-    } else {
-      left_idx = split;
-    }
+  const std::unique_lock<std::mutex> queue_lock = cl.lock_queue();
 
-    if (split + 1 == end) {
-      right_idx = n_internals + (split + 1);
-    } else {
-      right_idx = split + 1;
+  auto upload = [&](CLMem& dst, const auto& values) {
+    // Zero-sized buffers are invalid; the kernel never reads the extra one.
+    const size_t bytes = values.size() * sizeof(values[0]);
+    dst = cl.buffer(CL_MEM_READ_ONLY, std::max<size_t>(bytes, 1));
+    if (bytes) {
+      scene->uploads.push_back(cl.write(dst, 0, bytes, values.data()));
     }
+  };
+  upload(scene->nodes, scene->host.nodes);
+  upload(scene->indexes, scene->host.indexes);
+  upload(scene->boxes, scene->host.boxes);
+  upload(scene->vertices, scene->host.vertices);
+  upload(scene->degenerate, scene->host.degenerate);
+  return scene;
+}
 
-    nodes[i].left_idx  = left_idx;
-    nodes[i].right_idx = right_idx;
-    nodes[i].start     = 0;
-    nodes[i].n_objs    = 0;
+// Both bitsets come back in one copy of the results buffer.
+template <typename Index>
+void detail::query_any_hit(DeviceScene<Index>& scene,
+    std::vector<uint32_t>& hits, std::vector<uint32_t>& host_queries,
+    DeviceTimings* timings) {
+  const size_t n_words = div_up(scene.num_objects, 32);
+  hits.assign(n_words, 0);
+  host_queries.assign(n_words, 0);
+  if (scene.num_objects == 0) { return; }
+
+  CLRuntime&     cl = CLRuntime::require();
+  const CLKernel kernel(cl.program(acceleration::kernels::query_source,
+                            "-DSTACK_SIZE=" + std::to_string(query_stack_size) +
+                                index_option<Index>()),
+      "any_hit");
+  kernel.set_args(scene.nodes.handle, scene.indexes.handle,
+      scene.boxes.handle, scene.vertices.handle, scene.degenerate.handle,
+      scene.results.handle, scene.num_objects);
+
+  const size_t bytes = 2 * n_words * sizeof(uint32_t);
+
+  Profile                            profile;
+  const std::unique_lock<std::mutex> queue_lock = cl.lock_queue();
+
+  std::vector<cl_event> wait;
+  for (const CLEvent& upload : scene.uploads) { wait.push_back(upload.handle); }
+
+  profile.add(Profile::Kernel, cl.fill_zero(scene.results, bytes));
+  const cl_event done = profile.add(
+      Profile::Kernel, cl.run(kernel, scene.num_objects, wait));
+
+  CLPinned&      staging = cl.staging(readback_slot, bytes);
+  const cl_event copied  = profile.add(Profile::Readback,
+      cl.read(scene.results, 0, bytes, staging.data(), {done}));
+  if (clWaitForEvents(1, &copied) != CL_SUCCESS) {
+    throw std::runtime_error("OpenCL: Error copying the query results back");
   }
-
-  for (size_t i = 0; i < n_leafs; ++i) {
-    nodes[n_internals + i].start     = i;
-    nodes[n_internals + i].n_objs    = 1;
-    nodes[n_internals + i].left_idx  = -1;
-    nodes[n_internals + i].right_idx = -1;
+  // The kernel has read the uploads, so their arrays can go.
+  for (CLEvent& upload : scene.uploads) {
+    profile.add(Profile::Upload, std::move(upload));
   }
+  scene.uploads.clear();
+  scene.host = {};
 
-  LOG_INFO("fill_node succes");
+  const uint32_t* words = reinterpret_cast<const uint32_t*>(staging.data());
+  std::copy_n(words, n_words, hits.begin());
+  std::copy_n(words + n_words, n_words, host_queries.begin());
+
+  if (timings) { timings->merge(profile.totals()); }
 }
 
+template std::shared_ptr<detail::DeviceScene<uint32_t>>
+detail::upload_scene<uint32_t>(DeviceSceneData<uint32_t> data);
+template std::shared_ptr<detail::DeviceScene<uint64_t>>
+detail::upload_scene<uint64_t>(DeviceSceneData<uint64_t> data);
+template void detail::query_any_hit<uint32_t>(DeviceScene<uint32_t>& scene,
+    std::vector<uint32_t>& hits, std::vector<uint32_t>& host_queries,
+    DeviceTimings* timings);
+template void detail::query_any_hit<uint64_t>(DeviceScene<uint64_t>& scene,
+    std::vector<uint32_t>& hits, std::vector<uint32_t>& host_queries,
+    DeviceTimings* timings);
+
 #endif  // USE_OPENCL
-}  // namespace acceleration
\ No newline at end of file
+
+}  // namespace acceleration
@@ -0,0 +1,450 @@
+#include "acceleration/dispatcher.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/geometry.hpp"
+#include "utils/cache.hpp"
+#include "utils/logger.hpp"
+#include "utils/thread_pool.hpp"
+
+#ifdef USE_OPENCL
+#include "acceleration/opencl_runtime.hpp"
+#endif  // USE_OPENCL
+
+namespace acceleration {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+inline constexpr std::string_view calibration_header = "triangles-calibration";
+inline constexpr int              calibration_version = 1;
+
+// Scene sizes of the micro-benchmark and the runs each measurement takes
+// the best of.
+inline constexpr std::array<size_t, 2> calibration_sizes = {2000, 16000};
+inline constexpr size_t                calibration_runs  = 2;
+
+constexpr std::array<std::pair<BuildEngine, std::string_view>, 5>
+    engine_names = {{
+        {BuildEngine::Auto, "auto"},
+        {BuildEngine::Median, "median"},
+        {BuildEngine::SAH, "sah"},
+        {BuildEngine::LBVH, "lbvh"},
+        {BuildEngine::OpenCL, "opencl"},
+    }};
+
+// Small random triangles in a cube holding about one per unit volume, the
+// density of the end-to-end tests.
+[[nodiscard]] std::vector<geometry::TriangleF> calibration_scene(
+    const size_t n) {
+  std::mt19937                          gen(static_cast<unsigned>(n));
+  const float                           side = 2.0f * std::cbrt(float(n));
+  std::uniform_real_distribution<float> pos(0.0f, side);
+  std::uniform_real_distribution<float> off(-1.0f, 1.0f);
+
+  std::vector<geometry::TriangleF> scene;
+  scene.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    const geometry::Vector3F base{pos(gen), pos(gen), pos(gen)};
+    const geometry::Vector3F b{
+        base.x + off(gen), base.y + off(gen), base.z + off(gen)};
+    const geometry::Vector3F c{
+        base.x + off(gen), base.y + off(gen), base.z + off(gen)};
+    scene.emplace_back(base, b, c);
+  }
+  return scene;
+}
+
+template <typename Fn>
+[[nodiscard]] double time_us(Fn&& fn) {
+  const auto start = std::chrono::steady_clock::now();
+  fn();
+  return std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+struct Measurement {
+  double build_us = std::numeric_limits<double>::infinity();
+  double query_us = std::numeric_limits<double>::infinity();
+};
+
+// Best build and query times of `engine` on `scene`; `query` is Pipelined
+// in parallel, or Device.
+[[nodiscard]] Measurement measure(std::vector<geometry::TriangleF>& scene,
+    const BuildEngine engine, const QueryMode query) {
+  Measurement       best;
+  std::vector<bool> flags;
+  for (size_t run = 0; run < calibration_runs; ++run) {
+    std::unique_ptr<BVHTree<geometry::TriangleF>> tree;
+    best.build_us = std::min(best.build_us, time_us([&] {
+      tree = std::make_unique<BVHTree<geometry::TriangleF>>(scene, engine);
+    }));
+
+    best.query_us = std::min(best.query_us, time_us([&] {
+      tree->get_intersections(flags, QueryOptions{query, false, true});
+    }));
+  }
+  return best;
+}
+
+[[nodiscard]] const CostModel& host_query_model(
+    const Calibration& cal, const BuildEngine built) {
+  switch (built) {
+    case BuildEngine::SAH:
+      return cal.sah_query;
+    case BuildEngine::LBVH:
+    case BuildEngine::OpenCL:
+      return cal.lbvh_query;
+    default:
+      return cal.median_query;
+  }
+}
+
+// Names of the cost models in the cache file; `Cal` is Calibration or its
+// const.
+template <typename Cal>
+[[nodiscard]] auto cost_models(Cal& cal) {
+  return std::array{std::pair{"median_build", &cal.median_build},
+      std::pair{"sah_build", &cal.sah_build},
+      std::pair{"lbvh_build", &cal.lbvh_build},
+      std::pair{"opencl_build", &cal.opencl_build},
+      std::pair{"median_query", &cal.median_query},
+      std::pair{"sah_query", &cal.sah_query},
+      std::pair{"lbvh_query", &cal.lbvh_query},
+      std::pair{"device_query", &cal.device_query}};
+}
+
+[[nodiscard]] std::string format_ms(const double us) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.2f ms", us / 1000.0);
+  return buffer;
+}
+
+}  // namespace
+
+std::string_view to_string(const BuildEngine engine) {
+  for (const auto& [value, name] : engine_names) {
+    if (value == engine) { return name; }
+  }
+  return "unknown";
+}
+
+std::optional<BuildEngine> parse_build_engine(std::string_view name) {
+  for (const auto& [value, engine_name] : engine_names) {
+    if (engine_name == name) { return value; }
+  }
+  return std::nullopt;
+}
+
+CostModel CostModel::fit(
+    const size_t n1, const double us1, const size_t n2, const double us2) {
+  const double w1 = work(n1);
+  const double w2 = work(n2);
+
+  CostModel model;
+  model.scale_us = w2 > w1 ? std::max(0.0, (us2 - us1) / (w2 - w1)) : 0.0;
+  model.fixed_us = std::max(0.0, us1 - model.scale_us * w1);
+  return model;
+}
+
+// ====================== Cache file =======================
+
+std::string Calibration::serialize(std::string_view key) const {
+  std::ostringstream out;
+  out.precision(std::numeric_limits<double>::max_digits10);
+
+  out << calibration_header << ' ' << calibration_version << '\n';
+  out << "key " << key << '\n';
+  for (const auto& [name, model] : cost_models(*this)) {
+    out << name << ' ' << model->fixed_us << ' ' << model->scale_us << '\n';
+  }
+  out << "opencl_setup_us " << opencl_setup_us << '\n';
+  out << "has_device " << has_device << '\n';
+  out << "has_device_query " << has_device_query << '\n';
+  out << "device_type " << device_type << '\n';
+  out << "device_name " << device_name << '\n';
+  return out.str();
+}
+
+std::optional<Calibration> Calibration::parse(
+    std::string_view text, std::string_view key) {
+  std::istringstream in{std::string(text)};
+
+  std::string header;
+  int         version = 0;
+  if (!(in >> header >> version) || header != calibration_header ||
+      version != calibration_version) {
+    return std::nullopt;
+  }
+  in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+  Calibration cal;
+  bool        has_key = false;
+  for (std::string line; std::getline(in, line);) {
+    const size_t      space = line.find(' ');
+    const std::string name  = line.substr(0, space);
+    const std::string value =
+        space == std::string::npos ? std::string{} : line.substr(space + 1);
+    std::istringstream fields(value);
+
+    CostModel* model = nullptr;
+    for (const auto& [model_name, field] : cost_models(cal)) {
+      if (name == model_name) { model = field; }
+    }
+    bool ok = true;
+    if (model) {
+      ok = static_cast<bool>(fields >> model->fixed_us >> model->scale_us);
+    } else if (name == "key") {
+      has_key = value == key;
+      ok      = has_key;
+    } else if (name == "opencl_setup_us") {
+      ok = static_cast<bool>(fields >> cal.opencl_setup_us);
+    } else if (name == "has_device") {
+      ok = static_cast<bool>(fields >> cal.has_device);
+    } else if (name == "has_device_query") {
+      ok = static_cast<bool>(fields >> cal.has_device_query);
+    } else if (name == "device_type") {
+      cal.device_type = value;
+    } else if (name == "device_name") {
+      cal.device_name = value;
+    }
+    if (!ok) { return std::nullopt; }
+  }
+
+  if (!has_key) { return std::nullopt; }
+  return cal;
+}
+
+// ====================== Dispatcher =======================
+
+Dispatcher& Dispatcher::instance() {
+  static Dispatcher dispatcher;
+  return dispatcher;
+}
+
+std::filesystem::path Dispatcher::calibration_path() {
+  if (const char* env = std::getenv("TRIANGLES_CALIBRATION")) { return env; }
+
+  const fs::path root = utils::cache_root();
+  return root.empty() ? root : root / "calibration";
+}
+
+std::string Dispatcher::calibration_key() {
+  const char* cl_device = std::getenv("TRIANGLES_CL_DEVICE");
+
+  std::string key = "threads=" +
+                    std::to_string(std::thread::hardware_concurrency()) +
+                    " pool=" +
+                    std::to_string(utils::ThreadPool::instance().size()) +
+                    " cl=" + (cl_device ? cl_device : "auto");
+#ifdef USE_OPENCL
+  const CLRuntime& runtime = CLRuntime::instance();
+  key += " device=" +
+         (runtime.is_available() ? runtime.device_name() : std::string("-"));
+#endif  // USE_OPENCL
+  return key;
+}
+
+const Calibration& Dispatcher::calibration() {
+  std::call_once(loaded, [this] {
+    const fs::path    path = calibration_path();
+    const std::string key  = calibration_key();
+
+    if (!path.empty()) {
+      std::ifstream file(path);
+      const std::string text{std::istreambuf_iterator<char>(file), {}};
+      if (std::optional<Calibration> cached = Calibration::parse(text, key)) {
+        cal = *cached;
+        LOG_INFO("Dispatcher: calibration loaded from {}", path.string());
+        return;
+      }
+    }
+
+    LOG_INFO("Dispatcher: calibrating build and query engines");
+    cal = calibrate();
+    if (cal.has_device) { mark_device_warm(); }
+
+    if (!path.empty() && !utils::write_file_atomic(path, cal.serialize(key))) {
+      LOG_WARN("Dispatcher: couldn't store the calibration in {}",
+          path.string());
+    }
+  });
+  return cal;
+}
+
+Calibration Dispatcher::calibrate() {
+  Calibration cal;
+
+  std::array<Measurement, calibration_sizes.size()> median;
+  std::array<Measurement, calibration_sizes.size()> sah;
+  std::array<Measurement, calibration_sizes.size()> lbvh;
+  std::array<Measurement, calibration_sizes.size()> opencl;
+
+  std::array<std::vector<geometry::TriangleF>, calibration_sizes.size()>
+      scenes;
+  for (size_t k = 0; k < scenes.size(); ++k) {
+    scenes[k] = calibration_scene(calibration_sizes[k]);
+    median[k] = measure(scenes[k], BuildEngine::Median, QueryMode::Pipelined);
+    sah[k]    = measure(scenes[k], BuildEngine::SAH, QueryMode::Pipelined);
+    lbvh[k]   = measure(scenes[k], BuildEngine::LBVH, QueryMode::Pipelined);
+  }
+
+  auto fit = [](const auto& runs, double Measurement::*field) {
+    return CostModel::fit(calibration_sizes[0], runs[0].*field,
+        calibration_sizes[1], runs[1].*field);
+  };
+  cal.median_build = fit(median, &Measurement::build_us);
+  cal.sah_build    = fit(sah, &Measurement::build_us);
+  cal.lbvh_build   = fit(lbvh, &Measurement::build_us);
+  cal.median_query = fit(median, &Measurement::query_us);
+  cal.sah_query    = fit(sah, &Measurement::query_us);
+  cal.lbvh_query   = fit(lbvh, &Measurement::query_us);
+
+#ifdef USE_OPENCL
+  const CLRuntime& runtime = CLRuntime::instance();
+  if (!runtime.is_available()) { return cal; }
+
+  cal.device_type      = runtime.device_type();
+  cal.device_name      = runtime.device_name();
+  cal.has_device_query = runtime.has_fp64();
+
+  // The first build also loads the programs; the difference to a warm one
+  // is the setup cost.
+  double cold_us = 0.0;
+  {
+    std::vector<geometry::TriangleF>& scene = scenes[0];
+    cold_us = time_us([&] {
+      const BVHTree<geometry::TriangleF> tree(scene, BuildEngine::OpenCL);
+      cal.has_device = tree.build_engine() == BuildEngine::OpenCL;
+    });
+  }
+  if (!cal.has_device) { return cal; }
+
+  const QueryMode query =
+      cal.has_device_query ? QueryMode::Device : QueryMode::Pipelined;
+  for (size_t k = 0; k < scenes.size(); ++k) {
+    opencl[k] = measure(scenes[k], BuildEngine::OpenCL, query);
+  }
+  cal.opencl_setup_us = std::max(0.0, cold_us - opencl[0].build_us);
+  cal.opencl_build    = fit(opencl, &Measurement::build_us);
+  if (cal.has_device_query) {
+    cal.device_query = fit(opencl, &Measurement::query_us);
+  }
+#endif  // USE_OPENCL
+
+  return cal;
+}
+
+BuildEngine Dispatcher::choose_build(const size_t n_objs) {
+  if (const char* env = std::getenv("TRIANGLES_BUILD"); env && *env) {
+    const std::optional<BuildEngine> forced = parse_build_engine(env);
+    if (forced && *forced != BuildEngine::Auto) {
+      LOG_INFO("Build engine: {} (TRIANGLES_BUILD)", to_string(*forced));
+      return *forced;
+    }
+    if (!forced) { LOG_WARN("Ignoring TRIANGLES_BUILD={}", env); }
+  }
+
+  if (n_objs < dispatch_min_objects) {
+    LOG_INFO("Build engine: median ({} objects, below the dispatch size)",
+        n_objs);
+    return BuildEngine::Median;
+  }
+
+  std::string       reason;
+  const BuildEngine engine =
+      pick_build(calibration(), n_objs, device_warm.load(), &reason);
+  LOG_INFO("Build engine: {} ({})", to_string(engine), reason);
+  return engine;
+}
+
+bool Dispatcher::choose_device_query(
+    const size_t n_objs, const BuildEngine built) {
+  if (n_objs < dispatch_min_objects) { return false; }
+
+  std::string reason;
+  const bool  device = pick_device_query(
+      calibration(), n_objs, built, device_warm.load(), &reason);
+  LOG_INFO("Query engine: {} ({})", device ? "device" : "host", reason);
+  return device;
+}
+
+// Every engine is charged its build plus the cheaper of a host query over
+// its tree and a device query; the first OpenCL use pays the setup once.
+BuildEngine Dispatcher::pick_build(const Calibration& cal, const size_t n_objs,
+    const bool warm, std::string* reason) {
+  const double setup_us = warm ? 0.0 : cal.opencl_setup_us;
+  const double device_query_us =
+      cal.has_device_query ? cal.device_query(n_objs)
+                           : std::numeric_limits<double>::infinity();
+
+  BuildEngine best      = BuildEngine::Median;
+  double      best_cost = std::numeric_limits<double>::infinity();
+  std::string estimates;
+
+  for (const BuildEngine engine : {BuildEngine::Median, BuildEngine::SAH,
+           BuildEngine::LBVH, BuildEngine::OpenCL}) {
+    if (engine == BuildEngine::OpenCL && !cal.has_device) { continue; }
+
+    const double build_us =
+        engine == BuildEngine::Median ? cal.median_build(n_objs)
+        : engine == BuildEngine::SAH  ? cal.sah_build(n_objs)
+        : engine == BuildEngine::LBVH ? cal.lbvh_build(n_objs)
+                                      : cal.opencl_build(n_objs) + setup_us;
+    const double device_us =
+        device_query_us + (engine == BuildEngine::OpenCL ? 0.0 : setup_us);
+    const double cost =
+        build_us +
+        std::min(host_query_model(cal, engine)(n_objs), device_us);
+
+    estimates += (estimates.empty() ? "" : ", ") +
+                 std::string(to_string(engine)) + ' ' + format_ms(cost);
+    if (cost < best_cost) {
+      best      = engine;
+      best_cost = cost;
+    }
+  }
+
+  if (reason) {
+    *reason = std::to_string(n_objs) + " objects, build + query estimates: " +
+              estimates;
+    if (cal.has_device) {
+      *reason += "; OpenCL " + cal.device_type + " " + cal.device_name;
+    }
+  }
+  return best;
+}
+
+bool Dispatcher::pick_device_query(const Calibration& cal,
+    const size_t n_objs, const BuildEngine built, const bool warm,
+    std::string* reason) {
+  if (!cal.has_device_query) {
+    if (reason) { *reason = "no OpenCL device with fp64"; }
+    return false;
+  }
+
+  const double host_us   = host_query_model(cal, built)(n_objs);
+  const double device_us = cal.device_query(n_objs) +
+                           (warm ? 0.0 : cal.opencl_setup_us);
+  if (reason) {
+    *reason = std::to_string(n_objs) + " objects, host " + format_ms(host_us) +
+              ", " + cal.device_type + " device " + format_ms(device_us);
+  }
+  return device_us < host_us;
+}
+
+}  // namespace acceleration
@@ -1,106 +1,323 @@
-inline int get_common_prefix(__global const uint* codes, const int i, 
-                             const int j, const int num_objects) {
-    
+// Linear BVH build, kept resident on the device from the triangle vertices to
+// the final node array. Host and device must agree bit for bit, so float
+// expressions are never contracted into FMAs.
+//
+// Build options: GRID_RESOLUTION, RADIX_BITS, RADIX_CHUNK, SCAN_BLOCK and
+// INDEX_BITS. The host always passes them; the defaults only keep the file
+// self-contained.
+
+#pragma OPENCL FP_CONTRACT OFF
+
+#ifndef GRID_RESOLUTION
+#define GRID_RESOLUTION 1024
+#endif
+#ifndef RADIX_BITS
+#define RADIX_BITS 4
+#endif
+#ifndef RADIX_CHUNK
+#define RADIX_CHUNK 256
+#endif
+#ifndef SCAN_BLOCK
+#define SCAN_BLOCK 256
+#endif
+#ifndef INDEX_BITS
+#define INDEX_BITS 32
+#endif
+
+// Object and node indexes, as wide as the host tree's: signed where the
+// split search steps past either end, unsigned where they are stored.
+#if INDEX_BITS == 64
+typedef long  idx_t;
+typedef ulong uidx_t;
+#else
+typedef int  idx_t;
+typedef uint uidx_t;
+#endif
+
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define NO_CHILD      (-1)
+
+// Mirrors acceleration::detail::LBVHNode.
+typedef struct {
+  float  min[4];
+  float  max[4];
+  idx_t  left_idx;
+  idx_t  right_idx;
+  uidx_t object;
+  uidx_t pad;
+} LBVHNode;
+
+// Floats mapped to uints with the same order, so bounds reduce with integer
+// atomics.
+inline uint float_to_ordered(const float f) {
+  const uint u = as_uint(f);
+  return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+inline float ordered_to_float(const uint u) {
+  return as_float((u & 0x80000000u) ? (u & 0x7fffffffu) : ~u);
+}
+
+inline uint expand_bits(uint v) {
+  v &= 0x000003ffu;
+
+  v = (v | (v << 16)) & 0x030000ffu;
+  v = (v | (v << 8)) & 0x0300f00fu;
+  v = (v | (v << 4)) & 0x030c30c3u;
+  v = (v | (v << 2)) & 0x09249249u;
+  return v;
+}
+
+// ====================== Morton codes =====================
+
+// Centroids of the triangles (9 floats each) and their bounds. `bounds` holds
+// ordered min x, y, z then max x, y, z and starts at (~0, 0).
+__kernel void centroid_bounds(__global const float* vertices,
+                              __global float* centroids,
+                              volatile __global uint* bounds,
+                              const idx_t num_objects) {
+  const idx_t idx = get_global_id(0);
+  if (idx >= num_objects) return;
+
+  __global const float* tri = vertices + 9 * idx;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float c = (tri[axis] + tri[3 + axis] + tri[6 + axis]) * (1.0f / 3.0f);
+    centroids[3 * idx + axis] = c;
+
+    const uint ordered = float_to_ordered(c);
+    atomic_min(&bounds[axis], ordered);
+    atomic_max(&bounds[3 + axis], ordered);
+  }
+}
+
+__kernel void morton_codes(__global const float* centroids,
+                           __global const uint* bounds,
+                           __global uint* codes,
+                           __global uidx_t* ids,
+                           const idx_t num_objects) {
+  const idx_t idx = get_global_id(0);
+  if (idx >= num_objects) return;
+
+  uint cell[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    const float lo     = ordered_to_float(bounds[axis]);
+    const float extent = ordered_to_float(bounds[3 + axis]) - lo;
+    const float scaled =
+        extent > 0.0f
+            ? (centroids[3 * idx + axis] - lo) / extent * GRID_RESOLUTION
+            : 0.0f;
+    cell[axis] = min((uint)scaled, (uint)(GRID_RESOLUTION - 1));
+  }
+
+  codes[idx] = (expand_bits(cell[0]) << 2) | (expand_bits(cell[1]) << 1) |
+               expand_bits(cell[2]);
+  ids[idx] = idx;
+}
+
+// ====================== Radix sort =======================
+// Each work-item owns RADIX_CHUNK consecutive keys. Histograms are stored
+// digit-major, so one exclusive scan over them gives every (digit, chunk)
+// its output offset, and a sequential scatter per chunk keeps the sort
+// stable.
+
+__kernel void radix_histogram(__global const uint* keys,
+                              __global uidx_t* histogram,
+                              const idx_t num_keys,
+                              const idx_t num_chunks,
+                              const int shift) {
+  const idx_t chunk = get_global_id(0);
+  if (chunk >= num_chunks) return;
+
+  uint counts[RADIX_BUCKETS];
+  for (int d = 0; d < RADIX_BUCKETS; ++d) counts[d] = 0;
+
+  const idx_t first = chunk * RADIX_CHUNK;
+  const idx_t last  = min(first + RADIX_CHUNK, num_keys);
+  for (idx_t i = first; i < last; ++i) {
+    ++counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)];
+  }
+
+  for (int d = 0; d < RADIX_BUCKETS; ++d) {
+    histogram[d * num_chunks + chunk] = counts[d];
+  }
+}
+
+__kernel void radix_scatter(__global const uint* keys_in,
+                            __global const uidx_t* ids_in,
+                            __global uint* keys_out,
+                            __global uidx_t* ids_out,
+                            __global const uidx_t* offsets,
+                            const idx_t num_keys,
+                            const idx_t num_chunks,
+                            const int shift) {
+  const idx_t chunk = get_global_id(0);
+  if (chunk >= num_chunks) return;
+
+  uidx_t next[RADIX_BUCKETS];
+  for (int d = 0; d < RADIX_BUCKETS; ++d) {
+    next[d] = offsets[d * num_chunks + chunk];
+  }
+
+  const idx_t first = chunk * RADIX_CHUNK;
+  const idx_t last  = min(first + RADIX_CHUNK, num_keys);
+  for (idx_t i = first; i < last; ++i) {
+    const uint   key = keys_in[i];
+    const uidx_t dst = next[(key >> shift) & (RADIX_BUCKETS - 1)]++;
+    keys_out[dst]  = key;
+    ids_out[dst]   = ids_in[i];
+  }
+}
+
+// In-place exclusive scan of SCAN_BLOCK values per work-item; the block
+// totals go to `block_sums` and are scanned the same way by the host.
+__kernel void scan_blocks(__global uidx_t* data,
+                          __global uidx_t* block_sums,
+                          const idx_t num_values) {
+  const idx_t block = get_global_id(0);
+  const idx_t first = block * SCAN_BLOCK;
+  if (first >= num_values) return;
+
+  const idx_t last = min(first + SCAN_BLOCK, num_values);
+  uidx_t      sum  = 0;
+  for (idx_t i = first; i < last; ++i) {
+    const uidx_t value = data[i];
+    data[i]            = sum;
+    sum += value;
+  }
+  block_sums[block] = sum;
+}
+
+__kernel void add_block_offsets(__global uidx_t* data,
+                                __global const uidx_t* block_offsets,
+                                const idx_t num_values) {
+  const idx_t idx = get_global_id(0);
+  if (idx >= num_values) return;
+
+  data[idx] += block_offsets[idx / SCAN_BLOCK];
+}
+
+// ===================== Hierarchy =========================
+
+inline int get_common_prefix(__global const uint* codes, const idx_t i,
+                             const idx_t j, const idx_t num_objects) {
   if (i < 0 || i >= num_objects || j < 0 || j >= num_objects) {
-      return -1;
+    return -1;
   }
-  
+
   const uint a = codes[i];
   const uint b = codes[j];
-  
+
   if (a == b) {
-      return 32 + clz((uint)(i ^ j));
+    return 32 + clz((uidx_t)(i ^ j));
   }
-  
+
   return clz(a ^ b);
 }
 
+// Karras 2012: internal node idx covers the key range around idx, split at
+// the highest differing bit. Internal nodes take slots 0..n-2, leaves follow.
 __kernel void find_splits(__global const uint* sorted_morton_codes,
-                          __global int* out_splits,
-                          __global int* starts,
-                          __global int* n_objs,
-                          const int num_objects) {
-  const int idx = get_global_id(0);
-  
+                          __global LBVHNode* nodes,
+                          __global uidx_t* parents,
+                          const idx_t num_objects) {
+  const idx_t idx = get_global_id(0);
+
   if (idx >= num_objects - 1) return;
 
   const int prefix_left  = get_common_prefix(sorted_morton_codes, idx, idx - 1, num_objects);
   const int prefix_right = get_common_prefix(sorted_morton_codes, idx, idx + 1, num_objects);
-  
-  const int d = (prefix_right > prefix_left) ? 1 : -1;
-  
+
+  const idx_t d = (prefix_right > prefix_left) ? 1 : -1;
+
   const int prefix_min = min(prefix_left, prefix_right);
 
-  int l_max = 2;
-  while (get_common_prefix(sorted_morton_codes, idx, idx + l_max * d, num_objects) 
+  idx_t l_max = 2;
+  while (get_common_prefix(sorted_morton_codes, idx, idx + l_max * d, num_objects)
          > prefix_min) {
       l_max *= 2;
   }
-  
-  int l = 0;
-  for (int t = l_max / 2; t >= 1; t /= 2) {
+
+  idx_t l = 0;
+  for (idx_t t = l_max / 2; t >= 1; t /= 2) {
       if (get_common_prefix(sorted_morton_codes, idx, idx + (l + t) * d, num_objects) > prefix_min) {
           l += t;
       }
   }
-  const int edge = idx + l * d;
-  
+  const idx_t edge = idx + l * d;
+
   const int prefix_node = get_common_prefix(sorted_morton_codes, idx, edge, num_objects);
-  
-  int s = 0;
-  int step = l;
-  
+
+  idx_t s = 0;
+  idx_t step = l;
+
   do {
       step = (step + 1) >> 1;
       if (get_common_prefix(sorted_morton_codes, idx, idx + (s + step) * d, num_objects) > prefix_node) {
           s += step;
       }
   } while (step > 1);
-  
-  const int split = idx + s * d + min(d, 0);
-  const int start = min(edge, idx);
-  const int end   = max(edge, idx);
-  
-  out_splits[idx] = split;
-  starts[idx]     = start;
-  n_objs[idx]     = end - start + 1;
+
+  const idx_t split = idx + s * d + min(d, (idx_t)0);
+  const idx_t start = min(edge, idx);
+  const idx_t end   = max(edge, idx);
+
+  const idx_t n_internals = num_objects - 1;
+  const idx_t left  = (split == start) ? n_internals + split : split;
+  const idx_t right = (split + 1 == end) ? n_internals + split + 1 : split + 1;
+
+  nodes[idx].left_idx  = left;
+  nodes[idx].right_idx = right;
+  nodes[idx].object    = 0;
+  nodes[idx].pad       = 0;
+  parents[left]        = idx;
+  parents[right]       = idx;
 }
 
-// __kernel void compute_morton_codes(
-//   __global const float* centroids_x,
-//   __global const float* centroids_y,
-//   __global const float* centroids_z,
-//   __global uint* out_morton_codes,
-//   const float min_x, const float min_y, const float min_z,
-//   const float max_x, const float max_y, const float max_z,
-//   const int num_objects)
-//   {
-//   const int idx = get_global_id(0);
-//   if (idx >= num_objects) return;
-
-//   float nx = (centroids_x[idx] - min_x) / (max_x - min_x);
-//   float ny = (centroids_y[idx] - min_y) / (max_y - min_y);
-//   float nz = (centroids_z[idx] - min_z) / (max_z - min_z);
-
-//   uint ix = min((uint)(nx * 1024.0f), 1023u);
-//   uint iy = min((uint)(ny * 1024.0f), 1023u);
-//   uint iz = min((uint)(nz * 1024.0f), 1023u);
-
-//   ix = (ix | (ix << 16)) & 0x030000FF;
-//   ix = (ix | (ix <<  8)) & 0x0300F00F;
-//   ix = (ix | (ix <<  4)) & 0x030C30C3;
-//   ix = (ix | (ix <<  2)) & 0x09249249;
-
-//   iy = (iy | (iy << 16)) & 0x030000FF;
-//   iy = (iy | (iy <<  8)) & 0x0300F00F;
-//   iy = (iy | (iy <<  4)) & 0x030C30C3;
-//   iy = (iy | (iy <<  2)) & 0x09249249;
-
-//   iz = (iz | (iz << 16)) & 0x030000FF;
-//   iz = (iz | (iz <<  8)) & 0x0300F00F;
-//   iz = (iz | (iz <<  4)) & 0x030C30C3;
-//   iz = (iz | (iz <<  2)) & 0x09249249;
-
-//   out_morton_codes[idx] = (ix << 2) | (iy << 1) | iz;
-//   }
+// Leaf boxes from the vertices (`lower` rounded down, `upper` rounded up),
+// then a bottom-up walk: the second child to reach a node merges both boxes
+// and moves on, the first one stops.
+__kernel void refit(__global const float* lower,
+                    __global const float* upper,
+                    __global const uidx_t* sorted_ids,
+                    __global const uidx_t* parents,
+                    volatile __global uint* visits,
+                    volatile __global LBVHNode* nodes,
+                    const idx_t num_objects) {
+  const idx_t idx = get_global_id(0);
+  if (idx >= num_objects) return;
 
+  const idx_t  n_internals = num_objects - 1;
+  const idx_t  leaf        = n_internals + idx;
+  const uidx_t object      = sorted_ids[idx];
+
+  __global const float* lo = lower + 9 * object;
+  __global const float* hi = upper + 9 * object;
+  for (int axis = 0; axis < 3; ++axis) {
+    nodes[leaf].min[axis] = fmin(fmin(lo[axis], lo[3 + axis]), lo[6 + axis]);
+    nodes[leaf].max[axis] = fmax(fmax(hi[axis], hi[3 + axis]), hi[6 + axis]);
+  }
+  nodes[leaf].min[3]    = 0.0f;
+  nodes[leaf].max[3]    = 0.0f;
+  nodes[leaf].left_idx  = NO_CHILD;
+  nodes[leaf].right_idx = NO_CHILD;
+  nodes[leaf].object    = object;
+  nodes[leaf].pad       = 0;
+
+  if (leaf == 0) return;
+
+  uidx_t node = parents[leaf];
+  while (true) {
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    if (atomic_inc(&visits[node]) == 0) return;
+
+    const idx_t left  = nodes[node].left_idx;
+    const idx_t right = nodes[node].right_idx;
+    for (int axis = 0; axis < 4; ++axis) {
+      nodes[node].min[axis] = fmin(nodes[left].min[axis], nodes[right].min[axis]);
+      nodes[node].max[axis] = fmax(nodes[left].max[axis], nodes[right].max[axis]);
+    }
+
+    if (node == 0) return;
+    node = parents[node];
+  }
+}
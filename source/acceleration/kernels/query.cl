@@ -0,0 +1,622 @@
+// Any-hit query on the device: one query triangle per work-item, a stack
+// traversal of the node array and the narrowphase of Triangle::is_intersect
+// in double precision. Every expression follows the host code operation by
+// operation, so both sides take the same branches.
+//
+// A pair the device can't decide exactly - a degenerate triangle, or an
+// orient2d whose sign the filter can't prove - is left to the host: the
+// query is marked in `host_queries` and re-run there in full.
+//
+// Build options: STACK_SIZE, INDEX_BITS.
+
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#pragma OPENCL FP_CONTRACT OFF
+
+#ifndef STACK_SIZE
+#define STACK_SIZE 64
+#endif
+#ifndef INDEX_BITS
+#define INDEX_BITS 32
+#endif
+
+// Node and object indexes, as wide as the host tree's.
+#if INDEX_BITS == 64
+typedef long  idx_t;
+typedef ulong uidx_t;
+#else
+typedef int  idx_t;
+typedef uint uidx_t;
+#endif
+
+#define EPS           1e-6  // math::eps, abs_tol and rel_tol
+#define UNIT_ROUNDOFF 0x1p-53
+
+#define MISS   0
+#define HIT    1
+#define UNSURE 2
+
+// Mirrors acceleration::detail::QueryNode.
+typedef struct {
+  float  min[4];
+  float  max[4];
+  idx_t  left_idx;
+  idx_t  right_idx;
+  uidx_t start;
+  uidx_t n_objs;
+} QueryNode;
+
+typedef struct {
+  double x, y, z;
+} vec3;
+
+typedef struct {
+  vec3 a, b, c;
+} tri3;
+
+// ===================== Vector3D ==========================
+
+inline vec3 v_make(const double x, const double y, const double z) {
+  vec3 v;
+  v.x = x;
+  v.y = y;
+  v.z = z;
+  return v;
+}
+
+inline vec3 v_add(const vec3 l, const vec3 r) {
+  return v_make(l.x + r.x, l.y + r.y, l.z + r.z);
+}
+
+inline vec3 v_sub(const vec3 l, const vec3 r) {
+  return v_make(l.x - r.x, l.y - r.y, l.z - r.z);
+}
+
+inline vec3 v_mul(const vec3 v, const double s) {
+  return v_make(v.x * s, v.y * s, v.z * s);
+}
+
+inline vec3 v_div(const vec3 v, const double s) { return v_mul(v, 1.0 / s); }
+
+inline double v_dot(const vec3 l, const vec3 r) {
+  return l.x * r.x + l.y * r.y + l.z * r.z;
+}
+
+inline vec3 v_cross(const vec3 l, const vec3 r) {
+  return v_make(
+      l.y * r.z - l.z * r.y, l.z * r.x - l.x * r.z, l.x * r.y - l.y * r.x);
+}
+
+inline double v_length(const vec3 v) {
+  return sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+}
+
+inline double v_at(const vec3 v, const int axis) {
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// std::max and std::min: the first argument wins ties and NaNs.
+inline double max_d(const double a, const double b) { return a < b ? b : a; }
+inline double min_d(const double a, const double b) { return b < a ? b : a; }
+
+// math::is_zero
+inline bool is_zero(const double x, const double scale) {
+  const double diff = fabs(x);
+  return diff <= EPS || diff <= EPS * scale;
+}
+
+inline bool v_is_zero(const vec3 v, const double scale) {
+  return is_zero(v_length(v), scale);
+}
+
+inline bool v_is_collinear(const vec3 l, const vec3 r) {
+  return v_is_zero(v_cross(l, r), v_length(l) * v_length(r));
+}
+
+inline bool v_is_codirected(const vec3 l, const vec3 r) {
+  return v_is_collinear(l, r) && v_dot(l, r) >= 0.0;
+}
+
+inline bool v_is_match(const vec3 l, const vec3 r) {
+  return v_is_zero(v_sub(l, r), 1.0);
+}
+
+// ===================== Predicates ========================
+
+// orient2d_filter: writes the determinant, false when its sign is unproven
+// and the host would go to the exact expansion.
+inline bool orient2d(const double ax, const double ay, const double bx,
+                     const double by, const double cx, const double cy,
+                     double* det) {
+  const double bound = (3.0 + 16.0 * UNIT_ROUNDOFF) * UNIT_ROUNDOFF;
+  const double left  = (ax - cx) * (by - cy);
+  const double right = (ay - cy) * (bx - cx);
+  const double error = bound * (fabs(left) + fabs(right));
+
+  *det = left - right;
+  return fabs(*det) > error || error == 0.0;
+}
+
+// orient3d_filter, the determinant less its error bound in magnitude.
+inline double orient3d_certain(const vec3 a, const vec3 b, const vec3 c,
+                               const vec3 d, double* det) {
+  const double bound = (7.0 + 56.0 * UNIT_ROUNDOFF) * UNIT_ROUNDOFF;
+
+  const double adx = a.x - d.x;
+  const double ady = a.y - d.y;
+  const double adz = a.z - d.z;
+  const double bdx = b.x - d.x;
+  const double bdy = b.y - d.y;
+  const double bdz = b.z - d.z;
+  const double cdx = c.x - d.x;
+  const double cdy = c.y - d.y;
+  const double cdz = c.z - d.z;
+
+  const double bdxcdy = bdx * cdy;
+  const double cdxbdy = cdx * bdy;
+  const double cdxady = cdx * ady;
+  const double adxcdy = adx * cdy;
+  const double adxbdy = adx * bdy;
+  const double bdxady = bdx * ady;
+
+  *det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) +
+         cdz * (adxbdy - bdxady);
+  const double permanent = (fabs(bdxcdy) + fabs(cdxbdy)) * fabs(adz) +
+                           (fabs(cdxady) + fabs(adxcdy)) * fabs(bdz) +
+                           (fabs(adxbdy) + fabs(bdxady)) * fabs(cdz);
+  return fabs(*det) - bound * permanent;
+}
+
+// ===================== Line / Section ====================
+
+typedef struct {
+  vec3 origin;
+  vec3 dir;
+} line3;
+
+inline line3 line_of(const vec3 a, const vec3 b) {
+  line3 l;
+  l.origin = a;
+  l.dir    = v_sub(b, a);
+  return l;
+}
+
+inline bool line_is_match(const line3 l, const line3 o) {
+  return v_is_collinear(l.dir, o.dir) &&
+         v_is_collinear(v_sub(l.origin, o.origin), l.dir);
+}
+
+inline bool line_is_parallel(const line3 l, const line3 o) {
+  return v_is_collinear(l.dir, o.dir) &&
+         !v_is_collinear(v_sub(l.origin, o.origin), l.dir);
+}
+
+inline bool line_is_contains(const line3 l, const vec3 p) {
+  return v_is_collinear(v_sub(p, l.origin), l.dir);
+}
+
+inline bool line_is_intersect(const line3 l, const line3 o) {
+  if (line_is_match(l, o)) return true;
+  if (line_is_parallel(l, o)) return false;
+
+  const vec3   v     = v_sub(l.origin, o.origin);
+  const vec3   n     = v_cross(l.dir, o.dir);
+  const double scale = v_length(v) * v_length(n);
+  return is_zero(v_dot(v, n), scale);
+}
+
+inline bool line_intersect_point(const line3 l, const line3 o, vec3* out) {
+  if (!line_is_intersect(l, o) || line_is_match(l, o)) return false;
+
+  const vec3   n             = v_cross(l.dir, o.dir);
+  const double n_len_squared = v_length(n) * v_length(n);
+  const vec3   p21           = v_sub(o.origin, l.origin);
+
+  const double t = v_dot(v_cross(p21, o.dir), n) / n_len_squared;
+  const double s = v_dot(v_cross(p21, l.dir), n) / n_len_squared;
+  if (!(isfinite(t) && isfinite(s))) return false;
+
+  const vec3 a = v_add(l.origin, v_mul(l.dir, t));
+  const vec3 b = v_add(o.origin, v_mul(o.dir, s));
+
+  const double scale = max_d(max_d(v_length(a), v_length(b)), 1.0);
+  if (is_zero(v_length(v_sub(a, b)), scale)) {
+    *out = v_mul(v_add(a, b), 0.5);
+    return true;
+  }
+  return false;
+}
+
+inline bool section_is_contains(const vec3 a, const vec3 b, const vec3 p) {
+  const vec3 ap = v_sub(p, a);
+  const vec3 ab = v_sub(b, a);
+  const vec3 bp = v_sub(p, b);
+
+  if (v_is_collinear(ap, ab)) {
+    const double scalar_ap_bp = v_dot(ap, bp);
+    const double scale        = v_length(ab) * v_length(ab);
+    return scalar_ap_bp < 0 || is_zero(scalar_ap_bp, scale);
+  }
+  return false;
+}
+
+inline bool section_is_intersect_line(
+    const vec3 a, const vec3 b, const line3 other) {
+  const line3 l = line_of(a, b);
+  if (line_is_match(l, other)) return true;
+  if (!line_is_intersect(l, other)) return false;
+
+  vec3 p;
+  if (!line_intersect_point(l, other, &p)) return false;
+  return section_is_contains(a, b, p);
+}
+
+inline bool section_is_intersect(
+    const vec3 a, const vec3 b, const vec3 oa, const vec3 ob) {
+  double       det;
+  const double certain = orient3d_certain(a, b, oa, ob, &det);
+  if (certain > 0.0) {
+    const vec3   v       = v_sub(a, oa);
+    const vec3   n       = v_cross(v_sub(b, a), v_sub(ob, oa));
+    const double scale   = max_d(1.0, v_dot(v, v) * v_dot(n, n));
+    const double eps_one = max_d(EPS, EPS * 1.0);
+    if (certain * certain > eps_one * eps_one * scale) return false;
+  }
+
+  const line3 l1 = line_of(a, b);
+  const line3 l2 = line_of(oa, ob);
+
+  if (line_is_match(l1, l2)) {
+    const vec3   d     = v_sub(b, a);
+    const double abs_x = fabs(d.x);
+    const double abs_y = fabs(d.y);
+    const double abs_z = fabs(d.z);
+    const int    axis  = (abs_x >= abs_y && abs_x >= abs_z)
+                             ? 0
+                             : (abs_y >= abs_z ? 1 : 2);
+
+    double a1 = v_at(a, axis);
+    double b1 = v_at(b, axis);
+    double a2 = v_at(oa, axis);
+    double b2 = v_at(ob, axis);
+    if (a1 > b1) {
+      const double t = a1;
+      a1             = b1;
+      b1             = t;
+    }
+    if (a2 > b2) {
+      const double t = a2;
+      a2             = b2;
+      b2             = t;
+    }
+
+    const double left_max  = max_d(a1, a2);
+    const double right_min = min_d(b1, b2);
+    const double scale     = max_d(fabs(b1 - a1), fabs(b2 - a2));
+    const double scale_eps = max_d(EPS, EPS * scale);
+    return right_min + scale_eps >= left_max;
+  }
+
+  if (line_is_intersect(l1, l2)) {
+    vec3 p;
+    if (!line_intersect_point(l1, l2, &p)) return false;
+    return section_is_contains(a, b, p) && section_is_contains(oa, ob, p);
+  }
+  return false;
+}
+
+// ===================== Triangle ==========================
+
+typedef struct {
+  vec3   normal;  // unit
+  double D;
+} plane3;
+
+inline plane3 plane_of(const tri3 t) {
+  const vec3 n = v_cross(v_sub(t.b, t.a), v_sub(t.c, t.a));
+  plane3     pl;
+  pl.normal = v_div(n, v_length(n));
+  pl.D      = v_dot(pl.normal, t.a);
+  return pl;
+}
+
+inline double plane_distance(const plane3 l, const plane3 r) {
+  const double sign = v_is_codirected(l.normal, r.normal) ? 1.0 : -1.0;
+  return fabs(l.D - sign * r.D);
+}
+
+inline bool is_separated_by_plane(const tri3 t, const tri3 o) {
+  double da, db, dc;
+  const double ea = orient3d_certain(t.a, t.b, t.c, o.a, &da);
+  const double eb = orient3d_certain(t.a, t.b, t.c, o.b, &db);
+  const double ec = orient3d_certain(t.a, t.b, t.c, o.c, &dc);
+
+  const bool same_side = (da > 0.0 && db > 0.0 && dc > 0.0) ||
+                         (da < 0.0 && db < 0.0 && dc < 0.0);
+  if (!same_side) return false;
+
+  const double min_dist = fmin(fmin(ea, eb), ec);
+  if (min_dist <= 0.0) return false;
+
+  const vec3 normal = v_cross(v_sub(t.b, t.a), v_sub(t.c, t.a));
+  return min_dist * min_dist > (EPS * EPS) * v_dot(normal, normal);
+}
+
+// CoplanarView of triangle.cpp.
+typedef struct {
+  vec3   vertices[3];
+  vec3   unit_normal;
+  double plane_D;
+  double orientation;
+  double tol_factor;
+  double u[3];
+  double v[3];
+  double edge_len2[3];
+} coplanar_view;
+
+inline void view_init(coplanar_view* view, const tri3 t, const int axis) {
+  const int u_axis = (axis + 1) % 3;
+  const int v_axis = (axis + 2) % 3;
+  const vec3 normal = v_cross(v_sub(t.b, t.a), v_sub(t.c, t.a));
+
+  view->vertices[0] = t.a;
+  view->vertices[1] = t.b;
+  view->vertices[2] = t.c;
+  view->unit_normal = v_div(normal, v_length(normal));
+  view->plane_D     = v_dot(view->unit_normal, t.a);
+  view->orientation = v_at(normal, axis) < 0.0 ? -1.0 : 1.0;
+
+  const double tol  = EPS * v_at(view->unit_normal, axis);
+  view->tol_factor  = tol * tol;
+
+  for (int i = 0; i < 3; ++i) {
+    const vec3 edge = v_sub(view->vertices[(i + 1) % 3], view->vertices[i]);
+    view->u[i]         = v_at(view->vertices[i], u_axis);
+    view->v[i]         = v_at(view->vertices[i], v_axis);
+    view->edge_len2[i] = v_dot(edge, edge);
+  }
+}
+
+// Edge functions [i][j] of edge i of `view` and vertex j of `other`.
+inline bool view_edges(const coplanar_view* view, const coplanar_view* other,
+                       double edges[3][3]) {
+  for (int i = 0; i < 3; ++i) {
+    const int next = (i + 1) % 3;
+    for (int j = 0; j < 3; ++j) {
+      if (!orient2d(view->u[i], view->v[i], view->u[next], view->v[next],
+                    other->u[j], other->v[j], &edges[i][j])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+inline bool view_is_inside(const coplanar_view* view, const vec3 p,
+                           double edges[3][3], const int p_idx) {
+  if (!is_zero(v_dot(view->unit_normal, p) - view->plane_D, 1.0)) {
+    return false;
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    const double side = view->orientation * edges[i][p_idx];
+    if (side >= 0.0) continue;
+
+    const vec3 to_p = v_sub(p, view->vertices[i]);
+    if (side * side >
+        view->tol_factor * view->edge_len2[i] * v_dot(to_p, to_p)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline int intersect_2d(const tri3 t, const tri3 o) {
+  const vec3   n  = v_cross(v_sub(t.b, t.a), v_sub(t.c, t.a));
+  const double nx = fabs(n.x);
+  const double ny = fabs(n.y);
+  const double nz = fabs(n.z);
+  const int axis  = (nx >= ny && nx >= nz) ? 0 : (ny >= nz ? 1 : 2);
+
+  coplanar_view lhs;
+  coplanar_view rhs;
+  view_init(&lhs, t, axis);
+  view_init(&rhs, o, axis);
+
+  double lhs_edges[3][3];
+  double rhs_edges[3][3];
+  if (!view_edges(&lhs, &rhs, lhs_edges) ||
+      !view_edges(&rhs, &lhs, rhs_edges)) {
+    return UNSURE;
+  }
+
+  for (int j = 0; j < 3; ++j) {
+    if (view_is_inside(&lhs, rhs.vertices[j], lhs_edges, j)) return HIT;
+    if (view_is_inside(&rhs, lhs.vertices[j], rhs_edges, j)) return HIT;
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      const double d1 = lhs_edges[i][j];
+      const double d2 = lhs_edges[i][(j + 1) % 3];
+      const double d3 = rhs_edges[j][i];
+      const double d4 = rhs_edges[j][(i + 1) % 3];
+      if (d1 * d2 < 0.0 && d3 * d4 < 0.0) return HIT;
+    }
+  }
+  return MISS;
+}
+
+// Points where the sides of `t` meet `line`, as in is_intersect_3d. Returns
+// the point count, or -1 where the host would read an empty optional.
+inline int line_points(const tri3 t, const line3 line, vec3 points[6]) {
+  const vec3 ends[4] = {t.a, t.b, t.c, t.a};
+  int        count   = 0;
+
+  for (int i = 0; i < 3; ++i) {
+    const vec3 a = ends[i];
+    const vec3 b = ends[i + 1];
+
+    if (line_is_contains(line, a) && line_is_contains(line, b)) {
+      points[count++] = a;
+      points[count++] = b;
+    } else if (section_is_intersect_line(a, b, line)) {
+      const line3 side = line_of(a, b);
+      if (line_is_match(side, line) ||
+          !line_intersect_point(side, line, &points[count])) {
+        return -1;
+      }
+      ++count;
+    }
+  }
+  return count;
+}
+
+inline int intersect_3d(const tri3 t, const tri3 o) {
+  const plane3 pl1 = plane_of(t);
+  const plane3 pl2 = plane_of(o);
+
+  const vec3 n1  = pl1.normal;
+  const vec3 n2  = pl2.normal;
+  const vec3 dir = v_cross(n1, n2);
+
+  const double len = v_length(v_cross(n1, n2));
+  line3        line;
+  line.origin = v_div(
+      v_cross(v_sub(v_mul(n2, pl1.D), v_mul(n1, pl2.D)), v_cross(n1, n2)),
+      len * len);
+  line.dir = dir;
+
+  vec3      points1[6];
+  const int n_points1 = line_points(t, line, points1);
+  if (n_points1 < 0) return UNSURE;
+  if (n_points1 < 2) return MISS;
+
+  vec3      points2[6];
+  const int n_points2 = line_points(o, line, points2);
+  if (n_points2 < 0) return UNSURE;
+  if (n_points2 < 2) return MISS;
+
+  if (v_is_match(points1[0], points1[1])) {
+    if (v_is_match(points2[0], points2[1])) {
+      return v_is_match(points1[0], points2[0]) ? HIT : MISS;
+    }
+    return section_is_contains(points2[0], points2[1], points1[0]) ? HIT
+                                                                    : MISS;
+  }
+  if (v_is_match(points2[0], points2[1])) {
+    return section_is_contains(points1[0], points1[1], points2[0]) ? HIT
+                                                                    : MISS;
+  }
+  return section_is_intersect(points1[0], points1[1], points2[0], points2[1])
+             ? HIT
+             : MISS;
+}
+
+// Triangle::is_intersect for two non-degenerate triangles.
+inline int intersect(const tri3 t, const tri3 o) {
+  if (is_separated_by_plane(t, o) || is_separated_by_plane(o, t)) {
+    return MISS;
+  }
+
+  const plane3 pl1       = plane_of(t);
+  const plane3 pl2       = plane_of(o);
+  const bool   collinear = v_is_collinear(pl1.normal, pl2.normal);
+  if (collinear && is_zero(plane_distance(pl1, pl2), 1.0)) {
+    return intersect_2d(t, o);
+  }
+  if (collinear) return MISS;
+
+  return intersect_3d(t, o);
+}
+
+// ======================= Query ===========================
+
+inline tri3 load_triangle(__global const double* vertices, const uidx_t idx) {
+  __global const double* v = vertices + 9 * idx;
+
+  tri3 t;
+  t.a = v_make(v[0], v[1], v[2]);
+  t.b = v_make(v[3], v[4], v[5]);
+  t.c = v_make(v[6], v[7], v[8]);
+  return t;
+}
+
+inline bool is_flagged(volatile __global uint* bits, const uidx_t idx) {
+  return (bits[idx / 32] >> (idx % 32)) & 1u;
+}
+
+inline void flag(volatile __global uint* bits, const uidx_t idx) {
+  atomic_or(&bits[idx / 32], 1u << (idx % 32));
+}
+
+// AABB::is_overlap of the query box against a loose node box.
+inline bool is_overlap(__global const float* box,
+                       __global const QueryNode* node) {
+  for (int axis = 0; axis < 3; ++axis) {
+    if (!(box[axis] <= node->max[axis] && node->min[axis] <= box[4 + axis])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Fused query: the first hit flags both triangles and ends the work-item.
+// `results` holds the hit bitset followed by the host-query bitset, so both
+// come back in one copy.
+__kernel void any_hit(__global const QueryNode* nodes,
+                      __global const uidx_t* indexes,
+                      __global const float* boxes,
+                      __global const double* vertices,
+                      __global const uchar* degenerate,
+                      volatile __global uint* results,
+                      const uidx_t num_objects) {
+  const uidx_t query = get_global_id(0);
+  if (query >= num_objects) return;
+
+  volatile __global uint* hits         = results;
+  volatile __global uint* host_queries = results + (num_objects + 31) / 32;
+
+  if (degenerate[query]) {
+    flag(host_queries, query);
+    return;
+  }
+  if (is_flagged(hits, query)) return;
+
+  __global const float* box = boxes + 8 * query;
+  const tri3            tri = load_triangle(vertices, query);
+
+  bool  deferred = false;
+  idx_t stack[STACK_SIZE];
+  int   top    = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    __global const QueryNode* node = &nodes[stack[--top]];
+    if (!is_overlap(box, node)) continue;
+
+    if (node->n_objs == 0) {
+      stack[top++] = node->right_idx;
+      stack[top++] = node->left_idx;
+      continue;
+    }
+
+    for (uidx_t i = node->start; i < node->start + node->n_objs; ++i) {
+      const uidx_t other = indexes[i];
+      if (other == query) continue;
+      if (degenerate[other]) {
+        deferred = true;
+        continue;
+      }
+
+      const int result = intersect(tri, load_triangle(vertices, other));
+      if (result == HIT) {
+        flag(hits, query);
+        flag(hits, other);
+        return;
+      }
+      deferred |= result == UNSURE;
+    }
+  }
+
+  if (deferred) flag(host_queries, query);
+}
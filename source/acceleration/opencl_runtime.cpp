@@ -0,0 +1,448 @@
+#include "acceleration/opencl_runtime.hpp"
+
+#ifdef USE_OPENCL
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "utils/cache.hpp"
+#include "utils/logger.hpp"
+
+namespace acceleration {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+[[nodiscard]] std::string platform_info(
+    cl_platform_id platform, cl_platform_info param) {
+  size_t size = 0;
+  if (clGetPlatformInfo(platform, param, 0, NULL, &size) != CL_SUCCESS) {
+    return {};
+  }
+  std::string value(size, '\0');
+  clGetPlatformInfo(platform, param, size, value.data(), NULL);
+  value.resize(std::strlen(value.c_str()));
+  return value;
+}
+
+[[nodiscard]] std::string device_info(
+    cl_device_id device, cl_device_info param) {
+  size_t size = 0;
+  if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS) {
+    return {};
+  }
+  std::string value(size, '\0');
+  clGetDeviceInfo(device, param, size, value.data(), NULL);
+  value.resize(std::strlen(value.c_str()));
+  return value;
+}
+
+// Device types to look for, in order of preference.
+[[nodiscard]] std::vector<cl_device_type> requested_device_types() {
+  const char* env = std::getenv("TRIANGLES_CL_DEVICE");
+  if (env && std::strcmp(env, "gpu") == 0) { return {CL_DEVICE_TYPE_GPU}; }
+  if (env && std::strcmp(env, "cpu") == 0) { return {CL_DEVICE_TYPE_CPU}; }
+  if (env && std::strcmp(env, "any") == 0) { return {CL_DEVICE_TYPE_ALL}; }
+
+  if (env && *env && std::strcmp(env, "auto") != 0) {
+    LOG_WARN("Ignoring TRIANGLES_CL_DEVICE={}", env);
+  }
+  return {CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU};
+}
+
+[[nodiscard]] std::string device_type_name(cl_device_id device) {
+  cl_device_type type = 0;
+  clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+  if (type & CL_DEVICE_TYPE_GPU) { return "gpu"; }
+  if (type & CL_DEVICE_TYPE_CPU) { return "cpu"; }
+  return "other";
+}
+
+[[nodiscard]] fs::path default_cache_dir() {
+  if (const char* env = std::getenv("TRIANGLES_CL_CACHE")) { return env; }
+
+  const fs::path root = utils::cache_root();
+  return root.empty() ? root : root / "opencl";
+}
+
+[[nodiscard]] std::vector<unsigned char> read_binary(const fs::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) { return {}; }
+
+  return std::vector<unsigned char>(
+      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+[[nodiscard]] std::string_view as_string_view(
+    const std::vector<unsigned char>& bytes) {
+  return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+[[nodiscard]] std::vector<unsigned char> program_binary(cl_program program) {
+  size_t size = 0;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size,
+          NULL) != CL_SUCCESS ||
+      size == 0) {
+    return {};
+  }
+
+  std::vector<unsigned char> binary(size);
+  unsigned char*             data = binary.data();
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data,
+          NULL) != CL_SUCCESS) {
+    return {};
+  }
+  return binary;
+}
+
+[[nodiscard]] std::string build_log(cl_program program, cl_device_id device) {
+  size_t size = 0;
+  clGetProgramBuildInfo(
+      program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &size);
+  std::string log(size, '\0');
+  clGetProgramBuildInfo(
+      program, device, CL_PROGRAM_BUILD_LOG, size, log.data(), NULL);
+  while (!log.empty() && (log.back() == '\0' || log.back() == '\n')) {
+    log.pop_back();
+  }
+  return log;
+}
+
+}  // namespace
+
+CLRuntime::CLRuntime() : binary_dir(default_cache_dir()) { setup(); }
+
+CLRuntime::~CLRuntime() {
+  staging_buffers.clear();  // unmapped through the queues released below
+  for (auto& [key, program] : programs) { clReleaseProgram(program); }
+  if (cl_copy_queue) clReleaseCommandQueue(cl_copy_queue);
+  if (cl_queue) clReleaseCommandQueue(cl_queue);
+  if (cl_ctx) clReleaseContext(cl_ctx);
+}
+
+CLRuntime& CLRuntime::instance() {
+  static CLRuntime runtime;
+  return runtime;
+}
+
+CLRuntime& CLRuntime::require() {
+  CLRuntime& runtime = instance();
+  if (!runtime.is_available()) { throw std::runtime_error(runtime.error()); }
+  return runtime;
+}
+
+void CLRuntime::setup() {
+  cl_uint n_platforms = 0;
+  if (clGetPlatformIDs(0, NULL, &n_platforms) != CL_SUCCESS ||
+      n_platforms == 0) {
+    setup_error = "OpenCL: no platform found";
+    return;
+  }
+  std::vector<cl_platform_id> platforms(n_platforms);
+  clGetPlatformIDs(n_platforms, platforms.data(), NULL);
+
+  const std::vector<cl_device_type> types    = requested_device_types();
+  cl_platform_id                    platform = nullptr;
+  for (const cl_device_type type : types) {
+    for (cl_platform_id candidate : platforms) {
+      if (clGetDeviceIDs(candidate, type, 1, &cl_device, NULL) ==
+          CL_SUCCESS) {
+        platform = candidate;
+        break;
+      }
+    }
+    if (platform) { break; }
+  }
+  if (!platform) {
+    setup_error = types == std::vector<cl_device_type>{CL_DEVICE_TYPE_GPU}
+                      ? "OpenCL: GPU not found"
+                      : "OpenCL: device not found";
+    return;
+  }
+
+  cl_int err = CL_SUCCESS;
+  cl_ctx     = clCreateContext(NULL, 1, &cl_device, NULL, NULL, &err);
+  if (err != CL_SUCCESS) {
+    setup_error = "OpenCL: couldn't create a context";
+    return;
+  }
+  const cl_queue_properties profiling[] = {
+      CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+  cl_queue =
+      clCreateCommandQueueWithProperties(cl_ctx, cl_device, profiling, &err);
+  if (err == CL_SUCCESS) {
+    cl_copy_queue = clCreateCommandQueueWithProperties(
+        cl_ctx, cl_device, profiling, &err);
+  }
+  if (err != CL_SUCCESS) {
+    setup_error = "OpenCL: couldn't create a command queue";
+    return;
+  }
+
+  cl_device_fp_config fp_config = 0;
+  clGetDeviceInfo(cl_device, CL_DEVICE_SINGLE_FP_CONFIG, sizeof(fp_config),
+      &fp_config, NULL);
+  correctly_rounded_divide = fp_config & CL_FP_CORRECTLY_ROUNDED_DIVIDE_SQRT;
+
+  cl_device_fp_config fp64_config = 0;
+  clGetDeviceInfo(cl_device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64_config),
+      &fp64_config, NULL);
+  fp64 = fp64_config != 0;
+
+  name             = device_info(cl_device, CL_DEVICE_NAME);
+  type_name        = device_type_name(cl_device);
+  device_signature = platform_info(platform, CL_PLATFORM_VERSION) + '\n' +
+                     name + '\n' + device_info(cl_device, CL_DEVICE_VENDOR) +
+                     '\n' + device_info(cl_device, CL_DEVICE_VERSION) +
+                     '\n' + device_info(cl_device, CL_DRIVER_VERSION);
+  valid = true;
+  LOG_INFO("OpenCL device: {} ({})", name, type_name);
+}
+
+std::string CLRuntime::program_key(
+    std::string_view source, const std::string& options) const {
+  uint64_t hash = detail::fnv1a(device_signature);
+  hash          = detail::fnv1a(std::string_view("\0", 1), hash);
+  hash          = detail::fnv1a(options, hash);
+  hash          = detail::fnv1a(std::string_view("\0", 1), hash);
+  hash          = detail::fnv1a(source, hash);
+
+  char key[17];
+  std::snprintf(key, sizeof(key), "%016llx",
+      static_cast<unsigned long long>(hash));
+  return key;
+}
+
+cl_program CLRuntime::program(
+    std::string_view source, const std::string& options) {
+  const std::string key = program_key(source, options);
+
+  std::lock_guard<std::mutex> lock(program_mutex);
+  if (auto it = programs.find(key); it != programs.end()) { return it->second; }
+
+  cl_program built = build_program(source, options);
+  programs.emplace(key, built);
+  return built;
+}
+
+cl_program CLRuntime::build_program(
+    std::string_view source, const std::string& options) {
+  if (!valid) { throw std::runtime_error(setup_error); }
+
+  const fs::path dir  = cache_dir();
+  const fs::path path = dir.empty() ? fs::path{}
+                                    : dir / (program_key(source, options) +
+                                                ".bin");
+
+  if (!path.empty()) {
+    const std::vector<unsigned char> binary = read_binary(path);
+    if (!binary.empty()) {
+      const unsigned char* data   = binary.data();
+      const size_t         size   = binary.size();
+      cl_int               status = CL_SUCCESS;
+      cl_int               err    = CL_SUCCESS;
+
+      cl_program cached = clCreateProgramWithBinary(
+          cl_ctx, 1, &cl_device, &size, &data, &status, &err);
+      if (err == CL_SUCCESS && status == CL_SUCCESS &&
+          clBuildProgram(cached, 1, &cl_device, options.c_str(), NULL, NULL) ==
+              CL_SUCCESS) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        ++stats.n_disk_hits;
+        return cached;
+      }
+
+      if (cached) clReleaseProgram(cached);
+      LOG_WARN("OpenCL: discarding stale program binary {}", path.string());
+    }
+  }
+
+  const char*  source_str  = source.data();
+  const size_t source_size = source.size();
+  cl_int       err         = CL_SUCCESS;
+
+  cl_program built =
+      clCreateProgramWithSource(cl_ctx, 1, &source_str, &source_size, &err);
+  if (err != CL_SUCCESS) {
+    throw std::runtime_error("OpenCL: couldn't create a program");
+  }
+  if (clBuildProgram(built, 1, &cl_device, options.c_str(), NULL, NULL) !=
+      CL_SUCCESS) {
+    const std::string log = build_log(built, cl_device);
+    clReleaseProgram(built);
+    throw std::runtime_error("OpenCL: Kernel compilation error:\n" + log);
+  }
+
+  const bool stored =
+      !path.empty() &&
+      utils::write_file_atomic(path, as_string_view(program_binary(built)));
+  if (!path.empty() && !stored) {
+    LOG_WARN("OpenCL: couldn't cache the program binary in {}", dir.string());
+  }
+
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  ++stats.n_source_builds;
+  stats.n_disk_writes += stored;
+  return built;
+}
+
+CLMem CLRuntime::buffer(
+    cl_mem_flags flags, const size_t bytes, const void* host) {
+  cl_int       err    = CL_SUCCESS;
+  const cl_mem handle = clCreateBuffer(
+      cl_ctx, flags, bytes, const_cast<void*>(host), &err);
+  if (err != CL_SUCCESS) {
+    throw std::runtime_error("OpenCL: couldn't allocate a buffer of " +
+                             std::to_string(bytes) + " bytes");
+  }
+  return CLMem(handle);
+}
+
+CLEvent CLRuntime::run(const CLKernel& kernel, const size_t n_items,
+    const std::vector<cl_event>& wait, const size_t offset) {
+  cl_event     event = nullptr;
+  const cl_int err   = clEnqueueNDRangeKernel(cl_queue, kernel.handle, 1,
+        &offset, &n_items, NULL, static_cast<cl_uint>(wait.size()),
+        wait.empty() ? NULL : wait.data(), &event);
+  if (err != CL_SUCCESS) {
+    throw std::runtime_error(
+        "OpenCL: kernel launch failed (" + std::to_string(err) + ")");
+  }
+  return CLEvent(event);
+}
+
+// Each copy is flushed at once, and the kernels it waits on before it: a
+// command waiting on another queue's event must not wait for a flush that
+// never comes.
+CLEvent CLRuntime::write(const CLMem& dst, const size_t offset,
+    const size_t bytes, const void* host, const std::vector<cl_event>& wait) {
+  cl_event     event = nullptr;
+  const cl_int err   = clEnqueueWriteBuffer(cl_copy_queue, dst.handle,
+        CL_FALSE, offset, bytes, host, static_cast<cl_uint>(wait.size()),
+        wait.empty() ? NULL : wait.data(), &event);
+  if (err != CL_SUCCESS) {
+    throw std::runtime_error("OpenCL: couldn't copy to the device");
+  }
+  clFlush(cl_copy_queue);
+  return CLEvent(event);
+}
+
+CLEvent CLRuntime::read(const CLMem& src, const size_t offset,
+    const size_t bytes, void* host, const std::vector<cl_event>& wait) {
+  clFlush(cl_queue);
+
+  cl_event     event = nullptr;
+  const cl_int err   = clEnqueueReadBuffer(cl_copy_queue, src.handle,
+        CL_FALSE, offset, bytes, host, static_cast<cl_uint>(wait.size()),
+        wait.empty() ? NULL : wait.data(), &event);
+  if (err != CL_SUCCESS) {
+    throw std::runtime_error("OpenCL: couldn't copy from the device");
+  }
+  clFlush(cl_copy_queue);
+  return CLEvent(event);
+}
+
+CLEvent CLRuntime::fill_zero(const CLMem& dst, const size_t bytes) {
+  const cl_uint zero  = 0;
+  cl_event      event = nullptr;
+  if (clEnqueueFillBuffer(cl_queue, dst.handle, &zero, sizeof(zero), 0, bytes,
+          0, NULL, &event) != CL_SUCCESS) {
+    throw std::runtime_error("OpenCL: couldn't clear a buffer");
+  }
+  return CLEvent(event);
+}
+
+CLPinned& CLRuntime::staging(const size_t slot, const size_t bytes) {
+  if (staging_buffers.size() <= slot) { staging_buffers.resize(slot + 1); }
+
+  std::unique_ptr<CLPinned>& pinned = staging_buffers[slot];
+  if (!pinned || pinned->bytes < bytes) {
+    pinned.reset();
+    pinned = std::make_unique<CLPinned>(*this, bytes);
+  }
+  return *pinned;
+}
+
+fs::path CLRuntime::cache_dir() const {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  return binary_dir;
+}
+
+void CLRuntime::set_cache_dir(const fs::path& dir) {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  binary_dir = dir;
+}
+
+CLProgramCacheStats CLRuntime::cache_stats() const {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  return stats;
+}
+
+void CLEvent::wait() const {
+  if (clWaitForEvents(1, &handle) != CL_SUCCESS) {
+    throw std::runtime_error("OpenCL: a command failed");
+  }
+}
+
+uint64_t CLEvent::start_ns() const {
+  cl_ulong time = 0;
+  clGetEventProfilingInfo(
+      handle, CL_PROFILING_COMMAND_START, sizeof(time), &time, NULL);
+  return time;
+}
+
+uint64_t CLEvent::end_ns() const {
+  cl_ulong time = 0;
+  clGetEventProfilingInfo(
+      handle, CL_PROFILING_COMMAND_END, sizeof(time), &time, NULL);
+  return time;
+}
+
+CLPinned::CLPinned(CLRuntime& runtime, const size_t bytes_)
+    : mem(runtime.buffer(CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+          std::max<size_t>(bytes_, 1))),
+      queue(runtime.transfer_queue()),
+      bytes(bytes_) {
+  cl_int err = CL_SUCCESS;
+  host = clEnqueueMapBuffer(queue, mem.handle, CL_TRUE,
+      CL_MAP_READ | CL_MAP_WRITE, 0, std::max<size_t>(bytes, 1), 0, NULL, NULL,
+      &err);
+  if (err != CL_SUCCESS || !host) {
+    throw std::runtime_error("OpenCL: couldn't map a staging buffer");
+  }
+}
+
+CLPinned::~CLPinned() {
+  if (host) {
+    clEnqueueUnmapMemObject(queue, mem.handle, host, 0, NULL, NULL);
+    clFinish(queue);
+  }
+}
+
+CLKernel::CLKernel(cl_program program, const char* name) {
+  cl_int err = CL_SUCCESS;
+  handle     = clCreateKernel(program, name, &err);
+  if (err != CL_SUCCESS) {
+    throw std::runtime_error(
+        std::string("OpenCL: couldn't create kernel ") + name);
+  }
+}
+
+void CLKernel::set_arg(
+    const cl_uint idx, const size_t size, const void* value) const {
+  if (clSetKernelArg(handle, idx, size, value) != CL_SUCCESS) {
+    throw std::runtime_error(
+        "OpenCL: couldn't set argument " + std::to_string(idx));
+  }
+}
+
+}  // namespace acceleration
+
+#endif  // USE_OPENCL
@@ -0,0 +1,403 @@
+#include "acceleration/out_of_core.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "acceleration/AABB.hpp"
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/triangle_f.hpp"
+#include "utils/logger.hpp"
+#include "utils/triangle_io.hpp"
+
+namespace acceleration {
+
+using geometry::TriangleF;
+using geometry::Vector3D;
+using geometry::Vector3F;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A spilled triangle: its coordinates and its index in the scene.
+struct TileRecord {
+  float    coords[9];
+  uint32_t pad = 0;
+  uint64_t index;
+};
+static_assert(sizeof(TileRecord) == 48);
+
+// Per triangle of a tile: its record while loading, the triangle, its global
+// index, its box, about two tree nodes and an index, and the build's packed
+// lower and upper vertices.
+inline constexpr size_t tile_bytes_per_triangle =
+    sizeof(TileRecord) + sizeof(TriangleF) + sizeof(uint64_t) +
+    sizeof(AABB) + 2 * sizeof(BVHNode<uint32_t>) + sizeof(uint32_t) +
+    18 * sizeof(float);
+
+// A cut aims at this many times the tiles the budget asks for, since tiles
+// are uneven and straddling triangles are counted in each of theirs.
+inline constexpr size_t tile_slack = 2;
+// Tiles one cut makes at most; each is an open file while it runs.
+inline constexpr size_t max_tiles_per_cut = 256;
+// Records buffered per tile file, and read or parsed at a time.
+inline constexpr size_t tile_buffer_records = 512;
+inline constexpr size_t min_batch_records   = 1 << 10;
+inline constexpr size_t max_batch_records   = 1 << 20;
+// Tile triangles are constructed in ranges of this size.
+inline constexpr size_t triangle_grain = 1 << 14;
+
+struct Tile {
+  fs::path path;
+  size_t   count = 0;
+  AABB     bounds;  // of the record boxes; set when count > 0
+  size_t   depth = 0;
+};
+
+// The record's box grown by math::eps, as the tree's overlap test grows it,
+// so two triangles the tree could pair have overlapping boxes.
+[[nodiscard]] AABB record_box(const TileRecord& record) {
+  const float* c = record.coords;
+  return AABB(Vector3D{std::min({c[0], c[3], c[6]}),
+                  std::min({c[1], c[4], c[7]}), std::min({c[2], c[5], c[8]})},
+      Vector3D{std::max({c[0], c[3], c[6]}), std::max({c[1], c[4], c[7]}),
+          std::max({c[2], c[5], c[8]})})
+      .loosened();
+}
+
+// A fresh directory for the spill, removed with everything in it.
+class SpillDir {
+ public:
+  explicit SpillDir(const fs::path& parent) {
+    std::string pattern = (parent / "triangles-spill-XXXXXX").string();
+    if (!::mkdtemp(pattern.data())) {
+      throw std::runtime_error("Can't create a spill directory in " +
+                               parent.string() + ": " + std::strerror(errno));
+    }
+    path = pattern;
+  }
+  ~SpillDir() {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+  }
+
+  SpillDir(const SpillDir&)            = delete;
+  SpillDir& operator=(const SpillDir&) = delete;
+
+  [[nodiscard]] fs::path next_file() {
+    return path / ("tile-" + std::to_string(n_files++) + ".bin");
+  }
+
+ private:
+  fs::path path;
+  size_t   n_files = 0;
+};
+
+// Appends records to a tile file through a buffer; the file is created with
+// the first record.
+class TileWriter {
+ public:
+  explicit TileWriter(fs::path path_) : path(std::move(path_)) {}
+
+  void add(const TileRecord& record, const AABB& box) {
+    if (count == 0) {
+      bounds = box;
+    } else {
+      bounds.merge(box);
+    }
+    ++count;
+    buffer.push_back(record);
+    if (buffer.size() == tile_buffer_records) { flush(); }
+  }
+
+  [[nodiscard]] Tile finish(const size_t depth) {
+    flush();
+    if (out.is_open()) { out.close(); }
+    return Tile{path, count, bounds, depth};
+  }
+
+ private:
+  fs::path                path;
+  std::ofstream           out;
+  std::vector<TileRecord> buffer;
+  size_t                  count = 0;
+  AABB                    bounds;
+
+  void flush() {
+    if (buffer.empty()) { return; }
+    if (!out.is_open()) { out.open(path, std::ios::binary); }
+    out.write(reinterpret_cast<const char*>(buffer.data()),
+        static_cast<std::streamsize>(buffer.size() * sizeof(TileRecord)));
+    if (!out) { throw std::runtime_error("Can't write " + path.string()); }
+    buffer.clear();
+  }
+};
+
+void read_records(std::ifstream& in, const fs::path& path,
+    std::vector<TileRecord>& records, const size_t n) {
+  records.resize(n);
+  in.read(reinterpret_cast<char*>(records.data()),
+      static_cast<std::streamsize>(n * sizeof(TileRecord)));
+  if (static_cast<size_t>(in.gcount()) != n * sizeof(TileRecord)) {
+    throw std::runtime_error("Can't read " + path.string());
+  }
+}
+
+// Calls `fn(records)` with batches of the records of `tile`.
+template <typename Fn>
+void for_each_batch(const Tile& tile, const size_t batch, Fn&& fn) {
+  std::ifstream           in(tile.path, std::ios::binary);
+  std::vector<TileRecord> records;
+  for (size_t done = 0; done < tile.count; done += records.size()) {
+    read_records(in, tile.path, records, std::min(batch, tile.count - done));
+    fn(records);
+  }
+}
+
+// Uniform grid over a tile's bounds, with cells split along the longest
+// sides first. A box covers the cells from the one of its min corner to the
+// one of its max corner, clamped to the grid; the cell of a coordinate
+// never decreases as it grows, so boxes that overlap share a cell.
+class Grid {
+ public:
+  Grid(const AABB& bounds, const size_t n_tiles) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      origin[axis] = bounds.min[axis];
+      extent[axis] = bounds.max[axis] - bounds.min[axis];
+    }
+    while (size() < n_tiles && 2 * size() <= max_tiles_per_cut) {
+      size_t longest = 3;
+      float  side    = 0.0f;
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const float cell = extent[axis] / static_cast<float>(dims[axis]);
+        if (std::isfinite(cell) && cell > side) {
+          longest = axis;
+          side    = cell;
+        }
+      }
+      if (longest == 3) { break; }
+      dims[longest] *= 2;
+    }
+    for (size_t axis = 0; axis < 3; ++axis) {
+      inv_cell[axis] =
+          dims[axis] > 1 ? static_cast<float>(dims[axis]) / extent[axis] : 0;
+    }
+  }
+
+  [[nodiscard]] size_t size() const { return dims[0] * dims[1] * dims[2]; }
+
+  // Calls `fn(cell)` for every cell `box` covers.
+  template <typename Fn>
+  void for_each_cell(const AABB& box, Fn&& fn) const {
+    size_t lo[3];
+    size_t hi[3];
+    for (size_t axis = 0; axis < 3; ++axis) {
+      lo[axis] = cell_of(axis, box.min[axis]);
+      hi[axis] = cell_of(axis, box.max[axis]);
+    }
+    for (size_t z = lo[2]; z <= hi[2]; ++z) {
+      for (size_t y = lo[1]; y <= hi[1]; ++y) {
+        for (size_t x = lo[0]; x <= hi[0]; ++x) {
+          fn((z * dims[1] + y) * dims[0] + x);
+        }
+      }
+    }
+  }
+
+ private:
+  float  origin[3]   = {};
+  float  extent[3]   = {};
+  float  inv_cell[3] = {};
+  size_t dims[3]     = {1, 1, 1};
+
+  [[nodiscard]] size_t cell_of(const size_t axis, const float x) const {
+    const float t = (x - origin[axis]) * inv_cell[axis];
+    if (!(t > 0.0f)) { return 0; }
+    if (t >= static_cast<float>(dims[axis])) { return dims[axis] - 1; }
+    return static_cast<size_t>(t);
+  }
+};
+
+[[nodiscard]] size_t batch_records(const OutOfCoreConfig& config) {
+  return std::clamp(config.memory_budget / (4 * sizeof(TileRecord)),
+      min_batch_records, max_batch_records);
+}
+
+// Cuts `tile` into the tiles of a grid, duplicating straddling records, and
+// removes its file. Empty tiles are left out.
+[[nodiscard]] std::vector<Tile> cut_tile(const Tile& tile, SpillDir& spill,
+    const OutOfCoreConfig& config, OutOfCoreStats& stats) {
+  const size_t wanted =
+      tile_slack * ((tile_memory(tile.count) + config.memory_budget - 1) /
+                       config.memory_budget);
+  const Grid grid(tile.bounds, wanted);
+
+  std::vector<std::optional<TileWriter>> writers(grid.size());
+  for_each_batch(tile, batch_records(config),
+      [&](const std::vector<TileRecord>& records) {
+        for (const TileRecord& record : records) {
+          const AABB box = record_box(record);
+          grid.for_each_cell(box, [&](const size_t cell) {
+            if (!writers[cell]) { writers[cell].emplace(spill.next_file()); }
+            writers[cell]->add(record, box);
+            ++stats.n_spilled;
+          });
+        }
+      });
+  fs::remove(tile.path);
+
+  std::vector<Tile> tiles;
+  for (std::optional<TileWriter>& writer : writers) {
+    if (writer) { tiles.push_back(writer->finish(tile.depth + 1)); }
+  }
+  return tiles;
+}
+
+// Builds and queries the tree of one tile and sets the global flags of its
+// intersecting triangles.
+void query_tile(const Tile& tile, std::vector<bool>& flags,
+    utils::ThreadPool& pool) {
+  std::vector<TileRecord> records;
+  {
+    std::ifstream in(tile.path, std::ios::binary);
+    read_records(in, tile.path, records, tile.count);
+  }
+  fs::remove(tile.path);
+
+  const Vector3F         origin{0.0f, 0.0f, 0.0f};
+  std::vector<TriangleF> triangles(
+      tile.count, TriangleF{origin, origin, origin});
+  std::vector<uint64_t> indexes(tile.count);
+  pool.parallel_for(0, tile.count, triangle_grain,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          const float* c = records[i].coords;
+          triangles[i]   = TriangleF{Vector3F{c[0], c[1], c[2]},
+              Vector3F{c[3], c[4], c[5]}, Vector3F{c[6], c[7], c[8]}};
+          indexes[i]     = records[i].index;
+        }
+      });
+  records = {};
+
+  const std::vector<bool> hits = find_all_intersections(triangles, pool);
+  for (size_t i = 0; i < hits.size(); ++i) {
+    if (hits[i]) { flags[indexes[i]] = true; }
+  }
+}
+
+}  // namespace
+
+size_t tile_memory(const size_t n_triangles) {
+  return n_triangles * tile_bytes_per_triangle;
+}
+
+std::vector<bool> find_intersections_out_of_core(std::istream& in,
+    const OutOfCoreConfig& config, OutOfCoreStats* stats,
+    utils::ThreadPool& pool) {
+  utils::TriangleReader reader(in, pool);
+  OutOfCoreStats        local;
+  local.n_triangles = reader.size();
+
+  if (tile_memory(reader.size()) <= config.memory_budget) {
+    std::vector<TriangleF> triangles = reader.read_triangles(reader.size());
+    local.n_tiles            = 1;
+    local.max_tile_triangles = triangles.size();
+    if (stats) { *stats = local; }
+    return find_all_intersections(triangles, pool);
+  }
+
+  SpillDir spill(
+      config.spill_dir.empty() ? fs::temp_directory_path() : config.spill_dir);
+
+  // First pass: the whole scene to one file, and its bounds.
+  TileWriter         scene(spill.next_file());
+  std::vector<float> coords;
+  for (uint64_t index = 0; reader.remaining() > 0;) {
+    coords.clear();
+    const size_t n = reader.read(coords, batch_records(config));
+    for (size_t i = 0; i < n; ++i, ++index) {
+      TileRecord record;
+      std::copy_n(coords.data() + 9 * i, 9, record.coords);
+      record.index = index;
+      scene.add(record, record_box(record));
+    }
+  }
+  coords = {};
+
+  std::vector<bool> flags(reader.size(), false);
+  std::vector<Tile> pending{scene.finish(0)};
+  while (!pending.empty()) {
+    const Tile tile = std::move(pending.back());
+    pending.pop_back();
+    if (tile.count < 2) {
+      fs::remove(tile.path);
+      continue;
+    }
+
+    if (tile_memory(tile.count) > config.memory_budget &&
+        tile.depth < config.max_depth) {
+      for (Tile& part : cut_tile(tile, spill, config, local)) {
+        // Every box of the tile touches this part: cutting it again won't
+        // help either.
+        if (part.count == tile.count) { part.depth = config.max_depth; }
+        pending.push_back(std::move(part));
+      }
+      continue;
+    }
+
+    if (tile_memory(tile.count) > config.memory_budget) {
+      LOG_WARN("Out-of-core: a tile of {} triangles exceeds the budget",
+          tile.count);
+      ++local.n_oversized;
+    }
+    ++local.n_tiles;
+    local.max_tile_triangles = std::max(local.max_tile_triangles, tile.count);
+    query_tile(tile, flags, pool);
+  }
+
+  LOG_INFO("Out-of-core: {} triangles in {} tiles, {} records spilled",
+      local.n_triangles, local.n_tiles, local.n_spilled);
+  if (stats) { *stats = local; }
+  return flags;
+}
+
+std::optional<OutOfCoreConfig> default_out_of_core_config() {
+  const char* env = std::getenv("TRIANGLES_MEMORY_BUDGET");
+  if (!env || !*env) { return std::nullopt; }
+
+  char*              end   = nullptr;
+  unsigned long long value = std::strtoull(env, &end, 10);
+  if (end != env) {
+    switch (*end) {
+      case 'K': value <<= 10, ++end; break;
+      case 'M': value <<= 20, ++end; break;
+      case 'G': value <<= 30, ++end; break;
+      default: break;
+    }
+  }
+  if (end == env || *end != '\0' || value == 0) {
+    LOG_WARN("Ignoring TRIANGLES_MEMORY_BUDGET={}", env);
+    return std::nullopt;
+  }
+
+  OutOfCoreConfig config;
+  config.memory_budget = value;
+  if (const char* dir = std::getenv("TRIANGLES_SPILL_DIR"); dir && *dir) {
+    config.spill_dir = dir;
+  }
+  return config;
+}
+
+}  // namespace acceleration
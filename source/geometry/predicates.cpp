@@ -0,0 +1,217 @@
+#include "geometry/predicates.hpp"
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+#include "geometry/vector_3d.hpp"
+
+namespace geometry {
+
+namespace {
+
+// Half an ulp of 1.0: the relative rounding error of one operation.
+constexpr double unit_roundoff = 0x1p-53;
+
+constexpr double orient2d_bound = (3.0 + 16.0 * unit_roundoff) * unit_roundoff;
+constexpr double orient3d_bound = (7.0 + 56.0 * unit_roundoff) * unit_roundoff;
+
+// ================= Expansion arithmetic ==================
+// A value is kept as a sum of non-overlapping doubles ordered by increasing
+// magnitude (Shewchuk, "Adaptive Precision Floating-Point Arithmetic"). Sums
+// and products of expansions are exact, and the sign of the whole sum is the
+// sign of its largest component. Storage is inline: the orient3d determinant
+// needs at most 192 components.
+
+constexpr size_t expansion_cap = 192;
+
+struct Expansion {
+  std::array<double, expansion_cap> terms;
+  size_t                            size = 0;
+
+  Expansion() = default;
+  explicit Expansion(const double value) : size(1) { terms[0] = value; }
+  Expansion(const double hi, const double lo) {
+    if (lo != 0.0) { terms[size++] = lo; }
+    if (hi != 0.0 || size == 0) { terms[size++] = hi; }
+  }
+
+  [[nodiscard]] double estimate() const {
+    double sum = 0.0;
+    for (size_t i = 0; i < size; ++i) { sum += terms[i]; }
+    return sum;
+  }
+};
+
+void two_sum(const double a, const double b, double& x, double& y) {
+  x                 = a + b;
+  const double b_hi = x - a;
+  const double a_hi = x - b_hi;
+  y                 = (a - a_hi) + (b - b_hi);
+}
+
+void fast_two_sum(const double a, const double b, double& x, double& y) {
+  x = a + b;
+  y = b - (x - a);
+}
+
+void two_product(const double a, const double b, double& x, double& y) {
+  x = a * b;
+  y = std::fma(a, b, -x);
+}
+
+Expansion two_diff(const double a, const double b) {
+  const double x    = a - b;
+  const double b_hi = a - x;
+  const double a_hi = x + b_hi;
+  return Expansion{x, (a - a_hi) + (b_hi - b)};
+}
+
+// e += b, zero components dropped.
+void grow(Expansion& e, const double b) {
+  assert(e.size < expansion_cap);
+
+  double q     = b;
+  size_t n_out = 0;
+  for (size_t i = 0; i < e.size; ++i) {
+    double hh = 0.0;
+    two_sum(q, e.terms[i], q, hh);
+    if (hh != 0.0) { e.terms[n_out++] = hh; }
+  }
+  if (q != 0.0 || n_out == 0) { e.terms[n_out++] = q; }
+  e.size = n_out;
+}
+
+Expansion sum(const Expansion& e, const Expansion& f) {
+  Expansion res = e;
+  for (size_t i = 0; i < f.size; ++i) { grow(res, f.terms[i]); }
+  return res;
+}
+
+Expansion negate(Expansion e) {
+  for (size_t i = 0; i < e.size; ++i) { e.terms[i] = -e.terms[i]; }
+  return e;
+}
+
+Expansion scale(const Expansion& e, const double b) {
+  assert(2 * e.size <= expansion_cap);
+
+  Expansion res;
+  double    q  = 0.0;
+  double    hh = 0.0;
+
+  two_product(e.terms[0], b, q, hh);
+  if (hh != 0.0) { res.terms[res.size++] = hh; }
+
+  for (size_t i = 1; i < e.size; ++i) {
+    double hi = 0.0;
+    double lo = 0.0;
+    double s  = 0.0;
+    two_product(e.terms[i], b, hi, lo);
+    two_sum(q, lo, s, hh);
+    if (hh != 0.0) { res.terms[res.size++] = hh; }
+    fast_two_sum(hi, s, q, hh);
+    if (hh != 0.0) { res.terms[res.size++] = hh; }
+  }
+  if (q != 0.0 || res.size == 0) { res.terms[res.size++] = q; }
+  return res;
+}
+
+Expansion product(const Expansion& e, const Expansion& f) {
+  Expansion res{0.0};
+  for (size_t i = 0; i < f.size; ++i) { res = sum(res, scale(e, f.terms[i])); }
+  return res;
+}
+
+double orient2d_exact(const double ax, const double ay, const double bx,
+    const double by, const double cx, const double cy) {
+  const Expansion acx = two_diff(ax, cx);
+  const Expansion acy = two_diff(ay, cy);
+  const Expansion bcx = two_diff(bx, cx);
+  const Expansion bcy = two_diff(by, cy);
+
+  return sum(product(acx, bcy), negate(product(acy, bcx))).estimate();
+}
+
+double orient3d_exact(
+    const Vector3D& a, const Vector3D& b, const Vector3D& c, const Vector3D& d) {
+  const Expansion adx = two_diff(a.x, d.x);
+  const Expansion ady = two_diff(a.y, d.y);
+  const Expansion adz = two_diff(a.z, d.z);
+  const Expansion bdx = two_diff(b.x, d.x);
+  const Expansion bdy = two_diff(b.y, d.y);
+  const Expansion bdz = two_diff(b.z, d.z);
+  const Expansion cdx = two_diff(c.x, d.x);
+  const Expansion cdy = two_diff(c.y, d.y);
+  const Expansion cdz = two_diff(c.z, d.z);
+
+  auto minor = [](const Expansion& px, const Expansion& py, const Expansion& qx,
+                   const Expansion& qy) {
+    return sum(product(px, qy), negate(product(qx, py)));
+  };
+
+  const Expansion det_a = product(adz, minor(bdx, bdy, cdx, cdy));
+  const Expansion det_b = product(bdz, minor(cdx, cdy, adx, ady));
+  const Expansion det_c = product(cdz, minor(adx, ady, bdx, bdy));
+
+  return sum(sum(det_a, det_b), det_c).estimate();
+}
+
+}  // namespace
+
+FilteredDet orient2d_filter(const double ax, const double ay, const double bx,
+    const double by, const double cx, const double cy) {
+  const double left  = (ax - cx) * (by - cy);
+  const double right = (ay - cy) * (bx - cx);
+
+  return {left - right,
+      orient2d_bound * (std::fabs(left) + std::fabs(right))};
+}
+
+FilteredDet orient3d_filter(
+    const Vector3D& a, const Vector3D& b, const Vector3D& c, const Vector3D& d) {
+  const double adx = a.x - d.x;
+  const double ady = a.y - d.y;
+  const double adz = a.z - d.z;
+  const double bdx = b.x - d.x;
+  const double bdy = b.y - d.y;
+  const double bdz = b.z - d.z;
+  const double cdx = c.x - d.x;
+  const double cdy = c.y - d.y;
+  const double cdz = c.z - d.z;
+
+  const double bdxcdy = bdx * cdy;
+  const double cdxbdy = cdx * bdy;
+  const double cdxady = cdx * ady;
+  const double adxcdy = adx * cdy;
+  const double adxbdy = adx * bdy;
+  const double bdxady = bdx * ady;
+
+  const double det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) +
+                     cdz * (adxbdy - bdxady);
+  const double permanent =
+      (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * std::fabs(adz) +
+      (std::fabs(cdxady) + std::fabs(adxcdy)) * std::fabs(bdz) +
+      (std::fabs(adxbdy) + std::fabs(bdxady)) * std::fabs(cdz);
+
+  return {det, orient3d_bound * permanent};
+}
+
+double orient2d(const double ax, const double ay, const double bx,
+    const double by, const double cx, const double cy) {
+  const FilteredDet fast = orient2d_filter(ax, ay, bx, by, cx, cy);
+  if (fast.is_certain() || fast.error == 0.0) { return fast.det; }
+
+  return orient2d_exact(ax, ay, bx, by, cx, cy);
+}
+
+double orient3d(
+    const Vector3D& a, const Vector3D& b, const Vector3D& c, const Vector3D& d) {
+  const FilteredDet fast = orient3d_filter(a, b, c, d);
+  if (fast.is_certain() || fast.error == 0.0) { return fast.det; }
+
+  return orient3d_exact(a, b, c, d);
+}
+
+}  // namespace geometry
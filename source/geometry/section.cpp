@@ -6,6 +6,7 @@
 #include <iostream>
 
 #include "geometry/line.hpp"
+#include "geometry/predicates.hpp"
 #include "geometry/vector_3d.hpp"
 #include "math/math.hpp"
 
@@ -30,6 +31,20 @@ bool Section::is_intersect(const Section& other) const {
   assert(this->is_valid());
   assert(other.is_valid());
 
+  // Skew segments can't meet. The orient3d filter gives the volume spanned by
+  // the endpoints, i.e. the v . (d1 x d2) that Line::is_intersect compares
+  // with its tolerance, without building either line.
+  const FilteredDet volume = orient3d_filter(a, b, other.a, other.b);
+  const double      certain = std::fabs(volume.det) - volume.error;
+  if (certain > 0.0) {
+    const Vector3D v     = a - other.a;
+    const Vector3D n     = (b - a).cross(other.b - other.a);
+    const double   scale = std::max(1.0, v.scalar(v) * n.scalar(n));
+    if (certain * certain > math::sqr(math::get_eps(1.0)) * scale) {
+      return false;
+    }
+  }
+
   const Line l1 = this->get_line();
   const Line l2 = other.get_line();
 
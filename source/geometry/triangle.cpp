@@ -2,18 +2,151 @@
 
 #include <endian.h>
 
+#include <array>
 #include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <iostream>
-#include <vector>
 
 #include "geometry/plane.hpp"
+#include "geometry/predicates.hpp"
 #include "geometry/section.hpp"
 #include "geometry/vector_3d.hpp"
 #include "math/math.hpp"
 
 namespace geometry {
 
+namespace {
+
+// Points where the sides of one triangle meet the planes' intersection line.
+// Each of the three sides contributes at most two points, so a fixed inline
+// buffer keeps the narrowphase off the heap.
+class LinePoints {
+ public:
+  void push_back(const Vector3D& p) {
+    assert(n_points < points.size());
+    points[n_points++] = p;
+  }
+
+  [[nodiscard]] size_t size() const { return n_points; }
+  [[nodiscard]] const Vector3D& operator[](size_t idx) const {
+    assert(idx < n_points);
+    return points[idx];
+  }
+
+ private:
+  std::array<Vector3D, 6> points;
+  size_t                  n_points = 0;
+};
+
+// True when every vertex of `other` is certainly on the same side of the
+// plane of `tri` and farther from it than the math::eps Plane::is_contains
+// allows. Uses the orient3d filter only: |det| / |normal| is the distance, so
+// no plane has to be built and nothing is normalized.
+bool is_separated_by_plane(const Triangle& tri, const Triangle& other) {
+  const FilteredDet da = orient3d_filter(tri.a, tri.b, tri.c, other.a);
+  const FilteredDet db = orient3d_filter(tri.a, tri.b, tri.c, other.b);
+  const FilteredDet dc = orient3d_filter(tri.a, tri.b, tri.c, other.c);
+
+  const bool same_side = (da.det > 0.0 && db.det > 0.0 && dc.det > 0.0) ||
+                         (da.det < 0.0 && db.det < 0.0 && dc.det < 0.0);
+  if (!same_side) { return false; }
+
+  const double min_dist =
+      std::fmin(std::fmin(std::fabs(da.det) - da.error,
+                    std::fabs(db.det) - db.error),
+          std::fabs(dc.det) - dc.error);
+  if (min_dist <= 0.0) { return false; }
+
+  const Vector3D normal = (tri.b - tri.a).cross(tri.c - tri.a);
+  return min_dist * min_dist > math::sqr(math::eps) * normal.scalar(normal);
+}
+
+// Edge functions of every vertex of one triangle against every edge of the
+// other: [i][j] belongs to edge i and vertex j. They are shared by the
+// containment tests and the edge crossing tests, and come from the exact
+// orient2d, so the strict crossing test can't be fooled by rounding.
+using EdgeFunctions = std::array<std::array<double, 3>, 3>;
+
+// One triangle of a coplanar pair projected onto the two coordinate axes that
+// dominate the shared plane (the dropped axis is the normal's largest
+// component, so the projection never degenerates).
+struct CoplanarView {
+  std::array<Vector3D, 3> vertices;
+  size_t                  u_axis;
+  size_t                  v_axis;
+
+  Vector3D unit_normal;
+  double   plane_D;
+  double   orientation;  // sign of the normal along the dropped axis
+  double   tol_factor;   // (eps * |n_axis| / |n|)^2
+
+  std::array<double, 3> u;
+  std::array<double, 3> v;
+  std::array<double, 3> edge_len2;
+
+  CoplanarView(const Triangle& tri, const size_t axis)
+      : vertices{tri.a, tri.b, tri.c},
+        u_axis((axis + 1) % 3),
+        v_axis((axis + 2) % 3) {
+    const Vector3D normal = (tri.b - tri.a).cross(tri.c - tri.a);
+
+    unit_normal = normal / normal.length();
+    plane_D     = unit_normal.scalar(tri.a);
+    orientation = normal[axis] < 0.0 ? -1.0 : 1.0;
+    tol_factor  = math::sqr(math::eps * unit_normal[axis]);
+
+    for (size_t i = 0; i < 3; ++i) {
+      const Vector3D edge = vertices[(i + 1) % 3] - vertices[i];
+
+      u[i]         = vertices[i][u_axis];
+      v[i]         = vertices[i][v_axis];
+      edge_len2[i] = edge.scalar(edge);
+    }
+  }
+
+  [[nodiscard]] static size_t dominant_axis(const Triangle& tri) {
+    const Vector3D normal = (tri.b - tri.a).cross(tri.c - tri.a);
+    const double   nx     = std::fabs(normal.x);
+    const double   ny     = std::fabs(normal.y);
+    const double   nz     = std::fabs(normal.z);
+    return (nx >= ny && nx >= nz) ? 0 : (ny >= nz ? 1 : 2);
+  }
+
+  [[nodiscard]] EdgeFunctions edge_functions(const CoplanarView& other) const {
+    EdgeFunctions values;
+    for (size_t i = 0; i < 3; ++i) {
+      const size_t next = (i + 1) % 3;
+      for (size_t j = 0; j < 3; ++j) {
+        values[i][j] = orient2d(u[i], v[i], u[next], v[next], other.u[j],
+            other.v[j]);
+      }
+    }
+    return values;
+  }
+
+  // Same tolerance as Triangle::is_inside: the point is on the plane within
+  // math::eps and on the inner side of every edge up to
+  // eps * |edge| * |p - edge start|, measured in 3D and compared squared.
+  [[nodiscard]] bool is_inside(
+      const Vector3D& p, const EdgeFunctions& edges, const size_t p_idx) const {
+    if (!math::is_zero(unit_normal.scalar(p) - plane_D)) { return false; }
+
+    for (size_t i = 0; i < 3; ++i) {
+      const double side = orientation * edges[i][p_idx];
+      if (side >= 0.0) { continue; }
+
+      const Vector3D to_p = p - vertices[i];
+      if (side * side > tol_factor * edge_len2[i] * to_p.scalar(to_p)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+}  // namespace
+
 Triangle::Triangle(const Vector3D& a, const Vector3D& b,
                    const Vector3D& c)
     : a(a), b(b), c(c) {
@@ -124,6 +257,11 @@ bool Triangle::is_intersect(const Triangle& other) const {
     return this->is_intersect(Section{p, q});
   }
 
+  if (is_separated_by_plane(*this, other) ||
+      is_separated_by_plane(other, *this)) {
+    return false;
+  }
+
   const Plane first_pl = this->get_plane();
   const Plane second_pl = other.get_plane();
 
@@ -181,27 +319,29 @@ bool Triangle::is_intersect_2d(const Triangle& other) const {
   assert(other.is_valid());
   assert(this->get_plane().is_match(other.get_plane()));
 
-  const Section ab{a, b};
-  const Section bc{b, c};
-  const Section ca{c, a};
-  const Section other_ab{other.a, other.b};
-  const Section other_bc{other.b, other.c};
-  const Section other_ca{other.c, other.a};
+  const size_t       axis = CoplanarView::dominant_axis(*this);
+  const CoplanarView lhs{*this, axis};
+  const CoplanarView rhs{other, axis};
 
-  const Section* sides1[3] = {&ab, &bc, &ca};
-  const Section* sides2[3] = {&other_ab, &other_bc, &other_ca};
+  const EdgeFunctions lhs_edges = lhs.edge_functions(rhs);
+  const EdgeFunctions rhs_edges = rhs.edge_functions(lhs);
 
-  if (is_inside(other.a) || is_inside(other.b) || is_inside(other.c)) {
-    return true;
+  for (size_t j = 0; j < 3; ++j) {
+    if (lhs.is_inside(rhs.vertices[j], lhs_edges, j)) { return true; }
+    if (rhs.is_inside(lhs.vertices[j], rhs_edges, j)) { return true; }
   }
 
-  if (other.is_inside(a) || other.is_inside(b) || other.is_inside(c)) {
-    return true;
-  }
-
-  for (size_t i = 0; i < 3; i++) {
-    for (size_t j = 0; j < 3; j++) {
-      if (sides1[i]->is_intersect(*sides2[j])) { return true; };
+  // With no vertex inside the other triangle the only way left to overlap is
+  // a proper crossing of two edges: touching and collinear edges always put
+  // some vertex on the other triangle's boundary.
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      const double d1 = lhs_edges[i][j];
+      const double d2 = lhs_edges[i][(j + 1) % 3];
+      const double d3 = rhs_edges[j][i];
+      const double d4 = rhs_edges[j][(i + 1) % 3];
+
+      if (d1 * d2 < 0.0 && d3 * d4 < 0.0) { return true; }
     }
   }
 
@@ -223,7 +363,7 @@ bool Triangle::is_intersect_3d(const Triangle& other) const {
   assert(intersect_line.is_valid());
 
   const Section* sides1[3] = {&ab, &bc, &ca};
-  std::vector<Vector3D> intersect_points1;
+  LinePoints intersect_points1;
 
   for (size_t i = 0; i < 3; i++) {
     if (sides1[i]->is_belong(intersect_line)) {
@@ -239,7 +379,7 @@ bool Triangle::is_intersect_3d(const Triangle& other) const {
   if (intersect_points1.size() < 2) { return false; }
 
   const Section* sides2[3] = {&other_ab, &other_bc, &other_ca};
-  std::vector<Vector3D> intersect_points2;
+  LinePoints intersect_points2;
 
   for (size_t i = 0; i < 3; i++) {
     if (sides2[i]->is_belong(intersect_line)) {
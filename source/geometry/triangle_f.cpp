@@ -0,0 +1,109 @@
+#include "geometry/triangle_f.hpp"
+
+#include <cassert>
+#include <cmath>
+
+#include "geometry/triangle.hpp"
+#include "geometry/vector_3d.hpp"
+#include "math/math.hpp"
+
+namespace geometry {
+
+namespace {
+
+// Half an ulp of 1.0f.
+constexpr float unit_roundoff_f = 0x1p-24f;
+
+// Error bounds of the float filter relative to the permanents of the
+// expressions. Float orient3d needs (7 + 56u)u and the cross product about
+// 4u; the extra headroom covers the rounding of the permanents themselves and
+// of the double re-evaluation in Triangle::is_intersect.
+constexpr float det_bound    = 16.0f * unit_roundoff_f;
+constexpr float normal_bound = 16.0f * unit_roundoff_f;
+
+// Below this the products may be subnormal and lose their relative accuracy.
+constexpr float min_permanent = 0x1p-100f;
+
+// Twice the distance Plane::is_contains tolerates, so that a float answer
+// stays certain after the double normal is rounded differently.
+constexpr float separation_tol = static_cast<float>(2.0 * math::eps);
+
+// Float version of the double is_separated_by_plane in triangle.cpp. It
+// returns true only when every vertex of `other` is farther than
+// 2 * math::eps from the plane of `tri` on the same side, with all rounding
+// accounted for, so the double test is then certain to report the same.
+bool is_separated_by_plane(const TriangleF& tri, const TriangleF& other) {
+  const Vector3F ab = tri.b - tri.a;
+  const Vector3F ac = tri.c - tri.a;
+  const Vector3F n  = ab.cross(ac);
+
+  const float n_permanent =
+      std::fabs(ab.y * ac.z) + std::fabs(ab.z * ac.y) +
+      std::fabs(ab.z * ac.x) + std::fabs(ab.x * ac.z) +
+      std::fabs(ab.x * ac.y) + std::fabs(ab.y * ac.x);
+  if (!(n_permanent > min_permanent)) { return false; }
+
+  const float threshold =
+      separation_tol * (n.length() + normal_bound * n_permanent);
+
+  float sign = 0.0f;
+  for (const Vector3F* d : {&other.a, &other.b, &other.c}) {
+    const Vector3F ad = tri.a - *d;
+    const Vector3F bd = tri.b - *d;
+    const Vector3F cd = tri.c - *d;
+
+    const float det = ad.x * (bd.y * cd.z - bd.z * cd.y) +
+                      ad.y * (bd.z * cd.x - bd.x * cd.z) +
+                      ad.z * (bd.x * cd.y - bd.y * cd.x);
+    const float permanent =
+        std::fabs(ad.x) * (std::fabs(bd.y * cd.z) + std::fabs(bd.z * cd.y)) +
+        std::fabs(ad.y) * (std::fabs(bd.z * cd.x) + std::fabs(bd.x * cd.z)) +
+        std::fabs(ad.z) * (std::fabs(bd.x * cd.y) + std::fabs(bd.y * cd.x));
+    if (!(permanent > min_permanent)) { return false; }
+
+    if (!(std::fabs(det) - det_bound * permanent > threshold)) { return false; }
+    if (sign * det < 0.0f) { return false; }
+    sign = det;
+  }
+  return true;
+}
+
+}  // namespace
+
+TriangleF::TriangleF(const Vector3F& a, const Vector3F& b, const Vector3F& c)
+    : a(a), b(b), c(c) {
+  assert(a.is_valid() && b.is_valid() && c.is_valid());
+
+  const Triangle tri = to_triangle();
+  degenerate         = tri.is_point() || tri.is_section();
+}
+
+Triangle TriangleF::to_triangle() const {
+  return Triangle{Vector3D{a}, Vector3D{b}, Vector3D{c}};
+}
+
+Vector3D TriangleF::get_centre() const {
+  assert(this->is_valid());
+
+  return {(double{a.x} + b.x + c.x) / 3.0, (double{a.y} + b.y + c.y) / 3.0,
+          (double{a.z} + b.z + c.z) / 3.0};
+}
+
+bool TriangleF::is_valid() const {
+  return a.is_valid() && b.is_valid() && c.is_valid();
+}
+
+bool TriangleF::is_intersect(const TriangleF& other) const {
+  assert(this->is_valid());
+  assert(other.is_valid());
+
+  if (!degenerate && !other.degenerate &&
+      (is_separated_by_plane(*this, other) ||
+          is_separated_by_plane(other, *this))) {
+    return false;
+  }
+
+  return to_triangle().is_intersect(other.to_triangle());
+}
+
+}  // namespace geometry
@@ -0,0 +1,417 @@
+#include "server/scene_server.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "acceleration/bvh_tree.hpp"
+#include "acceleration/dispatcher.hpp"
+#include "geometry/triangle_f.hpp"
+#include "server/channel.hpp"
+#include "utils/logger.hpp"
+#include "utils/triangle_io.hpp"
+
+namespace server {
+
+namespace fs = std::filesystem;
+
+using detail::Channel;
+using geometry::TriangleF;
+
+namespace {
+
+// Query triangles per pool task.
+constexpr size_t query_grain = 256;
+// Replies may carry exception messages, so their lines get more room.
+constexpr size_t max_reply_line = 1 << 16;
+
+sockaddr_un socket_address(const fs::path& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+
+  const std::string& name = path.native();
+  if (name.empty() || name.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Invalid socket path: " + name);
+  }
+  std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+  return address;
+}
+
+// A connected socket, or -1 with errno set.
+int connect_to(const fs::path& path) {
+  const sockaddr_un address = socket_address(path);
+  const int         fd      = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) { return -1; }
+
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&address),
+          sizeof(address)) != 0) {
+    const int error = errno;
+    ::close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+std::runtime_error system_error(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+std::string ok_reply(const size_t n_lines, std::string_view body = {}) {
+  std::string reply = "OK " + std::to_string(n_lines) + "\n";
+  reply.append(body);
+  return reply;
+}
+
+std::string error_reply(std::string message) {
+  std::replace(message.begin(), message.end(), '\n', ' ');
+  return "ERR " + message + "\n";
+}
+
+std::vector<TriangleF> parse_triangles(
+    std::string_view payload, utils::ThreadPool& pool) {
+  std::istringstream in{std::string(payload)};
+  return utils::read_triangles(in, pool);
+}
+
+// write_intersections() output and the number of lines in it.
+std::string flags_reply(
+    const std::vector<bool>& flags, utils::ThreadPool& pool) {
+  std::ostringstream body;
+  utils::write_intersections(body, flags, pool);
+  return ok_reply(static_cast<size_t>(
+                      std::count(flags.begin(), flags.end(), true)),
+      body.str());
+}
+
+}  // namespace
+
+fs::path default_socket_path() {
+  if (const char* path = std::getenv("TRIANGLES_SOCKET"); path && *path) {
+    return path;
+  }
+  if (const char* dir = std::getenv("XDG_RUNTIME_DIR"); dir && *dir) {
+    return fs::path(dir) / "triangles.sock";
+  }
+  return fs::temp_directory_path() /
+         ("triangles-" + std::to_string(::getuid()) + ".sock");
+}
+
+// The triangles and the tree over them; FLAGS is answered once and then
+// served from the cached reply.
+class Scene {
+ public:
+  Scene(std::vector<TriangleF> triangles_, utils::Arena& scratch,
+      utils::ThreadPool& pool_)
+      : triangles(std::move(triangles_)),
+        pool(pool_),
+        tree(triangles, acceleration::BuildEngine::Auto, scratch, pool) {}
+
+  [[nodiscard]] size_t size() const { return triangles.size(); }
+  [[nodiscard]] acceleration::BuildEngine engine() const {
+    return tree.build_engine();
+  }
+  [[nodiscard]] const utils::ArenaStats& build_memory() const {
+    return tree.build_memory_stats();
+  }
+
+  [[nodiscard]] const std::string& flags() const {
+    std::call_once(flags_once, [this] {
+      flags_text = flags_reply(
+          tree.get_intersections(acceleration::default_query_options()),
+          pool);
+    });
+    return flags_text;
+  }
+
+  [[nodiscard]] std::vector<bool> query(
+      const std::vector<TriangleF>& queries) const {
+    std::vector<uint8_t> hits(queries.size());
+    pool.parallel_for(0, queries.size(), query_grain,
+        [&](const size_t lo, const size_t hi) {
+          for (size_t i = lo; i < hi; ++i) {
+            hits[i] = tree.intersects_any(queries[i]);
+          }
+        });
+    return std::vector<bool>(hits.begin(), hits.end());
+  }
+
+  double build_ms = 0.0;
+
+ private:
+  std::vector<TriangleF>           triangles;
+  utils::ThreadPool&               pool;
+  acceleration::BVHTree<TriangleF> tree;
+
+  mutable std::once_flag flags_once;
+  mutable std::string    flags_text;
+};
+
+SceneServer::SceneServer(fs::path socket_path_, utils::ThreadPool& pool_)
+    : socket_path(std::move(socket_path_)), pool(pool_) {
+  const sockaddr_un address = socket_address(socket_path);
+
+  // A socket file nobody listens on is left over from a killed server.
+  std::error_code error;
+  if (fs::is_socket(socket_path, error)) {
+    if (const int fd = connect_to(socket_path); fd >= 0) {
+      ::close(fd);
+      throw std::runtime_error(
+          "A server already listens on " + socket_path.string());
+    }
+    fs::remove(socket_path, error);
+  }
+
+  listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) { throw system_error("socket"); }
+  if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address),
+          sizeof(address)) != 0 ||
+      ::listen(listen_fd, SOMAXCONN) != 0) {
+    const std::runtime_error failure =
+        system_error("Cannot listen on " + socket_path.string());
+    ::close(listen_fd);
+    throw failure;
+  }
+  if (::pipe2(wake_fds, O_CLOEXEC) != 0) {
+    const std::runtime_error failure = system_error("pipe");
+    ::close(listen_fd);
+    fs::remove(socket_path, error);
+    throw failure;
+  }
+  LOG_INFO("Listening on {}", socket_path.string());
+}
+
+SceneServer::~SceneServer() {
+  close_listener();
+  ::close(wake_fds[0]);
+  ::close(wake_fds[1]);
+}
+
+void SceneServer::close_listener() {
+  if (listen_fd < 0) { return; }
+  ::close(listen_fd);
+  listen_fd = -1;
+
+  std::error_code error;
+  fs::remove(socket_path, error);
+}
+
+void SceneServer::run() {
+  while (!stopping.load()) {
+    pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake_fds[0], POLLIN, 0}};
+    if (::poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) { continue; }
+      LOG_ERR("poll: {}", std::strerror(errno));
+      break;
+    }
+    if (fds[1].revents != 0 || !(fds[0].revents & POLLIN)) { continue; }
+
+    const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) { continue; }
+
+    // Finished connections are joined here, so the list stays short.
+    connections.remove_if([](Connection& connection) {
+      if (!connection.done.load()) { return false; }
+      connection.thread.join();
+      ::close(connection.fd);
+      return true;
+    });
+
+    Connection& connection = connections.emplace_back();
+    connection.fd          = fd;
+    connection.thread = std::thread([this, &connection] { serve(connection); });
+    ++n_connections;
+  }
+
+  // New clients are refused from here on; the connections blocked in
+  // recv() are woken up.
+  close_listener();
+  for (Connection& connection : connections) {
+    ::shutdown(connection.fd, SHUT_RDWR);
+  }
+  for (Connection& connection : connections) {
+    connection.thread.join();
+    ::close(connection.fd);
+  }
+  connections.clear();
+  LOG_INFO("Server stopped");
+}
+
+void SceneServer::stop() {
+  stopping.store(true);
+  const char byte = 1;
+  [[maybe_unused]] const ssize_t written = ::write(wake_fds[1], &byte, 1);
+}
+
+// A request line that can't be parsed ends the connection: the payload
+// size is unknown, so the stream can't be resynchronized.
+void SceneServer::serve(Connection& connection) {
+  std::string buffer;
+  std::string line;
+  std::string payload;
+  Channel     channel(connection.fd, buffer);
+
+  while (channel.read_line(line, max_request_line)) {
+    const size_t           space   = line.find(' ');
+    const std::string_view command = std::string_view(line).substr(0, space);
+
+    size_t payload_bytes = 0;
+    if (space != std::string::npos) {
+      const char* first = line.data() + space + 1;
+      const char* last  = line.data() + line.size();
+      const auto [ptr, ec] = std::from_chars(first, last, payload_bytes);
+      if (ec != std::errc{} || ptr != last ||
+          payload_bytes > max_payload_bytes) {
+        (void)channel.write_all(error_reply("Bad payload size: " + line));
+        break;
+      }
+    }
+    if (!channel.read_bytes(payload_bytes, payload)) { break; }
+
+    const std::string reply = handle(command, payload);
+    if (!channel.write_all(reply)) { break; }
+    if (command == "SHUTDOWN") {
+      stop();
+      break;
+    }
+  }
+  connection.done.store(true);
+}
+
+std::string SceneServer::handle(
+    const std::string_view command, const std::string_view payload) {
+  ++n_requests;
+  try {
+    if (command == "LOAD") {
+      std::vector<TriangleF> triangles = parse_triangles(payload, pool);
+      std::shared_ptr<Scene> next;
+      {
+        // One build at a time, all in the same scratch.
+        const std::lock_guard<std::mutex> lock(build_mutex);
+        const auto start = std::chrono::steady_clock::now();
+        next = std::make_shared<Scene>(std::move(triangles), build_arena, pool);
+        next->build_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start)
+                             .count();
+      }
+
+      const size_t n_triangles = next->size();
+      {
+        const std::lock_guard<std::mutex> lock(scene_mutex);
+        scene = std::move(next);
+      }
+      ++n_loads;
+      return ok_reply(1, std::to_string(n_triangles) + "\n");
+    }
+    if (command == "QUERY") {
+      const std::shared_ptr<const Scene> current = current_scene();
+      const std::vector<TriangleF> queries = parse_triangles(payload, pool);
+      n_queries += queries.size();
+      return flags_reply(current->query(queries), pool);
+    }
+    if (command == "FLAGS") { return current_scene()->flags(); }
+    if (command == "STATS") {
+      std::shared_ptr<const Scene> current;
+      {
+        const std::lock_guard<std::mutex> lock(scene_mutex);
+        current = scene;
+      }
+      const double uptime_s = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - started)
+                                  .count();
+
+      std::ostringstream body;
+      body << "triangles " << (current ? current->size() : 0) << "\n"
+           << "engine "
+           << (current ? acceleration::to_string(current->engine()) : "none")
+           << "\n"
+           << "build_ms " << (current ? current->build_ms : 0.0) << "\n"
+           << "build_allocations "
+           << (current ? current->build_memory().n_allocations : 0) << "\n"
+           << "build_scratch_bytes "
+           << (current ? current->build_memory().peak_bytes : 0) << "\n"
+           << "loads " << n_loads.load() << "\n"
+           << "queries " << n_queries.load() << "\n"
+           << "requests " << n_requests.load() << "\n"
+           << "connections " << n_connections.load() << "\n"
+           << "uptime_s " << uptime_s << "\n";
+      return ok_reply(10, body.str());
+    }
+    if (command == "PING" || command == "SHUTDOWN") { return ok_reply(0); }
+    return error_reply("Unknown command: " + std::string(command));
+  } catch (const std::exception& e) {
+    return error_reply(e.what());
+  }
+}
+
+std::shared_ptr<const Scene> SceneServer::current_scene() {
+  const std::lock_guard<std::mutex> lock(scene_mutex);
+  if (!scene) { throw std::runtime_error("No scene loaded"); }
+  return scene;
+}
+
+SceneClient::SceneClient(const fs::path& socket_path)
+    : fd(connect_to(socket_path)) {
+  if (fd < 0) {
+    throw system_error("Cannot connect to " + socket_path.string());
+  }
+}
+
+SceneClient::~SceneClient() { ::close(fd); }
+
+Reply SceneClient::request(
+    const std::string_view command, const std::string_view payload) {
+  std::string header(command);
+  if (!payload.empty()) { header += " " + std::to_string(payload.size()); }
+  header += "\n";
+
+  Channel channel(fd, buffer);
+  if (!channel.write_all(header) || !channel.write_all(payload)) {
+    throw std::runtime_error("Connection to the server lost");
+  }
+
+  std::string status;
+  if (!channel.read_line(status, max_reply_line)) {
+    throw std::runtime_error("Connection to the server lost");
+  }
+
+  Reply reply;
+  if (status.starts_with("ERR ")) {
+    reply.error = status.substr(4);
+    return reply;
+  }
+
+  size_t n_lines = 0;
+  const auto [ptr, ec] = std::from_chars(
+      status.data() + std::min<size_t>(3, status.size()),
+      status.data() + status.size(), n_lines);
+  if (!status.starts_with("OK ") || ec != std::errc{} ||
+      ptr != status.data() + status.size()) {
+    throw std::runtime_error("Malformed reply: " + status);
+  }
+
+  reply.ok = true;
+  reply.lines.resize(n_lines);
+  for (std::string& line : reply.lines) {
+    if (!channel.read_line(line, max_reply_line)) {
+      throw std::runtime_error("Connection to the server lost");
+    }
+  }
+  return reply;
+}
+
+}  // namespace server
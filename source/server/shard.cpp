@@ -0,0 +1,440 @@
+#include "server/shard.hpp"
+
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "acceleration/AABB.hpp"
+#include "acceleration/bvh_tree.hpp"
+#include "server/channel.hpp"
+#include "utils/logger.hpp"
+
+extern char** environ;
+
+namespace server {
+
+using acceleration::AABB;
+using detail::Channel;
+using geometry::TriangleF;
+using geometry::Vector3F;
+
+namespace {
+
+// Triangles per pool task when boxing the scene and collecting ghosts.
+constexpr size_t shard_grain = 1 << 14;
+
+std::runtime_error system_error(const std::string& what, const int error) {
+  return std::runtime_error(what + ": " + std::strerror(error));
+}
+
+bool write_message(Channel& channel, const std::string_view command,
+    const std::string_view payload) {
+  const std::string line =
+      std::string(command) + " " + std::to_string(payload.size()) + "\n";
+  return channel.write_all(line) && channel.write_all(payload);
+}
+
+enum class Read { Message, End, Broken };
+
+// The next `COMMAND <bytes>` line and its payload. `buffer` is the one
+// behind `channel`: the stream may only end between messages.
+Read read_message(Channel& channel, const std::string& buffer,
+    std::string& command, std::string& payload) {
+  std::string line;
+  if (!channel.read_line(line, max_shard_line)) {
+    return buffer.empty() ? Read::End : Read::Broken;
+  }
+
+  const size_t space = line.find(' ');
+  if (space == std::string::npos) { return Read::Broken; }
+  size_t      bytes = 0;
+  const char* last  = line.data() + line.size();
+  const auto [ptr, ec] = std::from_chars(line.data() + space + 1, last, bytes);
+  if (ec != std::errc{} || ptr != last || bytes > max_shard_bytes) {
+    return Read::Broken;
+  }
+
+  command.assign(line, 0, space);
+  try {
+    return channel.read_bytes(bytes, payload) ? Read::Message : Read::Broken;
+  } catch (const std::bad_alloc&) { return Read::Broken; }
+}
+
+std::string shard_payload(const std::vector<TriangleF>& scene,
+    const std::vector<uint64_t>& owned, const std::vector<uint64_t>& ghosts) {
+  ShardHeader header;
+  header.n_owned  = owned.size();
+  header.n_ghosts = ghosts.size();
+
+  const size_t bytes =
+      sizeof(header) + (owned.size() + ghosts.size()) * 9 * sizeof(float);
+  if (bytes > max_shard_bytes) {
+    throw std::length_error("A shard of " + std::to_string(bytes) +
+                            " bytes is over max_shard_bytes");
+  }
+
+  std::string payload(bytes, '\0');
+  std::memcpy(payload.data(), &header, sizeof(header));
+
+  char* out = payload.data() + sizeof(header);
+  for (const std::vector<uint64_t>* part : {&owned, &ghosts}) {
+    for (const uint64_t index : *part) {
+      const TriangleF& tri       = scene[index];
+      const float      coords[9] = {tri.a.x, tri.a.y, tri.a.z, tri.b.x,
+               tri.b.y, tri.b.z, tri.c.x, tri.c.y, tri.c.z};
+      std::memcpy(out, coords, sizeof(coords));
+      out += sizeof(coords);
+    }
+  }
+  return payload;
+}
+
+// The FLAGS payload of a SHARD payload.
+std::string query_shard(
+    const std::string_view payload, utils::ThreadPool& pool) {
+  ShardHeader header;
+  if (payload.size() < sizeof(header)) {
+    throw std::runtime_error("Truncated shard");
+  }
+  std::memcpy(&header, payload.data(), sizeof(header));
+  if (header.magic != shard_magic) {
+    throw std::runtime_error("Not a shard, or of another byte order");
+  }
+  if (header.version != shard_protocol_version) {
+    throw std::runtime_error("Shard protocol version " +
+                             std::to_string(header.version) + ", expected " +
+                             std::to_string(shard_protocol_version));
+  }
+
+  const size_t n           = header.n_owned + header.n_ghosts;
+  const size_t coord_bytes = payload.size() - sizeof(header);
+  if (n < header.n_owned || coord_bytes % (9 * sizeof(float)) != 0 ||
+      coord_bytes / (9 * sizeof(float)) != n) {
+    throw std::runtime_error("Shard size doesn't match its header");
+  }
+
+  const char* const      coords = payload.data() + sizeof(header);
+  const Vector3F         origin{0.0f, 0.0f, 0.0f};
+  std::vector<TriangleF> triangles(n, TriangleF{origin, origin, origin});
+  pool.parallel_for(0, n, shard_grain, [&](const size_t lo, const size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+      float c[9];
+      std::memcpy(c, coords + i * sizeof(c), sizeof(c));
+      triangles[i] = TriangleF{Vector3F{c[0], c[1], c[2]},
+          Vector3F{c[3], c[4], c[5]}, Vector3F{c[6], c[7], c[8]}};
+    }
+  });
+
+  const std::vector<bool> flags =
+      acceleration::find_all_intersections(triangles, pool);
+  std::string bits((header.n_owned + 7) / 8, '\0');
+  for (size_t i = 0; i < header.n_owned; ++i) {
+    if (flags[i]) { bits[i / 8] |= static_cast<char>(1 << (i % 8)); }
+  }
+  return bits;
+}
+
+// A worker process with one end of a socket pair as its stdin and stdout.
+// Closing the socket ends the worker's input, so it exits.
+class Worker {
+ public:
+  Worker(const std::vector<std::string>& command, const size_t n_threads) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+      throw system_error("socketpair", errno);
+    }
+    fd = fds[0];
+
+    std::vector<std::string> env;
+    for (char** var = environ; *var; ++var) {
+      if (!std::string_view(*var).starts_with("TRIANGLES_THREADS=")) {
+        env.emplace_back(*var);
+      }
+    }
+    env.push_back("TRIANGLES_THREADS=" + std::to_string(n_threads));
+
+    std::vector<char*> argv;
+    for (const std::string& arg : command) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    std::vector<char*> envp;
+    for (std::string& var : env) { envp.push_back(var.data()); }
+    envp.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    const int error = ::posix_spawn(
+        &pid, argv[0], &actions, nullptr, argv.data(), envp.data());
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(fds[1]);
+    if (error != 0) {
+      ::close(fd);
+      throw system_error("Can't start shard worker " + command[0], error);
+    }
+  }
+
+  ~Worker() {
+    ::close(fd);
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      LOG_WARN("Shard worker {} exited with status {}", pid, status);
+    }
+  }
+
+  Worker(const Worker&)            = delete;
+  Worker& operator=(const Worker&) = delete;
+
+  // Sends a SHARD and returns the FLAGS payload of the reply.
+  [[nodiscard]] std::string query(const std::string_view shard) {
+    std::string buffer;
+    Channel     channel(fd, buffer);
+    if (!write_message(channel, "SHARD", shard)) {
+      throw std::runtime_error("Shard worker " + std::to_string(pid) +
+                               " stopped reading");
+    }
+
+    std::string command;
+    std::string reply;
+    if (read_message(channel, buffer, command, reply) != Read::Message) {
+      throw std::runtime_error("Shard worker " + std::to_string(pid) +
+                               " stopped answering");
+    }
+    if (command == "ERR") {
+      throw std::runtime_error("Shard worker " + std::to_string(pid) + ": " +
+                               reply);
+    }
+    if (command != "FLAGS") {
+      throw std::runtime_error("Unexpected reply from a shard worker: " +
+                               command);
+    }
+    return reply;
+  }
+
+ private:
+  int   fd  = -1;
+  pid_t pid = -1;
+};
+
+}  // namespace
+
+detail::ShardPlan detail::plan_shards(const std::vector<TriangleF>& scene,
+    size_t n_shards, utils::ThreadPool& pool) {
+  n_shards     = std::max<size_t>(n_shards, 1);
+  const size_t n = scene.size();
+
+  std::vector<AABB>                 boxes(n);
+  std::vector<std::array<float, 3>> centres(n);
+  pool.parallel_for(0, n, shard_grain, [&](const size_t lo, const size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+      boxes[i] = AABB(scene[i]).loosened();
+      for (size_t axis = 0; axis < 3; ++axis) {
+        centres[i][axis] = (boxes[i].min[axis] + boxes[i].max[axis]) / 2;
+      }
+    }
+  });
+
+  // Median splits of the centres, k shards per range.
+  std::vector<uint64_t> order(n);
+  std::iota(order.begin(), order.end(), uint64_t{0});
+  std::vector<std::pair<size_t, size_t>> ranges;
+  auto split = [&](auto& self, const size_t first, const size_t last,
+                   const size_t k) -> void {
+    if (k == 1) {
+      ranges.emplace_back(first, last);
+      return;
+    }
+    float lo[3] = {INFINITY, INFINITY, INFINITY};
+    float hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t i = first; i < last; ++i) {
+      for (size_t axis = 0; axis < 3; ++axis) {
+        lo[axis] = std::min(lo[axis], centres[order[i]][axis]);
+        hi[axis] = std::max(hi[axis], centres[order[i]][axis]);
+      }
+    }
+    size_t axis = 0;
+    for (size_t a = 1; a < 3; ++a) {
+      if (hi[a] - lo[a] > hi[axis] - lo[axis]) { axis = a; }
+    }
+
+    const size_t mid = first + (last - first) * (k / 2) / k;
+    std::nth_element(order.begin() + static_cast<ptrdiff_t>(first),
+        order.begin() + static_cast<ptrdiff_t>(mid),
+        order.begin() + static_cast<ptrdiff_t>(last),
+        [&](const uint64_t a, const uint64_t b) {
+          return centres[a][axis] < centres[b][axis];
+        });
+    self(self, first, mid, k / 2);
+    self(self, mid, last, k - k / 2);
+  };
+  split(split, 0, n, n_shards);
+
+  ShardPlan             plan;
+  std::vector<uint32_t> owner(n);
+  std::vector<AABB>     bounds(n_shards);
+  plan.owned.resize(n_shards);
+  plan.ghosts.resize(n_shards);
+  for (size_t s = 0; s < n_shards; ++s) {
+    const auto [first, last] = ranges[s];
+    plan.owned[s].assign(order.begin() + static_cast<ptrdiff_t>(first),
+        order.begin() + static_cast<ptrdiff_t>(last));
+    std::sort(plan.owned[s].begin(), plan.owned[s].end());
+    for (size_t i = 0; i < plan.owned[s].size(); ++i) {
+      const uint64_t index = plan.owned[s][i];
+      owner[index]         = static_cast<uint32_t>(s);
+      if (i == 0) {
+        bounds[s] = boxes[index];
+      } else {
+        bounds[s].merge(boxes[index]);
+      }
+    }
+  }
+
+  const size_t n_ranges = (n + shard_grain - 1) / shard_grain;
+  for (size_t s = 0; s < n_shards; ++s) {
+    if (plan.owned[s].empty()) { continue; }
+
+    std::vector<std::vector<uint64_t>> found(n_ranges);
+    pool.parallel_for(0, n_ranges, 1, [&](const size_t lo, const size_t hi) {
+      for (size_t k = lo; k < hi; ++k) {
+        const size_t last = std::min(n, (k + 1) * shard_grain);
+        for (size_t i = k * shard_grain; i < last; ++i) {
+          if (owner[i] != s && boxes[i].is_overlap(bounds[s])) {
+            found[k].push_back(i);
+          }
+        }
+      }
+    });
+    for (const std::vector<uint64_t>& part : found) {
+      plan.ghosts[s].insert(plan.ghosts[s].end(), part.begin(), part.end());
+    }
+  }
+  return plan;
+}
+
+std::vector<bool> find_intersections_sharded(
+    const std::vector<TriangleF>& scene, const ShardConfig& config,
+    ShardStats* stats, utils::ThreadPool& pool) {
+  const detail::ShardPlan plan =
+      detail::plan_shards(scene, config.n_shards, pool);
+  const size_t n_shards = plan.owned.size();
+
+  const std::vector<std::string> command =
+      config.worker_command.empty()
+          ? std::vector<std::string>{"/proc/self/exe", "--shard-worker"}
+          : config.worker_command;
+  const size_t n_threads =
+      config.threads_per_worker
+          ? config.threads_per_worker
+          : std::max<size_t>(std::thread::hardware_concurrency() / n_shards,
+                1);
+
+  // One thread per worker sends its shard and waits for the flags.
+  std::vector<std::string>        replies(n_shards);
+  std::vector<std::exception_ptr> errors(n_shards);
+  std::vector<std::thread>        threads;
+  for (size_t s = 0; s < n_shards; ++s) {
+    if (plan.owned[s].empty()) { continue; }
+    threads.emplace_back([&, s] {
+      try {
+        const std::string shard =
+            shard_payload(scene, plan.owned[s], plan.ghosts[s]);
+        Worker worker(command, n_threads);
+        replies[s] = worker.query(shard);
+      } catch (...) { errors[s] = std::current_exception(); }
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+  for (const std::exception_ptr& error : errors) {
+    if (error) { std::rethrow_exception(error); }
+  }
+
+  ShardStats        local;
+  std::vector<bool> flags(scene.size(), false);
+  for (size_t s = 0; s < n_shards; ++s) {
+    const std::vector<uint64_t>& owned = plan.owned[s];
+    if (replies[s].size() != (owned.size() + 7) / 8) {
+      throw std::runtime_error("Shard worker replied with " +
+                               std::to_string(replies[s].size()) +
+                               " bytes of flags for " +
+                               std::to_string(owned.size()) + " triangles");
+    }
+    for (size_t i = 0; i < owned.size(); ++i) {
+      if ((replies[s][i / 8] >> (i % 8)) & 1) { flags[owned[i]] = true; }
+    }
+
+    local.n_shards += owned.empty() ? 0 : 1;
+    local.n_ghosts += plan.ghosts[s].size();
+    local.max_shard_triangles = std::max(
+        local.max_shard_triangles, owned.size() + plan.ghosts[s].size());
+  }
+  LOG_INFO("Sharded: {} shards, {} ghosts", local.n_shards, local.n_ghosts);
+  if (stats) { *stats = local; }
+  return flags;
+}
+
+int serve_shards(const int in_fd, const int out_fd, utils::ThreadPool& pool) {
+  std::string in_buffer;
+  std::string out_buffer;
+  Channel     input(in_fd, in_buffer);
+  Channel     output(out_fd, out_buffer);
+
+  std::string command;
+  std::string payload;
+  while (true) {
+    switch (read_message(input, in_buffer, command, payload)) {
+      case Read::End: return 0;
+      case Read::Broken: return 1;
+      case Read::Message: break;
+    }
+
+    std::string reply_command = "FLAGS";
+    std::string reply;
+    try {
+      if (command != "SHARD") {
+        throw std::runtime_error("Unknown command: " + command);
+      }
+      reply = query_shard(payload, pool);
+    } catch (const std::exception& e) {
+      reply_command = "ERR";
+      reply         = e.what();
+    }
+    if (!write_message(output, reply_command, reply)) { return 1; }
+  }
+}
+
+std::optional<ShardConfig> default_shard_config() {
+  const char* env = std::getenv("TRIANGLES_SHARDS");
+  if (!env || !*env) { return std::nullopt; }
+
+  char*               end   = nullptr;
+  const unsigned long value = std::strtoul(env, &end, 10);
+  if (end == env || *end != '\0' || value == 0) {
+    LOG_WARN("Ignoring TRIANGLES_SHARDS={}", env);
+    return std::nullopt;
+  }
+
+  ShardConfig config;
+  config.n_shards = value;
+  return config;
+}
+
+}  // namespace server
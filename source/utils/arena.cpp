@@ -0,0 +1,124 @@
+#include "utils/arena.hpp"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace utils {
+
+namespace {
+
+[[nodiscard]] size_t align_up(const size_t value, const size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+[[nodiscard]] void* map_anonymous(const size_t size, const int extra_flags) {
+  void* const data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+  return data == MAP_FAILED ? nullptr : data;
+}
+
+}  // namespace
+
+Arena::Arena(const ArenaConfig& config_) : config(config_) {}
+
+Arena::~Arena() {
+  for (const Block& block : blocks) { free_block(block); }
+}
+
+void Arena::reset() {
+  const std::lock_guard<std::mutex> lock(mutex);
+  if (blocks.size() > 1) {
+    size_t total = 0;
+    for (const Block& block : blocks) {
+      total += block.size;
+      free_block(block);
+    }
+    blocks.clear();
+    blocks.push_back(allocate_block(total));
+  }
+
+  used             = 0;
+  current          = {};
+  current.capacity = blocks.empty() ? 0 : blocks.front().size;
+}
+
+ArenaStats Arena::stats() const {
+  const std::lock_guard<std::mutex> lock(mutex);
+  return current;
+}
+
+bool Arena::has_huge_pages() const {
+  const std::lock_guard<std::mutex> lock(mutex);
+  return std::any_of(blocks.begin(), blocks.end(),
+      [](const Block& block) { return block.huge; });
+}
+
+void* Arena::do_allocate(const size_t bytes, const size_t alignment) {
+  const std::lock_guard<std::mutex> lock(mutex);
+  ++current.n_allocations;
+
+  auto try_bump = [&]() -> void* {
+    if (blocks.empty()) { return nullptr; }
+    const Block&    block = blocks.back();
+    const uintptr_t base  = reinterpret_cast<uintptr_t>(block.data);
+    const size_t    start = align_up(base + used, alignment) - base;
+    if (start + bytes > block.size) { return nullptr; }
+
+    current.peak_bytes += start + bytes - used;
+    used = start + bytes;
+    return block.data + start;
+  };
+
+  if (void* const data = try_bump()) { return data; }
+
+  // The tail of the full block is given up; each new block doubles.
+  const size_t size =
+      blocks.empty()
+          ? std::max({bytes + alignment, config.initial_bytes, min_arena_block})
+          : std::max(bytes + alignment, 2 * blocks.back().size);
+  blocks.push_back(allocate_block(size));
+  used = 0;
+  ++current.n_blocks;
+  current.capacity += blocks.back().size;
+  return try_bump();
+}
+
+Arena::Block Arena::allocate_block(const size_t size) const {
+  Block block;
+  block.size = size;
+  if (!config.huge_pages) {
+    block.data = static_cast<std::byte*>(::operator new(size));
+    return block;
+  }
+
+  // Reserved huge pages if the system has them, else transparent ones.
+  block.size   = align_up(size, huge_page_size);
+  block.mapped = true;
+  void* data   = nullptr;
+#ifdef MAP_HUGETLB
+  data       = map_anonymous(block.size, MAP_HUGETLB);
+  block.huge = data != nullptr;
+#endif  // MAP_HUGETLB
+  if (!data) {
+    data = map_anonymous(block.size, 0);
+    if (!data) { throw std::bad_alloc(); }
+#ifdef MADV_HUGEPAGE
+    block.huge = ::madvise(data, block.size, MADV_HUGEPAGE) == 0;
+#endif  // MADV_HUGEPAGE
+  }
+  block.data = static_cast<std::byte*>(data);
+  return block;
+}
+
+void Arena::free_block(const Block& block) {
+  if (block.mapped) {
+    ::munmap(block.data, block.size);
+  } else {
+    ::operator delete(block.data);
+  }
+}
+
+}  // namespace utils
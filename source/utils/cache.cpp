@@ -0,0 +1,55 @@
+#include "utils/cache.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace utils {
+
+namespace fs = std::filesystem;
+
+fs::path cache_root() {
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    return fs::path(xdg) / "triangles";
+  }
+  if (const char* home = std::getenv("HOME"); home && *home) {
+    return fs::path(home) / ".cache" / "triangles";
+  }
+  return {};
+}
+
+bool write_file_atomic(const fs::path& path, std::string_view data) {
+  return write_file_atomic(path, [&](std::ostream& out) {
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  });
+}
+
+bool write_file_atomic(const fs::path& path,
+    const std::function<void(std::ostream&)>& write) {
+  std::error_code error;
+  fs::create_directories(path.parent_path(), error);
+  if (error) { return false; }
+
+  fs::path tmp = path;
+  tmp += ".tmp" + std::to_string(std::random_device{}());
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    write(file);
+    file.flush();
+    if (!file) {
+      fs::remove(tmp, error);
+      return false;
+    }
+  }
+
+  fs::rename(tmp, path, error);
+  if (error) {
+    fs::remove(tmp, error);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace utils
@@ -0,0 +1,211 @@
+#include "utils/thread_pool.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif  // __linux__
+
+#include "utils/logger.hpp"
+
+namespace utils {
+
+namespace {
+
+// Worker identity of the current thread, so forked tasks land on the
+// forking worker's own deque.
+thread_local const ThreadPool* current_pool   = nullptr;
+thread_local size_t            current_worker = 0;
+
+// Idle workers and joiners are woken by push(), joiners also by the end of
+// their group; the timeout only bounds a sleep.
+constexpr auto idle_poll_period = std::chrono::milliseconds(50);
+
+void pin_to_cpu(const size_t cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % CPU_SETSIZE, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    LOG_WARN("Failed to pin worker to CPU {}", cpu);
+  }
+#else
+  (void)cpu;
+#endif  // __linux__
+}
+
+}  // namespace
+
+size_t default_worker_count() {
+  if (const char* env = std::getenv("TRIANGLES_THREADS")) {
+    char*               end   = nullptr;
+    const unsigned long value = std::strtoul(env, &end, 10);
+    if (end != env && *end == '\0' && value > 0) { return value; }
+    LOG_WARN("Ignoring TRIANGLES_THREADS={}", env);
+  }
+  return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+ThreadPool::ThreadPool(const ThreadPoolConfig& config)
+    : n_workers(config.n_workers ? config.n_workers : default_worker_count()) {
+  if (n_workers <= 1) {
+    n_workers = 1;
+    return;
+  }
+
+  queues.reserve(n_workers);
+  for (size_t i = 0; i < n_workers; ++i) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+
+  threads.reserve(n_workers);
+  for (size_t i = 0; i < n_workers; ++i) {
+    threads.emplace_back(&ThreadPool::worker_loop, this, i, config.pin_workers);
+  }
+  LOG_INFO("Thread pool started with {} workers", n_workers);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  wake_up.notify_all();
+
+  for (std::thread& thread : threads) { thread.join(); }
+}
+
+ThreadPool& ThreadPool::instance() {
+  static ThreadPool pool{ThreadPoolConfig{default_worker_count()}};
+  return pool;
+}
+
+void ThreadPool::push(Task task, const size_t hint) {
+  size_t queue_idx = 0;
+  if (hint != any_worker) {
+    queue_idx = hint % n_workers;
+  } else if (current_pool == this) {
+    queue_idx = current_worker;
+  } else {
+    queue_idx = next_queue.fetch_add(1, std::memory_order_relaxed) % n_workers;
+  }
+
+  {
+    Queue&                      queue = *queues[queue_idx];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    n_queued.fetch_add(1, std::memory_order_relaxed);
+  }
+  wake_up.notify_one();
+  // A thread joining a group may steal the new task as well.
+  joiners.notify_all();
+}
+
+void ThreadPool::wake_joiners() {
+  std::lock_guard<std::mutex> lock(sleep_mutex);
+  joiners.notify_all();
+}
+
+bool ThreadPool::try_run_one() {
+  if (queues.empty()) { return false; }
+
+  Task task;
+  bool found = false;
+
+  const bool   is_worker = current_pool == this;
+  const size_t self      = is_worker ? current_worker : 0;
+
+  if (is_worker) {
+    Queue&                      own = *queues[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      found = true;
+    }
+  }
+
+  for (size_t i = 1; !found && i <= n_workers; ++i) {
+    Queue&                      victim = *queues[(self + i) % n_workers];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      found = true;
+    }
+  }
+
+  if (!found) { return false; }
+  n_queued.fetch_sub(1, std::memory_order_relaxed);
+
+  std::exception_ptr task_error;
+  try {
+    task.fn();
+  } catch (...) {
+    task_error = std::current_exception();
+  }
+  task.group->finish(task_error);
+  return true;
+}
+
+void ThreadPool::worker_loop(const size_t worker_idx, const bool pin) {
+  current_pool   = this;
+  current_worker = worker_idx;
+  if (pin) { pin_to_cpu(worker_idx); }
+
+  while (true) {
+    if (try_run_one()) { continue; }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake_up.wait_for(lock, idle_poll_period, [this] {
+      return stopping || n_queued.load(std::memory_order_relaxed) > 0;
+    });
+    if (stopping) { return; }
+  }
+}
+
+void TaskGroup::finish(std::exception_ptr task_error) {
+  // Once a waiter has taken the lock and seen zero, no task touches the
+  // group anymore and it may be destroyed, so keep the pool at hand.
+  ThreadPool& owner = pool;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (task_error && !error) { error = task_error; }
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1) { return; }
+  }
+  owner.wake_joiners();
+}
+
+void TaskGroup::join() {
+  while (pending.load(std::memory_order_acquire) > 0) {
+    if (pool.try_run_one()) { continue; }
+
+    // Sleep until one of the remaining tasks forks stealable work or the
+    // last of them finishes.
+    std::unique_lock<std::mutex> lock(pool.sleep_mutex);
+    pool.joiners.wait_for(lock, idle_poll_period, [this] {
+      return pending.load(std::memory_order_acquire) == 0 ||
+             pool.n_queued.load(std::memory_order_relaxed) > 0;
+    });
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+}
+
+void TaskGroup::wait() {
+  join();
+
+  std::exception_ptr first_error;
+  std::swap(first_error, error);
+  if (first_error) { std::rethrow_exception(first_error); }
+}
+
+}  // namespace utils
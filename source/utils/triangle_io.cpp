@@ -0,0 +1,177 @@
+#include "utils/triangle_io.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <system_error>
+
+namespace utils {
+
+using geometry::TriangleF;
+using geometry::Vector3F;
+
+namespace {
+
+// Input is read in blocks of a few of these and split into chunks of about
+// this many bytes for parallel parsing.
+constexpr size_t parse_chunk_size = 1 << 20;
+// Triangles are constructed and output is formatted in ranges of this size.
+constexpr size_t triangle_grain = 1 << 14;
+constexpr size_t format_grain   = 1 << 16;
+
+bool is_space(const char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+// Parses whitespace-separated floats of [first, last) like operator>> does:
+// parsing stops at the first token that is not a number. Returns false then.
+bool parse_floats(
+    const char* first, const char* last, std::vector<float>& out) {
+  while (true) {
+    while (first != last && is_space(*first)) { ++first; }
+    if (first == last) { return true; }
+
+    if (*first == '+') { ++first; }
+    float value = 0.0f;
+    const auto [ptr, ec] = std::from_chars(first, last, value);
+    if (ec != std::errc{} || (ptr != last && !is_space(*ptr))) {
+      return false;
+    }
+
+    out.push_back(value);
+    first = ptr;
+  }
+}
+
+}  // namespace
+
+TriangleReader::TriangleReader(std::istream& in_, ThreadPool& pool_)
+    : in(in_), pool(pool_) {
+  if (!(in >> tri_num)) {
+    tri_num = 0;
+    done    = true;
+  }
+}
+
+size_t TriangleReader::read(
+    std::vector<float>& coords, const size_t max_triangles) {
+  const size_t count  = std::min(max_triangles, remaining());
+  const size_t needed = 9 * count;
+  while (values.size() - next_value < needed && !done) { parse_block(); }
+
+  const size_t available = std::min(needed, values.size() - next_value);
+  const auto   first     = values.begin() + static_cast<ptrdiff_t>(next_value);
+  coords.insert(coords.end(), first, first + static_cast<ptrdiff_t>(available));
+  coords.resize(coords.size() + needed - available, 0.0f);
+
+  next_value += available;
+  n_read += count;
+  return count;
+}
+
+// Parses the next block, up to its last whitespace; the token cut there is
+// kept for the next one.
+void TriangleReader::parse_block() {
+  values.erase(values.begin(),
+      values.begin() + static_cast<ptrdiff_t>(next_value));
+  next_value = 0;
+
+  std::string  text       = std::move(carry);
+  const size_t block_size = parse_chunk_size * std::max<size_t>(pool.size(), 4);
+  const size_t kept       = text.size();
+  text.resize(kept + block_size);
+  in.read(text.data() + kept, static_cast<std::streamsize>(block_size));
+  text.resize(kept + static_cast<size_t>(in.gcount()));
+
+  size_t end = text.size();
+  carry.clear();
+  if (text.size() == kept + block_size) {
+    while (end > 0 && !is_space(text[end - 1])) { --end; }
+    if (end == 0) {
+      // One token longer than the block: read on.
+      carry = std::move(text);
+      return;
+    }
+    carry.assign(text, end);
+  } else {
+    done = true;
+  }
+
+  std::vector<size_t> bounds{0};
+  while (bounds.back() < end) {
+    size_t bound = std::min(end, bounds.back() + parse_chunk_size);
+    while (bound < end && !is_space(text[bound])) { ++bound; }
+    bounds.push_back(bound);
+  }
+
+  const size_t                    n_chunks = bounds.size() - 1;
+  std::vector<std::vector<float>> chunk_values(n_chunks);
+  std::vector<char>               chunk_ok(n_chunks, 1);
+
+  pool.parallel_for(0, n_chunks, 1, [&](const size_t lo, const size_t hi) {
+    for (size_t k = lo; k < hi; ++k) {
+      chunk_ok[k] = parse_floats(text.data() + bounds[k],
+          text.data() + bounds[k + 1], chunk_values[k]);
+    }
+  });
+
+  for (size_t k = 0; k < n_chunks; ++k) {
+    values.insert(values.end(), chunk_values[k].begin(), chunk_values[k].end());
+    if (!chunk_ok[k]) {
+      done = true;
+      break;
+    }
+  }
+}
+
+std::vector<TriangleF> TriangleReader::read_triangles(
+    const size_t max_triangles) {
+  std::vector<float> coords;
+  coords.reserve(9 * std::min(max_triangles, remaining()));
+  const size_t count = read(coords, max_triangles);
+
+  const Vector3F         origin{0.0f, 0.0f, 0.0f};
+  std::vector<TriangleF> input(count, TriangleF{origin, origin, origin});
+
+  pool.parallel_for(0, count, triangle_grain, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+      const float* c = coords.data() + 9 * i;
+      input[i] = TriangleF{Vector3F{c[0], c[1], c[2]},
+          Vector3F{c[3], c[4], c[5]}, Vector3F{c[6], c[7], c[8]}};
+    }
+  });
+
+  return input;
+}
+
+std::vector<TriangleF> read_triangles(std::istream& in, ThreadPool& pool) {
+  TriangleReader reader(in, pool);
+  return reader.read_triangles(reader.size());
+}
+
+void write_intersections(std::ostream& out, const std::vector<bool>& flags,
+    ThreadPool& pool) {
+  const size_t n_ranges = (flags.size() + format_grain - 1) / format_grain;
+  std::vector<std::string> ranges(n_ranges);
+
+  pool.parallel_for(0, n_ranges, 1, [&](const size_t lo, const size_t hi) {
+    for (size_t k = lo; k < hi; ++k) {
+      const size_t last = std::min(flags.size(), (k + 1) * format_grain);
+      for (size_t i = k * format_grain; i < last; ++i) {
+        if (!flags[i]) { continue; }
+
+        char       buffer[24];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), i);
+        ranges[k].append(buffer, result.ptr);
+        ranges[k].push_back('\n');
+      }
+    }
+  });
+
+  for (const std::string& range : ranges) { out << range; }
+  out.flush();
+}
+
+}  // namespace utils
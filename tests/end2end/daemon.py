@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Runs the end-to-end suite through a resident `triangles.x --serve`:
+every test loads its scene into the same daemon with triangles_client.x."""
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+
+def wait_for_socket(server: subprocess.Popen, socket: Path) -> bool:
+    for _ in range(200):
+        if socket.exists():
+            return True
+        if server.poll() is not None:
+            return False
+        time.sleep(0.05)
+    return False
+
+
+def main() -> None:
+    script_dir = Path(__file__).resolve().parent
+
+    ap = argparse.ArgumentParser(description="run.py against a daemon")
+    ap.add_argument("-s", "--server", required=True,
+                    help="Path to triangles.x")
+    ap.add_argument("-c", "--client", required=True,
+                    help="Path to triangles_client.x")
+    ap.add_argument("-m", "--match",
+                    help="Run only tests whose filename contains this substring")
+    args = ap.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        socket = Path(tmp) / "triangles.sock"
+        env = dict(os.environ, TRIANGLES_SOCKET=str(socket))
+
+        server = subprocess.Popen([args.server, "--serve", str(socket)],
+                                  env=env)
+        try:
+            if not wait_for_socket(server, socket):
+                print("ERROR: the server did not start")
+                sys.exit(2)
+
+            cmd = [sys.executable, str(script_dir / "run.py"),
+                   "-b", args.client, "-q"]
+            if args.match:
+                cmd += ["-m", args.match]
+            suite = subprocess.run(cmd, env=env, check=False)
+
+            stats = subprocess.run([args.client, "stats"], env=env,
+                                   capture_output=True, text=True,
+                                   check=False)
+            print(stats.stdout, end="")
+            shutdown = subprocess.run([args.client, "shutdown"], env=env,
+                                      check=False)
+            server.wait(timeout=30)
+        finally:
+            if server.poll() is None:
+                server.kill()
+                server.wait()
+
+        ok = (suite.returncode == 0 and stats.returncode == 0 and
+              shutdown.returncode == 0 and server.returncode == 0 and
+              not socket.exists())
+        sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+#include "acceleration/AABB.hpp"
+
+#include <gtest/gtest.h>
+
+#include "geometry/geometry.hpp"
+
+using namespace geometry;
+using acceleration::AABB;
+
+// ================== Box vs Box Tests =====================
+
+TEST(AABBTest, BoxFromTriangle) {
+  const AABB box{Triangle({1, -2, 3}, {4, 0, -1}, {0, 5, 2})};
+  EXPECT_DOUBLE_EQ(box.min.x, 0);
+  EXPECT_DOUBLE_EQ(box.min.y, -2);
+  EXPECT_DOUBLE_EQ(box.min.z, -1);
+  EXPECT_DOUBLE_EQ(box.max.x, 4);
+  EXPECT_DOUBLE_EQ(box.max.y, 5);
+  EXPECT_DOUBLE_EQ(box.max.z, 3);
+}
+
+TEST(AABBTest, DoubleCornersRoundOutward) {
+  const AABB box{{0.1, -0.1, 1.0}, {0.3, 1e-40, 1.0}};
+  EXPECT_LE(box.min.x, 0.1);
+  EXPECT_LE(box.min.y, -0.1);
+  EXPECT_GE(box.max.x, 0.3);
+  EXPECT_GT(box.max.y, 0.0);
+  // Values representable in float are kept as they are.
+  EXPECT_EQ(box.min.z, 1.0f);
+  EXPECT_EQ(box.max.z, 1.0f);
+}
+
+TEST(AABBTest, BoxesTouchingFaceIntersect) {
+  const AABB lhs{{0, 0, 0}, {1, 1, 1}};
+  const AABB rhs{{1, 0, 0}, {2, 1, 1}};
+  const AABB far{{1.1, 0, 0}, {2, 1, 1}};
+  EXPECT_TRUE(lhs.is_intersect(rhs));
+  EXPECT_FALSE(lhs.is_intersect(far));
+}
+
+TEST(AABBTest, PaddedFourLaneLayout) {
+  static_assert(alignof(AABB) == 16);
+  static_assert(sizeof(AABB) == 8 * sizeof(float));
+
+  const AABB box{{1, 2, 3}, {4, 5, 6}};
+  EXPECT_EQ(box.min.pad, 0.0f);
+  EXPECT_EQ(merge(box, AABB{{-1, 0, 0}, {0, 9, 0}}).max.pad, 0.0f);
+}
+
+TEST(AABBTest, MergeTakesCornerExtremes) {
+  const AABB merged =
+      merge(AABB{{0, 2, -1}, {1, 3, 0}}, AABB{{-1, 2.5, 0}, {0.5, 4, 2}});
+  EXPECT_EQ(merged.min.x, -1.0f);
+  EXPECT_EQ(merged.min.y, 2.0f);
+  EXPECT_EQ(merged.min.z, -1.0f);
+  EXPECT_EQ(merged.max.x, 1.0f);
+  EXPECT_EQ(merged.max.y, 4.0f);
+  EXPECT_EQ(merged.max.z, 2.0f);
+}
+
+TEST(AABBTest, OverlapWithLoosenedBoxKeepsTolerance) {
+  const AABB box{{0, 0, 0}, {1, 1, 1}};
+  const AABB loose = box.loosened();
+
+  EXPECT_TRUE(AABB({1 + 0.5e-6, 0, 0}, {2, 1, 1}).is_overlap(loose));
+  EXPECT_TRUE(AABB({-1, -1, -1}, {-0.5e-6, 0.5, 0.5}).is_overlap(loose));
+  EXPECT_FALSE(AABB({1 + 1e-5, 0, 0}, {2, 1, 1}).is_overlap(loose));
+  EXPECT_FALSE(AABB({0, 0, -2}, {1, 1, -1e-5}).is_overlap(loose));
+  EXPECT_FALSE(AABB({1 + 0.5e-6, 0, 0}, {2, 1, 1}).is_overlap(box));
+}
+
+TEST(AABBTest, SurfaceArea) {
+  EXPECT_DOUBLE_EQ(AABB({0, 0, 0}, {1, 2, 3}).surface_area(), 22.0);
+  EXPECT_DOUBLE_EQ(AABB({1, 1, 1}, {1, 1, 1}).surface_area(), 0.0);
+}
+
+// ================ Triangle vs Box (SAT) ==================
+
+TEST(AABBTest, TriangleInsideBox) {
+  const AABB box{{0, 0, 0}, {10, 10, 10}};
+  EXPECT_TRUE(box.is_intersect(Triangle({1, 1, 1}, {2, 1, 1}, {1, 2, 1})));
+}
+
+TEST(AABBTest, TriangleContainsBox) {
+  const AABB box{{0, 0, -1}, {1, 1, 1}};
+  EXPECT_TRUE(
+      box.is_intersect(Triangle({-10, -10, 0}, {30, -10, 0}, {-10, 30, 0})));
+}
+
+TEST(AABBTest, TriangleOutsideBoxAlongFaceAxis) {
+  const AABB box{{0, 0, 0}, {1, 1, 1}};
+  EXPECT_FALSE(box.is_intersect(Triangle({2, 0, 0}, {3, 0, 0}, {2, 1, 0})));
+}
+
+TEST(AABBTest, TriangleSeparatedByItsPlane) {
+  // Plane x + y + z = 3.5 passes the corner (1, 1, 1) of the box.
+  const AABB box{{0, 0, 0}, {1, 1, 1}};
+  EXPECT_FALSE(
+      box.is_intersect(Triangle({3.5, 0, 0}, {0, 3.5, 0}, {0, 0, 3.5})));
+  EXPECT_TRUE(
+      box.is_intersect(Triangle({2.5, 0, 0}, {0, 2.5, 0}, {0, 0, 2.5})));
+}
+
+TEST(AABBTest, DiagonalSliverMissesBox) {
+  // The sliver's bounding box covers the unit box, the sliver itself doesn't:
+  // only an edge cross product axis separates them.
+  const AABB     box{{0, 0, 0}, {1, 1, 1}};
+  const Triangle sliver({-5, 8, 0.5}, {8, -5, 0.5}, {8.1, -5, 0.6});
+  EXPECT_TRUE(box.is_intersect(AABB{sliver}));
+  EXPECT_FALSE(box.is_intersect(sliver));
+}
+
+TEST(AABBTest, TriangleTouchingWithinEps) {
+  const AABB box{{0, 0, 0}, {1, 1, 1}};
+  EXPECT_TRUE(box.is_intersect(
+      Triangle({1 + 1e-7, 0, 0}, {2, 0, 0}, {1 + 1e-7, 1, 0})));
+}
+
+TEST(AABBTest, DegenerateTriangles) {
+  const AABB box{{0, 0, 0}, {1, 1, 1}};
+  // Segment crossing the box and a segment passing by its corner.
+  EXPECT_TRUE(box.is_intersect(
+      Triangle({-1, 0.5, 0.5}, {2, 0.5, 0.5}, {2, 0.5, 0.5})));
+  EXPECT_FALSE(box.is_intersect(
+      Triangle({-1, 3.5, 0.5}, {3.5, -1, 0.5}, {3.5, -1, 0.5})));
+  // Points.
+  EXPECT_TRUE(box.is_intersect(Triangle({1, 1, 1}, {1, 1, 1}, {1, 1, 1})));
+  EXPECT_FALSE(box.is_intersect(Triangle({1, 2, 1}, {1, 2, 1}, {1, 2, 1})));
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/geometry.hpp"
+
+using namespace geometry;
+
+// ================ Global allocation counter ===============
+// Replaces the global operator new for the whole test binary. Allocations are
+// only counted between AllocationCounter construction and destruction.
+
+namespace {
+
+std::atomic<bool>   counting{false};
+std::atomic<size_t> n_allocations{0};
+
+void* counted_alloc(const size_t size) {
+  if (counting.load(std::memory_order_relaxed)) {
+    n_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr) { throw std::bad_alloc(); }
+  return ptr;
+}
+
+class AllocationCounter {
+ public:
+  AllocationCounter() {
+    n_allocations.store(0);
+    counting.store(true);
+  }
+  ~AllocationCounter() { counting.store(false); }
+
+  [[nodiscard]] size_t count() const { return n_allocations.load(); }
+};
+
+}  // namespace
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void  operator delete(void* ptr) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr) noexcept { std::free(ptr); }
+void  operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+// ================== Narrowphase Tests ====================
+
+TEST(AllocationTest, NarrowphaseIsAllocationFree) {
+  const std::vector<std::pair<Triangle, Triangle>> pairs = {
+      // 3D crossing
+      {Triangle({0, 0, 0}, {2, 0, 0}, {0, 2, 0}),
+          Triangle({0.5, 0.5, -1}, {0.5, 0.5, 1}, {1.5, 0.5, 0})},
+      // 3D, side lying on the intersection line
+      {Triangle({0, 0, 0}, {2, 0, 0}, {0, 2, 0}),
+          Triangle({0, 0, 0}, {2, 0, 0}, {0, 0, 2})},
+      // coplanar overlap
+      {Triangle({0, 0, 0}, {2, 0, 0}, {0, 2, 0}),
+          Triangle({1, 0, 0}, {3, 0, 0}, {1, 2, 0})},
+      // segment vs triangle
+      {Triangle({0, 0, 0}, {2, 0, 0}, {0, 2, 0}),
+          Triangle({0.5, 0.5, -1}, {0.5, 0.5, 1}, {0.5, 0.5, 1})},
+      // point vs point
+      {Triangle({1, 1, 1}, {1, 1, 1}, {1, 1, 1}),
+          Triangle({1, 1, 1}, {1, 1, 1}, {1, 1, 1})},
+  };
+
+  AllocationCounter counter;
+  size_t            n_hits = 0;
+  for (const auto& [lhs, rhs] : pairs) { n_hits += lhs.is_intersect(rhs); }
+
+  EXPECT_EQ(counter.count(), 0u);
+  EXPECT_EQ(n_hits, pairs.size());
+}
+
+// ==================== Query Tests ========================
+
+TEST(AllocationTest, QueryAfterBuildIsAllocationFree) {
+  std::vector<Triangle> input;
+  for (int i = 0; i < 200; ++i) {
+    const double x = 0.7 * i;
+    input.emplace_back(Vector3D(x, 0, 0), Vector3D(x + 1, 0, 1),
+        Vector3D(x, 1, (i % 2) ? 1.0 : -1.0));
+  }
+  acceleration::BVHTree<Triangle> tree(input);
+  ASSERT_TRUE(tree.validate_tree());
+
+  std::vector<bool> fused(input.size());
+  std::vector<bool> pipelined(input.size());
+
+  AllocationCounter counter;
+  tree.get_intersections(fused, acceleration::QueryMode::Fused);
+  tree.get_intersections(pipelined, acceleration::QueryMode::Pipelined);
+  const size_t n_allocations = counter.count();
+
+  EXPECT_EQ(n_allocations, 0u);
+  EXPECT_EQ(fused, pipelined);
+}
@@ -0,0 +1,84 @@
+#include "utils/arena.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using utils::Arena;
+using utils::ArenaConfig;
+
+// ==================== Allocation Tests ===================
+
+TEST(ArenaTest, AllocationsAreAlignedAndCounted) {
+  Arena arena;
+  for (const size_t alignment : {1, 8, 16, 64, 4096}) {
+    void* const data = arena.allocate(24, alignment);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(data) % alignment, 0u) << alignment;
+  }
+
+  const utils::ArenaStats stats = arena.stats();
+  EXPECT_EQ(stats.n_allocations, 5u);
+  EXPECT_GE(stats.peak_bytes, 5 * 24u);
+  EXPECT_EQ(stats.n_blocks, 1u);
+  EXPECT_GE(stats.capacity, stats.peak_bytes);
+}
+
+TEST(ArenaTest, ResetKeepsTheMemory) {
+  Arena arena;
+  auto  fill = [&] {
+    // Outgrows the first block several times.
+    std::pmr::vector<uint32_t> values(&arena);
+    for (uint32_t i = 0; i < 200000; ++i) { values.push_back(i); }
+    EXPECT_EQ(std::accumulate(values.begin(), values.end(), uint64_t{0}),
+        uint64_t{199999} * 200000 / 2);
+  };
+
+  fill();
+  const utils::ArenaStats first = arena.stats();
+  EXPECT_GT(first.n_blocks, 1u);
+
+  arena.reset();
+  EXPECT_EQ(arena.stats().n_allocations, 0u);
+  EXPECT_GE(arena.stats().capacity, first.capacity);
+
+  fill();
+  const utils::ArenaStats second = arena.stats();
+  EXPECT_EQ(second.n_blocks, 0u);
+  EXPECT_EQ(second.n_allocations, first.n_allocations);
+  EXPECT_EQ(second.peak_bytes, first.peak_bytes);
+}
+
+TEST(ArenaTest, InitialBlockServesFirstRound) {
+  Arena arena(ArenaConfig{size_t{1} << 20});
+  std::pmr::vector<double> values(100000, 1.0, &arena);
+  EXPECT_EQ(arena.stats().n_blocks, 1u);
+  EXPECT_EQ(arena.stats().capacity, size_t{1} << 20);
+}
+
+TEST(ArenaTest, HugePageBlocks) {
+  // Whether the system grants huge pages varies; the memory works anyway.
+  Arena arena(ArenaConfig{0, true});
+  std::pmr::vector<uint8_t> bytes(3 << 20, 7, &arena);
+  EXPECT_EQ(bytes.back(), 7);
+  EXPECT_EQ(arena.stats().capacity % utils::huge_page_size, 0u);
+}
+
+TEST(ArenaTest, ConcurrentAllocations) {
+  Arena                    arena;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (size_t i = 0; i < 1000; ++i) {
+        auto* value = static_cast<size_t*>(arena.allocate(sizeof(size_t)));
+        *value      = i;
+      }
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+  EXPECT_EQ(arena.stats().n_allocations, 4000u);
+}
@@ -2,13 +2,32 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory_resource>
+#include <random>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "geometry/geometry.hpp"
+#include "random_scene.hpp"
+#include "utils/arena.hpp"
+#include "utils/thread_pool.hpp"
+
+#ifdef USE_OPENCL
+#include "acceleration/opencl_runtime.hpp"
+#endif  // USE_OPENCL
 
 using namespace geometry;
 
+using test::random_scene;
+
 // ======================== Helpers ========================
 
 static std::vector<bool> brute_force_intersections(
@@ -151,3 +170,752 @@ TEST(BVHTreeTest, MatchesBruteForce) {
         << " brute=" << expected[i];
   }
 }
+
+// ================== Query Mode Tests =====================
+
+TEST(BVHTreeTest, PipelinedMatchesFused) {
+  std::vector<Triangle>           input = random_scene<Triangle>(500, 20, 42);
+  acceleration::BVHTree<Triangle> tree(input);
+
+  acceleration::QueryStats fused_stats;
+  acceleration::QueryStats pipelined_stats;
+
+  const std::vector<bool> fused =
+      tree.get_intersections(acceleration::QueryMode::Fused, &fused_stats);
+  const std::vector<bool> pipelined = tree.get_intersections(
+      acceleration::QueryMode::Pipelined, &pipelined_stats);
+
+  EXPECT_EQ(fused, pipelined);
+  EXPECT_EQ(pipelined, brute_force_intersections(input));
+
+  EXPECT_EQ(pipelined_stats.n_queries, input.size());
+  EXPECT_LE(pipelined_stats.n_narrowphase, pipelined_stats.n_candidates);
+  EXPECT_LE(pipelined_stats.n_hits, pipelined_stats.n_narrowphase);
+  EXPECT_GT(pipelined_stats.n_hits, 0u);
+}
+
+TEST(BVHTreeTest, PipelinedFlushesFullBuffer) {
+  // Heavily overlapping stack produces more candidates than one buffer holds.
+  std::vector<Triangle> input;
+  for (int i = 0; i < 64; ++i) {
+    const double z = 0.01 * i;
+    input.emplace_back(
+        Vector3D(0, 0, z), Vector3D(10, 0, z + 0.5), Vector3D(0, 10, z));
+  }
+  acceleration::BVHTree<Triangle> tree(input);
+
+  acceleration::QueryStats stats;
+  const std::vector<bool>  result =
+      tree.get_intersections(acceleration::QueryMode::Pipelined, &stats);
+
+  EXPECT_GT(stats.n_candidates, acceleration::candidate_buffer_cap);
+  EXPECT_EQ(result, brute_force_intersections(input));
+}
+
+// =================== SAT Culling Tests ===================
+
+TEST(BVHTreeTest, SatCullingKeepsResults) {
+  // Long diagonal slivers: their boxes overlap much more than the triangles.
+  std::vector<Triangle> input;
+  for (int i = 0; i < 40; ++i) {
+    const double o = 0.5 * i;
+    input.emplace_back(Vector3D(o, 0, 0), Vector3D(o + 10, 10, 0.2 * (i % 3)),
+        Vector3D(o + 10.1, 10, 0.1));
+  }
+  const std::vector<bool> expected = brute_force_intersections(input);
+
+  // The culling counts below assume leaves of several objects.
+  acceleration::BVHTree<Triangle> tree(
+      input, acceleration::BuildEngine::Median);
+
+  for (const auto mode :
+      {acceleration::QueryMode::Fused, acceleration::QueryMode::Pipelined}) {
+    acceleration::QueryStats stats;
+    const std::vector<bool>  result =
+        tree.get_intersections({mode, true}, &stats);
+
+    EXPECT_EQ(result, expected);
+    EXPECT_GT(stats.n_sat_tests, 0u);
+    EXPECT_GT(stats.n_sat_culled, 0u);
+    EXPECT_LE(stats.n_narrowphase + stats.n_sat_culled, stats.n_candidates);
+  }
+}
+
+// =================== Build Engine Tests ==================
+
+TEST(BVHTreeTest, EveryEngineMatchesBruteForce) {
+  const std::vector<Triangle> scene    = random_scene<Triangle>(1500, 20, 13);
+  const std::vector<bool>     expected = brute_force_intersections(scene);
+
+  for (const auto engine :
+      {acceleration::BuildEngine::Median, acceleration::BuildEngine::SAH,
+          acceleration::BuildEngine::LBVH,
+          acceleration::BuildEngine::OpenCL}) {
+    std::vector<Triangle>           input = scene;
+    acceleration::BVHTree<Triangle> tree(input, engine);
+    SCOPED_TRACE(std::string(acceleration::to_string(engine)));
+
+    EXPECT_TRUE(tree.validate_tree());
+    if (engine == acceleration::BuildEngine::OpenCL) {
+      EXPECT_NE(tree.build_engine(), acceleration::BuildEngine::Auto);
+    } else {
+      EXPECT_EQ(tree.build_engine(), engine);
+    }
+
+    EXPECT_EQ(tree.get_intersections(), expected);
+    EXPECT_EQ(tree.get_intersections({acceleration::QueryMode::Pipelined}),
+        expected);
+    EXPECT_EQ(
+        tree.get_intersections({acceleration::QueryMode::Auto}), expected);
+  }
+}
+
+TEST(BVHTreeTest, SAHBuildSplitsCoincidentCentroids) {
+  std::vector<Triangle> input(
+      50, Triangle({0, 0, 0}, {1, 0, 0}, {0, 1, 0}));
+  input.emplace_back(Vector3D(5, 5, 5), Vector3D(6, 5, 5), Vector3D(5, 6, 5));
+
+  acceleration::BVHTree<Triangle> tree(input, acceleration::BuildEngine::SAH);
+  EXPECT_TRUE(tree.validate_tree());
+
+  std::vector<bool> expected(input.size(), true);
+  expected.back() = false;
+  EXPECT_EQ(tree.get_intersections(), expected);
+}
+
+// ====================== Refit Tests ======================
+
+static const acceleration::BuildEngine all_engines[] = {
+    acceleration::BuildEngine::Median, acceleration::BuildEngine::SAH,
+    acceleration::BuildEngine::LBVH, acceleration::BuildEngine::OpenCL};
+
+TEST(BVHTreeTest, RefitWithoutMotionKeepsTheBoxes) {
+  for (const auto engine : all_engines) {
+    std::vector<Triangle>           input =
+        random_scene<Triangle>(1000, 20, 21);
+    acceleration::BVHTree<Triangle> tree(input, engine);
+    SCOPED_TRACE(std::string(acceleration::to_string(engine)));
+
+    const double cost = tree.sah_cost();
+    EXPECT_GT(cost, 1.0);
+    EXPECT_FALSE(tree.refit());
+    EXPECT_EQ(tree.sah_cost(), cost);
+    EXPECT_EQ(tree.cost_growth(), 1.0);
+  }
+}
+
+TEST(BVHTreeTest, RefitFollowsMovingTriangles) {
+  std::srand(22);
+  auto rnd = [] { return std::rand() / (RAND_MAX / 2.0) - 1.0; };
+
+  for (const auto engine : all_engines) {
+    std::vector<Triangle>           input =
+        random_scene<Triangle>(1500, 20, 23);
+    acceleration::BVHTree<Triangle> tree(input, engine);
+    SCOPED_TRACE(std::string(acceleration::to_string(engine)));
+    // Uploads the scene before the motion.
+    (void)tree.get_intersections({acceleration::QueryMode::Device});
+
+    for (size_t frame = 0; frame < 3; ++frame) {
+      for (Triangle& tri : input) {
+        const Vector3D delta(rnd(), rnd(), rnd());
+        tri = Triangle(tri.a + delta, tri.b + delta, tri.c + delta);
+      }
+      EXPECT_FALSE(tree.refit(std::numeric_limits<double>::infinity()));
+
+      const std::vector<bool> expected = brute_force_intersections(input);
+      EXPECT_TRUE(tree.validate_tree());
+      EXPECT_EQ(tree.get_intersections(), expected);
+      EXPECT_EQ(
+          tree.get_intersections({acceleration::QueryMode::Device}), expected);
+    }
+    EXPECT_GT(tree.cost_growth(), 1.0);
+  }
+}
+
+TEST(BVHTreeTest, RefitRebuildsDegradedTree) {
+  std::vector<Triangle>           input = random_scene<Triangle>(2000, 20, 24);
+  acceleration::BVHTree<Triangle> tree(input);
+
+  // Reversed, the leaves hold unrelated triangles and span the scene.
+  std::reverse(input.begin(), input.end());
+  EXPECT_FALSE(tree.refit(std::numeric_limits<double>::infinity()));
+  EXPECT_GT(tree.cost_growth(), acceleration::refit_max_cost_growth);
+
+  EXPECT_TRUE(tree.refit());
+  EXPECT_EQ(tree.cost_growth(), 1.0);
+  EXPECT_TRUE(tree.validate_tree());
+  EXPECT_EQ(tree.get_intersections(), brute_force_intersections(input));
+}
+
+TEST(BVHTreeTest, RefitRejectsResizedInput) {
+  std::vector<Triangle>           input = random_scene<Triangle>(100, 20, 25);
+  acceleration::BVHTree<Triangle> tree(input);
+
+  input.pop_back();
+  EXPECT_THROW(tree.refit(), std::length_error);
+}
+
+// =================== Saved Tree Tests ====================
+
+static std::filesystem::path make_tree_path() {
+  return std::filesystem::temp_directory_path() /
+         ("triangles_test_" + std::to_string(std::random_device{}()) +
+             ".bvh");
+}
+
+TEST(BVHTreeTest, SavedTreeMatchesBuilt) {
+  for (const auto engine : all_engines) {
+    std::vector<Triangle>                 input =
+        random_scene<Triangle>(1500, 20, 26);
+    const acceleration::BVHTree<Triangle> built(input, engine);
+    SCOPED_TRACE(std::string(acceleration::to_string(engine)));
+
+    const std::filesystem::path path = make_tree_path();
+    ASSERT_TRUE(built.save(path));
+    acceleration::BVHTree<Triangle> loaded(input, path);
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(loaded.build_engine(), built.build_engine());
+    EXPECT_EQ(loaded.max_depth_reached, built.max_depth_reached);
+    EXPECT_EQ(loaded.sah_cost(), built.sah_cost());
+    EXPECT_EQ(loaded.get_intersections(), built.get_intersections());
+
+    // The mapping is gone; a refit copies the nodes out of it first.
+    for (Triangle& tri : input) {
+      const Vector3D delta(0.5, -0.5, 0.25);
+      tri = Triangle(tri.a + delta, tri.b + delta, tri.c + delta);
+    }
+    EXPECT_FALSE(loaded.refit());
+    EXPECT_TRUE(loaded.validate_tree());
+    EXPECT_EQ(loaded.get_intersections(), brute_force_intersections(input));
+  }
+}
+
+TEST(BVHTreeTest, SavedTreeRejectsOtherInput) {
+  std::vector<Triangle>       input = random_scene<Triangle>(500, 20, 27);
+  const std::filesystem::path path  = make_tree_path();
+  ASSERT_TRUE(acceleration::BVHTree<Triangle>(input).save(path));
+
+  // Same objects in float: another object type.
+  std::vector<TriangleF> compact;
+  for (const Triangle& tri : input) {
+    compact.emplace_back(Vector3F{tri.a}, Vector3F{tri.b}, Vector3F{tri.c});
+  }
+  EXPECT_THROW((void)acceleration::BVHTree<TriangleF>(compact, path),
+      std::runtime_error);
+
+  input[123].b.y += 1e-9;
+  EXPECT_THROW(
+      (void)acceleration::BVHTree<Triangle>(input, path), std::runtime_error);
+  input.pop_back();
+  EXPECT_THROW(
+      (void)acceleration::BVHTree<Triangle>(input, path), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST(BVHTreeTest, SavedTreeRejectsDamagedFile) {
+  std::vector<Triangle>       input = random_scene<Triangle>(500, 20, 28);
+  const std::filesystem::path path  = make_tree_path();
+  ASSERT_TRUE(acceleration::BVHTree<Triangle>(input).save(path));
+  const size_t size = std::filesystem::file_size(path);
+
+  auto patch = [&](const size_t offset, const auto value) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  auto rejected = [&] {
+    try {
+      const acceleration::BVHTree<Triangle> tree(input, path);
+    } catch (const std::runtime_error&) { return true; }
+    return false;
+  };
+
+  const size_t version_offset =
+      offsetof(acceleration::detail::BVHFileHeader, version);
+  acceleration::detail::BVHFileHeader header;
+  {
+    std::ifstream file(path, std::ios::binary);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  }
+
+  // A newer format.
+  patch(version_offset, acceleration::bvh_file_version + 1);
+  EXPECT_TRUE(rejected());
+  patch(version_offset, acceleration::bvh_file_version);
+  EXPECT_FALSE(rejected());
+
+  // Leaf ranges that wrap around in 32 bits, or overlap with the same total.
+  using Node = acceleration::BVHNode<uint32_t>;
+  std::vector<Node> nodes(header.n_nodes);
+  {
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(header.nodes_offset));
+    file.read(reinterpret_cast<char*>(nodes.data()),
+        static_cast<std::streamsize>(nodes.size() * sizeof(Node)));
+  }
+  std::vector<size_t> leaves;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].is_leaf()) { leaves.push_back(i); }
+  }
+  const auto same_size =
+      std::find_if(leaves.begin() + 1, leaves.end(), [&](const size_t i) {
+        return nodes[i].n_objs == nodes[leaves[0]].n_objs;
+      });
+  ASSERT_NE(same_size, leaves.end());
+  auto patch_leaf = [&](const size_t i, const uint32_t start,
+                        const uint32_t n_objs) {
+    Node node   = nodes[i];
+    node.start  = start;
+    node.n_objs = n_objs;
+    patch(header.nodes_offset + i * sizeof(Node), node);
+  };
+
+  patch_leaf(leaves[0], 0u - nodes[leaves[0]].n_objs, nodes[leaves[0]].n_objs);
+  EXPECT_TRUE(rejected());
+  patch_leaf(leaves[0], nodes[*same_size].start, nodes[leaves[0]].n_objs);
+  EXPECT_TRUE(rejected());
+  patch_leaf(leaves[0], nodes[leaves[0]].start, nodes[leaves[0]].n_objs);
+  EXPECT_FALSE(rejected());
+
+  // An index past the input.
+  patch(header.indexes_offset, size_t{input.size()});
+  EXPECT_TRUE(rejected());
+
+  std::filesystem::resize_file(path, size / 2);
+  EXPECT_TRUE(rejected());
+  std::filesystem::remove(path);
+  EXPECT_TRUE(rejected());
+}
+
+TEST(BVHTreeTest, SavedInputRoundTrip) {
+  std::vector<Triangle>       input = random_scene<Triangle>(800, 20, 29);
+  const std::filesystem::path path  = make_tree_path();
+  const std::vector<bool>     flags =
+      acceleration::BVHTree<Triangle>(input).get_intersections();
+
+  ASSERT_TRUE(acceleration::BVHTree<Triangle>(input).save(path));
+  EXPECT_THROW(
+      (void)acceleration::BVHTree<Triangle>::load_input(path),
+      std::runtime_error);
+
+  ASSERT_TRUE(acceleration::BVHTree<Triangle>(input).save(path, true));
+  std::vector<Triangle> loaded =
+      acceleration::BVHTree<Triangle>::load_input(path);
+  ASSERT_EQ(loaded.size(), input.size());
+  EXPECT_EQ(std::memcmp(loaded.data(), input.data(),
+                input.size() * sizeof(Triangle)),
+      0);
+  EXPECT_EQ(acceleration::BVHTree<Triangle>(loaded, path).get_intersections(),
+      flags);
+  std::filesystem::remove(path);
+}
+
+TEST(BVHTreeTest, FindAllIntersectionsReusesTheSavedTree) {
+  std::vector<Triangle>       input    = random_scene<Triangle>(500, 20, 39);
+  const std::filesystem::path path     = make_tree_path();
+  const std::vector<bool>     expected = brute_force_intersections(input);
+  utils::ThreadPool&          pool     = utils::ThreadPool::instance();
+
+  EXPECT_EQ(acceleration::find_all_intersections(input, pool, path), expected);
+  ASSERT_TRUE(std::filesystem::exists(path));
+  const auto written = std::filesystem::last_write_time(path);
+  EXPECT_EQ(acceleration::find_all_intersections(input, pool, path), expected);
+  EXPECT_EQ(std::filesystem::last_write_time(path), written);
+
+  // Saved for another input: rebuilt and saved again.
+  std::vector<Triangle> other = random_scene<Triangle>(400, 20, 40);
+  EXPECT_EQ(acceleration::find_all_intersections(other, pool, path),
+      brute_force_intersections(other));
+  EXPECT_EQ((acceleration::BVHTree<Triangle>(other, path, pool)
+                    .get_intersections()),
+      brute_force_intersections(other));
+  std::filesystem::remove(path);
+}
+
+// ================= Scratch Arena Tests ===================
+
+TEST(BVHTreeTest, ArenaBuildsReuseTheScratch) {
+  utils::Arena arena;
+  for (const auto engine :
+      {acceleration::BuildEngine::SAH, acceleration::BuildEngine::LBVH}) {
+    std::vector<Triangle> input = random_scene<Triangle>(3000, 20, 30);
+    SCOPED_TRACE(std::string(acceleration::to_string(engine)));
+
+    const acceleration::BVHTree<Triangle> reference(input, engine);
+    acceleration::BVHTree<Triangle>       tree(input, engine, arena);
+    EXPECT_GE(reference.build_memory_stats().n_blocks, 1u);
+    EXPECT_EQ(tree.get_intersections(), reference.get_intersections());
+
+    // Same input again: the arena already holds enough.
+    tree.rebuild();
+    const utils::ArenaStats& stats = tree.build_memory_stats();
+    EXPECT_EQ(stats.n_blocks, 0u);
+    EXPECT_GT(stats.n_allocations, 0u);
+    EXPECT_EQ(stats.peak_bytes, reference.build_memory_stats().peak_bytes);
+    EXPECT_EQ(tree.get_intersections(), reference.get_intersections());
+  }
+
+  // The median split works in place.
+  std::vector<Triangle>                 input =
+      random_scene<Triangle>(1000, 20, 31);
+  const acceleration::BVHTree<Triangle> median(
+      input, acceleration::BuildEngine::Median, arena);
+  EXPECT_EQ(median.build_memory_stats().n_allocations, 0u);
+}
+
+// =================== Index Width Tests ===================
+
+TEST(BVHTreeTest, WideIndexesMatchCompact) {
+  const std::vector<Triangle> scene    = random_scene<Triangle>(1500, 20, 32);
+  const std::vector<bool>     expected = brute_force_intersections(scene);
+
+  for (const auto engine : all_engines) {
+    std::vector<Triangle>                           input = scene;
+    const acceleration::BVHTree<Triangle>           compact(input, engine);
+    const acceleration::BVHTree<Triangle, uint64_t> wide(input, engine);
+    SCOPED_TRACE(std::string(acceleration::to_string(engine)));
+
+    EXPECT_TRUE(wide.validate_tree());
+    EXPECT_EQ(wide.build_engine(), compact.build_engine());
+    EXPECT_EQ(wide.max_depth_reached, compact.max_depth_reached);
+    EXPECT_EQ(wide.get_intersections(), expected);
+    EXPECT_EQ(wide.get_intersections({acceleration::QueryMode::Pipelined}),
+        expected);
+    EXPECT_EQ(wide.get_intersections({acceleration::QueryMode::Device}),
+        expected);
+  }
+}
+
+TEST(BVHTreeTest, SavedTreeKeepsItsIndexWidth) {
+  std::vector<Triangle>       input = random_scene<Triangle>(500, 20, 33);
+  const std::filesystem::path path  = make_tree_path();
+
+  const acceleration::BVHTree<Triangle, uint64_t> wide(input);
+  ASSERT_TRUE(wide.save(path));
+
+  EXPECT_EQ((acceleration::BVHTree<Triangle, uint64_t>(input, path)
+                    .get_intersections()),
+      wide.get_intersections());
+  try {
+    (void)acceleration::BVHTree<Triangle>(input, path);
+    ADD_FAILURE() << "a 64-bit tree loaded with 32-bit indexes";
+  } catch (const std::runtime_error& e) {
+    EXPECT_NE(std::string(e.what()).find("64-bit indexes"), std::string::npos)
+        << e.what();
+  }
+  std::filesystem::remove(path);
+}
+
+// =================== Hit Query Tests =====================
+
+TEST(BVHTreeTest, FindHitsMatchesBruteForce) {
+  std::vector<Triangle>       scene   = random_scene<Triangle>(1500, 20, 34);
+  const std::vector<Triangle> queries = random_scene<Triangle>(400, 20, 35);
+
+  const acceleration::BVHTree<Triangle>           tree(scene);
+  const acceleration::BVHTree<Triangle, uint64_t> wide(scene);
+  std::vector<Triangle>                           batch = queries;
+
+  acceleration::HitOptions unordered;
+  unordered.morton_order = false;
+  const auto hits        = tree.find_hits(batch);
+  ASSERT_EQ(hits.size(), queries.size());
+
+  size_t n_hits = 0;
+  for (size_t q = 0; q < queries.size(); ++q) {
+    std::vector<uint32_t> expected;
+    for (size_t i = 0; i < scene.size(); ++i) {
+      if (queries[q].is_intersect(scene[i])) { expected.push_back(i); }
+    }
+    n_hits += expected.size();
+
+    const std::vector<uint32_t> got(hits[q].begin(), hits[q].end());
+    EXPECT_EQ(got, expected) << q;
+    EXPECT_EQ(tree.find_hits(queries[q]), expected) << q;
+  }
+  EXPECT_GT(n_hits, 0u);
+  EXPECT_EQ(tree.find_hits(batch, unordered).objects, hits.objects);
+  EXPECT_EQ(tree.find_hits(batch, unordered).offsets, hits.offsets);
+
+  const auto wide_hits = wide.find_hits(batch);
+  EXPECT_EQ(wide_hits.offsets, hits.offsets);
+  EXPECT_TRUE(std::equal(hits.objects.begin(), hits.objects.end(),
+      wide_hits.objects.begin(), wide_hits.objects.end()));
+}
+
+TEST(BVHTreeTest, FindHitsStopsAtTheLimit) {
+  std::vector<Triangle> scene = random_scene<Triangle>(1500, 20, 36);
+  std::vector<Triangle> batch = random_scene<Triangle>(400, 20, 37);
+  // A query that meets every copy of a stack of equal triangles.
+  for (size_t i = 0; i < 20; ++i) {
+    scene.push_back(Triangle({50, 50, 0}, {60, 50, 0}, {50, 60, 0}));
+  }
+  batch.push_back(Triangle({52, 52, -1}, {52, 52, 1}, {58, 52, 1}));
+
+  const acceleration::BVHTree<Triangle> tree(scene);
+  const auto                            all = tree.find_hits(batch);
+
+  acceleration::HitOptions any;
+  any.mode = acceleration::HitMode::Any;
+  acceleration::HitOptions first;
+  first.mode     = acceleration::HitMode::FirstK;
+  first.max_hits = 3;
+
+  const auto any_hits   = tree.find_hits(batch, any);
+  const auto first_hits = tree.find_hits(batch, first);
+  for (size_t q = 0; q < batch.size(); ++q) {
+    EXPECT_EQ(any_hits[q].size(), std::min<size_t>(all[q].size(), 1)) << q;
+    EXPECT_EQ(first_hits[q].size(), std::min<size_t>(all[q].size(), 3)) << q;
+    for (const uint32_t hit : first_hits[q]) {
+      EXPECT_TRUE(std::binary_search(all[q].begin(), all[q].end(), hit)) << q;
+    }
+  }
+  EXPECT_GE(all[batch.size() - 1].size(), 20u);
+}
+
+TEST(BVHTreeTest, FindHitsOfEmptyBatchAndTree) {
+  std::vector<Triangle> scene;
+  std::vector<Triangle> batch = random_scene<Triangle>(10, 20, 38);
+
+  const acceleration::BVHTree<Triangle> empty_tree(scene);
+  const auto                            hits = empty_tree.find_hits(batch);
+  EXPECT_EQ(hits.size(), batch.size());
+  EXPECT_TRUE(hits.objects.empty());
+
+  std::vector<Triangle>                 none;
+  const acceleration::BVHTree<Triangle> tree(batch);
+  EXPECT_EQ(tree.find_hits(none).size(), 0u);
+}
+
+// ================== Float Storage Tests ==================
+
+TEST(BVHTreeTest, FloatStorageMatchesDouble) {
+  std::vector<TriangleF> compact;
+  std::vector<Triangle>  promoted;
+  for (const Triangle& tri : random_scene<Triangle>(500, 20, 7)) {
+    compact.emplace_back(Vector3F{tri.a}, Vector3F{tri.b}, Vector3F{tri.c});
+    promoted.push_back(compact.back().to_triangle());
+  }
+
+  acceleration::BVHTree<TriangleF> tree(compact);
+  EXPECT_TRUE(tree.validate_tree());
+
+  const std::vector<bool> expected = brute_force_intersections(promoted);
+  EXPECT_EQ(tree.get_intersections(), expected);
+  EXPECT_EQ(tree.get_intersections({acceleration::QueryMode::Pipelined, true}),
+      expected);
+}
+
+// ================== Thread Pool Tests ====================
+
+TEST(BVHTreeTest, ParallelBuildAndQueryMatchSerial) {
+  std::vector<Triangle> serial_input   = random_scene<Triangle>(20000, 20, 3);
+  std::vector<Triangle> parallel_input = serial_input;
+
+  utils::ThreadPool serial_pool(utils::ThreadPoolConfig{1});
+  utils::ThreadPool parallel_pool(utils::ThreadPoolConfig{4});
+
+  acceleration::BVHTree<Triangle> serial_tree(
+      serial_input, acceleration::BuildEngine::Median, serial_pool);
+  acceleration::BVHTree<Triangle> parallel_tree(
+      parallel_input, acceleration::BuildEngine::Median, parallel_pool);
+
+  EXPECT_TRUE(parallel_tree.validate_tree());
+  EXPECT_EQ(parallel_tree.max_depth_reached, serial_tree.max_depth_reached);
+
+  for (const auto mode :
+      {acceleration::QueryMode::Fused, acceleration::QueryMode::Pipelined}) {
+    acceleration::QueryStats serial_stats;
+    acceleration::QueryStats parallel_stats;
+
+    const std::vector<bool> expected =
+        serial_tree.get_intersections(mode, &serial_stats);
+    const std::vector<bool> result = parallel_tree.get_intersections(
+        {mode, false, true}, &parallel_stats);
+
+    EXPECT_EQ(result, expected);
+    EXPECT_EQ(parallel_stats.n_hits > 0, serial_stats.n_hits > 0);
+    if (mode == acceleration::QueryMode::Pipelined) {
+      EXPECT_EQ(parallel_stats.n_candidates, serial_stats.n_candidates);
+    }
+  }
+}
+
+// =================== Device Query Tests ==================
+
+// Random triangles plus the cases the device hands back to the host:
+// coplanar pairs, touching edges, points and sections.
+static std::vector<Triangle> make_device_scene() {
+  std::vector<Triangle> input = random_scene<Triangle>(2000, 20, 9);
+
+  for (int i = 0; i < 20; ++i) {
+    const double x = 30.0 + i;
+    input.emplace_back(
+        Vector3D(x, 0, 0), Vector3D(x + 1.5, 0, 0), Vector3D(x, 1, 0));
+  }
+  input.emplace_back(
+      Vector3D(30, 5, 0), Vector3D(31, 5, 0), Vector3D(30, 6, 0));
+  input.emplace_back(
+      Vector3D(31, 5, 0), Vector3D(32, 5, 0), Vector3D(31, 6, 0));
+
+  input.emplace_back(Vector3D(40, 0.5, 0), Vector3D(40, 0.5, 0),
+      Vector3D(40, 0.5, 0));
+  input.emplace_back(Vector3D(45, -1, 0), Vector3D(45, 2, 0),
+      Vector3D(45, 3, 0));
+  input.emplace_back(Vector3D(60, 60, 60), Vector3D(61, 60, 60),
+      Vector3D(62, 60, 60));
+  return input;
+}
+
+TEST(BVHTreeTest, DeviceQueryMatchesBruteForce) {
+  std::vector<Triangle>   input    = make_device_scene();
+  const std::vector<bool> expected = brute_force_intersections(input);
+
+  std::vector<TriangleF> compact;
+  for (const Triangle& tri : input) {
+    compact.emplace_back(Vector3F{tri.a}, Vector3F{tri.b}, Vector3F{tri.c});
+  }
+  std::vector<Triangle> promoted;
+  for (const TriangleF& tri : compact) {
+    promoted.push_back(tri.to_triangle());
+  }
+
+  acceleration::BVHTree<Triangle>  tree(input);
+  acceleration::BVHTree<TriangleF> compact_tree(compact);
+
+  acceleration::QueryStats stats;
+  EXPECT_EQ(
+      tree.get_intersections(acceleration::QueryMode::Device, &stats),
+      expected);
+  EXPECT_EQ(compact_tree.get_intersections(acceleration::QueryMode::Device),
+      brute_force_intersections(promoted));
+  // The uploaded scene is reused.
+  EXPECT_EQ(tree.get_intersections(acceleration::QueryMode::Device),
+      expected);
+
+#ifdef USE_OPENCL
+  acceleration::CLRuntime& runtime = acceleration::CLRuntime::instance();
+  if (runtime.is_available() && runtime.has_fp64()) {
+    EXPECT_EQ(stats.n_queries, input.size());
+    EXPECT_GT(stats.n_host_fallbacks, 0);
+    EXPECT_LT(stats.n_host_fallbacks, input.size() / 10);
+    EXPECT_GT(stats.device.kernel_us, 0.0);
+    EXPECT_GE(stats.device.span_us, stats.device.kernel_us);
+  }
+#endif  // USE_OPENCL
+}
+
+// ==================== Linear BVH Tests ===================
+
+static acceleration::detail::LBVHInput pack_lbvh(
+    const std::vector<Triangle>& input) {
+  acceleration::detail::LBVHInput packed;
+  for (const Triangle& tri : input) {
+    for (const Vector3D& v : {tri.a, tri.b, tri.c}) {
+      for (const double x : {v.x, v.y, v.z}) {
+        packed.lower.push_back(acceleration::detail::round_down(x));
+        packed.upper.push_back(acceleration::detail::round_up(x));
+      }
+    }
+  }
+  return packed;
+}
+
+using LBVHNode32 = acceleration::detail::LBVHNode<uint32_t>;
+using LBVHNode64 = acceleration::detail::LBVHNode<uint64_t>;
+
+TEST(BVHTreeTest, HostLinearBuildIsValid) {
+  const std::vector<Triangle>        input =
+      random_scene<Triangle>(1000, 20, 11);
+  const std::pmr::vector<LBVHNode32> nodes =
+      acceleration::detail::build_lbvh_cpu<uint32_t>(pack_lbvh(input));
+  ASSERT_EQ(nodes.size(), 2 * input.size() - 1);
+
+  std::vector<int> seen(input.size(), 0);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const LBVHNode32& node = nodes[i];
+    if (node.left_idx == LBVHNode32::no_child) {
+      ++seen[node.object];
+      const acceleration::AABB box(input[node.object]);
+      for (size_t axis = 0; axis < 3; ++axis) {
+        EXPECT_EQ(node.min[axis], box.min[axis]);
+        EXPECT_EQ(node.max[axis], box.max[axis]);
+      }
+      continue;
+    }
+    for (const uint32_t child : {node.left_idx, node.right_idx}) {
+      for (size_t axis = 0; axis < 3; ++axis) {
+        EXPECT_LE(node.min[axis], nodes[child].min[axis]);
+        EXPECT_GE(node.max[axis], nodes[child].max[axis]);
+      }
+    }
+  }
+  EXPECT_EQ(seen, std::vector<int>(input.size(), 1));
+}
+
+TEST(BVHTreeTest, WideLinearBuildMatchesCompact) {
+  const acceleration::detail::LBVHInput packed =
+      pack_lbvh(random_scene<Triangle>(1000, 20, 12));
+  const std::pmr::vector<LBVHNode32> compact =
+      acceleration::detail::build_lbvh_cpu<uint32_t>(packed);
+  const std::pmr::vector<LBVHNode64> wide =
+      acceleration::detail::build_lbvh_cpu<uint64_t>(packed);
+
+  ASSERT_EQ(wide.size(), compact.size());
+  for (size_t i = 0; i < wide.size(); ++i) {
+    const bool is_leaf = compact[i].left_idx == LBVHNode32::no_child;
+    EXPECT_EQ(wide[i].left_idx == LBVHNode64::no_child, is_leaf);
+    if (!is_leaf) {
+      EXPECT_EQ(wide[i].left_idx, compact[i].left_idx);
+      EXPECT_EQ(wide[i].right_idx, compact[i].right_idx);
+    }
+    EXPECT_EQ(wide[i].object, compact[i].object);
+    EXPECT_EQ(std::memcmp(wide[i].min, compact[i].min, sizeof(float[4])), 0);
+    EXPECT_EQ(std::memcmp(wide[i].max, compact[i].max, sizeof(float[4])), 0);
+  }
+}
+
+#ifdef USE_OPENCL
+TEST(BVHTreeTest, DeviceLinearBuildMatchesHost) {
+  acceleration::CLRuntime& runtime = acceleration::CLRuntime::instance();
+  if (!runtime.is_available()) { GTEST_SKIP() << runtime.error(); }
+
+  auto expect_same = [](const auto& host, const auto& device, size_t n) {
+    ASSERT_EQ(device.size(), host.size());
+    EXPECT_EQ(std::memcmp(device.data(), host.data(),
+                  host.size() * sizeof(host[0])),
+        0)
+        << "n = " << n << ", " << 8 * sizeof(host[0].object) << "-bit";
+  };
+
+  // Enough objects for several scan levels over the radix histogram.
+  for (const size_t n : {2, 3, 1000, 70000}) {
+    const acceleration::detail::LBVHInput packed =
+        pack_lbvh(random_scene<Triangle>(n, 20, 5));
+    expect_same(acceleration::detail::build_lbvh_cpu<uint32_t>(packed),
+        acceleration::detail::build_lbvh_gpu<uint32_t>(packed), n);
+    expect_same(acceleration::detail::build_lbvh_cpu<uint64_t>(packed),
+        acceleration::detail::build_lbvh_gpu<uint64_t>(packed), n);
+  }
+}
+
+TEST(BVHTreeTest, DeviceBuildReportsTransferTimes) {
+  acceleration::CLRuntime& runtime = acceleration::CLRuntime::instance();
+  if (!runtime.is_available()) { GTEST_SKIP() << runtime.error(); }
+
+  // More than one upload and readback chunk.
+  std::vector<Triangle> input = random_scene<Triangle>(
+      acceleration::lbvh_upload_chunk + 1000, 20, 17);
+  acceleration::BVHTree<Triangle> tree(
+      input, acceleration::BuildEngine::OpenCL);
+  ASSERT_EQ(tree.build_engine(), acceleration::BuildEngine::OpenCL);
+
+  const acceleration::DeviceTimings& timings = tree.device_build_timings();
+  EXPECT_GT(timings.upload_us, 0.0);
+  EXPECT_GT(timings.kernel_us, 0.0);
+  EXPECT_GT(timings.readback_us, 0.0);
+  EXPECT_GE(timings.overlap_us(), 0.0);
+}
+#endif  // USE_OPENCL
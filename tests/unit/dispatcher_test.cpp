@@ -0,0 +1,132 @@
+#include "acceleration/dispatcher.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <optional>
+#include <string>
+
+using acceleration::BuildEngine;
+using acceleration::Calibration;
+using acceleration::CostModel;
+using acceleration::Dispatcher;
+
+// ======================== Helpers ========================
+
+// Host engines on one core: SAH builds slower and queries faster than Median.
+static Calibration make_host_calibration() {
+  Calibration cal;
+  cal.median_build = {50.0, 0.010};
+  cal.sah_build    = {50.0, 0.030};
+  cal.lbvh_build   = {50.0, 0.008};
+  cal.median_query = {20.0, 0.040};
+  cal.sah_query    = {20.0, 0.025};
+  cal.lbvh_query   = {20.0, 0.050};
+  return cal;
+}
+
+// A device that is slow to start and fast per object.
+static Calibration make_device_calibration() {
+  Calibration cal      = make_host_calibration();
+  cal.has_device       = true;
+  cal.has_device_query = true;
+  cal.device_type      = "gpu";
+  cal.device_name      = "test device";
+  cal.opencl_build     = {2000.0, 0.0005};
+  cal.device_query     = {3000.0, 0.0010};
+  cal.opencl_setup_us  = 200000.0;
+  return cal;
+}
+
+// ==================== Cost Model Tests ===================
+
+TEST(DispatcherTest, CostModelFitsTwoPoints) {
+  const CostModel truth{100.0, 0.02};
+  const CostModel fitted =
+      CostModel::fit(1000, truth(1000), 50000, truth(50000));
+
+  EXPECT_NEAR(fitted.fixed_us, truth.fixed_us, 1e-6);
+  EXPECT_NEAR(fitted.scale_us, truth.scale_us, 1e-9);
+  EXPECT_GE(CostModel::fit(1000, 500.0, 2000, 100.0).scale_us, 0.0);
+}
+
+TEST(DispatcherTest, EngineNamesRoundTrip) {
+  for (const auto engine : {BuildEngine::Auto, BuildEngine::Median,
+           BuildEngine::SAH, BuildEngine::LBVH, BuildEngine::OpenCL}) {
+    EXPECT_EQ(acceleration::parse_build_engine(acceleration::to_string(engine)),
+        engine);
+  }
+  EXPECT_EQ(acceleration::parse_build_engine("gpu"), std::nullopt);
+}
+
+// =================== Engine Choice Tests =================
+
+TEST(DispatcherTest, NoDeviceNeverPicksOpenCL) {
+  const Calibration cal = make_host_calibration();
+  for (const size_t n : {10, 10000, 10000000}) {
+    EXPECT_NE(Dispatcher::pick_build(cal, n, true), BuildEngine::OpenCL);
+    EXPECT_FALSE(Dispatcher::pick_device_query(cal, n, BuildEngine::SAH, true));
+  }
+}
+
+TEST(DispatcherTest, SmallInputsStayOnTheHost) {
+  const Calibration cal = make_device_calibration();
+
+  std::string       reason;
+  const BuildEngine engine = Dispatcher::pick_build(cal, 5000, false, &reason);
+  EXPECT_NE(engine, BuildEngine::OpenCL);
+  EXPECT_NE(reason.find("opencl"), std::string::npos);
+  EXPECT_FALSE(
+      Dispatcher::pick_device_query(cal, 5000, BuildEngine::Median, false));
+}
+
+TEST(DispatcherTest, LargeInputsGoToTheDevice) {
+  const Calibration cal = make_device_calibration();
+
+  EXPECT_EQ(Dispatcher::pick_build(cal, 5000000, false), BuildEngine::OpenCL);
+  EXPECT_TRUE(
+      Dispatcher::pick_device_query(cal, 5000000, BuildEngine::SAH, true));
+}
+
+TEST(DispatcherTest, QueryCostFavoursSAHTrees) {
+  Calibration cal  = make_host_calibration();
+  cal.median_query = {20.0, 0.200};
+  EXPECT_EQ(Dispatcher::pick_build(cal, 100000, true), BuildEngine::SAH);
+}
+
+TEST(DispatcherTest, DeviceWithoutFp64BuildsButQueriesOnHost) {
+  Calibration cal      = make_device_calibration();
+  cal.has_device_query = false;
+  cal.lbvh_query       = cal.sah_query;
+
+  EXPECT_EQ(Dispatcher::pick_build(cal, 5000000, true), BuildEngine::OpenCL);
+  EXPECT_FALSE(
+      Dispatcher::pick_device_query(cal, 5000000, BuildEngine::OpenCL, true));
+}
+
+TEST(DispatcherTest, ForcedEngineSkipsTheModel) {
+  setenv("TRIANGLES_BUILD", "lbvh", 1);
+  EXPECT_EQ(Dispatcher::instance().choose_build(10), BuildEngine::LBVH);
+  unsetenv("TRIANGLES_BUILD");
+
+  EXPECT_EQ(Dispatcher::instance().choose_build(10), BuildEngine::Median);
+}
+
+// ================= Calibration File Tests ================
+
+TEST(DispatcherTest, CalibrationRoundTrip) {
+  const Calibration cal  = make_device_calibration();
+  const std::string text = cal.serialize("threads=4 device=test device");
+
+  const std::optional<Calibration> loaded =
+      Calibration::parse(text, "threads=4 device=test device");
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(loaded->sah_query.scale_us, cal.sah_query.scale_us);
+  EXPECT_EQ(loaded->opencl_setup_us, cal.opencl_setup_us);
+  EXPECT_EQ(loaded->has_device_query, cal.has_device_query);
+  EXPECT_EQ(loaded->device_name, cal.device_name);
+
+  EXPECT_FALSE(Calibration::parse(text, "threads=8 device=test device"));
+  EXPECT_FALSE(Calibration::parse("triangles-calibration 0\n", "k"));
+  EXPECT_FALSE(Calibration::parse("", "k"));
+}
@@ -0,0 +1,167 @@
+#include "acceleration/dynamic_bvh.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/geometry.hpp"
+#include "random_scene.hpp"
+
+using namespace geometry;
+
+using test::random_scene;
+using test::random_triangle;
+
+using DynamicTree = acceleration::DynamicBVH<Triangle>;
+
+// ======================== Helpers ========================
+
+// Flags by id over the live objects of `scene`.
+static std::vector<bool> brute_force_intersections(
+    const std::vector<std::optional<Triangle>>& scene) {
+  std::vector<bool> result(scene.size(), false);
+  for (size_t i = 0; i < scene.size(); ++i) {
+    for (size_t j = i + 1; j < scene.size(); ++j) {
+      if (scene[i] && scene[j] && scene[i]->is_intersect(*scene[j])) {
+        result[i] = true;
+        result[j] = true;
+      }
+    }
+  }
+  return result;
+}
+
+// ================= Construction Tests ====================
+
+TEST(DynamicBVHTest, EmptyTree) {
+  DynamicTree tree;
+  EXPECT_TRUE(tree.validate_tree());
+  EXPECT_EQ(tree.size(), 0u);
+  EXPECT_EQ(tree.height(), 0u);
+  EXPECT_FALSE(
+      tree.intersects_any(Triangle({0, 0, 0}, {1, 0, 0}, {0, 1, 0})));
+  EXPECT_TRUE(tree.get_intersections().empty());
+}
+
+TEST(DynamicBVHTest, BulkBuildMatchesStaticTree) {
+  std::vector<Triangle> scene = random_scene<Triangle>(3000, 20, 1);
+
+  const DynamicTree                     tree(scene);
+  const acceleration::BVHTree<Triangle> reference(scene);
+
+  EXPECT_TRUE(tree.validate_tree());
+  EXPECT_EQ(tree.size(), scene.size());
+  EXPECT_EQ(tree.get_intersections(), reference.get_intersections());
+}
+
+TEST(DynamicBVHTest, InsertsMatchBulkBuild) {
+  const std::vector<Triangle> scene = random_scene<Triangle>(2000, 20, 2);
+
+  DynamicTree tree;
+  for (size_t i = 0; i < scene.size(); ++i) {
+    EXPECT_EQ(tree.insert(scene[i]), i);
+  }
+
+  EXPECT_TRUE(tree.validate_tree());
+  EXPECT_EQ(tree.get_intersections(), DynamicTree(scene).get_intersections());
+}
+
+// ==================== Edit Tests =========================
+
+TEST(DynamicBVHTest, RandomEditsMatchBruteForce) {
+  std::mt19937                         gen(3);
+  std::vector<std::optional<Triangle>> reference;
+  DynamicTree                          tree;
+
+  for (size_t op = 0; op < 3000; ++op) {
+    const size_t kind = gen() % 4;
+    const size_t id   = reference.empty() ? 0 : gen() % reference.size();
+
+    if (kind == 0 || reference.empty() || !reference[id]) {
+      const Triangle tri    = random_triangle<Triangle>(gen, 15);
+      const size_t   new_id = tree.insert(tri);
+      if (new_id == reference.size()) { reference.emplace_back(); }
+      ASSERT_FALSE(reference[new_id]);
+      reference[new_id] = tri;
+    } else if (kind == 1) {
+      tree.erase(id);
+      reference[id].reset();
+    } else {
+      // Small moves mostly stay inside the fat box, large ones don't.
+      const double   step = kind == 2 ? 0.01 : 5.0;
+      const Vector3D delta(step, -step, step);
+      const Triangle moved(reference[id]->a + delta, reference[id]->b + delta,
+          reference[id]->c + delta);
+      tree.move(id, moved);
+      reference[id] = moved;
+    }
+  }
+
+  ASSERT_TRUE(tree.validate_tree());
+  EXPECT_EQ(tree.id_bound(), reference.size());
+  EXPECT_EQ(tree.get_intersections(), brute_force_intersections(reference));
+}
+
+TEST(DynamicBVHTest, ErasedIdsAreReused) {
+  DynamicTree tree(random_scene<Triangle>(10, 20, 4));
+  tree.erase(3);
+  tree.erase(7);
+
+  EXPECT_FALSE(tree.contains(3));
+  EXPECT_EQ(tree.size(), 8u);
+  EXPECT_EQ(tree.insert(Triangle({0, 0, 0}, {1, 0, 0}, {0, 1, 0})), 7u);
+  EXPECT_EQ(tree.insert(Triangle({0, 0, 0}, {1, 0, 0}, {0, 1, 0})), 3u);
+  EXPECT_EQ(tree.insert(Triangle({0, 0, 0}, {1, 0, 0}, {0, 1, 0})), 10u);
+  EXPECT_TRUE(tree.validate_tree());
+}
+
+TEST(DynamicBVHTest, UnknownIdsThrow) {
+  DynamicTree tree(random_scene<Triangle>(5, 20, 5));
+  tree.erase(2);
+
+  const Triangle tri({0, 0, 0}, {1, 0, 0}, {0, 1, 0});
+  EXPECT_THROW(tree.erase(2), std::out_of_range);
+  EXPECT_THROW(tree.move(2, tri), std::out_of_range);
+  EXPECT_THROW(tree.move(5, tri), std::out_of_range);
+}
+
+TEST(DynamicBVHTest, SmallMoveKeepsTheTree) {
+  DynamicTree  tree(random_scene<Triangle>(1000, 20, 6));
+  const double cost = tree.sah_cost();
+
+  const Triangle& tri = tree.object(10);
+  const Vector3D  delta(1e-3, 0, 0);
+  tree.move(10, Triangle(tri.a + delta, tri.b + delta, tri.c + delta));
+
+  EXPECT_EQ(tree.sah_cost(), cost);
+  EXPECT_TRUE(tree.validate_tree());
+}
+
+// ================= Tree Quality Tests ====================
+
+TEST(DynamicBVHTest, SortedInsertsStayBalanced) {
+  // Inserting along a line is the worst order for a tree without rotations.
+  DynamicTree tree;
+  for (size_t i = 0; i < 4096; ++i) {
+    const double x = static_cast<double>(i);
+    (void)tree.insert(Triangle({x, 0, 0}, {x + 0.5, 0, 0}, {x, 0.5, 0}));
+  }
+
+  EXPECT_TRUE(tree.validate_tree());
+  EXPECT_LE(tree.height(), 3 * static_cast<size_t>(std::log2(4096.0)));
+}
+
+TEST(DynamicBVHTest, InsertedTreeCostNearBulkBuild) {
+  const std::vector<Triangle> scene = random_scene<Triangle>(4000, 20, 7);
+
+  DynamicTree inserted;
+  for (const Triangle& tri : scene) { (void)inserted.insert(tri); }
+
+  EXPECT_LT(inserted.sah_cost(), 2.0 * DynamicTree(scene).sah_cost());
+}
@@ -0,0 +1,145 @@
+#include "acceleration/incremental_intersections.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "geometry/geometry.hpp"
+#include "random_scene.hpp"
+
+using namespace geometry;
+
+using test::random_triangle;
+
+using Incremental = acceleration::IncrementalIntersections<Triangle>;
+using Scene       = std::vector<std::optional<Triangle>>;
+
+// ======================== Helpers ========================
+
+// Partner counts by id over the live objects of `scene`.
+static std::vector<size_t> brute_force_counts(const Scene& scene) {
+  std::vector<size_t> counts(scene.size(), 0);
+  for (size_t i = 0; i < scene.size(); ++i) {
+    for (size_t j = i + 1; j < scene.size(); ++j) {
+      if (scene[i] && scene[j] && scene[i]->is_intersect(*scene[j])) {
+        ++counts[i];
+        ++counts[j];
+      }
+    }
+  }
+  return counts;
+}
+
+static std::vector<size_t> flipped_between(
+    const std::vector<size_t>& before, const std::vector<size_t>& after) {
+  std::vector<size_t> flipped;
+  for (size_t id = 0; id < after.size(); ++id) {
+    const bool was = id < before.size() && before[id] > 0;
+    if (was != (after[id] > 0)) { flipped.push_back(id); }
+  }
+  return flipped;
+}
+
+// ==================== Count Tests ========================
+
+TEST(IncrementalIntersectionsTest, BulkCountsMatchBruteForce) {
+  std::mt19937          gen(1);
+  std::vector<Triangle> input;
+  Scene                 scene;
+  for (size_t i = 0; i < 1500; ++i) {
+    input.push_back(random_triangle<Triangle>(gen, 15));
+    scene.emplace_back(input.back());
+  }
+
+  const Incremental         state(input);
+  const std::vector<size_t> expected = brute_force_counts(scene);
+  for (size_t id = 0; id < input.size(); ++id) {
+    EXPECT_EQ(state.partner_count(id), expected[id]) << id;
+  }
+  EXPECT_EQ(state.get_intersections(), state.tree().get_intersections());
+}
+
+TEST(IncrementalIntersectionsTest, RandomEditsReportFlips) {
+  std::mt19937        gen(2);
+  Scene               scene;
+  Incremental         state;
+  std::vector<size_t> counts;
+  std::vector<size_t> flipped;
+
+  for (size_t op = 0; op < 800; ++op) {
+    const size_t kind = gen() % 4;
+    const size_t id   = scene.empty() ? 0 : gen() % scene.size();
+
+    if (kind == 0 || scene.empty() || !scene[id]) {
+      const Triangle tri    = random_triangle<Triangle>(gen, 8);
+      const size_t   new_id = state.insert(tri, &flipped);
+      if (new_id == scene.size()) { scene.emplace_back(); }
+      ASSERT_FALSE(scene[new_id]);
+      scene[new_id] = tri;
+    } else if (kind == 1) {
+      state.erase(id, &flipped);
+      scene[id].reset();
+    } else {
+      const double   step = kind == 2 ? 0.05 : 3.0;
+      const Vector3D delta(step, -step, step);
+      const Triangle moved(
+          scene[id]->a + delta, scene[id]->b + delta, scene[id]->c + delta);
+      state.move(id, moved, &flipped);
+      scene[id] = moved;
+    }
+
+    const std::vector<size_t> expected = brute_force_counts(scene);
+    ASSERT_EQ(flipped, flipped_between(counts, expected)) << "op " << op;
+    counts = expected;
+  }
+
+  for (size_t id = 0; id < scene.size(); ++id) {
+    EXPECT_EQ(state.partner_count(id), counts[id]) << id;
+  }
+  EXPECT_TRUE(state.tree().validate_tree());
+}
+
+// ==================== Edit Tests =========================
+
+TEST(IncrementalIntersectionsTest, TouchAndSeparate) {
+  const Triangle      base({0, 0, 0}, {4, 0, 0}, {0, 4, 0});
+  const Triangle      far({0, 0, 10}, {1, 0, 10}, {0, 1, 10});
+  const Triangle      piercing({1, 1, -1}, {1, 1, 1}, {2, 1, 1});
+  Incremental         state;
+  std::vector<size_t> flipped;
+
+  EXPECT_EQ(state.insert(base, &flipped), 0u);
+  EXPECT_TRUE(flipped.empty());
+  EXPECT_EQ(state.insert(far, &flipped), 1u);
+  EXPECT_TRUE(flipped.empty());
+
+  state.move(1, piercing, &flipped);
+  EXPECT_EQ(flipped, (std::vector<size_t>{0, 1}));
+
+  // A third triangle through both only flips itself.
+  EXPECT_EQ(state.insert(piercing, &flipped), 2u);
+  EXPECT_EQ(flipped, std::vector<size_t>{2});
+  EXPECT_EQ(state.partner_count(0), 2u);
+
+  // The other two still cross each other.
+  state.erase(0, &flipped);
+  EXPECT_EQ(flipped, std::vector<size_t>{0});
+  state.move(2, far, &flipped);
+  EXPECT_EQ(flipped, (std::vector<size_t>{1, 2}));
+  EXPECT_FALSE(state.is_intersecting(0));
+}
+
+TEST(IncrementalIntersectionsTest, UnknownIdsThrow) {
+  Incremental    state;
+  const Triangle tri({0, 0, 0}, {1, 0, 0}, {0, 1, 0});
+  (void)state.insert(tri);
+  state.erase(0);
+
+  EXPECT_THROW(state.erase(0), std::out_of_range);
+  EXPECT_THROW(state.move(0, tri), std::out_of_range);
+  EXPECT_THROW(state.move(3, tri), std::out_of_range);
+}
@@ -0,0 +1,172 @@
+#include "acceleration/object_view.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/geometry.hpp"
+#include "random_scene.hpp"
+
+using namespace geometry;
+
+using acceleration::BuildEngine;
+using acceleration::ObjectView;
+using acceleration::VertexLayout;
+using test::random_scene;
+
+// ======================== Helpers ========================
+
+// Vertex buffer of an engine: position, normal and uv per vertex, the
+// corners shared by triangles through the index buffer.
+struct MeshBuffers {
+  static constexpr size_t floats_per_vertex = 8;
+
+  std::vector<float>    vertices;
+  std::vector<uint32_t> indices;
+
+  explicit MeshBuffers(const std::vector<TriangleF>& scene) {
+    for (const TriangleF& tri : scene) {
+      for (const Vector3F* corner : {&tri.a, &tri.b, &tri.c}) {
+        indices.push_back(
+            static_cast<uint32_t>(vertices.size() / floats_per_vertex));
+        vertices.insert(vertices.end(),
+            {corner->x, corner->y, corner->z, 0.0f, 0.0f, 1.0f, 0.5f, 0.5f});
+      }
+    }
+    // Reversed, so the index buffer isn't the identity.
+    std::reverse(indices.begin(), indices.end());
+  }
+
+  [[nodiscard]] VertexLayout<float> layout() const {
+    return VertexLayout<float>::interleaved(vertices.data(),
+        floats_per_vertex * sizeof(float),
+        vertices.size() / floats_per_vertex);
+  }
+};
+
+static void expect_same_triangle(const TriangleF& lhs, const TriangleF& rhs) {
+  for (const auto& [l, r] : {std::pair{&lhs.a, &rhs.a},
+           std::pair{&lhs.b, &rhs.b}, std::pair{&lhs.c, &rhs.c}}) {
+    EXPECT_EQ(l->x, r->x);
+    EXPECT_EQ(l->y, r->y);
+    EXPECT_EQ(l->z, r->z);
+  }
+}
+
+// ======================== View Tests =====================
+
+TEST(ObjectViewTest, VertexBuffersAssembleTriangles) {
+  std::vector<TriangleF> scene = random_scene<TriangleF>(50, 15, 1);
+  const MeshBuffers      mesh(scene);
+  std::reverse(scene.begin(), scene.end());
+
+  const ObjectView<TriangleF> view(mesh.layout(), mesh.indices);
+  ASSERT_EQ(view.size(), scene.size());
+  EXPECT_EQ(view.data(), nullptr);
+  for (size_t i = 0; i < scene.size(); ++i) {
+    SCOPED_TRACE(i);
+    // The corners come out reversed too.
+    expect_same_triangle(
+        view[i], TriangleF(scene[i].c, scene[i].b, scene[i].a));
+  }
+}
+
+TEST(ObjectViewTest, SoAWithoutIndices) {
+  const std::vector<TriangleF> scene = random_scene<TriangleF>(40, 15, 2);
+  std::vector<double>          x, y, z;
+  for (const TriangleF& tri : scene) {
+    for (const Vector3F* corner : {&tri.a, &tri.b, &tri.c}) {
+      x.push_back(corner->x);
+      y.push_back(corner->y);
+      z.push_back(corner->z);
+    }
+  }
+
+  const ObjectView<Triangle> view(
+      VertexLayout<double>::soa(x.data(), y.data(), z.data(), x.size()));
+  ASSERT_EQ(view.size(), scene.size());
+  for (size_t i = 0; i < scene.size(); ++i) {
+    EXPECT_EQ(view[i].b.y, static_cast<double>(scene[i].b.y));
+  }
+}
+
+TEST(ObjectViewTest, VectorViewFollowsTheVector) {
+  std::vector<TriangleF>      scene = random_scene<TriangleF>(10, 15, 3);
+  const ObjectView<TriangleF> view(scene);
+  scene.push_back(scene.front());
+  EXPECT_EQ(view.size(), 11u);
+  EXPECT_EQ(view.data(), scene.data());
+}
+
+TEST(ObjectViewTest, BadBuffersThrow) {
+  const MeshBuffers mesh(random_scene<TriangleF>(4, 15, 4));
+
+  std::vector<uint32_t> indices = mesh.indices;
+  indices.pop_back();
+  EXPECT_THROW(
+      ObjectView<TriangleF>(mesh.layout(), indices), std::length_error);
+  indices.push_back(static_cast<uint32_t>(mesh.layout().n_vertices));
+  EXPECT_THROW(
+      ObjectView<TriangleF>(mesh.layout(), indices), std::out_of_range);
+}
+
+// ======================= Tree Tests ======================
+
+TEST(ObjectViewTest, TreeOverViewsMatchesVector) {
+  std::vector<TriangleF> scene = random_scene<TriangleF>(3000, 15, 5);
+  const MeshBuffers      mesh(scene);
+  // In the index buffer's triangle order, as the mesh view sees them.
+  std::vector<TriangleF> reordered;
+  for (auto it = scene.rbegin(); it != scene.rend(); ++it) {
+    reordered.emplace_back(it->c, it->b, it->a);
+  }
+  const std::vector<bool> expected =
+      acceleration::BVHTree<TriangleF>(reordered).get_intersections();
+
+  for (const auto engine :
+      {BuildEngine::Median, BuildEngine::SAH, BuildEngine::LBVH}) {
+    SCOPED_TRACE(std::string(acceleration::to_string(engine)));
+    const acceleration::BVHTree<TriangleF> span_tree(
+        ObjectView<TriangleF>(std::span<const TriangleF>(reordered)), engine);
+    const acceleration::BVHTree<TriangleF> mesh_tree(
+        ObjectView<TriangleF>(mesh.layout(), mesh.indices), engine);
+
+    EXPECT_TRUE(mesh_tree.validate_tree());
+    EXPECT_EQ(span_tree.get_intersections(), expected);
+    EXPECT_EQ(mesh_tree.get_intersections(), expected);
+    EXPECT_EQ(mesh_tree.get_intersections(acceleration::QueryMode::Pipelined),
+        expected);
+  }
+}
+
+TEST(ObjectViewTest, SavedVertexBuffersLoadAsVector) {
+  const MeshBuffers           mesh(random_scene<TriangleF>(700, 15, 6));
+  const ObjectView<TriangleF> view(mesh.layout(), mesh.indices);
+
+  const std::filesystem::path path =
+      std::filesystem::temp_directory_path() /
+      ("triangles_test_" + std::to_string(std::random_device{}()) + ".bvh");
+  const acceleration::BVHTree<TriangleF> tree(view);
+  ASSERT_TRUE(tree.save(path, true));
+
+  std::vector<TriangleF> loaded =
+      acceleration::BVHTree<TriangleF>::load_input(path);
+  ASSERT_EQ(loaded.size(), view.size());
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    expect_same_triangle(loaded[i], view[i]);
+  }
+  // Same coordinates, so the saved tree fits both.
+  EXPECT_EQ(acceleration::BVHTree<TriangleF>(loaded, path).get_intersections(),
+      tree.get_intersections());
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,125 @@
+#ifdef USE_OPENCL
+
+#include "acceleration/opencl_runtime.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "acceleration/kernels.hpp"
+
+using acceleration::CLEvent;
+using acceleration::CLKernel;
+using acceleration::CLMem;
+using acceleration::CLPinned;
+using acceleration::CLProgramCacheStats;
+using acceleration::CLRuntime;
+
+namespace fs = std::filesystem;
+
+// ================= Runtime Setup Tests ===================
+
+TEST(OpenCLRuntimeTest, KernelSourcesAreEmbedded) {
+  EXPECT_NE(acceleration::kernels::lbvh_source.find("find_splits"),
+      std::string_view::npos);
+}
+
+TEST(OpenCLRuntimeTest, RuntimeIsCreatedOnce) {
+  CLRuntime& runtime = CLRuntime::instance();
+  EXPECT_EQ(&runtime, &CLRuntime::instance());
+
+  if (!runtime.is_available()) {
+    EXPECT_FALSE(runtime.error().empty());
+    EXPECT_THROW((void)CLRuntime::require(), std::runtime_error);
+  }
+}
+
+// ================ Program Cache Tests ====================
+
+TEST(OpenCLRuntimeTest, ProgramIsBuiltOncePerProcess) {
+  CLRuntime& runtime = CLRuntime::instance();
+  if (!runtime.is_available()) { GTEST_SKIP() << runtime.error(); }
+
+  EXPECT_EQ(runtime.program(acceleration::kernels::lbvh_source),
+      runtime.program(acceleration::kernels::lbvh_source));
+}
+
+TEST(OpenCLRuntimeTest, BinaryCacheRoundTrip) {
+  CLRuntime& runtime = CLRuntime::instance();
+  if (!runtime.is_available()) { GTEST_SKIP() << runtime.error(); }
+
+  const fs::path saved_dir = runtime.cache_dir();
+  const fs::path dir       = fs::temp_directory_path() /
+                       ("triangles_cl_cache_" +
+                           std::to_string(std::random_device{}()));
+  runtime.set_cache_dir(dir);
+
+  const std::string source =
+      "__kernel void touch(__global int* out) { out[get_global_id(0)] = 1; }";
+
+  const CLProgramCacheStats before = runtime.cache_stats();
+  cl_program                built  = runtime.build_program(source);
+  const CLProgramCacheStats first  = runtime.cache_stats();
+  cl_program                cached = runtime.build_program(source);
+  const CLProgramCacheStats second = runtime.cache_stats();
+
+  EXPECT_EQ(first.n_source_builds, before.n_source_builds + 1);
+  EXPECT_EQ(first.n_disk_writes, before.n_disk_writes + 1);
+  EXPECT_EQ(second.n_disk_hits, first.n_disk_hits + 1);
+  EXPECT_EQ(second.n_source_builds, first.n_source_builds);
+  EXPECT_NO_THROW(CLKernel(cached, "touch"));
+
+  clReleaseProgram(built);
+  clReleaseProgram(cached);
+  runtime.set_cache_dir(saved_dir);
+  fs::remove_all(dir);
+}
+
+// ================== Transfer Tests =======================
+
+TEST(OpenCLRuntimeTest, StagedCopiesRoundTrip) {
+  CLRuntime& runtime = CLRuntime::instance();
+  if (!runtime.is_available()) { GTEST_SKIP() << runtime.error(); }
+
+  std::vector<uint32_t> values(5000);
+  std::iota(values.begin(), values.end(), 7u);
+  const size_t bytes = values.size() * sizeof(uint32_t);
+
+  CLMem buffer = runtime.buffer(CL_MEM_READ_WRITE, bytes);
+  const std::unique_lock<std::mutex> lock = runtime.lock_queue();
+
+  CLPinned& up   = runtime.staging(0, bytes);
+  CLPinned& down = runtime.staging(1, bytes);
+  EXPECT_GE(up.bytes, bytes);
+  std::memcpy(up.data(), values.data(), bytes);
+
+  // The second half goes up after the first and comes back in one read.
+  const size_t half   = bytes / 2;
+  CLEvent      first  = runtime.write(buffer, 0, half, up.data());
+  CLEvent      second = runtime.write(
+      buffer, half, bytes - half, up.data() + half, {first.handle});
+  CLEvent read = runtime.read(buffer, 0, bytes, down.data(), {second.handle});
+  read.wait();
+
+  EXPECT_EQ(std::memcmp(down.data(), values.data(), bytes), 0);
+  EXPECT_GE(read.end_ns(), read.start_ns());
+  EXPECT_GE(read.start_ns(), first.start_ns());
+
+  CLEvent cleared = runtime.fill_zero(buffer, bytes);
+  CLEvent zeros =
+      runtime.read(buffer, 0, bytes, down.data(), {cleared.handle});
+  zeros.wait();
+  EXPECT_EQ(std::vector<uint32_t>(reinterpret_cast<uint32_t*>(down.data()),
+                reinterpret_cast<uint32_t*>(down.data()) + values.size()),
+      std::vector<uint32_t>(values.size(), 0));
+}
+
+#endif  // USE_OPENCL
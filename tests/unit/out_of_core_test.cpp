@@ -0,0 +1,194 @@
+#include "acceleration/out_of_core.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/geometry.hpp"
+#include "random_scene.hpp"
+#include "utils/triangle_io.hpp"
+
+using namespace geometry;
+
+using acceleration::OutOfCoreConfig;
+using acceleration::OutOfCoreStats;
+using test::random_scene;
+
+// ======================== Helpers ========================
+
+// The triangles.x input of `coords`, 9 per triangle, printed exactly.
+static std::string scene_text(const std::vector<float>& coords) {
+  std::ostringstream out;
+  out.precision(9);
+  out << coords.size() / 9 << "\n";
+  for (size_t i = 0; i < coords.size(); ++i) {
+    out << coords[i] << ((i + 1) % 9 == 0 ? "\n" : " ");
+  }
+  return out.str();
+}
+
+// The coordinates of test::random_scene(), 9 per triangle.
+static std::vector<float> random_coords(
+    const size_t n, const float extent, const unsigned seed) {
+  std::vector<float> coords;
+  for (const TriangleF& tri : random_scene<TriangleF>(n, extent, seed)) {
+    for (const Vector3F& v : {tri.a, tri.b, tri.c}) {
+      coords.insert(coords.end(), {v.x, v.y, v.z});
+    }
+  }
+  return coords;
+}
+
+static std::vector<bool> in_memory_flags(const std::string& text) {
+  std::istringstream     in(text);
+  std::vector<TriangleF> input = utils::read_triangles(in);
+  const acceleration::BVHTree<TriangleF> tree(input);
+  return tree.get_intersections();
+}
+
+static std::vector<bool> out_of_core_flags(const std::string& text,
+    const OutOfCoreConfig& config, OutOfCoreStats& stats) {
+  std::istringstream in(text);
+  return acceleration::find_intersections_out_of_core(in, config, &stats);
+}
+
+// A spill directory of the test's own, to check it's left empty.
+static std::filesystem::path make_spill_dir() {
+  const std::filesystem::path dir =
+      std::filesystem::temp_directory_path() /
+      ("out_of_core_test_" + std::to_string(std::random_device{}()));
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+// ======================== Reader Tests ===================
+
+TEST(OutOfCoreTest, ReaderBatchesMatchWholeRead) {
+  const std::string text = scene_text(random_coords(1000, 20.0f, 1));
+
+  std::istringstream           whole_in(text);
+  const std::vector<TriangleF> whole = utils::read_triangles(whole_in);
+
+  std::istringstream    in(text);
+  utils::TriangleReader reader(in);
+  ASSERT_EQ(reader.size(), 1000u);
+
+  std::vector<float> coords;
+  while (reader.remaining() > 0) { EXPECT_LE(reader.read(coords, 7), 7u); }
+  ASSERT_EQ(coords.size(), 9 * whole.size());
+  for (size_t i = 0; i < whole.size(); ++i) {
+    EXPECT_EQ(coords[9 * i], whole[i].a.x) << i;
+    EXPECT_EQ(coords[9 * i + 8], whole[i].c.z) << i;
+  }
+}
+
+TEST(OutOfCoreTest, ReaderPadsMissingCoordinates) {
+  std::istringstream    in("3\n1 2 3 4 5 6 7 8 9 10 11 x 13");
+  utils::TriangleReader reader(in);
+
+  std::vector<float> coords;
+  EXPECT_EQ(reader.read(coords, 10), 3u);
+  ASSERT_EQ(coords.size(), 27u);
+  EXPECT_EQ(coords[8], 9.0f);
+  EXPECT_EQ(coords[10], 11.0f);
+  EXPECT_EQ(coords[11], 0.0f);
+  EXPECT_EQ(coords[26], 0.0f);
+  EXPECT_EQ(reader.read(coords, 10), 0u);
+}
+
+// ===================== Tiling Tests ======================
+
+TEST(OutOfCoreTest, SceneWithinBudgetStaysInMemory) {
+  const std::string text = scene_text(random_coords(2000, 20.0f, 2));
+
+  OutOfCoreStats stats;
+  EXPECT_EQ(out_of_core_flags(text, {}, stats), in_memory_flags(text));
+  EXPECT_EQ(stats.n_triangles, 2000u);
+  EXPECT_EQ(stats.n_tiles, 1u);
+  EXPECT_EQ(stats.n_spilled, 0u);
+}
+
+TEST(OutOfCoreTest, LargerThanBudgetMatchesInMemory) {
+  const size_t      n    = 20000;
+  const std::string text = scene_text(random_coords(n, 60.0f, 3));
+
+  OutOfCoreConfig config;
+  config.memory_budget = acceleration::tile_memory(n / 8);
+  config.spill_dir     = make_spill_dir();
+
+  OutOfCoreStats stats;
+  EXPECT_EQ(out_of_core_flags(text, config, stats), in_memory_flags(text));
+  EXPECT_GT(stats.n_tiles, 1u);
+  EXPECT_GT(stats.n_spilled, n);  // straddling triangles are duplicated
+  EXPECT_EQ(stats.n_oversized, 0u);
+  EXPECT_LE(acceleration::tile_memory(stats.max_tile_triangles),
+      config.memory_budget);
+
+  EXPECT_TRUE(std::filesystem::is_empty(config.spill_dir));
+  std::filesystem::remove_all(config.spill_dir);
+}
+
+TEST(OutOfCoreTest, StraddlingTrianglesMeetInEveryTile) {
+  // Small triangles leaning on the plane z = 0, crossed by long slivers
+  // that span the whole scene and so every tile.
+  std::vector<float> coords = random_coords(8000, 60.0f, 4);
+  for (size_t i = 2; i < coords.size(); i += 3) { coords[i] = 0.0f; }
+  for (size_t i = 0; i < coords.size(); i += 9) { coords[i + 5] = 0.5f; }
+  for (const float y : {10.0f, 30.0f, 50.0f}) {
+    coords.insert(coords.end(),
+        {-1.0f, y, -1.0f, 61.0f, y, -1.0f, 30.0f, y + 0.5f, 1.0f});
+  }
+  const std::string text = scene_text(coords);
+  const size_t      n    = coords.size() / 9;
+
+  OutOfCoreConfig config;
+  config.memory_budget = acceleration::tile_memory(n / 16);
+
+  OutOfCoreStats          stats;
+  const std::vector<bool> flags = out_of_core_flags(text, config, stats);
+  EXPECT_EQ(flags, in_memory_flags(text));
+  EXPECT_GT(stats.n_tiles, 8u);
+  for (size_t i = n - 3; i < n; ++i) { EXPECT_TRUE(flags[i]) << i; }
+}
+
+TEST(OutOfCoreTest, UncuttableTileIsQueriedWhole) {
+  // Every copy overlaps every cell a cut could make.
+  std::vector<float> coords;
+  for (size_t i = 0; i < 1200; ++i) {
+    coords.insert(coords.end(), {0, 0, 0, 4, 0, 0, 0, 4, 0});
+  }
+  const std::string text = scene_text(coords);
+
+  OutOfCoreConfig config;
+  config.memory_budget = acceleration::tile_memory(200);
+
+  OutOfCoreStats          stats;
+  const std::vector<bool> flags = out_of_core_flags(text, config, stats);
+  EXPECT_EQ(flags, std::vector<bool>(1200, true));
+  EXPECT_GE(stats.n_oversized, 1u);
+}
+
+TEST(OutOfCoreTest, ConfigFromEnvironment) {
+  unsetenv("TRIANGLES_MEMORY_BUDGET");
+  EXPECT_FALSE(acceleration::default_out_of_core_config());
+
+  setenv("TRIANGLES_MEMORY_BUDGET", "64M", 1);
+  setenv("TRIANGLES_SPILL_DIR", "/var/tmp", 1);
+  const auto config = acceleration::default_out_of_core_config();
+  ASSERT_TRUE(config);
+  EXPECT_EQ(config->memory_budget, size_t{64} << 20);
+  EXPECT_EQ(config->spill_dir, "/var/tmp");
+
+  setenv("TRIANGLES_MEMORY_BUDGET", "lots", 1);
+  EXPECT_FALSE(acceleration::default_out_of_core_config());
+
+  unsetenv("TRIANGLES_MEMORY_BUDGET");
+  unsetenv("TRIANGLES_SPILL_DIR");
+}
@@ -0,0 +1,87 @@
+#include "geometry/predicates.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "geometry/vector_3d.hpp"
+
+using namespace geometry;
+
+// ===================== orient2d ==========================
+
+TEST(PredicatesTest, Orient2dSigns) {
+  EXPECT_GT(orient2d(0, 0, 1, 0, 0, 1), 0);
+  EXPECT_LT(orient2d(0, 0, 0, 1, 1, 0), 0);
+  EXPECT_EQ(orient2d(0, 0, 1, 1, 2, 2), 0);
+}
+
+TEST(PredicatesTest, Orient2dFilterIsCertainForClearCases) {
+  EXPECT_TRUE(orient2d_filter(0, 0, 1, 0, 0, 1).is_certain());
+  EXPECT_FALSE(orient2d_filter(0.1, 0.1, 12.3, 12.3, 24.7, 24.7).is_certain());
+}
+
+TEST(PredicatesTest, Orient2dNearlyCollinear) {
+  // p slides along y = x in steps of one ulp; the plain formula returns
+  // noise here, the predicate has to be exactly 0 on the line and keep the
+  // sign of the offset off it.
+  const double base = 0.5;
+  const double b    = 12.0;
+  const double c    = 24.0;
+
+  double p = base;
+  for (int i = 0; i < 64; ++i) {
+    const double right = std::nextafter(p, 1.0);
+    const double left  = std::nextafter(p, 0.0);
+
+    EXPECT_EQ(orient2d(p, p, b, b, c, c), 0) << "step " << i;
+    EXPECT_LT(orient2d(right, p, b, b, c, c), 0) << "step " << i;
+    EXPECT_GT(orient2d(left, p, b, b, c, c), 0) << "step " << i;
+
+    p = right;
+  }
+}
+
+// ===================== orient3d ==========================
+
+TEST(PredicatesTest, Orient3dSigns) {
+  const Vector3D a{0, 0, 0};
+  const Vector3D b{1, 0, 0};
+  const Vector3D c{0, 1, 0};
+
+  EXPECT_LT(orient3d(a, b, c, {0, 0, 1}), 0);
+  EXPECT_GT(orient3d(a, b, c, {0, 0, -1}), 0);
+  EXPECT_EQ(orient3d(a, b, c, {0.3, 0.3, 0}), 0);
+}
+
+TEST(PredicatesTest, Orient3dExactlyCoplanar) {
+  // All points lie on the plane x = y; the coordinates are chosen so the
+  // floating-point determinant doesn't cancel exactly.
+  const Vector3D a{0.1, 0.1, 0.3};
+  const Vector3D b{1e7 + 0.3, 1e7 + 0.3, 5.0};
+  const Vector3D c{3.7, 3.7, -2.0};
+  const Vector3D d{123.456, 123.456, 7.77};
+
+  EXPECT_EQ(orient3d(a, b, c, d), 0);
+
+  const Vector3D above{std::nextafter(d.x, 1e9), d.y, d.z};
+  const Vector3D below{std::nextafter(d.x, 0.0), d.y, d.z};
+
+  const double up   = orient3d(a, b, c, above);
+  const double down = orient3d(a, b, c, below);
+  EXPECT_NE(up, 0);
+  EXPECT_NE(down, 0);
+  EXPECT_NE(std::signbit(up), std::signbit(down));
+}
+
+TEST(PredicatesTest, Orient3dSwapFlipsSign) {
+  const Vector3D a{0.1, 0.1, 0.3};
+  const Vector3D b{1e7 + 0.3, 1e7 + 0.3, 5.0};
+  const Vector3D c{3.7, 3.7, -2.0};
+  const Vector3D d{std::nextafter(123.456, 1e9), 123.456, 7.77};
+
+  const double det = orient3d(a, b, c, d);
+  ASSERT_NE(det, 0);
+  EXPECT_NE(std::signbit(det), std::signbit(orient3d(b, a, c, d)));
+  EXPECT_EQ(std::signbit(det), std::signbit(orient3d(b, c, a, d)));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "geometry/geometry.hpp"
+
+namespace test {
+
+// A triangle with one corner uniform in [0, extent]^3 and the other two
+// within 1 of it along each axis. `Tri` is Triangle or TriangleF.
+template <typename Tri>
+[[nodiscard]] Tri random_triangle(std::mt19937& gen, const double extent) {
+  using Vec   = decltype(Tri::a);
+  using Coord = decltype(Vec::x);
+  std::uniform_real_distribution<Coord> pos(0, static_cast<Coord>(extent));
+  std::uniform_real_distribution<Coord> offset(-1, 1);
+
+  const Vec base{pos(gen), pos(gen), pos(gen)};
+  const Vec b = base + Vec{offset(gen), offset(gen), offset(gen)};
+  const Vec c = base + Vec{offset(gen), offset(gen), offset(gen)};
+  return Tri(base, b, c);
+}
+
+// `n` such triangles, the same ones for the same seed.
+template <typename Tri>
+[[nodiscard]] std::vector<Tri> random_scene(
+    const size_t n, const double extent, const unsigned seed) {
+  std::mt19937     gen(seed);
+  std::vector<Tri> scene;
+  scene.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    scene.push_back(random_triangle<Tri>(gen, extent));
+  }
+  return scene;
+}
+
+}  // namespace test
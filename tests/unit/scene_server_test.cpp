@@ -0,0 +1,230 @@
+#include "server/scene_server.hpp"
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/triangle_f.hpp"
+#include "random_scene.hpp"
+
+using geometry::TriangleF;
+using geometry::Vector3F;
+using server::Reply;
+using server::SceneClient;
+using server::SceneServer;
+using test::random_scene;
+
+namespace fs = std::filesystem;
+
+// ======================== Helpers ========================
+
+static fs::path make_socket_path() {
+  return fs::temp_directory_path() /
+         ("triangles_test_" + std::to_string(std::random_device{}()) +
+             ".sock");
+}
+
+// A plain connected socket, for requests SceneClient wouldn't send.
+static int raw_connect(const fs::path& socket_path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, socket_path.c_str());
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&address),
+          sizeof(address)) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Can't connect to " + socket_path.string());
+  }
+  return fd;
+}
+
+// The scene in the triangles.x input format.
+static std::string to_text(const std::vector<TriangleF>& scene) {
+  std::ostringstream out;
+  out.precision(9);
+  out << scene.size() << "\n";
+  for (const TriangleF& tri : scene) {
+    for (const Vector3F& v : {tri.a, tri.b, tri.c}) {
+      out << v.x << " " << v.y << " " << v.z << " ";
+    }
+    out << "\n";
+  }
+  return out.str();
+}
+
+static std::vector<std::string> flagged_lines(const std::vector<bool>& flags) {
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < flags.size(); ++i) {
+    if (flags[i]) { lines.push_back(std::to_string(i)); }
+  }
+  return lines;
+}
+
+// A server on a fresh socket, run on its own thread until the fixture ends.
+class SceneServerTest : public ::testing::Test {
+ protected:
+  fs::path                     socket_path = make_socket_path();
+  std::unique_ptr<SceneServer> server =
+      std::make_unique<SceneServer>(socket_path);
+  std::thread runner{[this] { server->run(); }};
+
+  void TearDown() override {
+    server->stop();
+    if (runner.joinable()) { runner.join(); }
+    server.reset();
+    EXPECT_FALSE(fs::exists(socket_path));
+  }
+};
+
+// ===================== Protocol Tests ====================
+
+TEST_F(SceneServerTest, LoadAndFlagsMatchTheTree) {
+  std::vector<TriangleF>                 scene =
+      random_scene<TriangleF>(500, 20, 3);
+  const acceleration::BVHTree<TriangleF> tree(scene);
+  const std::vector<std::string>         expected =
+      flagged_lines(tree.get_intersections());
+  ASSERT_FALSE(expected.empty());
+
+  SceneClient client(socket_path);
+  const Reply loaded = client.request("LOAD", to_text(scene));
+  ASSERT_TRUE(loaded.ok) << loaded.error;
+  EXPECT_EQ(loaded.lines, std::vector<std::string>{"500"});
+
+  EXPECT_EQ(client.request("FLAGS").lines, expected);
+  // Served from the cache on a second connection.
+  SceneClient other(socket_path);
+  EXPECT_EQ(other.request("FLAGS").lines, expected);
+}
+
+TEST_F(SceneServerTest, QueryTrianglesAgainstTheScene) {
+  const std::vector<TriangleF> scene = {
+      TriangleF{Vector3F{0, 0, 0}, Vector3F{4, 0, 0}, Vector3F{0, 4, 0}}};
+  const std::vector<TriangleF> queries = {
+      // Pierces the scene triangle.
+      TriangleF{Vector3F{1, 1, -1}, Vector3F{1, 1, 1}, Vector3F{2, 1, 1}},
+      // Far above it.
+      TriangleF{Vector3F{0, 0, 5}, Vector3F{1, 0, 5}, Vector3F{0, 1, 5}},
+      // Coplanar and overlapping.
+      TriangleF{Vector3F{1, 1, 0}, Vector3F{6, 1, 0}, Vector3F{1, 6, 0}}};
+
+  SceneClient client(socket_path);
+  ASSERT_TRUE(client.request("LOAD", to_text(scene)).ok);
+
+  const Reply hits = client.request("QUERY", to_text(queries));
+  ASSERT_TRUE(hits.ok) << hits.error;
+  EXPECT_EQ(hits.lines, (std::vector<std::string>{"0", "2"}));
+}
+
+TEST_F(SceneServerTest, LoadReplacesTheScene) {
+  SceneClient client(socket_path);
+  ASSERT_TRUE(
+      client.request("LOAD", to_text(random_scene<TriangleF>(300, 20, 1))).ok);
+
+  std::vector<TriangleF>                 scene =
+      random_scene<TriangleF>(200, 20, 2);
+  const acceleration::BVHTree<TriangleF> tree(scene);
+  ASSERT_TRUE(client.request("LOAD", to_text(scene)).ok);
+  EXPECT_EQ(client.request("FLAGS").lines,
+      flagged_lines(tree.get_intersections()));
+
+  const Reply stats = client.request("STATS");
+  ASSERT_TRUE(stats.ok);
+  EXPECT_EQ(stats.lines.front(), "triangles 200");
+  EXPECT_NE(std::find(stats.lines.begin(), stats.lines.end(), "loads 2"),
+      stats.lines.end());
+}
+
+TEST_F(SceneServerTest, ErrorsKeepTheConnection) {
+  SceneClient client(socket_path);
+
+  const Reply no_scene = client.request("FLAGS");
+  EXPECT_FALSE(no_scene.ok);
+  EXPECT_EQ(no_scene.error, "No scene loaded");
+
+  const Reply unknown = client.request("EXPLODE");
+  EXPECT_FALSE(unknown.ok);
+  EXPECT_NE(unknown.error.find("EXPLODE"), std::string::npos);
+
+  EXPECT_TRUE(client.request("PING").ok);
+}
+
+TEST_F(SceneServerTest, OversizedPayloadIsRefused) {
+  const int fd = raw_connect(socket_path);
+  const std::string request =
+      "LOAD " + std::to_string(server::max_payload_bytes + 1) + "\n";
+  ASSERT_EQ(::write(fd, request.data(), request.size()),
+      static_cast<ssize_t>(request.size()));
+
+  char          reply[64] = {};
+  const ssize_t got       = ::read(fd, reply, sizeof(reply) - 1);
+  ::close(fd);
+  ASSERT_GT(got, 0);
+  EXPECT_EQ(std::string(reply).rfind("ERR Bad payload size", 0), 0u) << reply;
+}
+
+TEST_F(SceneServerTest, StalledPayloadDoesNotBlockOthers) {
+  // Announces the largest payload allowed, sends a few bytes and hangs up.
+  const int fd = raw_connect(socket_path);
+  const std::string request =
+      "LOAD " + std::to_string(server::max_payload_bytes) + "\n3\n0 0 0";
+  ASSERT_EQ(::write(fd, request.data(), request.size()),
+      static_cast<ssize_t>(request.size()));
+
+  SceneClient client(socket_path);
+  EXPECT_TRUE(client.request("PING").ok);
+  ::close(fd);
+  EXPECT_TRUE(client.request("PING").ok);
+}
+
+TEST_F(SceneServerTest, ShutdownStopsTheServer) {
+  SceneClient client(socket_path);
+  EXPECT_TRUE(client.request("SHUTDOWN").ok);
+  runner.join();
+
+  EXPECT_FALSE(fs::exists(socket_path));
+  EXPECT_THROW(SceneClient{socket_path}, std::runtime_error);
+}
+
+// ===================== Socket Tests ======================
+
+TEST_F(SceneServerTest, SecondServerOnTheSameSocketFails) {
+  EXPECT_THROW(SceneServer{socket_path}, std::runtime_error);
+}
+
+TEST(SceneServerSocketTest, StaleSocketIsReplaced) {
+  const fs::path socket_path = make_socket_path();
+
+  // Bound and closed without unlinking, as a crashed server leaves it.
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, socket_path.c_str());
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(::bind(fd, reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)),
+      0);
+  ::close(fd);
+  ASSERT_TRUE(fs::is_socket(socket_path));
+
+  SceneServer server(socket_path);
+  std::thread runner([&] { server.run(); });
+  {
+    SceneClient client(socket_path);
+    EXPECT_TRUE(client.request("PING").ok);
+  }
+  server.stop();
+  runner.join();
+}
@@ -0,0 +1,215 @@
+#include "server/shard.hpp"
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "acceleration/bvh_tree.hpp"
+#include "geometry/geometry.hpp"
+#include "random_scene.hpp"
+#include "server/channel.hpp"
+
+using namespace geometry;
+
+using server::ShardConfig;
+using server::ShardStats;
+using test::random_scene;
+
+// ======================== Helpers ========================
+
+static ShardConfig worker_config(const size_t n_shards) {
+  ShardConfig config;
+  config.n_shards           = n_shards;
+  config.worker_command     = {TRIANGLES_BINARY, "--shard-worker"};
+  config.threads_per_worker = 2;
+  return config;
+}
+
+// A SHARD payload of `owned` and `ghosts`.
+static std::string shard_payload(const std::vector<TriangleF>& owned,
+    const std::vector<TriangleF>& ghosts, const uint32_t magic) {
+  server::ShardHeader header;
+  header.magic    = magic;
+  header.n_owned  = owned.size();
+  header.n_ghosts = ghosts.size();
+
+  std::string payload(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const std::vector<TriangleF>* part : {&owned, &ghosts}) {
+    for (const TriangleF& tri : *part) {
+      const float coords[9] = {tri.a.x, tri.a.y, tri.a.z, tri.b.x, tri.b.y,
+          tri.b.z, tri.c.x, tri.c.y, tri.c.z};
+      payload.append(reinterpret_cast<const char*>(coords), sizeof(coords));
+    }
+  }
+  return payload;
+}
+
+// ======================== Plan Tests =====================
+
+TEST(ShardTest, PlanOwnsEveryTriangleOnce) {
+  const std::vector<TriangleF> scene = random_scene<TriangleF>(10001, 50.0, 1);
+  const server::detail::ShardPlan plan =
+      server::detail::plan_shards(scene, 3);
+  ASSERT_EQ(plan.owned.size(), 3u);
+  ASSERT_EQ(plan.ghosts.size(), 3u);
+
+  std::vector<int> owners(scene.size(), 0);
+  for (size_t s = 0; s < 3; ++s) {
+    EXPECT_GE(plan.owned[s].size(), 3333u);
+    EXPECT_LE(plan.owned[s].size(), 3334u);
+    for (const uint64_t index : plan.owned[s]) { ++owners[index]; }
+  }
+  EXPECT_EQ(owners, std::vector<int>(scene.size(), 1));
+}
+
+TEST(ShardTest, GhostsHoldEveryPartner) {
+  const std::vector<TriangleF> scene = random_scene<TriangleF>(1500, 20.0, 2);
+  const server::detail::ShardPlan plan =
+      server::detail::plan_shards(scene, 4);
+
+  std::vector<size_t>            owner(scene.size());
+  std::vector<std::vector<bool>> in_shard(4, std::vector<bool>(scene.size()));
+  for (size_t s = 0; s < 4; ++s) {
+    for (const uint64_t index : plan.owned[s]) {
+      owner[index]       = s;
+      in_shard[s][index] = true;
+    }
+    for (const uint64_t index : plan.ghosts[s]) {
+      EXPECT_FALSE(in_shard[s][index]) << index;
+      in_shard[s][index] = true;
+    }
+  }
+
+  size_t n_pairs = 0;
+  for (size_t i = 0; i < scene.size(); ++i) {
+    for (size_t j = 0; j < scene.size(); ++j) {
+      if (i == j || !scene[i].is_intersect(scene[j])) { continue; }
+      ++n_pairs;
+      EXPECT_TRUE(in_shard[owner[i]][j]) << i << " " << j;
+    }
+  }
+  EXPECT_GT(n_pairs, 0u);
+}
+
+// ======================== Worker Tests ===================
+
+TEST(ShardTest, WorkerAnswersUntilItsInputEnds) {
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  int         status = -1;
+  std::thread worker([&] { status = server::serve_shards(fds[1], fds[1]); });
+
+  const Vector3F origin{0.0f, 0.0f, 0.0f};
+  const Vector3F x{2.0f, 0.0f, 0.0f};
+  const Vector3F y{0.0f, 2.0f, 0.0f};
+  const Vector3F z{0.0f, 0.0f, 2.0f};
+  const Vector3F far{9.0f, 9.0f, 9.0f};
+  // The first owned triangle meets only the ghost; the second nothing.
+  const std::string shard = shard_payload(
+      {TriangleF{origin, x, y}, TriangleF{far, far + x, far + y}},
+      {TriangleF{Vector3F{0.5f, 0.5f, -1.0f}, Vector3F{0.5f, 0.5f, 1.0f}, z}},
+      server::shard_magic);
+  const std::string bad = shard_payload({}, {}, 0x12345678);
+
+  std::string             buffer;
+  server::detail::Channel channel(fds[0], buffer);
+  std::string             line;
+  std::string             reply;
+
+  ASSERT_TRUE(channel.write_all("SHARD " + std::to_string(shard.size()) +
+                                "\n" + shard));
+  ASSERT_TRUE(channel.read_line(line, server::max_shard_line));
+  EXPECT_EQ(line, "FLAGS 1");
+  ASSERT_TRUE(channel.read_bytes(1, reply));
+  EXPECT_EQ(reply, std::string(1, '\x01'));
+
+  ASSERT_TRUE(channel.write_all("SHARD " + std::to_string(bad.size()) +
+                                "\n" + bad));
+  ASSERT_TRUE(channel.read_line(line, server::max_shard_line));
+  EXPECT_EQ(line.rfind("ERR ", 0), 0u) << line;
+
+  ::shutdown(fds[0], SHUT_WR);
+  worker.join();
+  EXPECT_EQ(status, 0);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(ShardTest, WorkerRefusesOversizedShard) {
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  int         status = -1;
+  std::thread worker([&] { status = server::serve_shards(fds[1], fds[1]); });
+
+  std::string             buffer;
+  server::detail::Channel channel(fds[0], buffer);
+  ASSERT_TRUE(channel.write_all(
+      "SHARD " + std::to_string(server::max_shard_bytes + 1) + "\n"));
+
+  worker.join();
+  EXPECT_EQ(status, 1);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// ===================== Coordinator Tests =================
+
+TEST(ShardTest, ShardedFlagsMatchOneTree) {
+  std::vector<TriangleF> scene = random_scene<TriangleF>(20000, 60.0, 3);
+
+  ShardStats              stats;
+  const std::vector<bool> flags =
+      server::find_intersections_sharded(scene, worker_config(3), &stats);
+  EXPECT_EQ(flags, acceleration::find_all_intersections(scene,
+                       utils::ThreadPool::instance()));
+  EXPECT_EQ(stats.n_shards, 3u);
+  EXPECT_GT(stats.n_ghosts, 0u);
+  EXPECT_LT(stats.max_shard_triangles, scene.size());
+}
+
+TEST(ShardTest, MoreShardsThanTriangles) {
+  std::vector<TriangleF> scene = random_scene<TriangleF>(3, 1.0, 4);
+
+  ShardStats              stats;
+  const std::vector<bool> flags =
+      server::find_intersections_sharded(scene, worker_config(5), &stats);
+  EXPECT_EQ(flags, acceleration::find_all_intersections(scene,
+                       utils::ThreadPool::instance()));
+  EXPECT_EQ(stats.n_shards, 3u);
+}
+
+TEST(ShardTest, MissingWorkerThrows) {
+  const std::vector<TriangleF> scene = random_scene<TriangleF>(100, 10.0, 5);
+
+  ShardConfig config     = worker_config(2);
+  config.worker_command = {"/nonexistent/triangles.x", "--shard-worker"};
+  EXPECT_THROW((void)server::find_intersections_sharded(scene, config),
+      std::runtime_error);
+}
+
+TEST(ShardTest, ConfigFromEnvironment) {
+  unsetenv("TRIANGLES_SHARDS");
+  EXPECT_FALSE(server::default_shard_config());
+
+  setenv("TRIANGLES_SHARDS", "4", 1);
+  const auto config = server::default_shard_config();
+  ASSERT_TRUE(config);
+  EXPECT_EQ(config->n_shards, 4u);
+  EXPECT_TRUE(config->worker_command.empty());
+
+  setenv("TRIANGLES_SHARDS", "0", 1);
+  EXPECT_FALSE(server::default_shard_config());
+  setenv("TRIANGLES_SHARDS", "many", 1);
+  EXPECT_FALSE(server::default_shard_config());
+
+  unsetenv("TRIANGLES_SHARDS");
+}
@@ -0,0 +1,85 @@
+#include "utils/thread_pool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+using utils::TaskGroup;
+using utils::ThreadPool;
+using utils::ThreadPoolConfig;
+
+// ======================== Helpers ========================
+
+static size_t parallel_sum(ThreadPool& pool, const std::vector<size_t>& data,
+    const size_t lo, const size_t hi) {
+  if (hi - lo <= 64) {
+    return std::accumulate(data.begin() + lo, data.begin() + hi, size_t{0});
+  }
+
+  const size_t mid   = lo + (hi - lo) / 2;
+  size_t       left  = 0;
+  TaskGroup    group(pool);
+  group.run([&] { left = parallel_sum(pool, data, lo, mid); });
+  const size_t right = parallel_sum(pool, data, mid, hi);
+  group.wait();
+
+  return left + right;
+}
+
+// ===================== Scheduling Tests ==================
+
+TEST(ThreadPoolTest, ParallelForCoversRangeOnce) {
+  for (const size_t n_workers : {1, 4}) {
+    ThreadPool pool(ThreadPoolConfig{n_workers});
+    EXPECT_EQ(pool.size(), n_workers);
+    EXPECT_EQ(pool.is_serial(), n_workers == 1);
+
+    std::vector<std::atomic<int>> visits(10000);
+    pool.parallel_for(0, visits.size(), 37, [&](size_t lo, size_t hi) {
+      EXPECT_LE(hi - lo, 37u);
+      for (size_t i = lo; i < hi; ++i) { visits[i].fetch_add(1); }
+    });
+
+    for (const std::atomic<int>& count : visits) { ASSERT_EQ(count.load(), 1); }
+  }
+}
+
+TEST(ThreadPoolTest, NestedForkJoin) {
+  ThreadPool          pool(ThreadPoolConfig{4});
+  std::vector<size_t> data(100000);
+  std::iota(data.begin(), data.end(), size_t{0});
+
+  EXPECT_EQ(parallel_sum(pool, data, 0, data.size()),
+      data.size() * (data.size() - 1) / 2);
+}
+
+TEST(ThreadPoolTest, AffinityHintsAreAccepted) {
+  ThreadPool       pool(ThreadPoolConfig{3, true});
+  std::atomic<int> done{0};
+
+  TaskGroup group(pool);
+  for (size_t i = 0; i < 30; ++i) {
+    group.run([&] { done.fetch_add(1); }, i);
+  }
+  group.wait();
+
+  EXPECT_EQ(done.load(), 30);
+}
+
+TEST(ThreadPoolTest, WaitRethrowsTaskException) {
+  for (const size_t n_workers : {1, 2}) {
+    ThreadPool       pool(ThreadPoolConfig{n_workers});
+    std::atomic<int> done{0};
+
+    TaskGroup group(pool);
+    group.run([] { throw std::runtime_error("task failed"); });
+    group.run([&] { done.fetch_add(1); });
+
+    EXPECT_THROW(group.wait(), std::runtime_error);
+    EXPECT_EQ(done.load(), 1);
+  }
+}
@@ -0,0 +1,55 @@
+#include "geometry/triangle_f.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "geometry/geometry.hpp"
+
+using namespace geometry;
+
+TEST(TriangleFTest, PromotionIsExact) {
+  const TriangleF tri({0.1f, 0.2f, 0.3f}, {1.5f, 0, 0}, {0, 2.25f, 1e-3f});
+  const Triangle  promoted = tri.to_triangle();
+
+  EXPECT_EQ(promoted.a.x, double{0.1f});
+  EXPECT_EQ(promoted.c.z, double{1e-3f});
+  EXPECT_TRUE(promoted.get_centre().is_match(tri.get_centre()));
+}
+
+TEST(TriangleFTest, DegenerateFlag) {
+  EXPECT_FALSE(TriangleF({0, 0, 0}, {1, 0, 0}, {0, 1, 0}).is_degenerate());
+  EXPECT_TRUE(TriangleF({0, 0, 0}, {1, 1, 1}, {2, 2, 2}).is_degenerate());
+  EXPECT_TRUE(TriangleF({1, 1, 1}, {1, 1, 1}, {1, 1, 1}).is_degenerate());
+}
+
+TEST(TriangleFTest, SeparatedAndCrossing) {
+  const TriangleF base({0, 0, 0}, {4, 0, 0}, {0, 4, 0});
+
+  EXPECT_FALSE(base.is_intersect(TriangleF({0, 0, 1}, {4, 0, 1}, {0, 4, 2})));
+  EXPECT_TRUE(base.is_intersect(TriangleF({1, 1, -1}, {1, 1, 1}, {2, 1, 0})));
+  // Touching within math::eps: the filter can't decide, double does.
+  EXPECT_TRUE(
+      base.is_intersect(TriangleF({1, 1, 1e-7f}, {2, 1, 1}, {1, 2, 1})));
+}
+
+TEST(TriangleFTest, MatchesDoubleOnNearContacts) {
+  std::mt19937                          gen(11);
+  std::uniform_real_distribution<float> coord(-1.0f, 1.0f);
+  std::uniform_int_distribution<int>    snap(-2, 2);
+
+  for (int i = 0; i < 20000; ++i) {
+    // Half of the pairs sit on a coarse grid, where contacts are common.
+    auto point = [&]() {
+      return (i % 2) ? Vector3F{coord(gen), coord(gen), coord(gen)}
+                     : Vector3F(0.5f * snap(gen), 0.5f * snap(gen),
+                           0.5f * snap(gen));
+    };
+    const TriangleF lhs(point(), point(), point());
+    const TriangleF rhs(point(), point(), point());
+
+    ASSERT_EQ(lhs.is_intersect(rhs),
+        lhs.to_triangle().is_intersect(rhs.to_triangle()))
+        << "pair " << i;
+  }
+}
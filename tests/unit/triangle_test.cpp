@@ -437,4 +437,46 @@ TEST(TriangleDegenerateIntersection, SegmentFarFromProperTriangleNoIntersect) {
 
   EXPECT_FALSE(seg.is_intersect(tri));
   EXPECT_FALSE(tri.is_intersect(seg));
-}
\ No newline at end of file
+}
+// === Копланарные треугольники в наклонной плоскости ===
+// Плоскость x = 0.8 s, y = t, z = 0.6 s: проекция отбрасывает ось X.
+static Vector3D on_tilted_plane(double s, double t) {
+  return Vector3D(0.8 * s, t, 0.6 * s);
+}
+
+TEST(TriangleCoplanarTilted, Overlap) {
+  Triangle t1(on_tilted_plane(0, 0), on_tilted_plane(2, 0),
+      on_tilted_plane(0, 2));
+  Triangle t2(on_tilted_plane(1, 0.5), on_tilted_plane(3, 0.5),
+      on_tilted_plane(1, 2.5));
+  EXPECT_TRUE(t1.is_intersect(t2));
+  EXPECT_TRUE(t2.is_intersect(t1));
+}
+
+TEST(TriangleCoplanarTilted, EdgesCrossWithoutContainedVertices) {
+  // Звезда Давида: ни одна вершина не лежит внутри другого треугольника.
+  Triangle t1(on_tilted_plane(0, 0), on_tilted_plane(4, 0),
+      on_tilted_plane(2, 3));
+  Triangle t2(on_tilted_plane(0, 2), on_tilted_plane(2, -1),
+      on_tilted_plane(4, 2));
+  EXPECT_TRUE(t1.is_intersect(t2));
+  EXPECT_TRUE(t2.is_intersect(t1));
+}
+
+TEST(TriangleCoplanarTilted, OppositeWindingTouchAtVertex) {
+  Triangle t1(on_tilted_plane(0, 0), on_tilted_plane(1, 0),
+      on_tilted_plane(0, 1));
+  Triangle t2(on_tilted_plane(1, 0), on_tilted_plane(1, 1),
+      on_tilted_plane(2, 0));
+  EXPECT_TRUE(t1.is_intersect(t2));
+  EXPECT_TRUE(t2.is_intersect(t1));
+}
+
+TEST(TriangleCoplanarTilted, Disjoint) {
+  Triangle t1(on_tilted_plane(0, 0), on_tilted_plane(1, 0),
+      on_tilted_plane(0, 1));
+  Triangle t2(on_tilted_plane(0.6, 0.6), on_tilted_plane(2, 0.6),
+      on_tilted_plane(0.6, 2));
+  EXPECT_FALSE(t1.is_intersect(t2));
+  EXPECT_FALSE(t2.is_intersect(t1));
+}
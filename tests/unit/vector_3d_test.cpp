@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "geometry/vector_3d.hpp"
 #include <cmath>
+#include <type_traits>
 
 using namespace geometry;
 
@@ -9,9 +10,9 @@ constexpr float EPS = 1e-6f;
 // Проверка конструктора и геттеров
 TEST(Vector3DTest, ConstructorAndGetters) {
     Vector3D v(1.0f, 2.0f, 3.0f);
-    EXPECT_FLOAT_EQ(v.x(), 1.0f);
-    EXPECT_FLOAT_EQ(v.y(), 2.0f);
-    EXPECT_FLOAT_EQ(v.z(), 3.0f);
+    EXPECT_FLOAT_EQ(v.x, 1.0f);
+    EXPECT_FLOAT_EQ(v.y, 2.0f);
+    EXPECT_FLOAT_EQ(v.z, 3.0f);
 }
 
 // Проверка is_valid
@@ -52,22 +53,22 @@ TEST(Vector3DTest, AdditionAndSubtraction) {
     Vector3D sum = a + b;
     Vector3D diff = a - b;
 
-    EXPECT_FLOAT_EQ(sum.x(), 5);
-    EXPECT_FLOAT_EQ(sum.y(), 7);
-    EXPECT_FLOAT_EQ(sum.z(), 9);
+    EXPECT_FLOAT_EQ(sum.x, 5);
+    EXPECT_FLOAT_EQ(sum.y, 7);
+    EXPECT_FLOAT_EQ(sum.z, 9);
 
-    EXPECT_FLOAT_EQ(diff.x(), -3);
-    EXPECT_FLOAT_EQ(diff.y(), -3);
-    EXPECT_FLOAT_EQ(diff.z(), -3);
+    EXPECT_FLOAT_EQ(diff.x, -3);
+    EXPECT_FLOAT_EQ(diff.y, -3);
+    EXPECT_FLOAT_EQ(diff.z, -3);
 }
 
 // Проверка умножения на скаляр
 TEST(Vector3DTest, ScalarMultiplication) {
     Vector3D v(1, -2, 3);
     Vector3D r = v * 2.0f;
-    EXPECT_FLOAT_EQ(r.x(), 2);
-    EXPECT_FLOAT_EQ(r.y(), -4);
-    EXPECT_FLOAT_EQ(r.z(), 6);
+    EXPECT_FLOAT_EQ(r.x, 2);
+    EXPECT_FLOAT_EQ(r.y, -4);
+    EXPECT_FLOAT_EQ(r.z, 6);
 }
 
 // Проверка векторного произведения
@@ -76,9 +77,9 @@ TEST(Vector3DTest, CrossProduct) {
     Vector3D b(0, 1, 0);
     Vector3D c = a.cross(b);
 
-    EXPECT_NEAR(c.x(), 0, EPS);
-    EXPECT_NEAR(c.y(), 0, EPS);
-    EXPECT_NEAR(c.z(), 1, EPS);
+    EXPECT_NEAR(c.x, 0, EPS);
+    EXPECT_NEAR(c.y, 0, EPS);
+    EXPECT_NEAR(c.z, 1, EPS);
 }
 
 // Проверка коллинеарности
@@ -90,3 +91,30 @@ TEST(Vector3DTest, Collinearity) {
     EXPECT_TRUE(a.is_collinear(b));
     EXPECT_FALSE(a.is_collinear(c));
 }
+
+// Арифметика доступна на этапе компиляции
+TEST(Vector3DTest, ConstexprArithmetic) {
+    constexpr Vector3D a(1, 0, 0);
+    constexpr Vector3D b(0, 1, 0);
+    constexpr Vector3D c = a.cross(b) + a * 2.0 - b;
+
+    static_assert(c.x == 2.0 && c.y == -1.0 && c.z == 1.0);
+    static_assert(a.scalar(b) == 0.0);
+    static_assert(c[2] == 1.0);
+    EXPECT_TRUE(c.is_valid());
+}
+
+// Политика проверок выбирается параметром шаблона
+TEST(Vector3DTest, CheckPolicy) {
+    using Unchecked = BasicVector3D<double, UncheckedPolicy>;
+
+    static_assert(CheckedPolicy::enabled);
+    static_assert(!UncheckedPolicy::enabled);
+    static_assert(std::is_trivially_copyable_v<Vector3D>);
+    static_assert(sizeof(Unchecked) == 3 * sizeof(double));
+
+    Unchecked v(NAN, 0, 1);
+    Unchecked sum = v + Unchecked(1, 1, 1);
+    EXPECT_FALSE(sum.is_valid());
+    EXPECT_DOUBLE_EQ(sum.y, 1.0);
+}
@@ -0,0 +1,88 @@
+// Command-line client of a `triangles.x --serve` daemon.
+//   usage: triangles_client.x [-s socket] [command]
+// Commands: load and query send stdin (triangles.x input format), flags,
+// stats, ping and shutdown send nothing. Without a command the scene on
+// stdin is loaded and its flags printed, so the output matches triangles.x.
+// The socket defaults to TRIANGLES_SOCKET or server::default_socket_path().
+
+#include <cctype>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "server/scene_server.hpp"
+
+namespace {
+
+int usage() {
+  std::cerr << "usage: triangles_client.x [-s socket] "
+               "[load|query|flags|stats|ping|shutdown]\n";
+  return 2;
+}
+
+// Prints the reply lines; false after printing an ERR reply.
+bool print(const server::Reply& reply) {
+  if (!reply.ok) {
+    std::cerr << "triangles_client.x: " << reply.error << "\n";
+    return false;
+  }
+  std::string text;
+  for (const std::string& line : reply.lines) {
+    text += line;
+    text += '\n';
+  }
+  std::cout << text;
+  std::cout.flush();
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::filesystem::path socket_path = server::default_socket_path();
+  std::string_view      command;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "-s" && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (command.empty() && arg[0] != '-') {
+      command = arg;
+    } else {
+      return usage();
+    }
+  }
+
+  try {
+    server::SceneClient client(socket_path);
+
+    if (command.empty()) {
+      const std::string scene{std::istreambuf_iterator<char>(std::cin), {}};
+      const server::Reply loaded = client.request("LOAD", scene);
+      if (!loaded.ok) {
+        (void)print(loaded);
+        return 1;
+      }
+      return print(client.request("FLAGS")) ? 0 : 1;
+    }
+
+    std::string request(command);
+    for (char& c : request) { c = static_cast<char>(std::toupper(c)); }
+
+    if (request == "LOAD" || request == "QUERY") {
+      const std::string input{std::istreambuf_iterator<char>(std::cin), {}};
+      return print(client.request(request, input)) ? 0 : 1;
+    }
+    if (request == "FLAGS" || request == "STATS" || request == "PING" ||
+        request == "SHUTDOWN") {
+      return print(client.request(request)) ? 0 : 1;
+    }
+    return usage();
+  } catch (const std::exception& e) {
+    std::cerr << "triangles_client.x: " << e.what() << "\n";
+    return 1;
+  }
+}